@@ -0,0 +1,736 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__arm__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_ARM_NEON
+#define HWCAP_ARM_NEON ( 1 << 12 )
+#endif
+#endif
+
+#include "mali_blit.h"
+#include "mali_blit_kernels.h"
+
+/*
+ * The framebuffer is mapped uncached or write-combined, so the destination is
+ * written in aligned 64 byte chunks that the write buffer can merge into
+ * bursts, and never read. The source is cached and prefetched a few lines
+ * ahead of the copy. Which of the row kernels does that best, and how far
+ * ahead to prefetch, depends on the board, so it is picked per kind of
+ * destination memory at startup.
+ */
+typedef void (*CopyRowProc)( uint8_t *dst, const uint8_t *src, int bytes, int prefetch );
+
+static const char *copy_kernel_names[MALI_BLIT_COPY_KERNELS] = { "auto", "libc", "simd", "stream" };
+
+static struct mali_blit_copy_strategy copy_strategy[MALI_BLIT_MEMORY_TYPES] =
+{
+	{ MALI_BLIT_COPY_LIBC, 256 },
+	{ MALI_BLIT_COPY_LIBC, 256 },
+};
+
+static void copy_row_libc( uint8_t *dst, const uint8_t *src, int bytes, int prefetch )
+{
+	(void)prefetch;
+
+	memcpy( dst, src, bytes );
+}
+
+static const struct mali_blit_kernels kernels_c =
+{
+	copy_row_libc,
+	NULL,
+	NULL,
+	mali_blit_fill_row_c,
+	mali_blit_convert_row_c,
+	mali_blit_lerp_row_c,
+	mali_blit_over_row_c,
+	mali_blit_add_row_c,
+	mali_blit_yuv_row_c,
+	NULL,
+};
+
+/* Plain C until mali_blit_init() has looked at the CPU */
+static struct mali_blit_kernels kernels =
+{
+	copy_row_libc,
+	NULL,
+	NULL,
+	mali_blit_fill_row_c,
+	mali_blit_convert_row_c,
+	mali_blit_lerp_row_c,
+	mali_blit_over_row_c,
+	mali_blit_add_row_c,
+	mali_blit_yuv_row_c,
+	NULL,
+};
+
+#if defined(__i386__) || defined(__x86_64__)
+static int cpu_has_sse2( void )
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports( "sse2" );
+}
+
+#if defined(__x86_64__)
+/* This also checks that the kernel saves the AVX registers */
+static int cpu_has_avx2( void )
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports( "avx2" );
+}
+#endif
+#elif defined(__aarch64__)
+static int cpu_has_neon( void )
+{
+	return 1;
+}
+#elif defined(__arm__)
+/* Not every ARMv7 has it, Tegra 2 being the usual example */
+static int cpu_has_neon( void )
+{
+	return 0 != ( getauxval( AT_HWCAP ) & HWCAP_ARM_NEON );
+}
+#endif
+
+/* Each instruction set is installed over the ones before it */
+static const struct
+{
+	const char *name;
+	int (*usable)( void );
+	int (*setup)( struct mali_blit_kernels *kernels );
+} blit_isas[] =
+{
+	{ "c", NULL, NULL },
+#if defined(__i386__) || defined(__x86_64__)
+	{ "sse2", cpu_has_sse2, mali_blit_setup_sse2 },
+#if defined(__x86_64__)
+	{ "avx2", cpu_has_avx2, mali_blit_setup_avx2 },
+#endif
+#elif defined(__arm__) || defined(__aarch64__)
+	{ "neon", cpu_has_neon, mali_blit_setup_neon },
+#endif
+};
+
+#define BLIT_ISAS ( sizeof(blit_isas) / sizeof(blit_isas[0]) )
+
+const char *mali_blit_init( const char *isa )
+{
+	struct mali_blit_kernels k = kernels_c;
+	enum mali_blit_copy_kernel copy;
+	unsigned int i, top = BLIT_ISAS - 1, used = 0;
+	int m;
+
+	if ( NULL != isa )
+	{
+		for ( top = 0; top < BLIT_ISAS && 0 != strcasecmp( isa, blit_isas[top].name ); top++ );
+		if ( top == BLIT_ISAS ) return NULL;
+	}
+
+	for ( i = 1; i <= top; i++ )
+	{
+		if ( !blit_isas[i].usable() || !blit_isas[i].setup( &k ) )
+		{
+			if ( NULL != isa ) return NULL;
+			break;
+		}
+		used = i;
+	}
+
+	kernels = k;
+
+	/* Streaming stores where there are any, as before the copy kernels could be chosen */
+	if ( NULL != kernels.stream_row ) copy = MALI_BLIT_COPY_STREAM;
+	else if ( copy_row_libc != kernels.copy_row ) copy = MALI_BLIT_COPY_SIMD;
+	else copy = MALI_BLIT_COPY_LIBC;
+
+	for ( m = 0; m < MALI_BLIT_MEMORY_TYPES; m++ )
+	{
+		copy_strategy[m].kernel = copy;
+		copy_strategy[m].prefetch = 256;
+	}
+
+	return blit_isas[used].name;
+}
+
+static CopyRowProc copy_row_proc( enum mali_blit_copy_kernel kernel )
+{
+	switch ( kernel )
+	{
+	case MALI_BLIT_COPY_LIBC:
+		return copy_row_libc;
+	case MALI_BLIT_COPY_SIMD:
+		return copy_row_libc != kernels.copy_row ? kernels.copy_row : NULL;
+	case MALI_BLIT_COPY_STREAM:
+		return kernels.stream_row;
+	default:
+		return NULL;
+	}
+}
+
+const char *mali_blit_copy_kernel_name( enum mali_blit_copy_kernel kernel )
+{
+	return kernel < MALI_BLIT_COPY_KERNELS ? copy_kernel_names[kernel] : "unknown";
+}
+
+int mali_blit_copy_kernel_lookup( const char *name, enum mali_blit_copy_kernel *kernel )
+{
+	int k;
+
+	for ( k = 0; k < MALI_BLIT_COPY_KERNELS; k++ )
+	{
+		if ( 0 == strcasecmp( name, copy_kernel_names[k] ) )
+		{
+			*kernel = k;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int mali_blit_copy_kernel_available( enum mali_blit_copy_kernel kernel )
+{
+	return NULL != copy_row_proc( kernel );
+}
+
+void mali_blit_get_copy_strategy( enum mali_blit_memory memory, struct mali_blit_copy_strategy *strategy )
+{
+	*strategy = copy_strategy[memory];
+}
+
+int mali_blit_set_copy_strategy( enum mali_blit_memory memory, const struct mali_blit_copy_strategy *strategy )
+{
+	if ( !mali_blit_copy_kernel_available( strategy->kernel ) || strategy->prefetch < 0 ) return 0;
+
+	copy_strategy[memory] = *strategy;
+
+	return 1;
+}
+
+void mali_blit_copy_with( const struct mali_blit_copy_strategy *strategy, void *dst, int dst_pitch, const void *src, int src_pitch, int width, int height )
+{
+	CopyRowProc copy_row = copy_row_proc( strategy->kernel );
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	if ( NULL == copy_row ) copy_row = copy_row_libc;
+
+	for ( ; height > 0; height-- )
+	{
+		copy_row( d, s, width, strategy->prefetch );
+		d += dst_pitch;
+		s += src_pitch;
+	}
+
+	if ( MALI_BLIT_COPY_STREAM == strategy->kernel && NULL != kernels.stream_done ) kernels.stream_done();
+}
+
+void mali_blit_copy( enum mali_blit_memory memory, void *dst, int dst_pitch, const void *src, int src_pitch, int width, int height )
+{
+	mali_blit_copy_with( &copy_strategy[memory], dst, dst_pitch, src, src_pitch, width, height );
+}
+
+void mali_blit_fill_row_c( uint8_t *dst, uint32_t pattern, int bytes )
+{
+	const uint8_t *p = (const uint8_t *)&pattern;
+
+	for ( ; bytes > 0 && ( (uintptr_t)dst & 3 ); bytes--, dst++ ) *dst = p[(uintptr_t)dst & 3];
+	for ( ; bytes >= 4; bytes -= 4, dst += 4 ) *(uint32_t *)dst = pattern;
+	for ( ; bytes > 0; bytes--, dst++ ) *dst = p[(uintptr_t)dst & 3];
+}
+
+void mali_blit_fill( void *dst, int dst_pitch, int width, int height, int cpp, uint32_t pixel )
+{
+	uint8_t *d = dst;
+	uint32_t pattern;
+
+	/* Smaller pixels are repeated across the word, which lines up since they are aligned to their size */
+	switch ( cpp )
+	{
+	case 1:
+		pattern = ( pixel & 0xff ) * 0x01010101;
+		break;
+	case 2:
+		pattern = ( pixel & 0xffff ) * 0x00010001;
+		break;
+	default:
+		pattern = pixel;
+		break;
+	}
+
+	for ( ; height > 0; height-- )
+	{
+		kernels.fill_row( d, pattern, width * cpp );
+		d += dst_pitch;
+	}
+}
+
+/*
+ * 4x4 Bayer matrix scaled to the quantisation step of each channel: 8 for the
+ * five bit red and blue, 4 for the six bit green. Rows are repeated so that
+ * eight consecutive entries can be loaded from any starting column.
+ */
+const uint8_t mali_blit_dither_rb[4][12] =
+{
+	{ 0, 4, 1, 5, 0, 4, 1, 5, 0, 4, 1, 5 },
+	{ 6, 2, 7, 3, 6, 2, 7, 3, 6, 2, 7, 3 },
+	{ 1, 5, 0, 4, 1, 5, 0, 4, 1, 5, 0, 4 },
+	{ 7, 3, 6, 2, 7, 3, 6, 2, 7, 3, 6, 2 },
+};
+
+const uint8_t mali_blit_dither_g[4][12] =
+{
+	{ 0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2 },
+	{ 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1 },
+	{ 0, 2, 0, 2, 0, 2, 0, 2, 0, 2, 0, 2 },
+	{ 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1 },
+};
+
+static inline uint8_t add_sat( uint32_t a, uint32_t b )
+{
+	a += b;
+
+	return a > 255 ? 255 : a;
+}
+
+void mali_blit_convert_row_c( uint16_t *dst, const uint32_t *src, int x, int y, int width, int dither )
+{
+	const uint8_t *drb = mali_blit_dither_rb[y & 3];
+	const uint8_t *dg = mali_blit_dither_g[y & 3];
+	int i;
+
+	for ( i = 0; i < width; i++ )
+	{
+		uint32_t p = src[i];
+		uint32_t r = ( p >> 16 ) & 0xff;
+		uint32_t g = ( p >> 8 ) & 0xff;
+		uint32_t b = p & 0xff;
+
+		if ( dither )
+		{
+			int d = ( x + i ) & 3;
+
+			r = add_sat( r, drb[d] );
+			g = add_sat( g, dg[d] );
+			b = add_sat( b, drb[d] );
+		}
+
+		dst[i] = ( ( r & 0xf8 ) << 8 ) | ( ( g & 0xfc ) << 3 ) | ( b >> 3 );
+	}
+}
+
+void mali_blit_convert_8888_565( void *dst, int dst_pitch, const void *src, int src_pitch,
+                                 int x, int y, int width, int height, int dither )
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	for ( ; height > 0; height--, y++ )
+	{
+		kernels.convert_row_8888_565( (uint16_t *)d, (const uint32_t *)s, x, y, width, dither );
+		d += dst_pitch;
+		s += src_pitch;
+	}
+}
+
+/*
+ * Rotation walks the destination row by row, since the framebuffer only
+ * performs well when written sequentially, and gathers each row from a column
+ * of the source. The box is processed in tiles so that the source lines a
+ * tile touches stay in the cache while it is being transposed.
+ */
+#define ROTATE_TILE 16
+
+static const uint8_t *rotate_src( const uint8_t *src, int src_pitch, int width, int height, int cpp, int rotation,
+                                  int u, int v, int *step )
+{
+	switch ( rotation )
+	{
+	case 90:
+		*step = src_pitch;
+		return src + u * src_pitch + ( width - 1 - v ) * cpp;
+	case 180:
+		*step = -cpp;
+		return src + ( height - 1 - v ) * src_pitch + ( width - 1 - u ) * cpp;
+	case 270:
+		*step = -src_pitch;
+		return src + ( height - 1 - u ) * src_pitch + v * cpp;
+	default:
+		*step = cpp;
+		return src + v * src_pitch + u * cpp;
+	}
+}
+
+static void rotate_row( uint8_t *dst, const uint8_t *src, int step, int count, int cpp )
+{
+	int i;
+
+	if ( 4 == cpp )
+	{
+		uint32_t *d = (uint32_t *)dst;
+
+		for ( i = 0; i < count; i++, src += step ) d[i] = *(const uint32_t *)src;
+	}
+	else
+	{
+		uint16_t *d = (uint16_t *)dst;
+
+		for ( i = 0; i < count; i++, src += step ) d[i] = *(const uint16_t *)src;
+	}
+}
+
+void mali_blit_rotate( void *dst, int dst_pitch, const void *src, int src_pitch,
+                       int width, int height, int cpp, int rotation )
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	int dw, dh, u0, v0;
+
+	if ( 0 == rotation )
+	{
+		mali_blit_copy( MALI_BLIT_MEMORY_FRAMEBUFFER, dst, dst_pitch, src, src_pitch, width * cpp, height );
+		return;
+	}
+
+	dw = ( 180 == rotation ) ? width : height;
+	dh = ( 180 == rotation ) ? height : width;
+
+	for ( v0 = 0; v0 < dh; v0 += ROTATE_TILE )
+	{
+		int v1 = v0 + ROTATE_TILE < dh ? v0 + ROTATE_TILE : dh;
+
+		for ( u0 = 0; u0 < dw; u0 += ROTATE_TILE )
+		{
+			int u1 = u0 + ROTATE_TILE < dw ? u0 + ROTATE_TILE : dw;
+			int v = v0, step;
+
+			if ( 4 == cpp && 180 != rotation && NULL != kernels.rotate_block_8888 )
+			{
+				int un = u0 + ( ( u1 - u0 ) & ~3 );
+
+				for ( ; v + 4 <= v1; v += 4 )
+				{
+					int u, k;
+
+					for ( u = u0; u < un; u += 4 ) kernels.rotate_block_8888( d, dst_pitch, s, src_pitch, width, height, rotation, u, v );
+
+					for ( k = 0; k < 4 && un < u1; k++ )
+					{
+						const uint8_t *p = rotate_src( s, src_pitch, width, height, cpp, rotation, un, v + k, &step );
+
+						rotate_row( d + ( v + k ) * dst_pitch + un * cpp, p, step, u1 - un, cpp );
+					}
+				}
+			}
+
+			for ( ; v < v1; v++ )
+			{
+				const uint8_t *p = rotate_src( s, src_pitch, width, height, cpp, rotation, u0, v, &step );
+
+				rotate_row( d + v * dst_pitch + u0 * cpp, p, step, u1 - u0, cpp );
+			}
+		}
+	}
+}
+
+void mali_blit_rotate_convert_8888_565( void *dst, int dst_pitch, const void *src, int src_pitch,
+                                        int width, int height, int rotation,
+                                        int dst_x, int dst_y, int dither )
+{
+	uint32_t row[ROTATE_TILE];
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	int dw, dh, u0, v0;
+
+	if ( 0 == rotation )
+	{
+		mali_blit_convert_8888_565( dst, dst_pitch, src, src_pitch, dst_x, dst_y, width, height, dither );
+		return;
+	}
+
+	dw = ( 180 == rotation ) ? width : height;
+	dh = ( 180 == rotation ) ? height : width;
+
+	/* Gather a tile row at a time and convert it on the way out */
+	for ( v0 = 0; v0 < dh; v0 += ROTATE_TILE )
+	{
+		int v1 = v0 + ROTATE_TILE < dh ? v0 + ROTATE_TILE : dh;
+
+		for ( u0 = 0; u0 < dw; u0 += ROTATE_TILE )
+		{
+			int u1 = u0 + ROTATE_TILE < dw ? u0 + ROTATE_TILE : dw;
+			int v, step;
+
+			for ( v = v0; v < v1; v++ )
+			{
+				const uint8_t *p = rotate_src( s, src_pitch, width, height, 4, rotation, u0, v, &step );
+
+				rotate_row( (uint8_t *)row, p, step, u1 - u0, 4 );
+				kernels.convert_row_8888_565( (uint16_t *)( d + v * dst_pitch ) + u0, row, dst_x + u0, dst_y + v, u1 - u0, dither );
+			}
+		}
+	}
+}
+
+static inline int clamp_coord( int v, int size )
+{
+	return v < 0 ? 0 : ( v >= size ? size - 1 : v );
+}
+
+void mali_blit_sample_row_nearest( void *dst, const void *src, int src_pitch, int width, int height,
+                                   int32_t x, int32_t y, int32_t dx, int32_t dy, int count, int cpp )
+{
+	const uint8_t *s = src;
+	int i;
+
+	if ( 0 == dy )
+	{
+		/* Axis aligned scaling, the whole row comes from a single source line */
+		s += clamp_coord( y >> 16, height ) * src_pitch;
+
+		if ( 4 == cpp )
+		{
+			for ( i = 0; i < count; i++, x += dx ) ( (uint32_t *)dst )[i] = ( (const uint32_t *)s )[clamp_coord( x >> 16, width )];
+		}
+		else
+		{
+			for ( i = 0; i < count; i++, x += dx ) ( (uint16_t *)dst )[i] = ( (const uint16_t *)s )[clamp_coord( x >> 16, width )];
+		}
+		return;
+	}
+
+	for ( i = 0; i < count; i++, x += dx, y += dy )
+	{
+		const uint8_t *p = s + clamp_coord( y >> 16, height ) * src_pitch + clamp_coord( x >> 16, width ) * cpp;
+
+		if ( 4 == cpp ) ( (uint32_t *)dst )[i] = *(const uint32_t *)p;
+		else ( (uint16_t *)dst )[i] = *(const uint16_t *)p;
+	}
+}
+
+/* Blend two x8r8g8b8 pixels, w is the weight of b out of 256 */
+static inline uint32_t lerp_8888( uint32_t a, uint32_t b, unsigned int w )
+{
+	uint32_t rb = ( ( a & 0x00ff00ff ) * ( 256 - w ) + ( b & 0x00ff00ff ) * w ) >> 8;
+	uint32_t ag = ( ( a >> 8 ) & 0x00ff00ff ) * ( 256 - w ) + ( ( b >> 8 ) & 0x00ff00ff ) * w;
+
+	return ( rb & 0x00ff00ff ) | ( ag & 0xff00ff00 );
+}
+
+/* s + d * ( 255 - alpha of s ) / 255 for each byte, rounded and saturated as pixman does */
+static inline uint32_t over_8888( uint32_t s, uint32_t d )
+{
+	uint32_t a = 255 - ( s >> 24 );
+	uint32_t rb = ( d & 0x00ff00ff ) * a + 0x00800080;
+	uint32_t ag = ( ( d >> 8 ) & 0x00ff00ff ) * a + 0x00800080;
+
+	rb = ( ( ( rb + ( ( rb >> 8 ) & 0x00ff00ff ) ) >> 8 ) & 0x00ff00ff ) + ( s & 0x00ff00ff );
+	ag = ( ( ( ag + ( ( ag >> 8 ) & 0x00ff00ff ) ) >> 8 ) & 0x00ff00ff ) + ( ( s >> 8 ) & 0x00ff00ff );
+
+	rb = ( rb | ( 0x10000100 - ( ( rb >> 8 ) & 0x00ff00ff ) ) ) & 0x00ff00ff;
+	ag = ( ag | ( 0x10000100 - ( ( ag >> 8 ) & 0x00ff00ff ) ) ) & 0x00ff00ff;
+
+	return rb | ( ag << 8 );
+}
+
+void mali_blit_over_row_c( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha )
+{
+	int i;
+
+	for ( i = 0; i < count; i++ )
+	{
+		uint32_t s = src[i];
+
+		if ( s >= 0xff000000 ) dst[i] = s;
+		else if ( s ) dst[i] = over_8888( s, dst[i] | dst_alpha );
+	}
+}
+
+void mali_blit_add_row_c( uint8_t *dst, const uint8_t *src, int bytes )
+{
+	int i;
+
+	for ( i = 0; i < bytes; i++ )
+	{
+		if ( src[i] ) dst[i] = add_sat( dst[i], src[i] );
+	}
+}
+
+void mali_blit_over_row_8888( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha )
+{
+	kernels.over_row_8888( dst, src, count, dst_alpha );
+}
+
+void mali_blit_add_row( uint8_t *dst, const uint8_t *src, int bytes )
+{
+	kernels.add_row( dst, src, bytes );
+}
+
+/* Longest source span that is blended vertically in one go */
+#define SAMPLE_SPAN 1024
+
+void mali_blit_lerp_row_c( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count )
+{
+	int i;
+
+	for ( i = 0; i < count; i++ ) dst[i] = lerp_8888( a[i], b[i], w );
+}
+
+/* Blend count pixels of two source lines into dst, w is the weight of b out of 256 */
+static void lerp_lines_8888( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count )
+{
+	if ( 0 == w ) memcpy( dst, a, count * 4 );
+	else kernels.lerp_row_8888( dst, a, b, w, count );
+}
+
+void mali_blit_sample_row_bilinear_8888( uint32_t *dst, const void *src, int src_pitch, int width, int height,
+                                         int32_t x, int32_t y, int32_t dx, int32_t dy, int count )
+{
+	const uint8_t *s = src;
+	int i;
+
+	/* Sample positions are pixel centres */
+	x -= 0x8000;
+	y -= 0x8000;
+
+	if ( 0 == dy && count > 0 )
+	{
+		int32_t x_last = x + ( count - 1 ) * dx;
+		int first = ( dx >= 0 ? x : x_last ) >> 16;
+		int last = ( ( dx >= 0 ? x_last : x ) >> 16 ) + 1;
+
+		/*
+		 * Separable: blend the two source lines once over the span the row
+		 * covers, then interpolate horizontally within that.
+		 */
+		if ( last - first < SAMPLE_SPAN )
+		{
+			uint32_t a[SAMPLE_SPAN], b[SAMPLE_SPAN], line[SAMPLE_SPAN];
+			const uint32_t *la = (const uint32_t *)( s + clamp_coord( y >> 16, height ) * src_pitch );
+			const uint32_t *lb = (const uint32_t *)( s + clamp_coord( ( y >> 16 ) + 1, height ) * src_pitch );
+			int n = last - first + 1;
+
+			for ( i = 0; i < n; i++ )
+			{
+				int c = clamp_coord( first + i, width );
+
+				a[i] = la[c];
+				b[i] = lb[c];
+			}
+
+			lerp_lines_8888( line, a, b, ( y >> 8 ) & 0xff, n );
+
+			for ( i = 0; i < count; i++, x += dx )
+			{
+				const uint32_t *p = line + ( x >> 16 ) - first;
+
+				dst[i] = lerp_8888( p[0], p[1], ( x >> 8 ) & 0xff );
+			}
+			return;
+		}
+	}
+
+	for ( i = 0; i < count; i++, x += dx, y += dy )
+	{
+		int x0 = clamp_coord( x >> 16, width ), x1 = clamp_coord( ( x >> 16 ) + 1, width );
+		const uint32_t *la = (const uint32_t *)( s + clamp_coord( y >> 16, height ) * src_pitch );
+		const uint32_t *lb = (const uint32_t *)( s + clamp_coord( ( y >> 16 ) + 1, height ) * src_pitch );
+		unsigned int wx = ( x >> 8 ) & 0xff;
+
+		dst[i] = lerp_8888( lerp_8888( la[x0], la[x1], wx ), lerp_8888( lb[x0], lb[x1], wx ), ( y >> 8 ) & 0xff );
+	}
+}
+
+void mali_blit_gather_8( uint8_t *dst, const uint8_t *src, int stride, int32_t x, int32_t dx, int count )
+{
+	int i;
+
+	if ( 1 == stride )
+	{
+		for ( i = 0; i < count; i++, x += dx ) dst[i] = src[x >> 16];
+	}
+	else
+	{
+		for ( i = 0; i < count; i++, x += dx ) dst[i] = src[( x >> 16 ) * stride];
+	}
+}
+
+/* Coefficients with 6 fractional bits: luma, red from Cr, green from Cb and Cr, blue from Cb */
+static const int16_t yuv_coeffs[2][5] =
+{
+	{ 75, 102, 25, 52, 129 },	/* BT.601 */
+	{ 75, 115, 14, 34, 135 },	/* BT.709 */
+};
+
+static inline uint8_t clamp_u8( int v )
+{
+	return v < 0 ? 0 : ( v > 255 ? 255 : v );
+}
+
+void mali_blit_yuv_row_c( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                          int count, int chroma_shift, const int16_t *c )
+{
+	int i;
+
+	for ( i = 0; i < count; i++ )
+	{
+		int ci = i >> chroma_shift;
+		int yy = ( y[i] > 16 ? y[i] - 16 : 0 ) * c[0];
+		int uu = u[ci] - 128;
+		int vv = v[ci] - 128;
+
+		dst[i] = 0xff000000 |
+		         ( clamp_u8( ( yy + c[1] * vv ) >> 6 ) << 16 ) |
+		         ( clamp_u8( ( yy - c[2] * uu - c[3] * vv ) >> 6 ) << 8 ) |
+		         clamp_u8( ( yy + c[4] * uu ) >> 6 );
+	}
+}
+
+void mali_blit_yuv_to_8888( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                            int count, int chroma_shift, int phase, int bt709 )
+{
+	const int16_t *c = yuv_coeffs[bt709 ? 1 : 0];
+
+	/* Get onto a chroma pair boundary first */
+	if ( chroma_shift && phase && count > 0 )
+	{
+		mali_blit_yuv_row_c( dst, y, u, v, 1, 0, c );
+		dst++;
+		y++;
+		u++;
+		v++;
+		count--;
+	}
+
+	kernels.yuv_row_8888( dst, y, u, v, count, chroma_shift, c );
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_BLIT_H_
+#define _MALI_BLIT_H_
+
+#include <stdint.h>
+
+/*
+ * CPU pixel kernels for the EXA, shadow framebuffer, cursor and Xv paths:
+ * copies, fills, blending, format conversion, rotation and resampling. These have no X server
+ * dependencies.
+ */
+
+/*
+ * Install the fastest kernels the CPU can run. isa limits them to "c" or to
+ * one of "sse2", "avx2" and "neon", NULL takes the best there is. Returns the
+ * instruction set in use, or NULL without changing anything if the one asked
+ * for isn't known or can't run here. Until this is called everything is C.
+ * The copy strategies go back to their defaults.
+ */
+extern const char *mali_blit_init( const char *isa );
+
+/* What a copy writes to, each kind has a copy strategy of its own */
+enum mali_blit_memory
+{
+	MALI_BLIT_MEMORY_FRAMEBUFFER,	/* the uncached or write-combined fbdev mapping */
+	MALI_BLIT_MEMORY_CACHED,	/* heap and cached UMP memory */
+	MALI_BLIT_MEMORY_TYPES
+};
+
+enum mali_blit_copy_kernel
+{
+	MALI_BLIT_COPY_AUTO,	/* not a kernel: let startup probing decide */
+	MALI_BLIT_COPY_LIBC,	/* memcpy */
+	MALI_BLIT_COPY_SIMD,	/* 64 bytes at a time with NEON or SSE2 */
+	MALI_BLIT_COPY_STREAM,	/* the same with non-temporal stores, SSE2 only */
+	MALI_BLIT_COPY_KERNELS
+};
+
+struct mali_blit_copy_strategy
+{
+	enum mali_blit_copy_kernel kernel;
+	int prefetch;	/* bytes ahead of the source, 0 for none */
+};
+
+extern const char *mali_blit_copy_kernel_name( enum mali_blit_copy_kernel kernel );
+extern int mali_blit_copy_kernel_lookup( const char *name, enum mali_blit_copy_kernel *kernel );
+extern int mali_blit_copy_kernel_available( enum mali_blit_copy_kernel kernel );
+
+/* Setting fails for a kernel this build lacks */
+extern void mali_blit_get_copy_strategy( enum mali_blit_memory memory, struct mali_blit_copy_strategy *strategy );
+extern int mali_blit_set_copy_strategy( enum mali_blit_memory memory, const struct mali_blit_copy_strategy *strategy );
+
+/* width is in bytes, pitches may be negative */
+extern void mali_blit_copy( enum mali_blit_memory memory, void *dst, int dst_pitch, const void *src, int src_pitch, int width, int height );
+extern void mali_blit_copy_with( const struct mali_blit_copy_strategy *strategy, void *dst, int dst_pitch, const void *src, int src_pitch, int width, int height );
+
+/* Fill a box of 1, 2 or 4 byte pixels, width is in pixels */
+extern void mali_blit_fill( void *dst, int dst_pitch, int width, int height, int cpp, uint32_t pixel );
+
+/*
+ * Render's OVER of count premultiplied a8r8g8b8 pixels onto a row, rounded as
+ * pixman does. dst_alpha is ORed into the destination pixels first,
+ * 0xff000000 when they are x8r8g8b8. Destination pixels under a fully
+ * transparent source keep their value.
+ */
+extern void mali_blit_over_row_8888( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha );
+
+/* Render's ADD, a saturating add of each byte, so any format will do */
+extern void mali_blit_add_row( uint8_t *dst, const uint8_t *src, int bytes );
+
+/*
+ * Convert x8r8g8b8 to r5g6b5. Here width is in pixels, and x and y give the
+ * screen position of the first pixel so that the ordered dither pattern stays
+ * put when a region is redrawn.
+ */
+extern void mali_blit_convert_8888_565( void *dst, int dst_pitch, const void *src, int src_pitch,
+                                        int x, int y, int width, int height, int dither );
+
+/*
+ * Copy a width x height box of 16 or 32 bpp pixels, rotated counter-clockwise
+ * by 0, 90, 180 or 270 degrees as RandR does. dst is the top-left corner of
+ * the destination box, which is height x width for 90 and 270.
+ */
+extern void mali_blit_rotate( void *dst, int dst_pitch, const void *src, int src_pitch,
+                              int width, int height, int cpp, int rotation );
+
+/* The same from x8r8g8b8 into r5g6b5, dst_x and dst_y anchor the dither pattern */
+extern void mali_blit_rotate_convert_8888_565( void *dst, int dst_pitch, const void *src, int src_pitch,
+                                               int width, int height, int rotation,
+                                               int dst_x, int dst_y, int dither );
+
+/*
+ * Resample one destination row from a width x height source. x and y are the
+ * 16.16 source position of the centre of the first destination pixel and dx,
+ * dy the step per destination pixel. Samples outside the source are clamped
+ * to its edge.
+ */
+extern void mali_blit_sample_row_nearest( void *dst, const void *src, int src_pitch, int width, int height,
+                                          int32_t x, int32_t y, int32_t dx, int32_t dy, int count, int cpp );
+
+extern void mali_blit_sample_row_bilinear_8888( uint32_t *dst, const void *src, int src_pitch, int width, int height,
+                                                int32_t x, int32_t y, int32_t dx, int32_t dy, int count );
+
+/* Nearest-neighbour gather of count bytes taken stride bytes apart, x and dx are 16.16 */
+extern void mali_blit_gather_8( uint8_t *dst, const uint8_t *src, int stride, int32_t x, int32_t dx, int count );
+
+/*
+ * Limited range YCbCr to x8r8g8b8 with BT.601 or BT.709 coefficients. With
+ * chroma_shift 1 the chroma lines are at half resolution and phase says
+ * whether the first pixel is the second of its pair.
+ */
+extern void mali_blit_yuv_to_8888( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                   int count, int chroma_shift, int phase, int bt709 );
+
+#endif /* _MALI_BLIT_H_ */
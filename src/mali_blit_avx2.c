@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Only for the kernels that gain from 32 byte vectors, the rest stay SSE2.
+ * 64 bit only: some compilers can't take immintrin.h in an i386 build
+ * without SSE2.
+ */
+#if defined(__x86_64__) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define BLIT_AVX2 1
+#pragma GCC target("avx2")
+#include <immintrin.h>
+#endif
+
+#include "mali_blit_kernels.h"
+
+#ifdef BLIT_AVX2
+
+static void copy_row_avx2( uint8_t *dst, const uint8_t *src, int bytes, int prefetch )
+{
+	bytes = mali_blit_copy_align( &dst, &src, bytes );
+
+	for ( ; bytes >= 64; bytes -= 64, src += 64, dst += 64 )
+	{
+		__m256i a, b;
+
+		if ( prefetch ) _mm_prefetch( (const char *)src + prefetch, _MM_HINT_T0 );
+
+		a = _mm256_loadu_si256( (const __m256i *)src );
+		b = _mm256_loadu_si256( (const __m256i *)( src + 32 ) );
+		_mm256_storeu_si256( (__m256i *)dst, a );
+		_mm256_storeu_si256( (__m256i *)( dst + 32 ), b );
+	}
+
+	if ( bytes > 0 ) memcpy( dst, src, bytes );
+}
+
+static inline __m256i pack_565( __m256i p )
+{
+	__m256i r = _mm256_and_si256( _mm256_srli_epi32( p, 8 ), _mm256_set1_epi32( 0xf800 ) );
+	__m256i g = _mm256_and_si256( _mm256_srli_epi32( p, 5 ), _mm256_set1_epi32( 0x07e0 ) );
+	__m256i b = _mm256_and_si256( _mm256_srli_epi32( p, 3 ), _mm256_set1_epi32( 0x001f ) );
+
+	return _mm256_srai_epi32( _mm256_slli_epi32( _mm256_or_si256( _mm256_or_si256( r, g ), b ), 16 ), 16 );
+}
+
+static void convert_row_8888_565_avx2( uint16_t *dst, const uint32_t *src, int x, int y, int width, int dither )
+{
+	__m256i d = _mm256_setzero_si256();
+	int i = 0;
+
+	if ( dither )
+	{
+		const uint8_t *drb = mali_blit_dither_rb[y & 3];
+		const uint8_t *dg = mali_blit_dither_g[y & 3];
+		uint8_t pattern[32];
+		int k;
+
+		for ( k = 0; k < 8; k++ )
+		{
+			pattern[k * 4] = drb[( x + k ) & 3];
+			pattern[k * 4 + 1] = dg[( x + k ) & 3];
+			pattern[k * 4 + 2] = drb[( x + k ) & 3];
+			pattern[k * 4 + 3] = 0;
+		}
+		d = _mm256_loadu_si256( (const __m256i *)pattern );
+	}
+
+	for ( ; i + 16 <= width; i += 16 )
+	{
+		__m256i a = _mm256_adds_epu8( _mm256_loadu_si256( (const __m256i *)( src + i ) ), d );
+		__m256i b = _mm256_adds_epu8( _mm256_loadu_si256( (const __m256i *)( src + i + 8 ) ), d );
+
+		/* The pack works within each 128 bit half, put the quarters back in order */
+		_mm256_storeu_si256( (__m256i *)( dst + i ), _mm256_permute4x64_epi64( _mm256_packs_epi32( pack_565( a ), pack_565( b ) ), 0xd8 ) );
+	}
+
+	if ( i < width ) mali_blit_convert_row_c( dst + i, src + i, x + i, y, width - i, dither );
+}
+
+static void lerp_row_8888_avx2( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i wa = _mm256_set1_epi16( 256 - w );
+	const __m256i wb = _mm256_set1_epi16( w );
+	int i = 0;
+
+	/* Unpacking and packing both stay within 128 bit halves, so the order comes out right */
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m256i va = _mm256_loadu_si256( (const __m256i *)( a + i ) );
+		__m256i vb = _mm256_loadu_si256( (const __m256i *)( b + i ) );
+		__m256i lo = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_unpacklo_epi8( va, zero ), wa ), _mm256_mullo_epi16( _mm256_unpacklo_epi8( vb, zero ), wb ) );
+		__m256i hi = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_unpackhi_epi8( va, zero ), wa ), _mm256_mullo_epi16( _mm256_unpackhi_epi8( vb, zero ), wb ) );
+
+		_mm256_storeu_si256( (__m256i *)( dst + i ), _mm256_packus_epi16( _mm256_srli_epi16( lo, 8 ), _mm256_srli_epi16( hi, 8 ) ) );
+	}
+
+	if ( i < count ) mali_blit_lerp_row_c( dst + i, a + i, b + i, w, count - i );
+}
+
+int mali_blit_setup_avx2( struct mali_blit_kernels *kernels )
+{
+	kernels->copy_row = copy_row_avx2;
+	kernels->convert_row_8888_565 = convert_row_8888_565_avx2;
+	kernels->lerp_row_8888 = lerp_row_8888_avx2;
+
+	return 1;
+}
+
+#else
+
+int mali_blit_setup_avx2( struct mali_blit_kernels *kernels )
+{
+	(void)kernels;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_BLIT_KERNELS_H_
+#define _MALI_BLIT_KERNELS_H_
+
+#include <stdint.h>
+
+/*
+ * Internal to mali_blit: the row kernels behind the public blit functions.
+ * Each instruction set lives in a file of its own, built for that instruction
+ * set whatever the compiler flags, and mali_blit_init() installs the ones the
+ * CPU can run over the plain C versions.
+ */
+
+struct mali_blit_kernels
+{
+	/* width in bytes, prefetch is how far ahead of src to fetch */
+	void (*copy_row)( uint8_t *dst, const uint8_t *src, int bytes, int prefetch );
+
+	/* NULL when there is no way to write around the cache */
+	void (*stream_row)( uint8_t *dst, const uint8_t *src, int bytes, int prefetch );
+	void (*stream_done)( void );
+
+	/* pattern is what a 4 byte aligned word of the row holds */
+	void (*fill_row)( uint8_t *dst, uint32_t pattern, int bytes );
+
+	void (*convert_row_8888_565)( uint16_t *dst, const uint32_t *src, int x, int y, int width, int dither );
+
+	/* w is the weight of b out of 256, never 0 */
+	void (*lerp_row_8888)( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count );
+
+	/* Render's OVER and ADD, as mali_blit_over_row_8888 and mali_blit_add_row */
+	void (*over_row_8888)( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha );
+	void (*add_row)( uint8_t *dst, const uint8_t *src, int bytes );
+
+	/* count pixels from the start of a chroma pair */
+	void (*yuv_row_8888)( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+	                      int count, int chroma_shift, const int16_t *coeffs );
+
+	/* Destination rows v..v+3, columns u..u+3 of a 90 or 270 degree rotation of 32bpp pixels, NULL if there is none */
+	void (*rotate_block_8888)( uint8_t *dst, int dst_pitch, const uint8_t *src, int src_pitch,
+	                           int width, int height, int rotation, int u, int v );
+};
+
+/* Byte copy until dst is 16 byte aligned, returns what is left */
+static inline int mali_blit_copy_align( uint8_t **dst, const uint8_t **src, int bytes )
+{
+	while ( bytes > 0 && ( (uintptr_t)*dst & 15 ) )
+	{
+		*(*dst)++ = *(*src)++;
+		bytes--;
+	}
+
+	return bytes;
+}
+
+/* Ordered dither offsets, see mali_blit.c */
+extern const uint8_t mali_blit_dither_rb[4][12];
+extern const uint8_t mali_blit_dither_g[4][12];
+
+/* The C kernels, which the others fall back to for their tails */
+extern void mali_blit_fill_row_c( uint8_t *dst, uint32_t pattern, int bytes );
+extern void mali_blit_convert_row_c( uint16_t *dst, const uint32_t *src, int x, int y, int width, int dither );
+extern void mali_blit_lerp_row_c( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count );
+extern void mali_blit_over_row_c( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha );
+extern void mali_blit_add_row_c( uint8_t *dst, const uint8_t *src, int bytes );
+extern void mali_blit_yuv_row_c( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                 int count, int chroma_shift, const int16_t *coeffs );
+
+/* Replace the kernels an instruction set has, these return 0 if it wasn't built */
+extern int mali_blit_setup_neon( struct mali_blit_kernels *kernels );
+extern int mali_blit_setup_sse2( struct mali_blit_kernels *kernels );
+extern int mali_blit_setup_avx2( struct mali_blit_kernels *kernels );
+
+#endif /* _MALI_BLIT_KERNELS_H_ */
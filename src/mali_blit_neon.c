@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Built with NEON enabled whatever the compiler flags say, so that an armhf
+ * build still has these for the boards that can run them.
+ */
+#if defined(__aarch64__) || defined(__ARM_NEON__) || ( defined(__arm__) && !defined(__SOFTFP__) && __GNUC__ >= 8 )
+#define BLIT_NEON 1
+#if !defined(__aarch64__) && !defined(__ARM_NEON__)
+#pragma GCC target("fpu=neon")
+#endif
+#include <arm_neon.h>
+#endif
+
+#include "mali_blit_kernels.h"
+
+#ifdef BLIT_NEON
+
+static void copy_row_neon( uint8_t *dst, const uint8_t *src, int bytes, int prefetch )
+{
+	bytes = mali_blit_copy_align( &dst, &src, bytes );
+
+	for ( ; bytes >= 64; bytes -= 64, src += 64, dst += 64 )
+	{
+		uint8x16_t a, b, c, d;
+
+		if ( prefetch ) __builtin_prefetch( src + prefetch );
+
+		a = vld1q_u8( src );
+		b = vld1q_u8( src + 16 );
+		c = vld1q_u8( src + 32 );
+		d = vld1q_u8( src + 48 );
+		vst1q_u8( dst, a );
+		vst1q_u8( dst + 16, b );
+		vst1q_u8( dst + 32, c );
+		vst1q_u8( dst + 48, d );
+	}
+
+	if ( bytes > 0 ) memcpy( dst, src, bytes );
+}
+
+static void fill_row_neon( uint8_t *dst, uint32_t pattern, int bytes )
+{
+	uint8x16_t p = vreinterpretq_u8_u32( vdupq_n_u32( pattern ) );
+	int head = ( 16 - ( (uintptr_t)dst & 15 ) ) & 15;
+
+	if ( head > bytes ) head = bytes;
+	mali_blit_fill_row_c( dst, pattern, head );
+	dst += head;
+	bytes -= head;
+
+	for ( ; bytes >= 64; bytes -= 64, dst += 64 )
+	{
+		vst1q_u8( dst, p );
+		vst1q_u8( dst + 16, p );
+		vst1q_u8( dst + 32, p );
+		vst1q_u8( dst + 48, p );
+	}
+
+	for ( ; bytes >= 16; bytes -= 16, dst += 16 ) vst1q_u8( dst, p );
+
+	mali_blit_fill_row_c( dst, pattern, bytes );
+}
+
+static void convert_row_8888_565_neon( uint16_t *dst, const uint32_t *src, int x, int y, int width, int dither )
+{
+	const uint8_t *drb = mali_blit_dither_rb[y & 3];
+	const uint8_t *dg = mali_blit_dither_g[y & 3];
+	int i = 0;
+
+	for ( ; i + 8 <= width; i += 8 )
+	{
+		uint8x8x4_t p = vld4_u8( (const uint8_t *)( src + i ) );
+		uint16x8_t out;
+
+		__builtin_prefetch( src + i + 64 );
+
+		if ( dither )
+		{
+			uint8x8_t rb = vld1_u8( drb + ( ( x + i ) & 3 ) );
+			uint8x8_t g = vld1_u8( dg + ( ( x + i ) & 3 ) );
+
+			p.val[0] = vqadd_u8( p.val[0], rb );
+			p.val[1] = vqadd_u8( p.val[1], g );
+			p.val[2] = vqadd_u8( p.val[2], rb );
+		}
+
+		/* Shift each channel to the top of a 16 bit lane and insert the next one below it */
+		out = vshll_n_u8( p.val[2], 8 );
+		out = vsriq_n_u16( out, vshll_n_u8( p.val[1], 8 ), 5 );
+		out = vsriq_n_u16( out, vshll_n_u8( p.val[0], 8 ), 11 );
+
+		vst1q_u16( dst + i, out );
+	}
+
+	if ( i < width ) mali_blit_convert_row_c( dst + i, src + i, x + i, y, width - i, dither );
+}
+
+static void lerp_row_8888_neon( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count )
+{
+	uint8x8_t wa = vdup_n_u8( 256 - w );
+	uint8x8_t wb = vdup_n_u8( w );
+	int i = 0;
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		uint8x16_t va = vld1q_u8( (const uint8_t *)( a + i ) );
+		uint8x16_t vb = vld1q_u8( (const uint8_t *)( b + i ) );
+		uint16x8_t lo = vmlal_u8( vmull_u8( vget_low_u8( va ), wa ), vget_low_u8( vb ), wb );
+		uint16x8_t hi = vmlal_u8( vmull_u8( vget_high_u8( va ), wa ), vget_high_u8( vb ), wb );
+
+		vst1q_u8( (uint8_t *)( dst + i ), vcombine_u8( vshrn_n_u16( lo, 8 ), vshrn_n_u16( hi, 8 ) ) );
+	}
+
+	if ( i < count ) mali_blit_lerp_row_c( dst + i, a + i, b + i, w, count - i );
+}
+
+static void over_row_8888_neon( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha )
+{
+	uint8x8_t fill[4];
+	int i = 0, k;
+
+	for ( k = 0; k < 4; k++ ) fill[k] = vdup_n_u8( ( dst_alpha >> ( k * 8 ) ) & 0xff );
+
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		uint8x8x4_t s = vld4_u8( (const uint8_t *)( src + i ) );
+		uint8x8_t any = vorr_u8( vorr_u8( s.val[0], s.val[1] ), vorr_u8( s.val[2], s.val[3] ) );
+		uint8x8_t na = vmvn_u8( s.val[3] );
+		uint8x8_t clear;
+		uint8x8x4_t d, out;
+
+		/* Leave the destination alone where it can, it may be the uncached framebuffer */
+		if ( 0 == vget_lane_u64( vreinterpret_u64_u8( any ), 0 ) ) continue;
+		if ( 0 == vget_lane_u64( vreinterpret_u64_u8( na ), 0 ) )
+		{
+			vst4_u8( (uint8_t *)( dst + i ), s );
+			continue;
+		}
+
+		d = vld4_u8( (const uint8_t *)( dst + i ) );
+		clear = vceq_u8( any, vdup_n_u8( 0 ) );
+
+		/* ( t + ( ( t + 128 ) >> 8 ) + 128 ) >> 8 is pixman's rounded division by 255 */
+		for ( k = 0; k < 4; k++ )
+		{
+			uint16x8_t t = vmull_u8( vorr_u8( d.val[k], fill[k] ), na );
+			uint8x8_t r = vqadd_u8( vrshrn_n_u16( vrsraq_n_u16( t, t, 8 ), 8 ), s.val[k] );
+
+			/* Transparent pixels keep the destination as it was */
+			out.val[k] = vbsl_u8( clear, d.val[k], r );
+		}
+
+		vst4_u8( (uint8_t *)( dst + i ), out );
+	}
+
+	if ( i < count ) mali_blit_over_row_c( dst + i, src + i, count - i, dst_alpha );
+}
+
+static void add_row_neon( uint8_t *dst, const uint8_t *src, int bytes )
+{
+	int i = 0;
+
+	for ( ; i + 16 <= bytes; i += 16 )
+	{
+		uint8x16_t s = vld1q_u8( src + i );
+		uint64x2_t any = vreinterpretq_u64_u8( s );
+
+		if ( 0 == ( vgetq_lane_u64( any, 0 ) | vgetq_lane_u64( any, 1 ) ) ) continue;
+
+		vst1q_u8( dst + i, vqaddq_u8( vld1q_u8( dst + i ), s ) );
+	}
+
+	if ( i < bytes ) mali_blit_add_row_c( dst + i, src + i, bytes - i );
+}
+
+static void yuv_row_8888_neon( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                               int count, int chroma_shift, const int16_t *c )
+{
+	uint8x8_t off_y = vdup_n_u8( 16 ), off_c = vdup_n_u8( 128 ), cy = vdup_n_u8( c[0] );
+	uint8x8x4_t out;
+	int i = 0;
+
+	out.val[3] = vdup_n_u8( 0xff );
+
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		uint8x8_t vu, vv;
+		int16x8_t yy, uu, vv16, r, g, b;
+
+		if ( chroma_shift )
+		{
+			uint32_t cu, cv;
+
+			/* Only four chroma samples are needed, don't read past them */
+			memcpy( &cu, u + ( i >> 1 ), 4 );
+			memcpy( &cv, v + ( i >> 1 ), 4 );
+			vu = vreinterpret_u8_u32( vdup_n_u32( cu ) );
+			vv = vreinterpret_u8_u32( vdup_n_u32( cv ) );
+			vu = vzip_u8( vu, vu ).val[0];
+			vv = vzip_u8( vv, vv ).val[0];
+		}
+		else
+		{
+			vu = vld1_u8( u + i );
+			vv = vld1_u8( v + i );
+		}
+
+		yy = vreinterpretq_s16_u16( vmull_u8( vqsub_u8( vld1_u8( y + i ), off_y ), cy ) );
+		uu = vreinterpretq_s16_u16( vsubl_u8( vu, off_c ) );
+		vv16 = vreinterpretq_s16_u16( vsubl_u8( vv, off_c ) );
+
+		/* Saturating, blue can exceed 16 bits before it is clamped */
+		r = vqaddq_s16( yy, vmulq_n_s16( vv16, c[1] ) );
+		g = vqsubq_s16( vqsubq_s16( yy, vmulq_n_s16( uu, c[2] ) ), vmulq_n_s16( vv16, c[3] ) );
+		b = vqaddq_s16( yy, vmulq_n_s16( uu, c[4] ) );
+
+		out.val[0] = vqshrun_n_s16( b, 6 );
+		out.val[1] = vqshrun_n_s16( g, 6 );
+		out.val[2] = vqshrun_n_s16( r, 6 );
+		vst4_u8( (uint8_t *)( dst + i ), out );
+	}
+
+	if ( i < count ) mali_blit_yuv_row_c( dst + i, y + i, u + ( i >> chroma_shift ), v + ( i >> chroma_shift ), count - i, chroma_shift, c );
+}
+
+static inline void transpose_4x4( uint32x4_t r[4] )
+{
+	uint32x4x2_t t01 = vtrnq_u32( r[0], r[1] );
+	uint32x4x2_t t23 = vtrnq_u32( r[2], r[3] );
+
+	r[0] = vcombine_u32( vget_low_u32( t01.val[0] ), vget_low_u32( t23.val[0] ) );
+	r[1] = vcombine_u32( vget_low_u32( t01.val[1] ), vget_low_u32( t23.val[1] ) );
+	r[2] = vcombine_u32( vget_high_u32( t01.val[0] ), vget_high_u32( t23.val[0] ) );
+	r[3] = vcombine_u32( vget_high_u32( t01.val[1] ), vget_high_u32( t23.val[1] ) );
+}
+
+static void rotate_block_8888_neon( uint8_t *dst, int dst_pitch, const uint8_t *src, int src_pitch,
+                                    int width, int height, int rotation, int u, int v )
+{
+	uint32x4_t r[4];
+	int k;
+
+	if ( 90 == rotation )
+	{
+		const uint8_t *s = src + u * src_pitch + ( width - 4 - v ) * 4;
+
+		for ( k = 0; k < 4; k++ ) r[k] = vld1q_u32( (const uint32_t *)( s + k * src_pitch ) );
+		transpose_4x4( r );
+
+		/* Source column width-4-v+m lands on destination row v+3-m */
+		for ( k = 0; k < 4; k++ ) vst1q_u32( (uint32_t *)( dst + ( v + 3 - k ) * dst_pitch + u * 4 ), r[k] );
+	}
+	else
+	{
+		const uint8_t *s = src + ( height - 4 - u ) * src_pitch + v * 4;
+
+		for ( k = 0; k < 4; k++ ) r[k] = vld1q_u32( (const uint32_t *)( s + k * src_pitch ) );
+		transpose_4x4( r );
+
+		/* The source rows run bottom-up along the destination row */
+		for ( k = 0; k < 4; k++ )
+		{
+			uint32x4_t x = vrev64q_u32( r[k] );
+
+			vst1q_u32( (uint32_t *)( dst + ( v + k ) * dst_pitch + u * 4 ), vcombine_u32( vget_high_u32( x ), vget_low_u32( x ) ) );
+		}
+	}
+}
+
+int mali_blit_setup_neon( struct mali_blit_kernels *kernels )
+{
+	kernels->copy_row = copy_row_neon;
+	kernels->fill_row = fill_row_neon;
+	kernels->convert_row_8888_565 = convert_row_8888_565_neon;
+	kernels->lerp_row_8888 = lerp_row_8888_neon;
+	kernels->over_row_8888 = over_row_8888_neon;
+	kernels->add_row = add_row_neon;
+	kernels->yuv_row_8888 = yuv_row_8888_neon;
+	kernels->rotate_block_8888 = rotate_block_8888_neon;
+
+	return 1;
+}
+
+#else
+
+int mali_blit_setup_neon( struct mali_blit_kernels *kernels )
+{
+	(void)kernels;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/* Always built with SSE2 on x86, i386 builds don't get it by default */
+#if defined(__i386__) || defined(__x86_64__)
+#define BLIT_SSE2 1
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+#endif
+
+#include "mali_blit_kernels.h"
+
+#ifdef BLIT_SSE2
+
+static void copy_row_sse2( uint8_t *dst, const uint8_t *src, int bytes, int prefetch )
+{
+	bytes = mali_blit_copy_align( &dst, &src, bytes );
+
+	for ( ; bytes >= 64; bytes -= 64, src += 64, dst += 64 )
+	{
+		__m128i a, b, c, d;
+
+		if ( prefetch ) _mm_prefetch( (const char *)src + prefetch, _MM_HINT_T0 );
+
+		a = _mm_loadu_si128( (const __m128i *)src );
+		b = _mm_loadu_si128( (const __m128i *)( src + 16 ) );
+		c = _mm_loadu_si128( (const __m128i *)( src + 32 ) );
+		d = _mm_loadu_si128( (const __m128i *)( src + 48 ) );
+		_mm_store_si128( (__m128i *)dst, a );
+		_mm_store_si128( (__m128i *)( dst + 16 ), b );
+		_mm_store_si128( (__m128i *)( dst + 32 ), c );
+		_mm_store_si128( (__m128i *)( dst + 48 ), d );
+	}
+
+	if ( bytes > 0 ) memcpy( dst, src, bytes );
+}
+
+/* Stores that bypass the cache, so a large copy doesn't evict everything else on its way out */
+static void stream_row_sse2( uint8_t *dst, const uint8_t *src, int bytes, int prefetch )
+{
+	bytes = mali_blit_copy_align( &dst, &src, bytes );
+
+	for ( ; bytes >= 64; bytes -= 64, src += 64, dst += 64 )
+	{
+		__m128i a, b, c, d;
+
+		if ( prefetch ) _mm_prefetch( (const char *)src + prefetch, _MM_HINT_NTA );
+
+		a = _mm_loadu_si128( (const __m128i *)src );
+		b = _mm_loadu_si128( (const __m128i *)( src + 16 ) );
+		c = _mm_loadu_si128( (const __m128i *)( src + 32 ) );
+		d = _mm_loadu_si128( (const __m128i *)( src + 48 ) );
+		_mm_stream_si128( (__m128i *)dst, a );
+		_mm_stream_si128( (__m128i *)( dst + 16 ), b );
+		_mm_stream_si128( (__m128i *)( dst + 32 ), c );
+		_mm_stream_si128( (__m128i *)( dst + 48 ), d );
+	}
+
+	if ( bytes > 0 ) memcpy( dst, src, bytes );
+}
+
+/* Streaming stores are weakly ordered */
+static void stream_done_sse2( void )
+{
+	_mm_sfence();
+}
+
+static void fill_row_sse2( uint8_t *dst, uint32_t pattern, int bytes )
+{
+	__m128i p = _mm_set1_epi32( pattern );
+	int head = ( 16 - ( (uintptr_t)dst & 15 ) ) & 15;
+
+	if ( head > bytes ) head = bytes;
+	mali_blit_fill_row_c( dst, pattern, head );
+	dst += head;
+	bytes -= head;
+
+	for ( ; bytes >= 64; bytes -= 64, dst += 64 )
+	{
+		_mm_store_si128( (__m128i *)dst, p );
+		_mm_store_si128( (__m128i *)( dst + 16 ), p );
+		_mm_store_si128( (__m128i *)( dst + 32 ), p );
+		_mm_store_si128( (__m128i *)( dst + 48 ), p );
+	}
+
+	for ( ; bytes >= 16; bytes -= 16, dst += 16 ) _mm_store_si128( (__m128i *)dst, p );
+
+	mali_blit_fill_row_c( dst, pattern, bytes );
+}
+
+/* Four x8r8g8b8 pixels to r5g6b5, left in the low half of each 32 bit lane */
+static inline __m128i pack_565( __m128i p )
+{
+	__m128i r = _mm_and_si128( _mm_srli_epi32( p, 8 ), _mm_set1_epi32( 0xf800 ) );
+	__m128i g = _mm_and_si128( _mm_srli_epi32( p, 5 ), _mm_set1_epi32( 0x07e0 ) );
+	__m128i b = _mm_and_si128( _mm_srli_epi32( p, 3 ), _mm_set1_epi32( 0x001f ) );
+
+	/* Sign extended, so that the saturating pack to 16 bits passes it through */
+	return _mm_srai_epi32( _mm_slli_epi32( _mm_or_si128( _mm_or_si128( r, g ), b ), 16 ), 16 );
+}
+
+static void convert_row_8888_565_sse2( uint16_t *dst, const uint32_t *src, int x, int y, int width, int dither )
+{
+	__m128i d = _mm_setzero_si128();
+	int i = 0;
+
+	if ( dither )
+	{
+		const uint8_t *drb = mali_blit_dither_rb[y & 3];
+		const uint8_t *dg = mali_blit_dither_g[y & 3];
+		uint8_t pattern[16];
+		int k;
+
+		/* The pattern repeats every four pixels, so one vector of it does for the whole row */
+		for ( k = 0; k < 4; k++ )
+		{
+			pattern[k * 4] = drb[( x + k ) & 3];
+			pattern[k * 4 + 1] = dg[( x + k ) & 3];
+			pattern[k * 4 + 2] = drb[( x + k ) & 3];
+			pattern[k * 4 + 3] = 0;
+		}
+		d = _mm_loadu_si128( (const __m128i *)pattern );
+	}
+
+	for ( ; i + 8 <= width; i += 8 )
+	{
+		__m128i a = _mm_adds_epu8( _mm_loadu_si128( (const __m128i *)( src + i ) ), d );
+		__m128i b = _mm_adds_epu8( _mm_loadu_si128( (const __m128i *)( src + i + 4 ) ), d );
+
+		_mm_storeu_si128( (__m128i *)( dst + i ), _mm_packs_epi32( pack_565( a ), pack_565( b ) ) );
+	}
+
+	if ( i < width ) mali_blit_convert_row_c( dst + i, src + i, x + i, y, width - i, dither );
+}
+
+static void lerp_row_8888_sse2( uint32_t *dst, const uint32_t *a, const uint32_t *b, unsigned int w, int count )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wa = _mm_set1_epi16( 256 - w );
+	const __m128i wb = _mm_set1_epi16( w );
+	int i = 0;
+
+	/* At most 255 * 256 per channel, which fits in a 16 bit lane */
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128i va = _mm_loadu_si128( (const __m128i *)( a + i ) );
+		__m128i vb = _mm_loadu_si128( (const __m128i *)( b + i ) );
+		__m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( va, zero ), wa ), _mm_mullo_epi16( _mm_unpacklo_epi8( vb, zero ), wb ) );
+		__m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( va, zero ), wa ), _mm_mullo_epi16( _mm_unpackhi_epi8( vb, zero ), wb ) );
+
+		_mm_storeu_si128( (__m128i *)( dst + i ), _mm_packus_epi16( _mm_srli_epi16( lo, 8 ), _mm_srli_epi16( hi, 8 ) ) );
+	}
+
+	if ( i < count ) mali_blit_lerp_row_c( dst + i, a + i, b + i, w, count - i );
+}
+
+/* Each 16 bit lane of d times the alpha lane of its pixel in a, over 255 as pixman rounds it */
+static inline __m128i mul_un8_sse2( __m128i d, __m128i a )
+{
+	a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( a, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+
+	return _mm_mulhi_epu16( _mm_add_epi16( _mm_mullo_epi16( d, a ), _mm_set1_epi16( 0x80 ) ), _mm_set1_epi16( 0x0101 ) );
+}
+
+static void over_row_8888_sse2( uint32_t *dst, const uint32_t *src, int count, uint32_t dst_alpha )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32( 0xff000000 );
+	const __m128i fill = _mm_set1_epi32( dst_alpha );
+	int i = 0;
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128i s = _mm_loadu_si128( (const __m128i *)( src + i ) );
+		__m128i clear = _mm_cmpeq_epi32( s, zero );
+		__m128i d, na, r;
+
+		/* Leave the destination alone where it can, it may be the uncached framebuffer */
+		if ( 0xffff == _mm_movemask_epi8( clear ) ) continue;
+		if ( 0xffff == _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_and_si128( s, alpha ), alpha ) ) )
+		{
+			_mm_storeu_si128( (__m128i *)( dst + i ), s );
+			continue;
+		}
+
+		d = _mm_loadu_si128( (const __m128i *)( dst + i ) );
+		na = _mm_xor_si128( s, _mm_set1_epi8( (char)0xff ) );
+		r = _mm_or_si128( d, fill );
+		r = _mm_packus_epi16( mul_un8_sse2( _mm_unpacklo_epi8( r, zero ), _mm_unpacklo_epi8( na, zero ) ),
+		                      mul_un8_sse2( _mm_unpackhi_epi8( r, zero ), _mm_unpackhi_epi8( na, zero ) ) );
+		r = _mm_adds_epu8( r, s );
+
+		/* Transparent pixels keep the destination as it was */
+		r = _mm_or_si128( _mm_andnot_si128( clear, r ), _mm_and_si128( clear, d ) );
+		_mm_storeu_si128( (__m128i *)( dst + i ), r );
+	}
+
+	if ( i < count ) mali_blit_over_row_c( dst + i, src + i, count - i, dst_alpha );
+}
+
+static void add_row_sse2( uint8_t *dst, const uint8_t *src, int bytes )
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+
+	for ( ; i + 16 <= bytes; i += 16 )
+	{
+		__m128i s = _mm_loadu_si128( (const __m128i *)( src + i ) );
+
+		if ( 0xffff == _mm_movemask_epi8( _mm_cmpeq_epi8( s, zero ) ) ) continue;
+
+		_mm_storeu_si128( (__m128i *)( dst + i ), _mm_adds_epu8( _mm_loadu_si128( (const __m128i *)( dst + i ) ), s ) );
+	}
+
+	if ( i < bytes ) mali_blit_add_row_c( dst + i, src + i, bytes - i );
+}
+
+static void yuv_row_8888_sse2( uint32_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                               int count, int chroma_shift, const int16_t *c )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi8( (char)0xff );
+	const __m128i off_y = _mm_set1_epi8( 16 );
+	const __m128i off_c = _mm_set1_epi16( 128 );
+	int i = 0;
+
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m128i vu, vv, yy, uu, vv16, r, g, b, bg, ra;
+
+		if ( chroma_shift )
+		{
+			int32_t cu, cv;
+
+			/* Only four chroma samples are needed, don't read past them */
+			memcpy( &cu, u + ( i >> 1 ), 4 );
+			memcpy( &cv, v + ( i >> 1 ), 4 );
+			vu = _mm_cvtsi32_si128( cu );
+			vv = _mm_cvtsi32_si128( cv );
+			vu = _mm_unpacklo_epi8( vu, vu );
+			vv = _mm_unpacklo_epi8( vv, vv );
+		}
+		else
+		{
+			vu = _mm_loadl_epi64( (const __m128i *)( u + i ) );
+			vv = _mm_loadl_epi64( (const __m128i *)( v + i ) );
+		}
+
+		yy = _mm_subs_epu8( _mm_loadl_epi64( (const __m128i *)( y + i ) ), off_y );
+		yy = _mm_mullo_epi16( _mm_unpacklo_epi8( yy, zero ), _mm_set1_epi16( c[0] ) );
+		uu = _mm_sub_epi16( _mm_unpacklo_epi8( vu, zero ), off_c );
+		vv16 = _mm_sub_epi16( _mm_unpacklo_epi8( vv, zero ), off_c );
+
+		/* Saturating, blue can exceed 16 bits before it is clamped */
+		r = _mm_adds_epi16( yy, _mm_mullo_epi16( vv16, _mm_set1_epi16( c[1] ) ) );
+		g = _mm_subs_epi16( _mm_subs_epi16( yy, _mm_mullo_epi16( uu, _mm_set1_epi16( c[2] ) ) ), _mm_mullo_epi16( vv16, _mm_set1_epi16( c[3] ) ) );
+		b = _mm_adds_epi16( yy, _mm_mullo_epi16( uu, _mm_set1_epi16( c[4] ) ) );
+
+		r = _mm_packus_epi16( _mm_srai_epi16( r, 6 ), zero );
+		g = _mm_packus_epi16( _mm_srai_epi16( g, 6 ), zero );
+		b = _mm_packus_epi16( _mm_srai_epi16( b, 6 ), zero );
+
+		bg = _mm_unpacklo_epi8( b, g );
+		ra = _mm_unpacklo_epi8( r, alpha );
+		_mm_storeu_si128( (__m128i *)( dst + i ), _mm_unpacklo_epi16( bg, ra ) );
+		_mm_storeu_si128( (__m128i *)( dst + i + 4 ), _mm_unpackhi_epi16( bg, ra ) );
+	}
+
+	if ( i < count ) mali_blit_yuv_row_c( dst + i, y + i, u + ( i >> chroma_shift ), v + ( i >> chroma_shift ), count - i, chroma_shift, c );
+}
+
+static inline void transpose_4x4( __m128i r[4] )
+{
+	__m128i t0 = _mm_unpacklo_epi32( r[0], r[1] );
+	__m128i t1 = _mm_unpacklo_epi32( r[2], r[3] );
+	__m128i t2 = _mm_unpackhi_epi32( r[0], r[1] );
+	__m128i t3 = _mm_unpackhi_epi32( r[2], r[3] );
+
+	r[0] = _mm_unpacklo_epi64( t0, t1 );
+	r[1] = _mm_unpackhi_epi64( t0, t1 );
+	r[2] = _mm_unpacklo_epi64( t2, t3 );
+	r[3] = _mm_unpackhi_epi64( t2, t3 );
+}
+
+/* The same walk as the NEON version */
+static void rotate_block_8888_sse2( uint8_t *dst, int dst_pitch, const uint8_t *src, int src_pitch,
+                                    int width, int height, int rotation, int u, int v )
+{
+	__m128i r[4];
+	int k;
+
+	if ( 90 == rotation )
+	{
+		const uint8_t *s = src + u * src_pitch + ( width - 4 - v ) * 4;
+
+		for ( k = 0; k < 4; k++ ) r[k] = _mm_loadu_si128( (const __m128i *)( s + k * src_pitch ) );
+		transpose_4x4( r );
+
+		for ( k = 0; k < 4; k++ ) _mm_storeu_si128( (__m128i *)( dst + ( v + 3 - k ) * dst_pitch + u * 4 ), r[k] );
+	}
+	else
+	{
+		const uint8_t *s = src + ( height - 4 - u ) * src_pitch + v * 4;
+
+		for ( k = 0; k < 4; k++ ) r[k] = _mm_loadu_si128( (const __m128i *)( s + k * src_pitch ) );
+		transpose_4x4( r );
+
+		for ( k = 0; k < 4; k++ )
+		{
+			_mm_storeu_si128( (__m128i *)( dst + ( v + k ) * dst_pitch + u * 4 ), _mm_shuffle_epi32( r[k], _MM_SHUFFLE( 0, 1, 2, 3 ) ) );
+		}
+	}
+}
+
+int mali_blit_setup_sse2( struct mali_blit_kernels *kernels )
+{
+	kernels->copy_row = copy_row_sse2;
+	kernels->stream_row = stream_row_sse2;
+	kernels->stream_done = stream_done_sse2;
+	kernels->fill_row = fill_row_sse2;
+	kernels->convert_row_8888_565 = convert_row_8888_565_sse2;
+	kernels->lerp_row_8888 = lerp_row_8888_sse2;
+	kernels->over_row_8888 = over_row_8888_sse2;
+	kernels->add_row = add_row_sse2;
+	kernels->yuv_row_8888 = yuv_row_8888_sse2;
+	kernels->rotate_block_8888 = rotate_block_8888_sse2;
+
+	return 1;
+}
+
+#else
+
+int mali_blit_setup_sse2( struct mali_blit_kernels *kernels )
+{
+	(void)kernels;
+
+	return 0;
+}
+
+#endif
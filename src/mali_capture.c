@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "xf86.h"
+#include "exa.h"
+#include "picturestr.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_exa.h"
+#include "mali_vsync.h"
+#include "mali_capture.h"
+
+struct mali_capture
+{
+	int fd;
+	char *path;
+	struct mali_capture_file *file;
+
+	/* the chunk being written, at chunk_start bytes into the records */
+	unsigned char *chunk;
+	uint64_t chunk_start;
+	uint32_t used;
+
+	CARD64 last;
+	uint32_t next_id;
+};
+
+static void capture_stop( ScrnInfoPtr pScrn, struct mali_capture *cap, const char *what )
+{
+	xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] EXA capture stopped, %s failed: %s\n", __FUNCTION__, __LINE__, what, strerror(errno) );
+
+	if ( cap->chunk ) munmap( cap->chunk, MALI_CAPTURE_CHUNK );
+	cap->chunk = NULL;
+}
+
+/* Blocks are reserved up front, running out of disk space in a shared mapping would mean SIGBUS */
+static Bool capture_map_chunk( ScrnInfoPtr pScrn, struct mali_capture *cap )
+{
+	off_t offset = MALI_CAPTURE_DATA + cap->chunk_start;
+	int err;
+
+	err = posix_fallocate( cap->fd, offset, MALI_CAPTURE_CHUNK );
+	if ( err )
+	{
+		errno = err;
+		capture_stop( pScrn, cap, "growing the file" );
+		return FALSE;
+	}
+
+	cap->chunk = mmap( NULL, MALI_CAPTURE_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, cap->fd, offset );
+	if ( MAP_FAILED == cap->chunk )
+	{
+		cap->chunk = NULL;
+		capture_stop( pScrn, cap, "mapping the file" );
+		return FALSE;
+	}
+
+	cap->used = 0;
+
+	return TRUE;
+}
+
+/* Room for a record of the given type, to be filled in and handed to capture_commit */
+static void *capture_begin( ScrnInfoPtr pScrn, uint16_t type, uint16_t size )
+{
+	struct mali_capture *cap = MALIPTR(pScrn)->capture;
+	struct mali_capture_record *r;
+	CARD64 now;
+
+	if ( NULL == cap || NULL == cap->chunk ) return NULL;
+
+	if ( cap->used + size > MALI_CAPTURE_CHUNK )
+	{
+		if ( cap->used + sizeof(*r) <= MALI_CAPTURE_CHUNK )
+		{
+			r = (struct mali_capture_record *)( cap->chunk + cap->used );
+			r->type = MALI_CAPTURE_PAD;
+			r->size = sizeof(*r);
+			r->delta = 0;
+		}
+
+		munmap( cap->chunk, MALI_CAPTURE_CHUNK );
+		cap->chunk = NULL;
+		cap->chunk_start += MALI_CAPTURE_CHUNK;
+		cap->file->length = cap->chunk_start;
+
+		if ( !capture_map_chunk( pScrn, cap ) ) return NULL;
+	}
+
+	now = MaliVSyncGetTime();
+
+	r = (struct mali_capture_record *)( cap->chunk + cap->used );
+	memset( r, 0, size );
+	r->type = type;
+	r->size = size;
+	r->delta = now - cap->last;
+	cap->last = now;
+
+	return r;
+}
+
+static void capture_commit( ScrnInfoPtr pScrn, void *record )
+{
+	struct mali_capture *cap = MALIPTR(pScrn)->capture;
+
+	cap->used += ( (struct mali_capture_record *)record )->size;
+	cap->file->length = cap->chunk_start + cap->used;
+}
+
+static uint32_t capture_id( PixmapPtr pPixmap )
+{
+	PrivPixmap *privPixmap;
+
+	if ( NULL == pPixmap ) return 0;
+
+	privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate( pPixmap );
+
+	return privPixmap ? privPixmap->capture_id : 0;
+}
+
+static uint8_t capture_picture_flags( PicturePtr pPicture )
+{
+	uint8_t flags;
+
+	if ( NULL == pPicture ) return 0;
+
+	flags = MALI_CAPTURE_PICT_PRESENT;
+	if ( pPicture->pDrawable ) flags |= MALI_CAPTURE_PICT_DRAWABLE;
+	if ( pPicture->transform ) flags |= MALI_CAPTURE_PICT_TRANSFORM;
+	if ( pPicture->repeat ) flags |= MALI_CAPTURE_PICT_REPEAT;
+	flags |= ( pPicture->repeatType & 3 ) << 4;
+	if ( pPicture->alphaMap ) flags |= MALI_CAPTURE_PICT_ALPHA_MAP;
+	if ( pPicture->componentAlpha ) flags |= MALI_CAPTURE_PICT_COMPONENT_ALPHA;
+
+	return flags;
+}
+
+void MaliCaptureInit( ScrnInfoPtr pScrn, const char *path )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_capture *cap;
+
+	if ( NULL == path || '\0' == path[0] ) return;
+
+	cap = calloc( 1, sizeof(*cap) );
+	if ( NULL == cap ) return;
+
+	cap->path = strdup( path );
+	cap->fd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	if ( NULL == cap->path || cap->fd < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to create EXA capture %s: %s\n", __FUNCTION__, __LINE__, path, strerror(errno) );
+		goto fail;
+	}
+
+	if ( ftruncate( cap->fd, MALI_CAPTURE_DATA ) < 0 ) goto fail_map;
+
+	cap->file = mmap( NULL, MALI_CAPTURE_DATA, PROT_READ | PROT_WRITE, MAP_SHARED, cap->fd, 0 );
+	if ( MAP_FAILED == cap->file ) goto fail_map;
+
+	cap->last = MaliVSyncGetTime();
+	cap->file->version = MALI_CAPTURE_VERSION;
+	cap->file->screen = pScrn->scrnIndex;
+	cap->file->width = pScrn->virtualX;
+	cap->file->height = pScrn->virtualY;
+	cap->file->bpp = pScrn->bitsPerPixel;
+	cap->file->pitch = fPtr->fb_lcd_fix.line_length;
+	cap->file->chunk_size = MALI_CAPTURE_CHUNK;
+	cap->file->start = cap->last;
+	cap->file->length = 0;
+	memcpy( cap->file->magic, MALI_CAPTURE_MAGIC, sizeof(cap->file->magic) );
+
+	fPtr->capture = cap;
+	if ( !capture_map_chunk( pScrn, cap ) )
+	{
+		MaliCaptureClose( pScrn );
+		return;
+	}
+
+	xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Capturing EXA calls to %s\n", path );
+
+	return;
+
+fail_map:
+	xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to map EXA capture %s: %s\n", __FUNCTION__, __LINE__, path, strerror(errno) );
+fail:
+	if ( cap->fd >= 0 ) close( cap->fd );
+	free( cap->path );
+	free( cap );
+}
+
+void MaliCaptureClose( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_capture *cap = fPtr->capture;
+	uint64_t length;
+
+	if ( NULL == cap ) return;
+
+	length = cap->file->length;
+	if ( cap->chunk ) munmap( cap->chunk, MALI_CAPTURE_CHUNK );
+	munmap( cap->file, MALI_CAPTURE_DATA );
+
+	/* Drop the unused end of the last chunk */
+	if ( ftruncate( cap->fd, MALI_CAPTURE_DATA + length ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed to trim EXA capture %s: %s\n", __FUNCTION__, __LINE__, cap->path, strerror(errno) );
+	}
+	close( cap->fd );
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "EXA capture of %llu bytes left in %s\n", (unsigned long long)length, cap->path );
+
+	free( cap->path );
+	free( cap );
+	fPtr->capture = NULL;
+}
+
+void MaliCaptureCreatePixmap( ScrnInfoPtr pScrn, PrivPixmap *privPixmap, int size, int align )
+{
+	struct mali_capture *cap = MALIPTR(pScrn)->capture;
+	struct mali_capture_create *r;
+
+	if ( NULL == cap ) return;
+
+	privPixmap->capture_id = ++cap->next_id;
+
+	r = capture_begin( pScrn, MALI_CAPTURE_CREATE_PIXMAP, sizeof(*r) );
+	if ( NULL == r ) return;
+
+	r->id = privPixmap->capture_id;
+	r->size = size;
+	r->align = align;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureDestroyPixmap( ScrnInfoPtr pScrn, PrivPixmap *privPixmap )
+{
+	struct mali_capture_destroy *r = capture_begin( pScrn, MALI_CAPTURE_DESTROY_PIXMAP, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->id = privPixmap->capture_id;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureModifyPixmap( ScrnInfoPtr pScrn, PixmapPtr pPixmap, int width, int height, int depth, int bitsPerPixel, int devKind, enum mali_capture_memory memory )
+{
+	struct mali_capture_modify *r = capture_begin( pScrn, MALI_CAPTURE_MODIFY_PIXMAP, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->id = capture_id( pPixmap );
+	r->width = width;
+	r->height = height;
+	r->depth = depth;
+	r->bpp = bitsPerPixel;
+	r->devkind = devKind;
+	r->memory = memory;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureAccess( ScrnInfoPtr pScrn, PixmapPtr pPixmap, int index, Bool prepare, Bool ok )
+{
+	struct mali_capture_access *r = capture_begin( pScrn, prepare ? MALI_CAPTURE_PREPARE_ACCESS : MALI_CAPTURE_FINISH_ACCESS, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->id = capture_id( pPixmap );
+	r->index = index;
+	r->ok = ok;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureSolid( ScrnInfoPtr pScrn, PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fg )
+{
+	struct mali_capture_solid *r = capture_begin( pScrn, MALI_CAPTURE_SOLID, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->id = capture_id( pPixmap );
+	r->alu = alu;
+	r->planemask = planemask;
+	r->fg = fg;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureCopy( ScrnInfoPtr pScrn, PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int xdir, int ydir, int alu, Pixel planemask )
+{
+	struct mali_capture_copy *r = capture_begin( pScrn, MALI_CAPTURE_COPY, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->src = capture_id( pSrcPixmap );
+	r->dst = capture_id( pDstPixmap );
+	r->xdir = xdir;
+	r->ydir = ydir;
+	r->alu = alu;
+	r->planemask = planemask;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureComposite( ScrnInfoPtr pScrn, int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture )
+{
+	struct mali_capture_composite *r = capture_begin( pScrn, MALI_CAPTURE_COMPOSITE, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->op = op;
+	r->src_format = pSrcPicture ? pSrcPicture->format : 0;
+	r->mask_format = pMaskPicture ? pMaskPicture->format : 0;
+	r->dst_format = pDstPicture->format;
+	r->src_flags = capture_picture_flags( pSrcPicture );
+	r->mask_flags = capture_picture_flags( pMaskPicture );
+	r->dst_flags = capture_picture_flags( pDstPicture );
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCapturePrepareComposite( ScrnInfoPtr pScrn, int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst, Bool ok )
+{
+	struct mali_capture_prepare_composite *r = capture_begin( pScrn, MALI_CAPTURE_PREPARE_COMPOSITE, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->op = op;
+	r->src = capture_id( pSrc );
+	r->mask = capture_id( pMask );
+	r->dst = capture_id( pDst );
+	r->src_format = pSrcPicture->format;
+	r->mask_format = pMaskPicture ? pMaskPicture->format : 0;
+	r->dst_format = pDstPicture->format;
+	r->src_flags = capture_picture_flags( pSrcPicture );
+	r->mask_flags = capture_picture_flags( pMaskPicture );
+	r->dst_flags = capture_picture_flags( pDstPicture );
+	r->ok = ok;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureRect( ScrnInfoPtr pScrn, int srcX, int srcY, int maskX, int maskY, int dstX, int dstY, int width, int height )
+{
+	struct mali_capture_rect *r = capture_begin( pScrn, MALI_CAPTURE_RECT, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->src_x = srcX;
+	r->src_y = srcY;
+	r->mask_x = maskX;
+	r->mask_y = maskY;
+	r->dst_x = dstX;
+	r->dst_y = dstY;
+	r->width = width;
+	r->height = height;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureDone( ScrnInfoPtr pScrn, PixmapPtr pDst )
+{
+	struct mali_capture_done *r = capture_begin( pScrn, MALI_CAPTURE_DONE, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->dst = capture_id( pDst );
+	r->pad = 0;
+
+	capture_commit( pScrn, r );
+}
+
+void MaliCaptureSwap( ScrnInfoPtr pScrn, PixmapPtr pFront, PixmapPtr pBack, uint32_t path )
+{
+	struct mali_capture_swap *r = capture_begin( pScrn, MALI_CAPTURE_SWAP, sizeof(*r) );
+
+	if ( NULL == r ) return;
+
+	r->front = capture_id( pFront );
+	r->back = capture_id( pBack );
+	r->path = path;
+
+	capture_commit( pScrn, r );
+}
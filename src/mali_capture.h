@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_CAPTURE_H_
+#define _MALI_CAPTURE_H_
+
+#include <stdint.h>
+
+/*
+ * EXA capture: with Option "EXA_CAPTURE" set to a file name, every call EXA
+ * makes into the driver is appended to that file, along with the DRI2 swaps,
+ * for tools/mali-exa-replay to run again offline. Pixmaps are named by a
+ * number handed out when their driver private is created, 0 is no pixmap.
+ *
+ * The file starts with a page holding struct mali_capture_file, records
+ * follow from MALI_CAPTURE_DATA on. They are written through a window mapped
+ * chunk_size bytes at a time and never straddle two chunks; a PAD record
+ * skips to the start of the next one. length is updated after every record,
+ * so a server that died leaves a readable capture behind. Every record
+ * starts with struct mali_capture_record, size includes it and is a multiple
+ * of 8, delta is the time in microseconds since the previous record.
+ *
+ * An accepted operation is followed by a RECT record for every rectangle it
+ * is asked to draw and a DONE record, which belong to the last prepare.
+ */
+
+#define MALI_CAPTURE_MAGIC "MALICAPT"
+#define MALI_CAPTURE_VERSION 2
+#define MALI_CAPTURE_DATA 4096
+#define MALI_CAPTURE_CHUNK ( 1024 * 1024 )
+
+enum mali_capture_type
+{
+	MALI_CAPTURE_PAD,
+	MALI_CAPTURE_CREATE_PIXMAP,
+	MALI_CAPTURE_DESTROY_PIXMAP,
+	MALI_CAPTURE_MODIFY_PIXMAP,
+	MALI_CAPTURE_PREPARE_ACCESS,
+	MALI_CAPTURE_FINISH_ACCESS,
+	MALI_CAPTURE_SOLID,
+	MALI_CAPTURE_COPY,
+	MALI_CAPTURE_COMPOSITE,
+	MALI_CAPTURE_SWAP,
+	MALI_CAPTURE_PREPARE_COMPOSITE,
+	MALI_CAPTURE_RECT,
+	MALI_CAPTURE_DONE,
+	MALI_CAPTURE_TYPES
+};
+
+/* What ModifyPixmapHeader was asked to wrap */
+enum mali_capture_memory
+{
+	MALI_CAPTURE_MEMORY_NONE,
+	MALI_CAPTURE_MEMORY_FRAMEBUFFER,
+	MALI_CAPTURE_MEMORY_FRAMEBUFFER_BACK,
+	MALI_CAPTURE_MEMORY_SHADOW,
+	MALI_CAPTURE_MEMORY_OTHER,
+};
+
+/* Describes each picture of a composite */
+#define MALI_CAPTURE_PICT_PRESENT         0x01
+#define MALI_CAPTURE_PICT_DRAWABLE        0x02
+#define MALI_CAPTURE_PICT_TRANSFORM       0x04
+#define MALI_CAPTURE_PICT_REPEAT          0x08
+#define MALI_CAPTURE_PICT_REPEAT_TYPE(f)  ( ( (f) >> 4 ) & 3 )
+#define MALI_CAPTURE_PICT_ALPHA_MAP       0x40
+#define MALI_CAPTURE_PICT_COMPONENT_ALPHA 0x80
+
+struct mali_capture_file
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t screen;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bpp;
+	uint32_t pitch;
+	uint32_t chunk_size;
+	uint32_t pad;
+	uint64_t start;
+	volatile uint64_t length;
+};
+
+struct mali_capture_record
+{
+	uint16_t type;
+	uint16_t size;
+	uint32_t delta;
+};
+
+struct mali_capture_create
+{
+	struct mali_capture_record r;
+	uint32_t id;
+	int32_t size;
+	int32_t align;
+	uint32_t pad;
+};
+
+struct mali_capture_destroy
+{
+	struct mali_capture_record r;
+	uint32_t id;
+	uint32_t pad;
+};
+
+struct mali_capture_modify
+{
+	struct mali_capture_record r;
+	uint32_t id;
+	int32_t width;
+	int32_t height;
+	int32_t depth;
+	int32_t bpp;
+	int32_t devkind;
+	uint32_t memory;
+	uint32_t pad;
+};
+
+struct mali_capture_access
+{
+	struct mali_capture_record r;
+	uint32_t id;
+	int32_t index;
+	uint32_t ok;
+	uint32_t pad;
+};
+
+struct mali_capture_solid
+{
+	struct mali_capture_record r;
+	uint32_t id;
+	int32_t alu;
+	uint32_t planemask;
+	uint32_t fg;
+};
+
+struct mali_capture_copy
+{
+	struct mali_capture_record r;
+	uint32_t src;
+	uint32_t dst;
+	int32_t xdir;
+	int32_t ydir;
+	int32_t alu;
+	uint32_t planemask;
+};
+
+struct mali_capture_composite
+{
+	struct mali_capture_record r;
+	int32_t op;
+	uint32_t src_format;
+	uint32_t mask_format;
+	uint32_t dst_format;
+	uint8_t src_flags;
+	uint8_t mask_flags;
+	uint8_t dst_flags;
+	uint8_t pad[5];
+};
+
+struct mali_capture_prepare_composite
+{
+	struct mali_capture_record r;
+	int32_t op;
+	uint32_t src;
+	uint32_t mask;
+	uint32_t dst;
+	uint32_t src_format;
+	uint32_t mask_format;
+	uint32_t dst_format;
+	uint8_t src_flags;
+	uint8_t mask_flags;
+	uint8_t dst_flags;
+	uint8_t ok;
+};
+
+/* Solid only uses dst and the size, Copy has no mask */
+struct mali_capture_rect
+{
+	struct mali_capture_record r;
+	int32_t src_x;
+	int32_t src_y;
+	int32_t mask_x;
+	int32_t mask_y;
+	int32_t dst_x;
+	int32_t dst_y;
+	int32_t width;
+	int32_t height;
+};
+
+struct mali_capture_done
+{
+	struct mali_capture_record r;
+	uint32_t dst;
+	uint32_t pad;
+};
+
+struct mali_capture_swap
+{
+	struct mali_capture_record r;
+	uint32_t front;
+	uint32_t back;
+	uint32_t path;
+	uint32_t pad;
+};
+
+#ifndef _MALI_CAPTURE_NO_SERVER
+#include "xf86.h"
+#include "picturestr.h"
+
+#include "mali_exa.h"
+
+extern void MaliCaptureInit( ScrnInfoPtr pScrn, const char *path );
+extern void MaliCaptureClose( ScrnInfoPtr pScrn );
+
+extern void MaliCaptureCreatePixmap( ScrnInfoPtr pScrn, PrivPixmap *privPixmap, int size, int align );
+extern void MaliCaptureDestroyPixmap( ScrnInfoPtr pScrn, PrivPixmap *privPixmap );
+extern void MaliCaptureModifyPixmap( ScrnInfoPtr pScrn, PixmapPtr pPixmap, int width, int height, int depth, int bitsPerPixel, int devKind, enum mali_capture_memory memory );
+extern void MaliCaptureAccess( ScrnInfoPtr pScrn, PixmapPtr pPixmap, int index, Bool prepare, Bool ok );
+extern void MaliCaptureSolid( ScrnInfoPtr pScrn, PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fg );
+extern void MaliCaptureCopy( ScrnInfoPtr pScrn, PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int xdir, int ydir, int alu, Pixel planemask );
+extern void MaliCaptureComposite( ScrnInfoPtr pScrn, int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture );
+extern void MaliCapturePrepareComposite( ScrnInfoPtr pScrn, int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst, Bool ok );
+extern void MaliCaptureRect( ScrnInfoPtr pScrn, int srcX, int srcY, int maskX, int maskY, int dstX, int dstY, int width, int height );
+extern void MaliCaptureDone( ScrnInfoPtr pScrn, PixmapPtr pDst );
+extern void MaliCaptureSwap( ScrnInfoPtr pScrn, PixmapPtr pFront, PixmapPtr pBack, uint32_t path );
+#endif
+
+#endif /* _MALI_CAPTURE_H_ */
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mali_blit.h"
+#include "mali_composite.h"
+
+/*
+ * Pixels are taken to premultiplied a8r8g8b8, combined, and written back in
+ * the destination format, with the same rounding as pixman so that results
+ * match it bit for bit. The kernels are stamped out by COMPOSITE_KERNEL from
+ * the fetch, store and operator pieces below; the compiler inlines them and
+ * drops what a combination doesn't use, such as reading the destination for
+ * SRC.
+ */
+
+/* Each byte of x times a / 255 */
+static inline uint32_t mul_un8x4( uint32_t x, uint32_t a )
+{
+	uint32_t rb = ( x & 0x00ff00ff ) * a + 0x00800080;
+	uint32_t ag = ( ( x >> 8 ) & 0x00ff00ff ) * a + 0x00800080;
+
+	rb = ( ( rb + ( ( rb >> 8 ) & 0x00ff00ff ) ) >> 8 ) & 0x00ff00ff;
+	ag = ( ag + ( ( ag >> 8 ) & 0x00ff00ff ) ) & 0xff00ff00;
+
+	return rb | ag;
+}
+
+/* Saturating, byte by byte */
+static inline uint32_t add_un8x4( uint32_t x, uint32_t y )
+{
+	uint32_t rb = ( x & 0x00ff00ff ) + ( y & 0x00ff00ff );
+	uint32_t ag = ( ( x >> 8 ) & 0x00ff00ff ) + ( ( y >> 8 ) & 0x00ff00ff );
+
+	rb = ( rb | ( 0x10000100 - ( ( rb >> 8 ) & 0x00ff00ff ) ) ) & 0x00ff00ff;
+	ag = ( ag | ( 0x10000100 - ( ( ag >> 8 ) & 0x00ff00ff ) ) ) & 0x00ff00ff;
+
+	return rb | ( ag << 8 );
+}
+
+static inline uint32_t swap_rb( uint32_t p )
+{
+	return ( p & 0xff00ff00 ) | ( ( p >> 16 ) & 0xff ) | ( ( p & 0xff ) << 16 );
+}
+
+#define PIXEL_32( p, i ) ( ( (const uint32_t *)(p) )[i] )
+#define PIXEL_16( p, i ) ( ( (const uint16_t *)(p) )[i] )
+
+static inline uint32_t fetch_a8r8g8b8( const uint8_t *p, int i ) { return PIXEL_32( p, i ); }
+static inline uint32_t fetch_x8r8g8b8( const uint8_t *p, int i ) { return PIXEL_32( p, i ) | 0xff000000; }
+static inline uint32_t fetch_a8b8g8r8( const uint8_t *p, int i ) { return swap_rb( PIXEL_32( p, i ) ); }
+static inline uint32_t fetch_x8b8g8r8( const uint8_t *p, int i ) { return swap_rb( PIXEL_32( p, i ) ) | 0xff000000; }
+static inline uint32_t fetch_a8( const uint8_t *p, int i ) { return (uint32_t)p[i] << 24; }
+
+/* The top bits of each channel are repeated into the bottom ones */
+static inline uint32_t fetch_r5g6b5( const uint8_t *p, int i )
+{
+	uint32_t s = PIXEL_16( p, i );
+
+	return 0xff000000 |
+	       ( ( s << 8 ) & 0xf80000 ) | ( ( s << 3 ) & 0x070000 ) |
+	       ( ( s << 5 ) & 0x00fc00 ) | ( ( s >> 1 ) & 0x000300 ) |
+	       ( ( s << 3 ) & 0x0000f8 ) | ( ( s >> 2 ) & 0x000007 );
+}
+
+static inline void store_a8r8g8b8( uint8_t *p, int i, uint32_t v ) { ( (uint32_t *)p )[i] = v; }
+static inline void store_x8r8g8b8( uint8_t *p, int i, uint32_t v ) { ( (uint32_t *)p )[i] = v; }
+static inline void store_a8b8g8r8( uint8_t *p, int i, uint32_t v ) { ( (uint32_t *)p )[i] = swap_rb( v ); }
+static inline void store_x8b8g8r8( uint8_t *p, int i, uint32_t v ) { ( (uint32_t *)p )[i] = swap_rb( v ); }
+static inline void store_a8( uint8_t *p, int i, uint32_t v ) { p[i] = v >> 24; }
+
+static inline void store_r5g6b5( uint8_t *p, int i, uint32_t v )
+{
+	( (uint16_t *)p )[i] = ( ( v >> 8 ) & 0xf800 ) | ( ( v >> 5 ) & 0x07e0 ) | ( ( v >> 3 ) & 0x001f );
+}
+
+/* Only the alpha of a mask counts, component alpha is left to fb */
+#define MASK_none( p, m, i )     ( p )
+#define MASK_a8( p, m, i )       mul_un8x4( p, (m)[i] )
+#define MASK_a8r8g8b8( p, m, i ) mul_un8x4( p, PIXEL_32( m, i ) >> 24 )
+
+/*
+ * The operators write the destination themselves, so that pixels they leave
+ * alone are never read or written back: the destination may well be the
+ * uncached framebuffer.
+ */
+#define OP_SRC( s, dst, d, i ) store_##dst( d, i, s )
+
+#define OP_OVER( s, dst, d, i ) \
+	if ( s >= 0xff000000 ) store_##dst( d, i, s ); \
+	else if ( s ) store_##dst( d, i, add_un8x4( s, mul_un8x4( fetch_##dst( d, i ), 255 - ( s >> 24 ) ) ) )
+
+#define OP_ADD( s, dst, d, i ) \
+	if ( s ) store_##dst( d, i, add_un8x4( s, fetch_##dst( d, i ) ) )
+
+#define COMPOSITE_NAME( op, src, mask, dst ) composite_##op##_##src##_##mask##_##dst
+
+#define COMPOSITE_KERNEL( op, src, mask, dst ) \
+static void COMPOSITE_NAME( op, src, mask, dst )( uint8_t *d, const uint8_t *s, const uint8_t *m, int width ) \
+{ \
+	int i; \
+	\
+	(void)m; \
+	for ( i = 0; i < width; i++ ) \
+	{ \
+		uint32_t p = MASK_##mask( fetch_##src( s, i ), m, i ); \
+		\
+		OP_##op( p, dst, d, i ); \
+	} \
+}
+
+#define COMPOSITE_ENTRY( op, src, mask, dst ) \
+	[MALI_COMPOSITE_OP_##op][MALI_COMPOSITE_FORMAT_##src][MALI_COMPOSITE_FORMAT_##mask][MALI_COMPOSITE_FORMAT_##dst] = COMPOSITE_NAME( op, src, mask, dst ),
+
+/*
+ * What X sends often enough to be worth a kernel, one line each. Anything
+ * else falls back to fb, so adding a combination is a matter of adding it
+ * here.
+ */
+#define COMPOSITE_KERNELS( K ) \
+	/* Copies between formats, mostly window contents and images */ \
+	K( SRC,  a8r8g8b8, none,     a8r8g8b8 ) \
+	K( SRC,  a8r8g8b8, none,     x8r8g8b8 ) \
+	K( SRC,  a8r8g8b8, none,     r5g6b5 ) \
+	K( SRC,  x8r8g8b8, none,     a8r8g8b8 ) \
+	K( SRC,  x8r8g8b8, none,     x8r8g8b8 ) \
+	K( SRC,  x8r8g8b8, none,     r5g6b5 ) \
+	K( SRC,  a8b8g8r8, none,     a8r8g8b8 ) \
+	K( SRC,  a8b8g8r8, none,     x8r8g8b8 ) \
+	K( SRC,  x8b8g8r8, none,     x8r8g8b8 ) \
+	K( SRC,  r5g6b5,   none,     r5g6b5 ) \
+	K( SRC,  r5g6b5,   none,     x8r8g8b8 ) \
+	K( SRC,  a8,       none,     a8 ) \
+	/* Translucent windows, icons and images */ \
+	K( OVER, a8r8g8b8, none,     r5g6b5 ) \
+	K( OVER, a8b8g8r8, none,     a8r8g8b8 ) \
+	K( OVER, a8b8g8r8, none,     x8r8g8b8 ) \
+	K( OVER, a8b8g8r8, none,     r5g6b5 ) \
+	/* Text: a repeating colour through the glyph mask */ \
+	K( OVER, a8r8g8b8, a8,       a8r8g8b8 ) \
+	K( OVER, a8r8g8b8, a8,       x8r8g8b8 ) \
+	K( OVER, a8r8g8b8, a8,       r5g6b5 ) \
+	K( OVER, x8r8g8b8, a8,       x8r8g8b8 ) \
+	K( OVER, x8r8g8b8, a8,       r5g6b5 ) \
+	K( OVER, a8r8g8b8, a8r8g8b8, a8r8g8b8 ) \
+	K( OVER, a8r8g8b8, a8r8g8b8, x8r8g8b8 ) \
+	/* Filling the glyph cache */ \
+	K( ADD,  a8r8g8b8, a8,       a8r8g8b8 )
+
+COMPOSITE_KERNELS( COMPOSITE_KERNEL )
+
+/* The most common blends need no conversion either way, and go to the SIMD row kernels in mali_blit */
+#define COMPOSITE_BLIT_KERNELS( K ) \
+	K( OVER, a8r8g8b8, none,     a8r8g8b8 ) \
+	K( OVER, a8r8g8b8, none,     x8r8g8b8 ) \
+	K( ADD,  a8,       none,     a8 ) \
+	K( ADD,  a8r8g8b8, none,     a8r8g8b8 )
+
+static void COMPOSITE_NAME( OVER, a8r8g8b8, none, a8r8g8b8 )( uint8_t *d, const uint8_t *s, const uint8_t *m, int width )
+{
+	(void)m;
+	mali_blit_over_row_8888( (uint32_t *)d, (const uint32_t *)s, width, 0 );
+}
+
+static void COMPOSITE_NAME( OVER, a8r8g8b8, none, x8r8g8b8 )( uint8_t *d, const uint8_t *s, const uint8_t *m, int width )
+{
+	(void)m;
+	mali_blit_over_row_8888( (uint32_t *)d, (const uint32_t *)s, width, 0xff000000 );
+}
+
+static void COMPOSITE_NAME( ADD, a8, none, a8 )( uint8_t *d, const uint8_t *s, const uint8_t *m, int width )
+{
+	(void)m;
+	mali_blit_add_row( d, s, width );
+}
+
+static void COMPOSITE_NAME( ADD, a8r8g8b8, none, a8r8g8b8 )( uint8_t *d, const uint8_t *s, const uint8_t *m, int width )
+{
+	(void)m;
+	mali_blit_add_row( d, s, width * 4 );
+}
+
+static const MaliCompositeRowProc composite_kernels[MALI_COMPOSITE_OPS][MALI_COMPOSITE_FORMATS][MALI_COMPOSITE_FORMATS][MALI_COMPOSITE_FORMATS] =
+{
+	COMPOSITE_KERNELS( COMPOSITE_ENTRY )
+	COMPOSITE_BLIT_KERNELS( COMPOSITE_ENTRY )
+};
+
+MaliCompositeRowProc mali_composite_lookup( enum mali_composite_op op, enum mali_composite_format src,
+                                            enum mali_composite_format mask, enum mali_composite_format dst )
+{
+	if ( op >= MALI_COMPOSITE_OPS || src >= MALI_COMPOSITE_FORMATS || mask >= MALI_COMPOSITE_FORMATS || dst >= MALI_COMPOSITE_FORMATS ) return NULL;
+
+	return composite_kernels[op][src][mask][dst];
+}
+
+int mali_composite_format_cpp( enum mali_composite_format format )
+{
+	switch ( format )
+	{
+	case MALI_COMPOSITE_FORMAT_r5g6b5:
+		return 2;
+	case MALI_COMPOSITE_FORMAT_a8:
+		return 1;
+	case MALI_COMPOSITE_FORMAT_none:
+		return 0;
+	default:
+		return 4;
+	}
+}
+
+/* Longest run handed to a kernel, and so the size of the buffers that repeating pictures are unrolled into */
+#define COMPOSITE_SPAN 256
+
+static inline int composite_wrap( int v, int size )
+{
+	v %= size;
+
+	return v < 0 ? v + size : v;
+}
+
+/* count pixels of s from x,y, unrolled into buf when a repeating picture wraps within them */
+static const uint8_t *composite_line( const struct mali_composite_surface *s, int x, int y, int count, uint8_t *buf )
+{
+	const uint8_t *line;
+	int bytes, period, filled;
+
+	if ( !s->repeat ) return s->bits + y * s->pitch + x * s->cpp;
+
+	line = s->bits + composite_wrap( y, s->height ) * s->pitch;
+	x = composite_wrap( x, s->width );
+	if ( x + count <= s->width ) return line + x * s->cpp;
+
+	/* One period, then doubled until the span is full */
+	bytes = count * s->cpp;
+	period = s->width * s->cpp;
+	memcpy( buf, line + x * s->cpp, period - x * s->cpp );
+	memcpy( buf + period - x * s->cpp, line, x * s->cpp < bytes - ( period - x * s->cpp ) ? x * s->cpp : bytes - ( period - x * s->cpp ) );
+
+	for ( filled = period; filled < bytes; filled *= 2 )
+	{
+		memcpy( buf + filled, buf, filled < bytes - filled ? filled : bytes - filled );
+	}
+
+	return buf;
+}
+
+void mali_composite( MaliCompositeRowProc row, const struct mali_composite_surface *dst,
+                     const struct mali_composite_surface *src, const struct mali_composite_surface *mask,
+                     int src_x, int src_y, int mask_x, int mask_y, int dst_x, int dst_y, int width, int height )
+{
+	uint8_t src_buf[COMPOSITE_SPAN * 4], mask_buf[COMPOSITE_SPAN * 4];
+	int x, y, n;
+
+	for ( y = 0; y < height; y++ )
+	{
+		uint8_t *d = dst->bits + ( dst_y + y ) * dst->pitch + dst_x * dst->cpp;
+
+		for ( x = 0; x < width; x += n )
+		{
+			const uint8_t *m = NULL;
+
+			n = width - x < COMPOSITE_SPAN ? width - x : COMPOSITE_SPAN;
+			if ( mask ) m = composite_line( mask, mask_x + x, mask_y + y, n, mask_buf );
+
+			row( d + x * dst->cpp, composite_line( src, src_x + x, src_y + y, n, src_buf ), m, n );
+		}
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_COMPOSITE_H_
+#define _MALI_COMPOSITE_H_
+
+#include <stdint.h>
+
+/*
+ * CPU composite kernels, one per operator and source, mask and destination
+ * format, so that the inner loops carry no per pixel decisions. These have
+ * no X server dependencies; mali_exa.c maps Render pictures onto them.
+ */
+
+enum mali_composite_op
+{
+	MALI_COMPOSITE_OP_SRC,
+	MALI_COMPOSITE_OP_OVER,
+	MALI_COMPOSITE_OP_ADD,
+	MALI_COMPOSITE_OPS
+};
+
+enum mali_composite_format
+{
+	MALI_COMPOSITE_FORMAT_none,	/* no mask */
+	MALI_COMPOSITE_FORMAT_a8r8g8b8,
+	MALI_COMPOSITE_FORMAT_x8r8g8b8,
+	MALI_COMPOSITE_FORMAT_a8b8g8r8,
+	MALI_COMPOSITE_FORMAT_x8b8g8r8,
+	MALI_COMPOSITE_FORMAT_r5g6b5,
+	MALI_COMPOSITE_FORMAT_a8,
+	MALI_COMPOSITE_FORMATS
+};
+
+/* Composites width pixels of src, through mask if there is one, onto dst */
+typedef void (*MaliCompositeRowProc)( uint8_t *dst, const uint8_t *src, const uint8_t *mask, int width );
+
+/* NULL when there is no kernel for the combination */
+extern MaliCompositeRowProc mali_composite_lookup( enum mali_composite_op op, enum mali_composite_format src,
+                                                   enum mali_composite_format mask, enum mali_composite_format dst );
+
+extern int mali_composite_format_cpp( enum mali_composite_format format );
+
+struct mali_composite_surface
+{
+	uint8_t *bits;
+	int pitch;
+	int width;
+	int height;
+	int cpp;
+	int repeat;	/* tiled across the plane, otherwise coordinates stay inside */
+};
+
+/* mask may be NULL */
+extern void mali_composite( MaliCompositeRowProc row, const struct mali_composite_surface *dst,
+                            const struct mali_composite_surface *src, const struct mali_composite_surface *mask,
+                            int src_x, int src_y, int mask_x, int mask_y, int dst_x, int dst_y, int width, int height );
+
+#endif /* _MALI_COMPOSITE_H_ */
@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xf86.h"
+#include "xf86Cursor.h"
+#include "cursorstr.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_blit.h"
+#include "mali_composite.h"
+#include "mali_cursor.h"
+
+#define MALI_CURSOR_SIZE 64
+
+struct mali_cursor
+{
+	xf86CursorInfoPtr info;
+
+	/* set from the input code, which may run in a signal handler */
+	volatile int x;
+	volatile int y;
+	volatile Bool visible;
+	volatile Bool dirty;
+
+	/* premultiplied ARGB, MALI_CURSOR_SIZE pixels per row */
+	uint32_t image[MALI_CURSOR_SIZE * MALI_CURSOR_SIZE];
+	int width;
+	int height;
+
+	/* core cursors: source and mask bitmaps as realized by the cursor code */
+	unsigned char bits[MALI_CURSOR_SIZE * MALI_CURSOR_SIZE / 4];
+	Bool core;
+	CARD32 fg;
+	CARD32 bg;
+
+	/* where the flush puts the cursor, clipped to the screen and empty when hidden */
+	BoxRec shown;
+	int shown_x;
+	int shown_y;
+
+	/* the shadow pixels under the cursor while it is blended in */
+	uint32_t save[MALI_CURSOR_SIZE * MALI_CURSOR_SIZE];
+};
+
+#define CURSORPTR(p) (MALIPTR(p)->cursor)
+
+static void cursor_expand_core( struct mali_cursor *cursor )
+{
+	const unsigned char *src = cursor->bits;
+	const unsigned char *mask = cursor->bits + MALI_CURSOR_SIZE * MALI_CURSOR_SIZE / 8;
+	int x, y;
+
+	for ( y = 0; y < MALI_CURSOR_SIZE; y++ )
+	{
+		for ( x = 0; x < MALI_CURSOR_SIZE; x++ )
+		{
+			int i = y * MALI_CURSOR_SIZE + x;
+			int bit = 1 << ( x & 7 );
+
+			if ( mask[i >> 3] & bit ) cursor->image[i] = 0xff000000 | ( ( src[i >> 3] & bit ) ? cursor->fg : cursor->bg );
+			else cursor->image[i] = 0;
+		}
+	}
+
+	cursor->width = MALI_CURSOR_SIZE;
+	cursor->height = MALI_CURSOR_SIZE;
+}
+
+static void MaliCursorSetColors( ScrnInfoPtr pScrn, int bg, int fg )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+
+	cursor->bg = bg & 0xffffff;
+	cursor->fg = fg & 0xffffff;
+
+	if ( cursor->core )
+	{
+		cursor_expand_core( cursor );
+		cursor->dirty = TRUE;
+	}
+}
+
+static void MaliCursorSetPosition( ScrnInfoPtr pScrn, int x, int y )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+
+	/* Relative to the frame, the flush works on the whole screen */
+	cursor->x = x + pScrn->frameX0;
+	cursor->y = y + pScrn->frameY0;
+	cursor->dirty = TRUE;
+}
+
+static void MaliCursorLoadImage( ScrnInfoPtr pScrn, unsigned char *bits )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+
+	memcpy( cursor->bits, bits, sizeof(cursor->bits) );
+	cursor->core = TRUE;
+	cursor_expand_core( cursor );
+	cursor->dirty = TRUE;
+}
+
+static void MaliCursorHide( ScrnInfoPtr pScrn )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+
+	cursor->visible = FALSE;
+	cursor->dirty = TRUE;
+}
+
+static void MaliCursorShow( ScrnInfoPtr pScrn )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+
+	cursor->visible = TRUE;
+	cursor->dirty = TRUE;
+}
+
+static Bool MaliCursorUse( ScreenPtr pScreen, CursorPtr pCurs )
+{
+	IGNORE( pScreen );
+	IGNORE( pCurs );
+
+	return TRUE;
+}
+
+#ifdef ARGB_CURSOR
+static void MaliCursorLoadARGB( ScrnInfoPtr pScrn, CursorPtr pCurs )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+	int width = min( pCurs->bits->width, MALI_CURSOR_SIZE );
+	int height = min( pCurs->bits->height, MALI_CURSOR_SIZE );
+	int y;
+
+	for ( y = 0; y < height; y++ )
+	{
+		memcpy( &cursor->image[y * MALI_CURSOR_SIZE], &pCurs->bits->argb[y * pCurs->bits->width], width * sizeof(uint32_t) );
+	}
+
+	cursor->width = width;
+	cursor->height = height;
+	cursor->core = FALSE;
+	cursor->dirty = TRUE;
+}
+#endif
+
+Bool MaliCursorDirty( ScrnInfoPtr pScrn )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+
+	return cursor && cursor->dirty;
+}
+
+/* Adds where the cursor was and where it is going to damage */
+void MaliCursorDamage( ScrnInfoPtr pScrn, RegionPtr damage )
+{
+	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+	RegionRec region;
+	BoxRec box;
+	int x, y;
+
+	if ( NULL == cursor || !cursor->dirty ) return;
+
+	cursor->dirty = FALSE;
+	x = cursor->x;
+	y = cursor->y;
+
+	if ( cursor->shown.x1 < cursor->shown.x2 )
+	{
+		REGION_INIT( pScreen, &region, &cursor->shown, 1 );
+		REGION_UNION( pScreen, damage, damage, &region );
+		REGION_UNINIT( pScreen, &region );
+	}
+
+	box.x1 = max( x, 0 );
+	box.y1 = max( y, 0 );
+	box.x2 = min( x + cursor->width, pScrn->virtualX );
+	box.y2 = min( y + cursor->height, pScrn->virtualY );
+
+	if ( !cursor->visible || box.x1 >= box.x2 || box.y1 >= box.y2 )
+	{
+		memset( &cursor->shown, 0, sizeof(BoxRec) );
+		return;
+	}
+
+	cursor->shown = box;
+	cursor->shown_x = x;
+	cursor->shown_y = y;
+
+	REGION_INIT( pScreen, &region, &box, 1 );
+	REGION_UNION( pScreen, damage, damage, &region );
+	REGION_UNINIT( pScreen, &region );
+}
+
+/*
+ * Blend the cursor into the shadow for the duration of a copy to the
+ * framebuffer, if it overlaps what is being copied. The pixels underneath
+ * are kept aside and put back by MaliCursorUnblend.
+ */
+Bool MaliCursorBlend( ScrnInfoPtr pScrn, RegionPtr region, unsigned char *virt, int pitch )
+{
+	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+	BoxPtr extents = REGION_EXTENTS( pScreen, region );
+	BoxPtr box;
+	struct mali_composite_surface src, dst;
+	int cpp = pScrn->bitsPerPixel / 8;
+	int width, height;
+
+	if ( NULL == cursor ) return FALSE;
+
+	box = &cursor->shown;
+
+	/* The screen may have shrunk since the cursor was last placed */
+	if ( box->x2 > pScrn->virtualX || box->y2 > pScrn->virtualY ) return FALSE;
+
+	if ( box->x1 >= box->x2 || box->x1 >= extents->x2 || box->x2 <= extents->x1 || box->y1 >= extents->y2 || box->y2 <= extents->y1 ) return FALSE;
+
+	width = box->x2 - box->x1;
+	height = box->y2 - box->y1;
+
+	mali_blit_copy( MALI_BLIT_MEMORY_CACHED, cursor->save, width * cpp, virt + box->y1 * pitch + box->x1 * cpp, pitch, width * cpp, height );
+
+	memset( &src, 0, sizeof(src) );
+	src.bits = (uint8_t *)cursor->image;
+	src.pitch = MALI_CURSOR_SIZE * 4;
+	src.width = MALI_CURSOR_SIZE;
+	src.height = MALI_CURSOR_SIZE;
+	src.cpp = 4;
+
+	memset( &dst, 0, sizeof(dst) );
+	dst.bits = virt;
+	dst.pitch = pitch;
+	dst.width = pScrn->virtualX;
+	dst.height = pScrn->virtualY;
+	dst.cpp = cpp;
+
+	/* The cursor may hang off the top or left of the screen */
+	mali_composite( mali_composite_lookup( MALI_COMPOSITE_OP_OVER, MALI_COMPOSITE_FORMAT_a8r8g8b8, MALI_COMPOSITE_FORMAT_none,
+	                                       ( 16 == pScrn->bitsPerPixel ) ? MALI_COMPOSITE_FORMAT_r5g6b5 : MALI_COMPOSITE_FORMAT_x8r8g8b8 ),
+	                &dst, &src, NULL, box->x1 - cursor->shown_x, box->y1 - cursor->shown_y, 0, 0, box->x1, box->y1, width, height );
+
+	return TRUE;
+}
+
+void MaliCursorUnblend( ScrnInfoPtr pScrn, unsigned char *virt, int pitch )
+{
+	struct mali_cursor *cursor = CURSORPTR(pScrn);
+	BoxPtr box = &cursor->shown;
+	int cpp = pScrn->bitsPerPixel / 8;
+	int width = box->x2 - box->x1;
+
+	mali_blit_copy( MALI_BLIT_MEMORY_CACHED, virt + box->y1 * pitch + box->x1 * cpp, pitch, cursor->save, width * cpp, width * cpp, box->y2 - box->y1 );
+}
+
+Bool MaliCursorInit( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_cursor *cursor;
+	xf86CursorInfoPtr info;
+
+	cursor = calloc( 1, sizeof(struct mali_cursor) );
+	info = xf86CreateCursorInfoRec();
+	if ( NULL == cursor || NULL == info )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate the cursor\n", __FUNCTION__, __LINE__ );
+		free( cursor );
+		if ( info ) xf86DestroyCursorInfoRec( info );
+		return FALSE;
+	}
+
+	info->MaxWidth = MALI_CURSOR_SIZE;
+	info->MaxHeight = MALI_CURSOR_SIZE;
+	info->Flags = HARDWARE_CURSOR_UPDATE_UNHIDDEN;
+	info->SetCursorColors = MaliCursorSetColors;
+	info->SetCursorPosition = MaliCursorSetPosition;
+	info->LoadCursorImage = MaliCursorLoadImage;
+	info->HideCursor = MaliCursorHide;
+	info->ShowCursor = MaliCursorShow;
+	info->UseHWCursor = MaliCursorUse;
+#ifdef ARGB_CURSOR
+	info->Flags |= HARDWARE_CURSOR_ARGB;
+	info->UseHWCursorARGB = MaliCursorUse;
+	info->LoadCursorARGB = MaliCursorLoadARGB;
+#endif
+
+	cursor->info = info;
+	fPtr->cursor = cursor;
+
+	if ( !xf86InitCursor( pScreen, info ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] xf86InitCursor failed\n", __FUNCTION__, __LINE__ );
+		xf86DestroyCursorInfoRec( info );
+		free( cursor );
+		fPtr->cursor = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void MaliCursorCloseScreen( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_cursor *cursor = fPtr->cursor;
+
+	if ( NULL == cursor ) return;
+
+	xf86DestroyCursorInfoRec( cursor->info );
+	free( cursor );
+	fPtr->cursor = NULL;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_CURSOR_H_
+#define _MALI_CURSOR_H_
+
+#include "xf86.h"
+
+/*
+ * Cursor plane emulated on top of the shadow framebuffer. The X cursor code
+ * treats it as a hardware cursor; the image only ever reaches the display
+ * while the shadow is being copied out, so neither the shadow nor the
+ * framebuffer is read back or patched up when the pointer moves.
+ */
+extern Bool MaliCursorInit( ScreenPtr pScreen );
+extern void MaliCursorCloseScreen( ScreenPtr pScreen );
+
+/* For the shadow flush */
+extern Bool MaliCursorDirty( ScrnInfoPtr pScrn );
+extern void MaliCursorDamage( ScrnInfoPtr pScrn, RegionPtr damage );
+extern Bool MaliCursorBlend( ScrnInfoPtr pScrn, RegionPtr region, unsigned char *virt, int pitch );
+extern void MaliCursorUnblend( ScrnInfoPtr pScrn, unsigned char *virt, int pitch );
+
+#endif /* _MALI_CURSOR_H_ */
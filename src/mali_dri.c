@@ -25,6 +25,8 @@
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <sys/types.h>
@@ -39,10 +41,15 @@
 #include "xf86drm.h"
 #include "dri2.h"
 #include "damage.h"
+#include "resource.h"
 #include "mali_def.h"
 #include "mali_fbdev.h"
 #include "mali_exa.h"
 #include "mali_dri.h"
+#include "mali_vsync.h"
+#include "mali_stats.h"
+#include "mali_trace.h"
+#include "mali_capture.h"
 #include "damage.h"
 
 typedef struct
@@ -161,6 +168,10 @@ static DRI2Buffer2Ptr MaliDRI2CreateBuffer( DrawablePtr pDraw, unsigned int atta
 
 	pPixmapToWrap->refcnt++;
 
+#if DRI2INFOREC_VERSION >= 6
+	if ( fPtr->swap_limit > 1 && DRI2BufferFrontLeft == attachment ) DRI2SwapLimit( pDraw, fPtr->swap_limit );
+#endif
+
 	return buffer;
 }
 
@@ -205,6 +216,154 @@ static int wt_set_window_pixmap(WindowPtr win, pointer data)
 	}
 }
 
+/*
+ * Index of the windows whose pixmap is one of the two fbdev halves. After a
+ * page flip only these need to be moved to the new front buffer, so instead of
+ * walking the whole window tree at every flip we keep the list up to date from
+ * the window create/destroy hooks and from SetWindowPixmap, which is how the
+ * Composite extension redirects and unredirects windows.
+ *
+ * Each tracked window stores its slot in the list (plus one) in a window
+ * private so that it can be removed in constant time.
+ */
+static DevPrivateKeyRec mali_fb_window_key;
+
+static int fb_window_slot( WindowPtr pWin )
+{
+	return (int)(intptr_t)dixLookupPrivate( &pWin->devPrivates, &mali_fb_window_key ) - 1;
+}
+
+static void fb_window_set_slot( WindowPtr pWin, int slot )
+{
+	dixSetPrivate( &pWin->devPrivates, &mali_fb_window_key, (pointer)(intptr_t)(slot + 1) );
+}
+
+static Bool fb_window_uses_framebuffer( WindowPtr pWin )
+{
+	ScreenPtr pScreen = pWin->drawable.pScreen;
+	PixmapPtr pPixmap = pScreen->GetWindowPixmap( pWin );
+	PrivPixmap *privPixmap;
+
+	if ( NULL == pPixmap ) return FALSE;
+
+	privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate( pPixmap );
+	if ( NULL == privPixmap || NULL == privPixmap->priv ) return FALSE;
+
+	return privPixmap->priv->isFrameBuffer;
+}
+
+static void fb_window_add( MaliPtr fPtr, WindowPtr pWin )
+{
+	if ( fb_window_slot( pWin ) >= 0 ) return;
+
+	if ( fPtr->num_fb_windows == fPtr->size_fb_windows )
+	{
+		int size = fPtr->size_fb_windows ? fPtr->size_fb_windows * 2 : 32;
+		WindowPtr *windows = realloc( fPtr->fb_windows, size * sizeof(WindowPtr) );
+
+		if ( NULL == windows )
+		{
+			/* We can no longer tell which windows need updating on a flip, so fall back to walking the tree */
+			fPtr->fb_windows_lost = TRUE;
+			return;
+		}
+
+		fPtr->fb_windows = windows;
+		fPtr->size_fb_windows = size;
+	}
+
+	fb_window_set_slot( pWin, fPtr->num_fb_windows );
+	fPtr->fb_windows[fPtr->num_fb_windows++] = pWin;
+}
+
+static void fb_window_remove( MaliPtr fPtr, WindowPtr pWin )
+{
+	int slot = fb_window_slot( pWin );
+	WindowPtr last;
+
+	if ( slot < 0 ) return;
+
+	/* Move the last entry into the vacated slot */
+	last = fPtr->fb_windows[--fPtr->num_fb_windows];
+	fPtr->fb_windows[slot] = last;
+	fb_window_set_slot( last, slot );
+
+	fb_window_set_slot( pWin, -1 );
+}
+
+static void fb_window_update( MaliPtr fPtr, WindowPtr pWin )
+{
+	if ( fb_window_uses_framebuffer( pWin ) ) fb_window_add( fPtr, pWin );
+	else fb_window_remove( fPtr, pWin );
+}
+
+static Bool MaliDRI2CreateWindow( WindowPtr pWin )
+{
+	ScreenPtr pScreen = pWin->drawable.pScreen;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	Bool ret;
+
+	pScreen->CreateWindow = fPtr->CreateWindow;
+	ret = (*pScreen->CreateWindow)( pWin );
+	fPtr->CreateWindow = pScreen->CreateWindow;
+	pScreen->CreateWindow = MaliDRI2CreateWindow;
+
+	if ( ret ) fb_window_update( fPtr, pWin );
+
+	return ret;
+}
+
+static Bool MaliDRI2DestroyWindow( WindowPtr pWin )
+{
+	ScreenPtr pScreen = pWin->drawable.pScreen;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	Bool ret;
+
+	fb_window_remove( fPtr, pWin );
+
+	pScreen->DestroyWindow = fPtr->DestroyWindow;
+	ret = (*pScreen->DestroyWindow)( pWin );
+	fPtr->DestroyWindow = pScreen->DestroyWindow;
+	pScreen->DestroyWindow = MaliDRI2DestroyWindow;
+
+	return ret;
+}
+
+static void MaliDRI2SetWindowPixmap( WindowPtr pWin, PixmapPtr pPixmap )
+{
+	ScreenPtr pScreen = pWin->drawable.pScreen;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	pScreen->SetWindowPixmap = fPtr->SetWindowPixmap;
+	(*pScreen->SetWindowPixmap)( pWin, pPixmap );
+	fPtr->SetWindowPixmap = pScreen->SetWindowPixmap;
+	pScreen->SetWindowPixmap = MaliDRI2SetWindowPixmap;
+
+	fb_window_update( fPtr, pWin );
+}
+
+static void set_fb_windows_pixmap( ScreenPtr pScreen, PixmapPtr pPixmap )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	int i;
+
+	if ( fPtr->fb_windows_lost || NULL == fPtr->CreateWindow )
+	{
+		WalkTree( pScreen, wt_set_window_pixmap, pPixmap );
+		return;
+	}
+
+	/* The windows stay in the index across this since they keep using a framebuffer pixmap */
+	for ( i = 0; i < fPtr->num_fb_windows; i++ )
+	{
+		pScreen->SetWindowPixmap( fPtr->fb_windows[i], pPixmap );
+	}
+}
+
 DrawablePtr dri2_get_drawable( DrawablePtr pDraw, DRI2BufferPtr buffer )
 {
 	DrawablePtr drawable = NULL;
@@ -313,22 +472,73 @@ static void platform_wait_for_vsync(ScrnInfoPtr pScrn, int fb_lcd_fd)
 #endif
 }
 
-static void MaliDRI2CopyRegion( DrawablePtr pDraw, RegionPtr pRegion, DRI2BufferPtr pDstBuffer, DRI2BufferPtr pSrcBuffer )
+/*
+ * In adaptive mode a flip only waits for vblank if it arrived in time for the vblank following the previous flip.
+ * A frame that missed it is shown straight away, tearing once instead of costing a whole refresh.
+ */
+static Bool flip_wants_vsync( ScrnInfoPtr pScrn, CARD64 now )
 {
-	GCPtr pGC;
-	RegionPtr copyRegion;
-	ScreenPtr pScreen = pDraw->pScreen;
-	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	MaliPtr fPtr = MALIPTR(pScrn);
-	PixmapPtr winPixmap;
+	CARD64 period;
 
-	MaliDRI2BufferPrivatePtr srcPrivate = pSrcBuffer->driverPrivate;
-	MaliDRI2BufferPrivatePtr dstPrivate = pDstBuffer->driverPrivate;
+	/* With throttling the flip retires at the next vblank instead of blocking the server until then */
+	if ( !fPtr->use_pageflipping_vsync || fPtr->swap_limit > 0 ) return FALSE;
+	if ( !fPtr->use_pageflipping_vsync_adaptive ) return TRUE;
+
+	period = MaliVSyncGetPeriod( pScrn );
+
+	/* A frame arriving after an idle period was not aiming for any particular vblank */
+	return !( fPtr->flip_ust && now > fPtr->flip_ust + period && now <= fPtr->flip_ust + 2 * period );
+}
+
+static void pan_to_pixmap( ScrnInfoPtr pScrn, PrivPixmap *privPixmap )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	unsigned int line_length = fPtr->fb_lcd_fix.line_length ? fPtr->fb_lcd_fix.line_length : fPtr->fb_lcd_var.xres_virtual * fPtr->fb_lcd_var.bits_per_pixel / 8;
+	CARD64 now = MaliVSyncGetTime();
+	Bool synced = flip_wants_vsync( pScrn, now );
+	CARD64 pan_start = now, pan_end;
+
+	fPtr->fb_lcd_var.yoffset = privPixmap->priv->mem_info->offset / line_length;
+	//ErrorF("flip................ ofs %i\n", fPtr->fb_lcd_var.yoffset);
+
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPAN_DISPLAY, &fPtr->fb_lcd_var ) == -1 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPAN_DISPLAY\n", __FUNCTION__, __LINE__ );
+	}
+	pan_end = now = MaliVSyncGetTime();
+
+	if ( synced )
+	{
+		platform_wait_for_vsync(pScrn, fPtr->fb_lcd_fd);
+		now = MaliVSyncGetTime();
+		fPtr->flips_synced++;
+		MALI_STATS_INC( pScrn, DRI2_FLIP_SYNCED );
+		MALI_STATS_INC( pScrn, VSYNC_BLOCKING_WAIT );
+		MALI_STATS_ADD( pScrn, VSYNC_BLOCKING_WAIT_TIME, now - pan_end );
+	}
+	else if ( fPtr->use_pageflipping_vsync_adaptive && 0 == fPtr->swap_limit )
+	{
+		xf86DrvMsgVerb( pScrn->scrnIndex, X_INFO, 5, "late flip shown immediately, %llu us after the previous one\n",
+		                (unsigned long long)( now - fPtr->flip_ust ) );
+		fPtr->flips_late++;
+		MALI_STATS_INC( pScrn, DRI2_FLIP_LATE );
+	}
 
-	PixmapPtr srcPixmap = srcPrivate->pPixmap;
-	PixmapPtr dstPixmap = dstPrivate->pPixmap;
+	MaliTraceSwapPan( pScrn, pan_start, pan_end, synced, now - pan_end );
 
-	DrawablePtr srcDrawable = &srcPrivate->pPixmap->drawable;
+	fPtr->flip_ust = now;
+
+	ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var );
+}
+
+static void copy_pixmap_to_drawable( DrawablePtr pDraw, RegionPtr pRegion, PixmapPtr srcPixmap )
+{
+	GCPtr pGC;
+	RegionPtr copyRegion;
+	ScreenPtr pScreen = pDraw->pScreen;
+
+	DrawablePtr srcDrawable = &srcPixmap->drawable;
 	DrawablePtr dstDrawable = pDraw;
 
 	//ErrorF("blit................\n");
@@ -342,6 +552,166 @@ static void MaliDRI2CopyRegion( DrawablePtr pDraw, RegionPtr pRegion, DRI2Buffer
 	FreeScratchGC(pGC);
 }
 
+/* Damage from an exchange, pRegion is in drawable coordinates and left translated */
+static void damage_exchanged( DrawablePtr pDraw, RegionPtr pRegion )
+{
+	PixmapPtr pPixmap = dri2_get_drawable_pixmap( pDraw );
+
+	/* TODO: not sure if doing the translate is correct for a non-composite scenario */
+	RegionTranslate( pRegion, pPixmap->screen_x, pPixmap->screen_y );
+	DamageDamageRegion( pDraw, pRegion );
+}
+
+static void MaliDRI2CopyRegion( DrawablePtr pDraw, RegionPtr pRegion, DRI2BufferPtr pDstBuffer, DRI2BufferPtr pSrcBuffer )
+{
+	MaliDRI2BufferPrivatePtr srcPrivate = pSrcBuffer->driverPrivate;
+
+	IGNORE( pDstBuffer );
+
+	copy_pixmap_to_drawable( pDraw, pRegion, srcPrivate->pPixmap );
+}
+
+/*
+ * Drawables with completions deferred to the next vblank carry a resource of this type, which is freed along with
+ * the drawable. Deleting it drops the drawable from what was deferred, so that nothing is done to a drawable that
+ * has gone away, nor to a new one that happens to get its XID.
+ */
+static RESTYPE mali_swap_drawable_type;
+static unsigned long mali_swap_generation;
+
+/* Called before anything is deferred, as a failing AddResource runs the delete function */
+static Bool track_drawable( DrawablePtr pDraw )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDraw->pScreen->myNum];
+	pointer value;
+
+	if ( dixLookupResourceByType( &value, pDraw->id, mali_swap_drawable_type, NULL, DixReadAccess ) == Success ) return TRUE;
+
+	return AddResource( pDraw->id, mali_swap_drawable_type, pScrn );
+}
+
+/*
+ * A swap whose completion is held back until the next vblank. The DRI2 core counts it as pending until then and
+ * blocks the client once it has swap_limit of them outstanding, which bounds the number of frames in flight.
+ * client is cleared when the client disconnects and drawable_id when the drawable is destroyed.
+ */
+typedef struct _MaliDRI2Swap
+{
+	ClientPtr client;
+	XID drawable_id;
+	int type;
+	DRI2SwapEventPtr func;
+	void *data;
+	uint32_t trace;
+	struct _MaliDRI2Swap *next;
+} MaliDRI2SwapRec, *MaliDRI2SwapPtr;
+
+/* Drops the drawable's resource once nothing is deferred for it any more */
+static void untrack_drawable( ScrnInfoPtr pScrn, XID id )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap;
+
+	if ( None == id ) return;
+
+	for ( swap = fPtr->swaps; swap != NULL; swap = swap->next )
+	{
+		if ( swap->drawable_id == id ) return;
+	}
+
+	FreeResourceByType( id, mali_swap_drawable_type, TRUE );
+}
+
+static int drawable_gone( pointer value, XID id )
+{
+	ScrnInfoPtr pScrn = value;
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap;
+
+	/* Completions stay queued, they just have no drawable left to complete */
+	for ( swap = fPtr->swaps; swap != NULL; swap = swap->next )
+	{
+		if ( swap->drawable_id == id ) swap->drawable_id = None;
+	}
+
+	return Success;
+}
+
+static void client_state_changed( CallbackListPtr *pcbl, pointer closure, pointer calldata )
+{
+	ScrnInfoPtr pScrn = closure;
+	MaliPtr fPtr = MALIPTR(pScrn);
+	ClientPtr client = ( (NewClientInfoRec *)calldata )->client;
+	MaliDRI2SwapPtr swap;
+
+	IGNORE( pcbl );
+
+	if ( ClientStateGone != client->clientState ) return;
+
+	for ( swap = fPtr->swaps; swap != NULL; swap = swap->next )
+	{
+		if ( swap->client == client ) swap->client = NULL;
+	}
+}
+
+static void swap_complete_handler( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap = data, *prev;
+	DrawablePtr pDraw;
+
+	for ( prev = &fPtr->swaps; *prev != swap; prev = &(*prev)->next );
+	*prev = swap->next;
+
+	MaliTraceSwapComplete( pScrn, swap->trace, msc, ust );
+
+	/* Without its client the DRI2 core still has to count the swap as done, but there is no one to tell */
+	if ( None != swap->drawable_id &&
+	     dixLookupDrawable( &pDraw, swap->drawable_id, serverClient, M_ANY, DixWriteAccess ) == Success )
+	{
+		DRI2SwapComplete( swap->client, pDraw, msc, ust / 1000000, ust % 1000000, swap->type,
+		                  swap->client ? swap->func : NULL, swap->data );
+	}
+
+	untrack_drawable( pScrn, swap->drawable_id );
+	free( swap );
+}
+
+static Bool queue_swap_complete( ClientPtr client, DrawablePtr pDraw, int type, DRI2SwapEventPtr func, void *data, uint32_t trace )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pDraw->pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliDRI2SwapPtr swap;
+
+	if ( !track_drawable( pDraw ) ) return FALSE;
+
+	swap = calloc( 1, sizeof(*swap) );
+	if ( NULL == swap )
+	{
+		untrack_drawable( pScrn, pDraw->id );
+		return FALSE;
+	}
+
+	swap->client = client;
+	swap->drawable_id = pDraw->id;
+	swap->type = type;
+	swap->func = func;
+	swap->data = data;
+	swap->trace = trace;
+
+	if ( !MaliVSyncQueueEvent( pScrn, swap_complete_handler, swap ) )
+	{
+		free( swap );
+		untrack_drawable( pScrn, pDraw->id );
+		return FALSE;
+	}
+
+	swap->next = fPtr->swaps;
+	fPtr->swaps = swap;
+
+	return TRUE;
+}
+
 /*
  * MaliDRI2ScheduleSwap is the implementation of DRI2SwapBuffers, this function
  * should wait for vblank event which will trigger registered event handler.
@@ -361,6 +731,7 @@ static int MaliDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw, DRI2BufferP
 	RegionRec region;
 	void *tmp;
 	int dri2_complete_cmd = DRI2_BLIT_COMPLETE;
+	uint32_t trace = MaliTraceSwapBegin( pScrn, pDraw->id );
 
 	MaliDRI2BufferPrivatePtr front_priv = front->driverPrivate;
 	MaliDRI2BufferPrivatePtr back_priv  = back->driverPrivate;
@@ -373,24 +744,12 @@ static int MaliDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw, DRI2BufferP
 	PrivPixmap *front_pixmap_priv = (PrivPixmap *)exaGetPixmapDriverPrivate(front_pixmap);
 	PrivPixmap *back_pixmap_priv  = (PrivPixmap *)exaGetPixmapDriverPrivate(back_pixmap);
 
+	MALI_STATS_INC( pScrn, DRI2_SWAP );
+
 	if (DRI2CanFlip(pDraw) && fPtr->use_pageflipping && DRAWABLE_WINDOW == pDraw->type && front_priv->isPageFlipped)
 	{
 
-		unsigned int line_length = fPtr->fb_lcd_var.xres * fPtr->fb_lcd_var.bits_per_pixel / 8;
-		fPtr->fb_lcd_var.yoffset = back_pixmap_priv->priv->mem_info->offset / line_length;
-		//ErrorF("flip................ ofs %i\n", fPtr->fb_lcd_var.yoffset);
-
-		if ( ioctl( fPtr->fb_lcd_fd, FBIOPAN_DISPLAY, &fPtr->fb_lcd_var ) == -1 )
-		{
-			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPAN_DISPLAY\n", __FUNCTION__, __LINE__ );
-		}
-
-		if ( fPtr->use_pageflipping_vsync )
-		{
-			platform_wait_for_vsync(pScrn, fPtr->fb_lcd_fd);
-		}
-
-		ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var );
+		pan_to_pixmap( pScrn, back_pixmap_priv );
 
 		dri2_complete_cmd = DRI2_FLIP_COMPLETE;
 		exchange_buffers(pDraw, front, back, dri2_complete_cmd);
@@ -405,16 +764,15 @@ static int MaliDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw, DRI2BufferP
 		pScreen->SetScreenPixmap(back_pixmap);
 
 		/* Update all windows so that their front buffer is now the other half of the fbdev */
-		WalkTree(pScreen, wt_set_window_pixmap, back_pixmap);
+		set_fb_windows_pixmap(pScreen, back_pixmap);
 
 
 	}
 	else if(front_pixmap->drawable.width        == back_pixmap->drawable.width   &&
 			front_pixmap->drawable.height       == back_pixmap->drawable.height  &&
-			front_pixmap->drawable.bitsPerPixel == back_pixmap->drawable.bitsPerPixel)
+			front_pixmap->drawable.bitsPerPixel == back_pixmap->drawable.bitsPerPixel &&
+			!front_pixmap_priv->priv->isShadow)
 	{
-		PixmapPtr dst_pix = dri2_get_drawable_pixmap( dri2_get_drawable( pDraw, front ) );
-
 		dri2_complete_cmd = DRI2_EXCHANGE_COMPLETE;
 		exchange_buffers(pDraw, front, back, dri2_complete_cmd);
 		//ErrorF("swap................  %i\n");
@@ -424,10 +782,7 @@ static int MaliDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw, DRI2BufferP
 		box.y2 = pDraw->height;
 		REGION_INIT(pScreen, &region, &box, 0);
 
-		/* TODO: not sure if doing the translate is correct for a non-composite scenario */
-		RegionTranslate( &region, dst_pix->screen_x, dst_pix->screen_y );
-
-		DamageDamageRegion(pDraw, &region);
+		damage_exchanged( pDraw, &region );
 
 		front_pixmap->drawable.serialNumber = NEXT_SERIAL_NUMBER ;
 		back_pixmap->drawable.serialNumber = NEXT_SERIAL_NUMBER ;
@@ -444,7 +799,48 @@ static int MaliDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw, DRI2BufferP
 		dri2_complete_cmd = DRI2_BLIT_COMPLETE;
 	}
 
-	DRI2SwapComplete(client, pDraw, 0, 0, 0, dri2_complete_cmd, func, data);
+	if ( DRI2_FLIP_COMPLETE == dri2_complete_cmd )
+	{
+		MALI_STATS_INC( pScrn, DRI2_FLIP );
+		MaliTraceSwapPath( pScrn, MALI_TRACE_PATH_FLIP );
+		MaliCaptureSwap( pScrn, front_pixmap, back_pixmap, MALI_TRACE_PATH_FLIP );
+	}
+	else if ( DRI2_EXCHANGE_COMPLETE == dri2_complete_cmd )
+	{
+		MALI_STATS_INC( pScrn, DRI2_EXCHANGE );
+		MaliTraceSwapPath( pScrn, MALI_TRACE_PATH_EXCHANGE );
+		MaliCaptureSwap( pScrn, front_pixmap, back_pixmap, MALI_TRACE_PATH_EXCHANGE );
+	}
+	else
+	{
+		MALI_STATS_INC( pScrn, DRI2_BLIT );
+		MaliTraceSwapPath( pScrn, MALI_TRACE_PATH_BLIT );
+		MaliCaptureSwap( pScrn, front_pixmap, back_pixmap, MALI_TRACE_PATH_BLIT );
+	}
+
+	if ( fPtr->swap_limit > 0 && queue_swap_complete( client, pDraw, dri2_complete_cmd, func, data, trace ) )
+	{
+		CARD64 msc, ust;
+
+		MaliVSyncGetLast( pScrn, &msc, &ust );
+		*target_msc = msc + 1;
+
+		return TRUE;
+	}
+
+	if ( DRI2_FLIP_COMPLETE == dri2_complete_cmd )
+	{
+		/* Report when the flip actually reached the screen, so that clients can tell synced and late frames apart */
+		CARD64 ust = fPtr->flip_ust;
+
+		MaliTraceSwapComplete( pScrn, trace, MaliVSyncGetMSC( pScrn, ust ), ust );
+		DRI2SwapComplete(client, pDraw, MaliVSyncGetMSC( pScrn, ust ), ust / 1000000, ust % 1000000, dri2_complete_cmd, func, data);
+	}
+	else
+	{
+		MaliTraceSwapComplete( pScrn, trace, 0, MaliVSyncGetTime() );
+		DRI2SwapComplete(client, pDraw, 0, 0, 0, dri2_complete_cmd, func, data);
+	}
 
 	/* Adjust returned value */
 	*target_msc += 1;
@@ -516,7 +912,7 @@ Bool MaliDRI2ScreenInit( ScreenPtr pScreen )
 	info.CopyRegion = MaliDRI2CopyRegion;
 
 #if DRI2INFOREC_VERSION >= 4
-	if (fPtr->use_pageflipping)
+	if (fPtr->use_pageflipping || fPtr->swap_limit > 0)
 	{
 		info.version = 4;
 		info.ScheduleSwap = MaliDRI2ScheduleSwap;
@@ -528,17 +924,111 @@ Bool MaliDRI2ScreenInit( ScreenPtr pScreen )
 	}
 #endif
 
-	if ( FALSE == DRI2ScreenInit( pScreen, &info ) ) return FALSE;
+	if ( mali_swap_generation != serverGeneration )
+	{
+		mali_swap_drawable_type = CreateNewResourceType( drawable_gone, "MaliDRI2DeferredSwap" );
+		if ( !mali_swap_drawable_type ) return FALSE;
+
+		mali_swap_generation = serverGeneration;
+	}
+
+	fPtr->swaps = NULL;
+	if ( !AddCallback( &ClientStateCallback, client_state_changed, pScrn ) ) return FALSE;
+
+	if ( FALSE == DRI2ScreenInit( pScreen, &info ) )
+	{
+		DeleteCallback( &ClientStateCallback, client_state_changed, pScrn );
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Wrap the window hooks that keep the framebuffer window index up to date. This has to be called once fb and EXA
+ * have installed their own screen functions, and before the root window is created.
+ */
+Bool MaliDRI2ScreenInitWindows( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( !dixRegisterPrivateKey( &mali_fb_window_key, PRIVATE_WINDOW, 0 ) ) return FALSE;
+
+	fPtr->fb_windows = NULL;
+	fPtr->num_fb_windows = 0;
+	fPtr->size_fb_windows = 0;
+	fPtr->fb_windows_lost = FALSE;
+
+	fPtr->CreateWindow = pScreen->CreateWindow;
+	pScreen->CreateWindow = MaliDRI2CreateWindow;
+	fPtr->DestroyWindow = pScreen->DestroyWindow;
+	pScreen->DestroyWindow = MaliDRI2DestroyWindow;
+	fPtr->SetWindowPixmap = pScreen->SetWindowPixmap;
+	pScreen->SetWindowPixmap = MaliDRI2SetWindowPixmap;
 
 	return TRUE;
 }
 
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,10,0,0,0)
+static int invalidate_window( WindowPtr pWin, pointer data )
+{
+	IGNORE( data );
+
+	/* A no-op for windows that never asked for DRI2 buffers */
+	DRI2InvalidateDrawable( &pWin->drawable );
+
+	return WT_WALKCHILDREN;
+}
+#endif
+
+/*
+ * After a resize the framebuffer pixmaps have new sizes and offsets, so any
+ * buffers handed out for windows on them, or for windows flipping through the
+ * second half, are stale. Clients are told to ask again.
+ */
+void MaliDRI2InvalidateFramebuffer( ScreenPtr pScreen )
+{
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,10,0,0,0)
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( DRI_2 != fPtr->dri_render || NULL == pScreen->root ) return;
+
+	TraverseTree( pScreen->root, invalidate_window, NULL );
+#else
+	IGNORE( pScreen );
+#endif
+}
+
 void MaliDRI2CloseScreen( ScreenPtr pScreen )
 {
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	MaliPtr fPtr = MALIPTR(pScrn);
 
 	DRI2CloseScreen( pScreen );
+	DeleteCallback( &ClientStateCallback, client_state_changed, pScrn );
+
+	if ( fPtr->use_pageflipping_vsync_adaptive )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Adaptive vsync: %lu flips synced to vblank, %lu late flips shown immediately\n",
+		            fPtr->flips_synced, fPtr->flips_late );
+	}
+
+	if ( fPtr->CreateWindow )
+	{
+		pScreen->CreateWindow = fPtr->CreateWindow;
+		pScreen->DestroyWindow = fPtr->DestroyWindow;
+		pScreen->SetWindowPixmap = fPtr->SetWindowPixmap;
+		fPtr->CreateWindow = NULL;
+		fPtr->DestroyWindow = NULL;
+		fPtr->SetWindowPixmap = NULL;
+	}
+
+	free( fPtr->fb_windows );
+	fPtr->fb_windows = NULL;
+	fPtr->num_fb_windows = 0;
+	fPtr->size_fb_windows = 0;
 
 	fPtr->dri_render = DRI_NONE;
 }
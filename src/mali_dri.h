@@ -31,6 +31,8 @@ enum dri_type
 };
 
 extern Bool MaliDRI2ScreenInit( ScreenPtr pScreen );
+extern Bool MaliDRI2ScreenInitWindows( ScreenPtr pScreen );
 extern void MaliDRI2CloseScreen( ScreenPtr pScreen );
+extern void MaliDRI2InvalidateFramebuffer( ScreenPtr pScreen );
 
 #endif /* _MALI_DRI_H_ */
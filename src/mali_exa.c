@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
@@ -32,6 +33,13 @@
 #include "mali_def.h"
 #include "mali_fbdev.h"
 #include "mali_exa.h"
+#include "mali_shadow.h"
+#include "mali_video.h"
+#include "mali_stats.h"
+#include "mali_vsync.h"
+#include "mali_capture.h"
+#include "mali_composite.h"
+#include "mali_blit.h"
 
 #if UMP_LOCK_ENABLED
 #include "umplock_ioctl.h"
@@ -44,62 +52,156 @@ static struct mali_info mi;
 
 static int fd_fbdev = -1;
 
-static Bool maliPrepareSolid( PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fg )
+/*
+ * Fills and copies on UMP pixmaps go through mali_blit, composites only when mali_composite.c has a kernel for
+ * them; everything else falls back to fb. What is recorded is the first thing a straightforward fast path would
+ * trip over, so that unaccelerated counts ops such a path would have taken.
+ */
+static Bool mali_pixmap_in_ump( PixmapPtr pPixmap )
 {
-	IGNORE( pPixmap );
-	IGNORE( alu );
-	IGNORE( planemask );
-	IGNORE( fg );
+	PrivPixmap *privPixmap_wrapper = (PrivPixmap *)exaGetPixmapDriverPrivate( pPixmap );
 
- 	return FALSE;
+	return privPixmap_wrapper && privPixmap_wrapper->priv && privPixmap_wrapper->priv->mem_info;
 }
 
-static void maliSolid( PixmapPtr pPixmap, int x1, int y1, int x2, int y2 )
+static Bool mali_pixmap_format_ok( PixmapPtr pPixmap )
 {
-	IGNORE( pPixmap );
-	IGNORE( x1 );
-	IGNORE( y1 );
-	IGNORE( x2 );
-	IGNORE( y2 );
+	return 16 == pPixmap->drawable.bitsPerPixel || 32 == pPixmap->drawable.bitsPerPixel;
 }
 
-static void maliDoneSolid( PixmapPtr pPixmap )
+static uint32_t mali_pixmap_format( PixmapPtr pPixmap )
 {
-	IGNORE( pPixmap );
+	return MALI_FALLBACK_PIXMAP_FORMAT( pPixmap->drawable.depth, pPixmap->drawable.bitsPerPixel );
 }
 
-static Bool maliPrepareCopy( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int xdir, int ydir, int alu, Pixel planemask )
+static enum mali_fallback_reason mali_solid_fallback( PixmapPtr pPixmap, int alu, Pixel planemask )
 {
-	IGNORE( pSrcPixmap );
-	IGNORE( pDstPixmap );
-	IGNORE( xdir );
-	IGNORE( ydir );
-	IGNORE( alu );
-	IGNORE( planemask );
+	if ( !mali_pixmap_in_ump( pPixmap ) ) return MALI_FALLBACK_LOCATION;
+	if ( !mali_pixmap_format_ok( pPixmap ) ) return MALI_FALLBACK_FORMAT;
+	if ( GXcopy != alu ) return MALI_FALLBACK_ALU;
+	if ( !EXA_PM_IS_SOLID( &pPixmap->drawable, planemask ) ) return MALI_FALLBACK_PLANEMASK;
 
-	return FALSE;
+	return MALI_FALLBACK_UNACCELERATED;
 }
 
-static void maliCopy( PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY, int width, int height )
+static enum mali_fallback_reason mali_copy_fallback( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int alu, Pixel planemask )
 {
-	IGNORE( pDstPixmap );
-	IGNORE( srcX );
-	IGNORE( srcY );
-	IGNORE( dstX );
-	IGNORE( dstY );
-	IGNORE( width );
-	IGNORE( height );
+	if ( !mali_pixmap_in_ump( pSrcPixmap ) || !mali_pixmap_in_ump( pDstPixmap ) ) return MALI_FALLBACK_LOCATION;
+	if ( !mali_pixmap_format_ok( pDstPixmap ) || pSrcPixmap->drawable.bitsPerPixel != pDstPixmap->drawable.bitsPerPixel ) return MALI_FALLBACK_FORMAT;
+	if ( GXcopy != alu ) return MALI_FALLBACK_ALU;
+	if ( !EXA_PM_IS_SOLID( &pDstPixmap->drawable, planemask ) ) return MALI_FALLBACK_PLANEMASK;
+
+	return MALI_FALLBACK_UNACCELERATED;
 }
 
-static void maliDoneCopy( PixmapPtr pDstPixmap )
+static Bool mali_picture_format_ok( PictFormatShort format )
+{
+	switch ( format )
+	{
+		case PICT_a8r8g8b8:
+		case PICT_x8r8g8b8:
+		case PICT_a8b8g8r8:
+		case PICT_x8b8g8r8:
+		case PICT_r5g6b5:
+		case PICT_a8:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/* Checks a source or mask picture, leaving *format pointing at it when it is the one at fault */
+static enum mali_fallback_reason mali_picture_fallback( PicturePtr pPicture, uint32_t *format )
+{
+	if ( NULL == pPicture ) return MALI_FALLBACK_UNACCELERATED;
+
+	*format = pPicture->format;
+
+	/* Solid fills and gradients have no drawable */
+	if ( NULL == pPicture->pDrawable ) return MALI_FALLBACK_SOURCE_PICTURE;
+	if ( !mali_picture_format_ok( pPicture->format ) ) return MALI_FALLBACK_FORMAT;
+	if ( pPicture->transform ) return MALI_FALLBACK_TRANSFORM;
+	if ( pPicture->repeat && RepeatNormal != pPicture->repeatType ) return MALI_FALLBACK_REPEAT;
+	if ( pPicture->alphaMap ) return MALI_FALLBACK_ALPHA_MAP;
+	if ( pPicture->componentAlpha ) return MALI_FALLBACK_COMPONENT_ALPHA;
+
+	return MALI_FALLBACK_UNACCELERATED;
+}
+
+static enum mali_composite_format mali_composite_format( PicturePtr pPicture )
+{
+	if ( NULL == pPicture ) return MALI_COMPOSITE_FORMAT_none;
+
+	switch ( pPicture->format )
+	{
+		case PICT_a8r8g8b8:
+			return MALI_COMPOSITE_FORMAT_a8r8g8b8;
+		case PICT_x8r8g8b8:
+			return MALI_COMPOSITE_FORMAT_x8r8g8b8;
+		case PICT_a8b8g8r8:
+			return MALI_COMPOSITE_FORMAT_a8b8g8r8;
+		case PICT_x8b8g8r8:
+			return MALI_COMPOSITE_FORMAT_x8b8g8r8;
+		case PICT_r5g6b5:
+			return MALI_COMPOSITE_FORMAT_r5g6b5;
+		case PICT_a8:
+			return MALI_COMPOSITE_FORMAT_a8;
+		default:
+			return MALI_COMPOSITE_FORMATS;
+	}
+}
+
+static MaliCompositeRowProc mali_composite_kernel( int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture )
 {
-	IGNORE( pDstPixmap );
+	enum mali_composite_op mop;
+
+	switch ( op )
+	{
+		case PictOpSrc:
+			mop = MALI_COMPOSITE_OP_SRC;
+			break;
+		case PictOpOver:
+			mop = MALI_COMPOSITE_OP_OVER;
+			break;
+		case PictOpAdd:
+			mop = MALI_COMPOSITE_OP_ADD;
+			break;
+		default:
+			return NULL;
+	}
+
+	return mali_composite_lookup( mop, mali_composite_format( pSrcPicture ), mali_composite_format( pMaskPicture ), mali_composite_format( pDstPicture ) );
+}
+
+static enum mali_fallback_reason mali_composite_fallback( int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture, uint32_t *format )
+{
+	enum mali_fallback_reason reason;
+
+	*format = pDstPicture->format;
+
+	if ( PictOpSrc != op && PictOpOver != op && PictOpAdd != op ) return MALI_FALLBACK_OPERATOR;
+	if ( !mali_picture_format_ok( pDstPicture->format ) ) return MALI_FALLBACK_FORMAT;
+	if ( pDstPicture->alphaMap ) return MALI_FALLBACK_ALPHA_MAP;
+
+	reason = mali_picture_fallback( pSrcPicture, format );
+	if ( MALI_FALLBACK_UNACCELERATED != reason ) return reason;
+
+	reason = mali_picture_fallback( pMaskPicture, format );
+	if ( MALI_FALLBACK_UNACCELERATED != reason ) return reason;
+
+	*format = pDstPicture->format;
+
+	return MALI_FALLBACK_UNACCELERATED;
 }
 
+/* The only asynchronous work is Xv frames being converted by the video threads */
 static void maliWaitMarker( ScreenPtr pScreen, int marker )
 {
-	IGNORE( pScreen );
 	IGNORE( marker );
+
+	MALI_STATS_INC( mi.pScrn, EXA_WAIT_MARKER );
+
+	MaliVideoSync( pScreen );
 }
 
 static void* maliCreatePixmap(ScreenPtr pScreen, int size, int align )
@@ -116,12 +218,11 @@ static void* maliCreatePixmap(ScreenPtr pScreen, int size, int align )
 		return NULL;
 	}
 
-	IGNORE( pScreen );
-	IGNORE( size );
-	IGNORE( align );
-
 	privPixmap_wrapper->priv = privPixmap;
 
+	MALI_STATS_INC( pScrn, EXA_CREATE_PIXMAP );
+	MaliCaptureCreatePixmap( pScrn, privPixmap_wrapper, size, align );
+
 	privPixmap->isFrameBuffer  = FALSE;
 	privPixmap->bits_per_pixel = 0;
 	privPixmap->other_buffer   = NULL;
@@ -138,12 +239,21 @@ static void maliDestroyPixmap(ScreenPtr pScreen, void *driverPriv )
 	PrivPixmapInternal *privPixmap = (PrivPixmapInternal *)privPixmap_wrapper->priv;
 
 	IGNORE( pScreen );
+
+	MALI_STATS_INC( mi.pScrn, EXA_DESTROY_PIXMAP );
+	MaliCaptureDestroyPixmap( mi.pScrn, privPixmap_wrapper );
+
 	if ( NULL != privPixmap->mem_info )
 	{
 		/* TODO: Need to destroy the other buffer if it's present. At the moment this never gets called for a
 		 * framebuffer pixmap so asserting here for now because it will break if it is called with a framebuffer
 		 * pixmap */
 		assert(privPixmap->other_buffer == NULL);
+		if ( !privPixmap->isShadow && !privPixmap->isFrameBuffer )
+		{
+			MALI_STATS_INC( mi.pScrn, UMP_FREE );
+			MALI_STATS_ADD( mi.pScrn, UMP_FREE_BYTES, privPixmap->mem_info->usize );
+		}
 		ump_reference_release(privPixmap->mem_info->handle);
 		free( privPixmap->mem_info );
 		free( privPixmap );
@@ -153,12 +263,24 @@ static void maliDestroyPixmap(ScreenPtr pScreen, void *driverPriv )
 
 static unsigned int offset = 0;
 
+/* What kind of memory maliModifyPixmapHeader is about to wrap, in the order it checks */
+static enum mali_capture_memory mali_capture_memory( pointer pPixData )
+{
+	if ( pPixData == mi.fb_virt ) return MALI_CAPTURE_MEMORY_FRAMEBUFFER;
+	if ( offset ) return MALI_CAPTURE_MEMORY_FRAMEBUFFER_BACK;
+	if ( NULL == pPixData ) return MALI_CAPTURE_MEMORY_NONE;
+	if ( MaliShadowGetMemInfo( mi.pScrn, pPixData ) ) return MALI_CAPTURE_MEMORY_SHADOW;
+
+	return MALI_CAPTURE_MEMORY_OTHER;
+}
+
 static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int depth, int bitsPerPixel, int devKind, pointer pPixData)
 {
 	unsigned int size;
 	PrivPixmap *privPixmap_wrapper = (PrivPixmap *)exaGetPixmapDriverPrivate(pPixmap);
 	PrivPixmapInternal *privPixmap = (PrivPixmapInternal *)privPixmap_wrapper->priv;
 	mali_mem_info *mem_info;
+	mali_mem_info *shadow_mem_info;
 	ScreenPtr pScreen = pPixmap->drawable.pScreen;
 
 	if (!pPixmap) 
@@ -166,6 +288,9 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 		return FALSE;
 	}
 
+	MALI_STATS_INC( mi.pScrn, EXA_MODIFY_PIXMAP_HEADER );
+	if ( MALIPTR(mi.pScrn)->capture ) MaliCaptureModifyPixmap( mi.pScrn, pPixmap, width, height, depth, bitsPerPixel, devKind, mali_capture_memory( pPixData ) );
+
 	miModifyPixmapHeader(pPixmap, width, height, depth, bitsPerPixel, devKind, pPixData);
 
 	if ((pPixData == mi.fb_virt) || offset)
@@ -210,8 +335,10 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 		}
 
 		mem_info->handle = ump_handle_create_from_secure_id( ump_id );
+		MALI_STATS_INC( mi.pScrn, UMP_IMPORT );
 		if ( UMP_INVALID_MEMORY_HANDLE == mem_info->handle )
 		{
+			MALI_STATS_INC( mi.pScrn, UMP_IMPORT_FAILED );
 			xf86DrvMsg( mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] UMP failed to create handle from secure id\n", __FUNCTION__, __LINE__);
 			free( mem_info );
 			privPixmap->mem_info = NULL;
@@ -258,6 +385,38 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 		return TRUE;
 	}
 
+	shadow_mem_info = MaliShadowGetMemInfo( mi.pScrn, pPixData );
+	if ( shadow_mem_info )
+	{
+		/* The screen pixmap of a shadowed screen is cached UMP memory that we allocated ourselves */
+		mem_info = privPixmap->mem_info;
+		if ( mem_info ) 
+		{
+			if ( mem_info->handle == shadow_mem_info->handle ) return TRUE;
+
+			/* The shadow was reallocated for a new screen size */
+			ump_reference_release( mem_info->handle );
+		}
+		else
+		{
+			mem_info = calloc(1, sizeof(*mem_info));
+			if (!mem_info) 
+			{
+				xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate for memory metadata\n", __FUNCTION__, __LINE__);
+				return FALSE;
+			}
+		}
+
+		*mem_info = *shadow_mem_info;
+		ump_reference_add( mem_info->handle );
+
+		privPixmap->isShadow = TRUE;
+		privPixmap->mem_info = mem_info;
+		if( bitsPerPixel != 0 ) privPixmap->bits_per_pixel = bitsPerPixel;
+
+		return TRUE;
+	}
+
 	if ( pPixData )
 	{
 		/* TODO: When this happens we're being told to wrap existing pixmap data for which we don't know the UMP
@@ -287,6 +446,8 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 
 	if ( mem_info && mem_info->usize != 0 )
 	{
+		MALI_STATS_INC( mi.pScrn, UMP_FREE );
+		MALI_STATS_ADD( mi.pScrn, UMP_FREE_BYTES, mem_info->usize );
 		ump_reference_release(mem_info->handle);
 		mem_info->handle = NULL;
 		memset(privPixmap, 0, sizeof(*privPixmap));
@@ -317,10 +478,14 @@ static Bool maliModifyPixmapHeader(PixmapPtr pPixmap, int width, int height, int
 
 	if ( UMP_INVALID_MEMORY_HANDLE == mem_info->handle )
 	{
+		MALI_STATS_INC( mi.pScrn, UMP_ALLOC_FAILED );
 		xf86DrvMsg(mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate UMP memory (%i bytes)\n", __FUNCTION__, __LINE__, size);
 		return FALSE;
 	}
 
+	MALI_STATS_INC( mi.pScrn, UMP_ALLOC );
+	MALI_STATS_ADD( mi.pScrn, UMP_ALLOC_BYTES, size );
+
 	mem_info->usize = size;
 	privPixmap->mem_info = mem_info;
 	privPixmap->mem_info->usize = size;
@@ -335,6 +500,8 @@ static Bool maliPixmapIsOffscreen( PixmapPtr pPix )
 	PrivPixmap *privPixmap_wrapper = (PrivPixmap *)exaGetPixmapDriverPrivate(pPix);
 	PrivPixmapInternal *privPixmap = (PrivPixmapInternal *)privPixmap_wrapper->priv;
 
+	MALI_STATS_INC( mi.pScrn, EXA_PIXMAP_IS_OFFSCREEN );
+
 	if (pScreen->GetScreenPixmap(pScreen) == pPix ) 
 	{
 		return TRUE;
@@ -348,7 +515,7 @@ static Bool maliPixmapIsOffscreen( PixmapPtr pPix )
 	return FALSE;
 }
 
-static Bool maliPrepareAccess(PixmapPtr pPix, int index)
+static Bool mali_prepare_access(PixmapPtr pPix, int index)
 {
 	PrivPixmap *privPixmap_wrapper = (PrivPixmap *)exaGetPixmapDriverPrivate(pPix);
 	PrivPixmapInternal *privPixmap = (PrivPixmapInternal *)privPixmap_wrapper->priv;
@@ -429,7 +596,7 @@ static Bool maliPrepareAccess(PixmapPtr pPix, int index)
 	return TRUE;
 }
 
-static void maliFinishAccess(PixmapPtr pPix, int index)
+static void mali_finish_access(PixmapPtr pPix, int index)
 {
 	PrivPixmap *privPixmap_wrapper = (PrivPixmap *)exaGetPixmapDriverPrivate(pPix);
 	PrivPixmapInternal *privPixmap = (PrivPixmapInternal *)privPixmap_wrapper->priv;
@@ -477,53 +644,406 @@ static void maliFinishAccess(PixmapPtr pPix, int index)
 	privPixmap->refs--;
 }
 
+/* The time spent here is mostly UMP locking and cache maintenance */
+static Bool maliPrepareAccess( PixmapPtr pPix, int index )
+{
+	CARD64 start = MaliVSyncGetTime();
+	Bool ret = mali_prepare_access( pPix, index );
+
+	MALI_STATS_INC( mi.pScrn, EXA_PREPARE_ACCESS );
+	MALI_STATS_ADD( mi.pScrn, EXA_PREPARE_ACCESS_TIME, MaliVSyncGetTime() - start );
+	if ( !ret ) MALI_STATS_INC( mi.pScrn, EXA_PREPARE_ACCESS_FAILED );
+	MaliCaptureAccess( mi.pScrn, pPix, index, TRUE, ret );
+
+	return ret;
+}
+
+static void maliFinishAccess( PixmapPtr pPix, int index )
+{
+	CARD64 start = MaliVSyncGetTime();
+
+	mali_finish_access( pPix, index );
+
+	MALI_STATS_INC( mi.pScrn, EXA_FINISH_ACCESS );
+	MALI_STATS_ADD( mi.pScrn, EXA_FINISH_ACCESS_TIME, MaliVSyncGetTime() - start );
+	MaliCaptureAccess( mi.pScrn, pPix, index, FALSE, TRUE );
+}
+
+/* Between the Prepare and Done of a fill or copy, EXA doesn't nest them */
+static struct
+{
+	Pixel fg;
+	PixmapPtr pSrc;
+	enum mali_blit_memory memory;
+} blit;
+
+static enum mali_blit_memory mali_pixmap_memory( PixmapPtr pPixmap )
+{
+	PrivPixmap *privPixmap = (PrivPixmap *)exaGetPixmapDriverPrivate( pPixmap );
+
+	return privPixmap->priv->isFrameBuffer ? MALI_BLIT_MEMORY_FRAMEBUFFER : MALI_BLIT_MEMORY_CACHED;
+}
+
+static Bool maliPrepareSolid( PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fg )
+{
+	enum mali_fallback_reason reason = mali_solid_fallback( pPixmap, alu, planemask );
+
+	MALI_STATS_INC( mi.pScrn, EXA_PREPARE_SOLID );
+	MaliCaptureSolid( mi.pScrn, pPixmap, alu, planemask, fg );
+
+	if ( MALI_FALLBACK_UNACCELERATED == reason )
+	{
+		/* The Xv threads may still be writing to it */
+		MaliVideoSync( pPixmap->drawable.pScreen );
+
+		if ( mali_prepare_access( pPixmap, EXA_PREPARE_DEST ) )
+		{
+			blit.fg = fg;
+			return TRUE;
+		}
+		reason = MALI_FALLBACK_LOCATION;
+	}
+
+	MALI_STATS_INC( mi.pScrn, EXA_FALLBACK_SOLID );
+	MaliStatsFallback( mi.pScrn, MALI_FALLBACK_SOLID, reason, mali_pixmap_format( pPixmap ) );
+
+	return FALSE;
+}
+
+static void maliSolid( PixmapPtr pPixmap, int x1, int y1, int x2, int y2 )
+{
+	int cpp = pPixmap->drawable.bitsPerPixel / 8;
+
+	MALI_STATS_INC( mi.pScrn, EXA_SOLID );
+	MaliCaptureRect( mi.pScrn, 0, 0, 0, 0, x1, y1, x2 - x1, y2 - y1 );
+
+	mali_blit_fill( (unsigned char *)pPixmap->devPrivate.ptr + y1 * pPixmap->devKind + x1 * cpp, pPixmap->devKind, x2 - x1, y2 - y1, cpp, blit.fg );
+}
+
+static void maliDoneSolid( PixmapPtr pPixmap )
+{
+	MALI_STATS_INC( mi.pScrn, EXA_DONE_SOLID );
+	MaliCaptureDone( mi.pScrn, pPixmap );
+
+	mali_finish_access( pPixmap, EXA_PREPARE_DEST );
+}
+
+/* Copies within a pixmap are mapped once, and ordered in maliCopy from the coordinates */
+static Bool maliPrepareCopy( PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int xdir, int ydir, int alu, Pixel planemask )
+{
+	enum mali_fallback_reason reason = mali_copy_fallback( pSrcPixmap, pDstPixmap, alu, planemask );
+
+	IGNORE( xdir );
+	IGNORE( ydir );
+
+	MALI_STATS_INC( mi.pScrn, EXA_PREPARE_COPY );
+	MaliCaptureCopy( mi.pScrn, pSrcPixmap, pDstPixmap, xdir, ydir, alu, planemask );
+
+	if ( MALI_FALLBACK_UNACCELERATED == reason )
+	{
+		MaliVideoSync( pDstPixmap->drawable.pScreen );
+
+		if ( mali_prepare_access( pDstPixmap, EXA_PREPARE_DEST ) )
+		{
+			if ( pSrcPixmap == pDstPixmap || mali_prepare_access( pSrcPixmap, EXA_PREPARE_SRC ) )
+			{
+				blit.pSrc = pSrcPixmap;
+				blit.memory = mali_pixmap_memory( pDstPixmap );
+				return TRUE;
+			}
+
+			mali_finish_access( pDstPixmap, EXA_PREPARE_DEST );
+		}
+		reason = MALI_FALLBACK_LOCATION;
+	}
+
+	MALI_STATS_INC( mi.pScrn, EXA_FALLBACK_COPY );
+	MaliStatsFallback( mi.pScrn, MALI_FALLBACK_COPY, reason, mali_pixmap_format( pDstPixmap ) );
+
+	return FALSE;
+}
+
+static void maliCopy( PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY, int width, int height )
+{
+	PixmapPtr pSrcPixmap = blit.pSrc;
+	int cpp = pDstPixmap->drawable.bitsPerPixel / 8;
+	int src_pitch = pSrcPixmap->devKind, dst_pitch = pDstPixmap->devKind;
+	unsigned char *src = (unsigned char *)pSrcPixmap->devPrivate.ptr + srcY * src_pitch + srcX * cpp;
+	unsigned char *dst = (unsigned char *)pDstPixmap->devPrivate.ptr + dstY * dst_pitch + dstX * cpp;
+
+	MALI_STATS_INC( mi.pScrn, EXA_COPY );
+	MaliCaptureRect( mi.pScrn, srcX, srcY, 0, 0, dstX, dstY, width, height );
+
+	if ( pSrcPixmap == pDstPixmap && srcY == dstY )
+	{
+		/* Sideways within the same rows, the row kernels only copy forwards */
+		for ( ; height > 0; height--, src += src_pitch, dst += dst_pitch ) memmove( dst, src, width * cpp );
+	}
+	else if ( pSrcPixmap == pDstPixmap && srcY < dstY )
+	{
+		mali_blit_copy( blit.memory, dst + ( height - 1 ) * dst_pitch, -dst_pitch, src + ( height - 1 ) * src_pitch, -src_pitch, width * cpp, height );
+	}
+	else
+	{
+		mali_blit_copy( blit.memory, dst, dst_pitch, src, src_pitch, width * cpp, height );
+	}
+}
+
+static void maliDoneCopy( PixmapPtr pDstPixmap )
+{
+	MALI_STATS_INC( mi.pScrn, EXA_DONE_COPY );
+	MaliCaptureDone( mi.pScrn, pDstPixmap );
+
+	if ( blit.pSrc != pDstPixmap ) mali_finish_access( blit.pSrc, EXA_PREPARE_SRC );
+	mali_finish_access( pDstPixmap, EXA_PREPARE_DEST );
+}
+
+/* Repeats wrap at the pixmap size, which is only the picture's size for pixmaps */
+static Bool mali_composite_repeat_ok( PicturePtr pPicture )
+{
+	return NULL == pPicture || !pPicture->repeat || DRAWABLE_PIXMAP == pPicture->pDrawable->type;
+}
+
 static Bool maliCheckComposite( int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture )
 {
-	IGNORE( op );
-	IGNORE( pSrcPicture );
-	IGNORE( pMaskPicture );
-	IGNORE( pDstPicture );
+	enum mali_fallback_reason reason;
+	uint32_t format;
+
+	MALI_STATS_INC( mi.pScrn, EXA_CHECK_COMPOSITE );
+	MaliCaptureComposite( mi.pScrn, op, pSrcPicture, pMaskPicture, pDstPicture );
+
+	reason = mali_composite_fallback( op, pSrcPicture, pMaskPicture, pDstPicture, &format );
+	if ( MALI_FALLBACK_UNACCELERATED == reason )
+	{
+		if ( !mali_composite_repeat_ok( pSrcPicture ) || !mali_composite_repeat_ok( pMaskPicture ) ) reason = MALI_FALLBACK_REPEAT;
+		else if ( mali_composite_kernel( op, pSrcPicture, pMaskPicture, pDstPicture ) ) return TRUE;
+	}
+
+	MALI_STATS_INC( mi.pScrn, EXA_FALLBACK_COMPOSITE );
+	MaliStatsFallback( mi.pScrn, MALI_FALLBACK_COMPOSITE, reason, format );
 
 	return FALSE;
 }
 
+/* Between PrepareComposite and DoneComposite, EXA doesn't nest them */
+static struct
+{
+	MaliCompositeRowProc row;
+	PixmapPtr pSrc;
+	PixmapPtr pMask;
+	Bool src_repeat;
+	Bool mask_repeat;
+	Bool copy;
+	enum mali_blit_memory memory;
+} composite;
+
+static Bool mali_composite_bpp_ok( PixmapPtr pPixmap, PicturePtr pPicture )
+{
+	return pPixmap->drawable.bitsPerPixel == 8 * mali_composite_format_cpp( mali_composite_format( pPicture ) );
+}
+
 static Bool maliPrepareComposite( int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture, PixmapPtr pSrcPixmap, PixmapPtr pMask, PixmapPtr pDstPixmap )
 {
-	IGNORE( op );
-	IGNORE( pSrcPicture );
-	IGNORE( pMaskPicture );
-	IGNORE( pDstPicture );
-	IGNORE( pSrcPixmap );
-	IGNORE( pMask );
-	IGNORE( pDstPixmap );
+	enum mali_fallback_reason reason = MALI_FALLBACK_LOCATION;
+
+	MALI_STATS_INC( mi.pScrn, EXA_PREPARE_COMPOSITE );
+
+	/* EXA only gets here when CheckComposite agreed, so only the pixmaps are left to object */
+	if ( !pSrcPixmap || !mali_pixmap_in_ump( pSrcPixmap ) || ( pMask && !mali_pixmap_in_ump( pMask ) ) || !mali_pixmap_in_ump( pDstPixmap ) )
+	{
+		reason = MALI_FALLBACK_LOCATION;
+	}
+	else if ( !mali_composite_bpp_ok( pSrcPixmap, pSrcPicture ) || ( pMask && !mali_composite_bpp_ok( pMask, pMaskPicture ) ) || !mali_composite_bpp_ok( pDstPixmap, pDstPicture ) )
+	{
+		reason = MALI_FALLBACK_FORMAT;
+	}
+	/* The kernels read the source while writing the destination, which must not overlap */
+	else if ( pSrcPixmap == pDstPixmap || pMask == pDstPixmap )
+	{
+		reason = MALI_FALLBACK_OVERLAP;
+	}
+	else
+	{
+		composite.row = mali_composite_kernel( op, pSrcPicture, pMaskPicture, pDstPicture );
+		composite.pSrc = pSrcPixmap;
+		composite.pMask = pMask;
+		composite.src_repeat = pSrcPicture->repeat;
+		composite.mask_repeat = pMask && pMaskPicture->repeat;
+
+		/* SRC between pictures of one format is a straight copy, as pixman's own fast path has it */
+		composite.copy = PictOpSrc == op && !pMask && !pSrcPicture->repeat && pSrcPicture->format == pDstPicture->format;
+		composite.memory = mali_pixmap_memory( pDstPixmap );
+
+		if ( NULL == composite.row ) reason = MALI_FALLBACK_UNACCELERATED;
+		else
+		{
+			/* Unlike fb, EXA doesn't wait for the driver before an accelerated op, and the Xv threads may still be writing */
+			MaliVideoSync( pDstPixmap->drawable.pScreen );
+
+			if ( mali_prepare_access( pDstPixmap, EXA_PREPARE_DEST ) )
+			{
+				if ( mali_prepare_access( pSrcPixmap, EXA_PREPARE_SRC ) )
+				{
+					if ( !pMask || mali_prepare_access( pMask, EXA_PREPARE_MASK ) )
+					{
+						MaliCapturePrepareComposite( mi.pScrn, op, pSrcPicture, pMaskPicture, pDstPicture, pSrcPixmap, pMask, pDstPixmap, TRUE );
+						return TRUE;
+					}
+
+					mali_finish_access( pSrcPixmap, EXA_PREPARE_SRC );
+				}
+
+				mali_finish_access( pDstPixmap, EXA_PREPARE_DEST );
+			}
+		}
+	}
+
+	MaliCapturePrepareComposite( mi.pScrn, op, pSrcPicture, pMaskPicture, pDstPicture, pSrcPixmap, pMask, pDstPixmap, FALSE );
+	MALI_STATS_INC( mi.pScrn, EXA_FALLBACK_COMPOSITE );
+	MaliStatsFallback( mi.pScrn, MALI_FALLBACK_COMPOSITE, reason, pDstPicture->format );
 
 	return FALSE;
 }
 
+static void mali_composite_describe( struct mali_composite_surface *surface, PixmapPtr pPixmap, Bool repeat )
+{
+	surface->bits = pPixmap->devPrivate.ptr;
+	surface->pitch = pPixmap->devKind;
+	surface->width = pPixmap->drawable.width;
+	surface->height = pPixmap->drawable.height;
+	surface->cpp = pPixmap->drawable.bitsPerPixel / 8;
+	surface->repeat = repeat;
+}
+
 static void maliComposite( PixmapPtr pDstPixmap, int srcX, int srcY, int maskX, int maskY, int dstX, int dstY, int width, int height)
 {
-	IGNORE( pDstPixmap );
-	IGNORE( srcX );
-	IGNORE( srcY );
-	IGNORE( maskX );
-	IGNORE( maskY );
-	IGNORE( dstX );
-	IGNORE( dstY );
-	IGNORE( width );
-	IGNORE( height );
+	struct mali_composite_surface dst, src, mask;
+
+	MALI_STATS_INC( mi.pScrn, EXA_COMPOSITE );
+	MaliCaptureRect( mi.pScrn, srcX, srcY, maskX, maskY, dstX, dstY, width, height );
+
+	if ( composite.copy )
+	{
+		PixmapPtr pSrcPixmap = composite.pSrc;
+		int cpp = pDstPixmap->drawable.bitsPerPixel / 8;
+
+		mali_blit_copy( composite.memory, (unsigned char *)pDstPixmap->devPrivate.ptr + dstY * pDstPixmap->devKind + dstX * cpp, pDstPixmap->devKind,
+		                (unsigned char *)pSrcPixmap->devPrivate.ptr + srcY * pSrcPixmap->devKind + srcX * cpp, pSrcPixmap->devKind, width * cpp, height );
+		return;
+	}
+
+	mali_composite_describe( &dst, pDstPixmap, FALSE );
+	mali_composite_describe( &src, composite.pSrc, composite.src_repeat );
+	if ( composite.pMask ) mali_composite_describe( &mask, composite.pMask, composite.mask_repeat );
+
+	mali_composite( composite.row, &dst, &src, composite.pMask ? &mask : NULL, srcX, srcY, maskX, maskY, dstX, dstY, width, height );
 }
 
 static void maliDoneComposite( PixmapPtr pDst )
 {
-	IGNORE( pDst );
+	MALI_STATS_INC( mi.pScrn, EXA_DONE_COMPOSITE );
+	MaliCaptureDone( mi.pScrn, pDst );
+
+	if ( composite.pMask ) mali_finish_access( composite.pMask, EXA_PREPARE_MASK );
+	mali_finish_access( composite.pSrc, EXA_PREPARE_SRC );
+	mali_finish_access( pDst, EXA_PREPARE_DEST );
 }
 
 
+/* CPU access for driver code writing to pixmaps outside of an EXA operation, such as Xv */
+Bool maliPixmapBeginCPUAccess( PixmapPtr pPixmap )
+{
+	return maliPrepareAccess( pPixmap, EXA_PREPARE_DEST );
+}
+
+void maliPixmapEndCPUAccess( PixmapPtr pPixmap )
+{
+	maliFinishAccess( pPixmap, EXA_PREPARE_DEST );
+}
+
 static void maliDumpInfo(void)
 {
 	xf86DrvMsg(mi.pScrn->scrnIndex, X_INFO, "XRES: %i YRES: %i PHYS: 0x%x VIRT: 0x%x\n", mi.fb_xres, mi.fb_yres, (int)mi.fb_phys, (int)mi.fb_virt);
 }
 
+/*
+ * The fbdev virtual area has been reconfigured for a new screen size. Both
+ * framebuffer pixmaps get fresh UMP handles and sizes, and the second buffer
+ * moves to just past the first one at the new pitch.
+ */
+Bool maliResizeFramebuffer( ScreenPtr pScreen, int xres, int yres, int pitch, unsigned char *virt )
+{
+	MaliPtr fPtr = MALIPTR(mi.pScrn);
+	PixmapPtr pFront = (*pScreen->GetScreenPixmap)(pScreen);
+	PixmapPtr pixmaps[2];
+	int i;
+
+	pixmaps[0] = pFront;
+	pixmaps[1] = ((PrivPixmap *)exaGetPixmapDriverPrivate(pFront))->priv->other_buffer;
+
+	mi.fb_xres = xres;
+	mi.fb_yres = yres;
+	mi.fb_virt = virt;
+
+	/* The framebuffer may have been mapped again somewhere else */
+	fPtr->exa->memoryBase = virt;
+	fPtr->exa->offScreenBase = pitch * yres;
+	fPtr->exa->memorySize = fPtr->fb_lcd_fix.smem_len;
+
+	for ( i = 0; i < 2; i++ )
+	{
+		PrivPixmapInternal *privPixmap;
+		mali_mem_info *mem_info;
+		ump_secure_id ump_id = UMP_INVALID_SECURE_ID;
+		ump_handle handle;
+		Bool second;
+
+		if ( NULL == pixmaps[i] ) continue;
+
+		privPixmap = ((PrivPixmap *)exaGetPixmapDriverPrivate(pixmaps[i]))->priv;
+		mem_info = privPixmap->mem_info;
+		if ( !privPixmap->isFrameBuffer || NULL == mem_info ) continue;
+
+		/* Each pixmap keeps its half, whichever of them is on screen right now */
+		second = ( 0 != mem_info->offset );
+
+		(void)ioctl( fd_fbdev, second ? GET_UMP_SECURE_ID_BUF2 : GET_UMP_SECURE_ID_BUF1, &ump_id );
+		if ( UMP_INVALID_SECURE_ID == ump_id )
+		{
+			xf86DrvMsg( mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] UMP failed to retrieve secure id\n", __FUNCTION__, __LINE__ );
+			return FALSE;
+		}
+
+		handle = ump_handle_create_from_secure_id( ump_id );
+		if ( UMP_INVALID_MEMORY_HANDLE == handle )
+		{
+			xf86DrvMsg( mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] UMP failed to create handle from secure id\n", __FUNCTION__, __LINE__ );
+			return FALSE;
+		}
+
+		ump_reference_release( mem_info->handle );
+		mem_info->handle = handle;
+		mem_info->usize = pitch * yres;
+		mem_info->offset = second ? pitch * yres : 0;
+
+		if ( privPixmap->refs > 0 ) privPixmap->addr = (unsigned long)virt + mem_info->offset;
+
+		/* Through EXA, so that it updates its own idea of the pixmap too. With the new address we are only
+		 * told to wrap what the pixmap already has. */
+		if ( !(*pScreen->ModifyPixmapHeader)( pixmaps[i], xres, yres, pixmaps[i]->drawable.depth,
+		                                       pixmaps[i]->drawable.bitsPerPixel, pitch, virt + mem_info->offset ) )
+		{
+			xf86DrvMsg( mi.pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to resize FRAMEBUFFER pixmap %p\n", __FUNCTION__, __LINE__, pixmaps[i] );
+			return FALSE;
+		}
+
+		xf86DrvMsg( mi.pScrn->scrnIndex, X_INFO, "Resized FRAMEBUFFER pixmap %p to %dx%d at offset %lu\n",
+		            pixmaps[i], xres, yres, mem_info->offset );
+	}
+
+	return TRUE;
+}
+
 Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsigned char *virt )
 {
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
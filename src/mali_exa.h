@@ -51,6 +51,7 @@ typedef struct
 typedef struct
 {
 	Bool isFrameBuffer;
+	Bool isShadow;
 	int refs;
 	int bits_per_pixel;
 #if UMP_LOCK_ENABLED
@@ -64,8 +65,12 @@ typedef struct
 typedef struct
 {
 	PrivPixmapInternal *priv;
+	unsigned int capture_id;
 } PrivPixmap;
 
 extern Bool maliSetupExa( ScreenPtr pScreen, ExaDriverPtr exa, int xres, int yres, unsigned char *virt );
+extern Bool maliResizeFramebuffer( ScreenPtr pScreen, int xres, int yres, int pitch, unsigned char *virt );
+extern Bool maliPixmapBeginCPUAccess( PixmapPtr pPixmap );
+extern void maliPixmapEndCPUAccess( PixmapPtr pPixmap );
 
 #endif /* _MALI_EXA_H_ */
@@ -39,6 +39,7 @@
 #include <xf86drm.h>
 #include "xf86xv.h"
 #include "xf86Crtc.h"
+#include "xf86RandR12.h"
 #include "micmap.h"
 #include "compat-api.h"
 
@@ -47,6 +48,15 @@
 #include "mali_exa.h"
 #include "mali_dri.h"
 #include "mali_lcd.h"
+#include "mali_vsync.h"
+#include "mali_shadow.h"
+#include "mali_blit.h"
+#include "mali_video.h"
+#include "mali_cursor.h"
+#include "mali_stats.h"
+#include "mali_trace.h"
+#include "mali_capture.h"
+#include "mali_tune.h"
 
 #define MALI_VERSION        4000
 #define MALI_NAME           "MALI"
@@ -62,6 +72,10 @@ static Bool	MaliPreInit(ScrnInfoPtr pScrn, int flags);
 static Bool	MaliScreenInit(SCREEN_INIT_ARGS_DECL);
 static Bool	MaliCloseScreen(CLOSE_SCREEN_ARGS_DECL);
 
+void*	MaliHWMapVidmem(ScrnInfoPtr pScrn);
+Bool	MaliHWUnmapVidmem(ScrnInfoPtr pScrn);
+int	MaliHWLinearOffset(ScrnInfoPtr pScrn);
+
 static int pix24bpp = 0;
 static int malihwPrivateIndex = -1;
 
@@ -89,12 +103,36 @@ typedef enum {
 	OPTION_DRI2,
 	OPTION_DRI2_PAGE_FLIP,
 	OPTION_DRI2_WAIT_VSYNC,
+	OPTION_DRI2_SWAP_LIMIT,
+	OPTION_SHADOW_FB,
+	OPTION_SHADOW_VSYNC,
+	OPTION_TEAR_FREE,
+	OPTION_SHADOW_DITHER,
+	OPTION_SHADOW_CURSOR,
+	OPTION_EXA_CAPTURE,
+	OPTION_FB_COPY,
+	OPTION_CACHED_COPY,
+	OPTION_CPU_KERNELS,
+	OPTION_XV_PIPELINE,
+	OPTION_STATS,
 } FBDevOpts;
 
 static const OptionInfoRec MaliOptions[] = {
 	{ OPTION_DRI2,             "DRI2",            OPTV_BOOLEAN, {0}, TRUE  },
 	{ OPTION_DRI2_PAGE_FLIP,   "DRI2_PAGE_FLIP",  OPTV_BOOLEAN, {0}, FALSE },
-	{ OPTION_DRI2_WAIT_VSYNC,  "DRI2_WAIT_VSYNC", OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_DRI2_WAIT_VSYNC,  "DRI2_WAIT_VSYNC", OPTV_ANYSTR,  {0}, FALSE },
+	{ OPTION_DRI2_SWAP_LIMIT,  "DRI2_SWAP_LIMIT", OPTV_INTEGER, {0}, FALSE },
+	{ OPTION_SHADOW_FB,        "SHADOW_FB",       OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_SHADOW_VSYNC,     "SHADOW_VSYNC",    OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_TEAR_FREE,        "TEAR_FREE",       OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_SHADOW_DITHER,    "SHADOW_DITHER",   OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_SHADOW_CURSOR,    "SHADOW_CURSOR",   OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_EXA_CAPTURE,      "EXA_CAPTURE",     OPTV_STRING,  {0}, FALSE },
+	{ OPTION_FB_COPY,          "FB_COPY",         OPTV_STRING,  {0}, FALSE },
+	{ OPTION_CACHED_COPY,      "CACHED_COPY",     OPTV_STRING,  {0}, FALSE },
+	{ OPTION_CPU_KERNELS,      "CPU_KERNELS",     OPTV_STRING,  {0}, FALSE },
+	{ OPTION_XV_PIPELINE,      "XV_PIPELINE",     OPTV_BOOLEAN, {0}, FALSE },
+	{ OPTION_STATS,            "STATS",           OPTV_BOOLEAN, {0}, FALSE },
 	{ -1,                      NULL,	             OPTV_NONE,    {0}, FALSE }
 };
 
@@ -218,6 +256,135 @@ static void MaliIdentify(int flags)
 	xf86PrintChipsets(MALI_NAME, "driver for Mali Framebuffer", MaliChipsets);
 }
 
+/*
+ * Reconfigure the fbdev virtual area to hold two buffers of the new screen
+ * size and rewrap the framebuffer pixmaps around it. The kernel may move the
+ * framebuffer when it grows, in which case it is mapped again. What was on
+ * screen is carried over to the new layout, the rest gets redrawn by X.
+ * Returns the new pitch, or 0 on failure.
+ */
+static int fbdev_resize_framebuffer( ScrnInfoPtr pScrn, int width, int height )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliHWPtr hwPtr = MALIHWPTR(pScrn);
+	ScreenPtr pScreen = pScrn->pScreen;
+	PixmapPtr pFront = (*pScreen->GetScreenPixmap)(pScreen);
+	PrivPixmap *privFront = (PrivPixmap *)exaGetPixmapDriverPrivate(pFront);
+	struct fb_var_screeninfo old_var = fPtr->fb_lcd_var;
+	struct fb_fix_screeninfo old_fix = fPtr->fb_lcd_fix;
+	int cpp = pScrn->bitsPerPixel / 8;
+	int old_pitch = pFront->devKind;
+	int rows = min( height, pScrn->virtualY );
+	int row_bytes = min( width, pScrn->virtualX ) * cpp;
+	unsigned char *saved;
+	Bool remapped = FALSE, rewrapped = FALSE;
+	int pitch;
+
+	saved = malloc( rows * row_bytes );
+	if ( NULL == saved )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate %d bytes\n", __FUNCTION__, __LINE__, rows * row_bytes );
+		return 0;
+	}
+
+	mali_blit_copy( MALI_BLIT_MEMORY_CACHED, saved, row_bytes, fPtr->fbmem + privFront->priv->mem_info->offset, old_pitch, row_bytes, rows );
+
+	fPtr->fb_lcd_var.xres_virtual = max( width, (int)old_var.xres );
+	fPtr->fb_lcd_var.yres_virtual = 2 * max( height, (int)old_var.yres );
+	fPtr->fb_lcd_var.xoffset = 0;
+	fPtr->fb_lcd_var.yoffset = 0;
+
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPUT_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 ||
+	     ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 ||
+	     ioctl( fPtr->fb_lcd_fd, FBIOGET_FSCREENINFO, &fPtr->fb_lcd_fix ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to resize the framebuffer to %dx%d: %s\n",
+		            __FUNCTION__, __LINE__, width, height, strerror( errno ) );
+		goto fail;
+	}
+
+	pitch = fPtr->fb_lcd_fix.line_length ? (int)fPtr->fb_lcd_fix.line_length : (int)fPtr->fb_lcd_var.xres_virtual * cpp;
+
+	if ( fPtr->fb_lcd_fix.smem_len < (unsigned int)( 2 * pitch * height ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] framebuffer too small for two %dx%d buffers\n", __FUNCTION__, __LINE__, width, height );
+		goto fail;
+	}
+
+	if ( fPtr->fb_lcd_fix.smem_start != old_fix.smem_start || fPtr->fb_lcd_fix.smem_len != old_fix.smem_len )
+	{
+		hwPtr->fix = fPtr->fb_lcd_fix;
+		MaliHWUnmapVidmem( pScrn );
+		remapped = TRUE;
+		fPtr->fbmem = MaliHWMapVidmem( pScrn );
+		if ( NULL == fPtr->fbmem )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to map the resized framebuffer\n", __FUNCTION__, __LINE__ );
+			goto fail;
+		}
+
+		fPtr->fboff = MaliHWLinearOffset( pScrn );
+		fPtr->fbstart = fPtr->fbmem + fPtr->fboff;
+	}
+	hwPtr->var = fPtr->fb_lcd_var;
+
+	rewrapped = TRUE;
+	if ( !maliResizeFramebuffer( pScreen, width, height, pitch, fPtr->fbmem ) ) goto fail;
+
+	mali_blit_copy( MALI_BLIT_MEMORY_FRAMEBUFFER, fPtr->fbmem + privFront->priv->mem_info->offset, pitch, saved, row_bytes, row_bytes, rows );
+	free( saved );
+
+	/* Keep showing whichever half the screen pixmap lives in */
+	fPtr->fb_lcd_var.yoffset = privFront->priv->mem_info->offset / pitch;
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPAN_DISPLAY, &fPtr->fb_lcd_var ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPAN_DISPLAY\n", __FUNCTION__, __LINE__ );
+	}
+
+	MaliDRI2InvalidateFramebuffer( pScreen );
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Framebuffer resized to %dx%d, virtual %dx%d, pitch %d\n",
+	            width, height, fPtr->fb_lcd_var.xres_virtual, fPtr->fb_lcd_var.yres_virtual, pitch );
+
+	return pitch;
+
+fail:
+	free( saved );
+
+	/* Back to the old geometry, and to a mapping of the memory that goes with it */
+	fPtr->fb_lcd_var = old_var;
+	fPtr->fb_lcd_fix = old_fix;
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPUT_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 ||
+	     ioctl( fPtr->fb_lcd_fd, FBIOGET_FSCREENINFO, &fPtr->fb_lcd_fix ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to restore the framebuffer: %s\n", __FUNCTION__, __LINE__, strerror( errno ) );
+	}
+	hwPtr->var = fPtr->fb_lcd_var;
+	hwPtr->fix = fPtr->fb_lcd_fix;
+
+	if ( remapped )
+	{
+		MaliHWUnmapVidmem( pScrn );
+		fPtr->fbmem = MaliHWMapVidmem( pScrn );
+		if ( NULL == fPtr->fbmem )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to map the framebuffer again\n", __FUNCTION__, __LINE__ );
+			return 0;
+		}
+
+		fPtr->fboff = MaliHWLinearOffset( pScrn );
+		fPtr->fbstart = fPtr->fbmem + fPtr->fboff;
+	}
+
+	/* The pixmaps may have been rewrapped in part */
+	if ( rewrapped && !maliResizeFramebuffer( pScreen, pScrn->virtualX, pScrn->virtualY, old_pitch, fPtr->fbmem ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to restore the framebuffer pixmaps\n", __FUNCTION__, __LINE__ );
+	}
+
+	return 0;
+}
+
 static Bool fbdev_crtc_config_resize( ScrnInfoPtr pScrn, int width, int height )
 {
 	MaliPtr fPtr = MALIPTR(pScrn);
@@ -227,21 +394,27 @@ static Bool fbdev_crtc_config_resize( ScrnInfoPtr pScrn, int width, int height )
 	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "%s: width = %d height = %d\n", __FUNCTION__, width, height);
 
 	/* we currently need EXA for this to work */
-	if( fPtr->exa == NULL ) return TRUE;
+	if( fPtr->exa == NULL && fPtr->shadow == NULL ) return TRUE;
 
-	/* calculate new pitch, align to any HW requirements if needed */
-	pitch = width * (pScrn->bitsPerPixel/8);
+	if ( width == pScrn->virtualX && height == pScrn->virtualY ) return TRUE;
 
-	pScrn->virtualX = width;
-	pScrn->virtualY = height;
+	/* The screen's memory is about to move, an Xv frame may still be going into it */
+	MaliVideoSync( xf86ScrnToScreen(pScrn) );
 
-	/* update pitch setting in EXA */
-	PixmapPtr frontPixmap = (*pScrn->pScreen->GetScreenPixmap)(pScrn->pScreen);
-	PixmapPtr backPixmap  = ((PrivPixmap *)exaGetPixmapDriverPrivate(frontPixmap))->priv->other_buffer;
+	if ( fPtr->shadow )
+	{
+		if ( !MaliShadowResize( pScrn, width, height ) ) return FALSE;
 
-	backPixmap->devKind = frontPixmap->devKind = pitch;
-	backPixmap->drawable.width = frontPixmap->drawable.width = width;
-	backPixmap->drawable.height = frontPixmap->drawable.width = height;
+		pitch = width * (pScrn->bitsPerPixel/8);
+	}
+	else
+	{
+		pitch = fbdev_resize_framebuffer( pScrn, width, height );
+		if ( pitch <= 0 ) return FALSE;
+	}
+
+	pScrn->virtualX = width;
+	pScrn->virtualY = height;
 
 	pScrn->displayWidth = pitch / (pScrn->bitsPerPixel/8);
 
@@ -261,6 +434,8 @@ static Bool fbdev_crtc_config_resize( ScrnInfoPtr pScrn, int width, int height )
 static void mali_check_dri_options( ScrnInfoPtr pScrn )
 {
 	MaliPtr fPtr = MALIPTR(pScrn);
+	const char *vsync;
+	Bool wait_vsync;
 
 	fPtr->dri_render = DRI_NONE;
 
@@ -280,16 +455,38 @@ static void mali_check_dri_options( ScrnInfoPtr pScrn )
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip disabled. No support in config file\n");
 	}
 
-	if ( xf86ReturnOptValBool(fPtr->Options, OPTION_DRI2_WAIT_VSYNC, FALSE ) )
+	/* Either a boolean or "adaptive", which only syncs frames that are not already late. The option on its own,
+	 * as older configs have it, is an empty string and means true to xf86getBoolValue. */
+	vsync = xf86GetOptValString(fPtr->Options, OPTION_DRI2_WAIT_VSYNC);
+	if ( vsync && 0 == xf86NameCmp( vsync, "adaptive" ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip VSYNC'd unless the frame is late\n");
+		fPtr->use_pageflipping_vsync = TRUE;
+		fPtr->use_pageflipping_vsync_adaptive = TRUE;
+	}
+	else if ( vsync && xf86getBoolValue( &wait_vsync, vsync ) && wait_vsync )
 	{
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip VSYNC'd\n");
 		fPtr->use_pageflipping_vsync = TRUE;
 	}
 	else
 	{
+		if ( vsync && !xf86getBoolValue( &wait_vsync, vsync ) )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "Invalid DRI2_WAIT_VSYNC value \"%s\"\n", vsync );
+		}
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip VSYNC disabled\n");
 	}
 
+	fPtr->swap_limit = 0;
+	if ( xf86GetOptValInteger(fPtr->Options, OPTION_DRI2_SWAP_LIMIT, &fPtr->swap_limit ) )
+	{
+		if ( fPtr->swap_limit < 0 ) fPtr->swap_limit = 0;
+
+		if ( fPtr->swap_limit > 0 ) xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI swaps throttled to %d frame(s) in flight per drawable\n", fPtr->swap_limit );
+		else xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI swap throttling disabled\n" );
+	}
+
 	if ( pScrn->depth != 16 && pScrn->depth != 24 )
 	{
 		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI is disabled since display does not run at 16bpp or 24bpp\n" );
@@ -297,13 +494,106 @@ static void mali_check_dri_options( ScrnInfoPtr pScrn )
 	}
 }
 
+static void mali_check_cpu_kernels( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	const char *isa = xf86GetOptValString( fPtr->Options, OPTION_CPU_KERNELS );
+	const char *used;
+
+	if ( NULL != isa && 0 == xf86NameCmp( isa, "auto" ) ) isa = NULL;
+
+	used = mali_blit_init( isa );
+	if ( NULL == used )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "CPU_KERNELS \"%s\" is not available on this CPU\n", isa );
+		isa = NULL;
+		used = mali_blit_init( NULL );
+	}
+
+	xf86DrvMsg( pScrn->scrnIndex, isa ? X_CONFIG : X_PROBED, "Using %s pixel kernels\n", used );
+}
+
+/* "auto", or a copy kernel optionally followed by the prefetch distance, as in "simd:256" */
+static void mali_check_copy_option( ScrnInfoPtr pScrn, int option, const char *name, struct mali_blit_copy_strategy *strategy )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	const char *value = xf86GetOptValString( fPtr->Options, option );
+	char kernel[16];
+	char *end;
+	size_t len;
+
+	strategy->kernel = MALI_BLIT_COPY_AUTO;
+	strategy->prefetch = 256;
+	if ( NULL == value ) return;
+
+	len = strcspn( value, ":" );
+	if ( len < sizeof(kernel) )
+	{
+		memcpy( kernel, value, len );
+		kernel[len] = '\0';
+
+		if ( mali_blit_copy_kernel_lookup( kernel, &strategy->kernel ) )
+		{
+			if ( ':' != value[len] ) return;
+
+			strategy->prefetch = strtol( value + len + 1, &end, 10 );
+			if ( '\0' == *end && strategy->prefetch >= 0 ) return;
+		}
+	}
+
+	xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "Invalid %s value \"%s\", probing instead\n", name, value );
+	strategy->kernel = MALI_BLIT_COPY_AUTO;
+}
+
 static void mali_check_exa_options( ScrnInfoPtr pScrn )
 {
 	MaliPtr fPtr = MALIPTR(pScrn);
+	int m;
 
-	IGNORE(fPtr);
+	mali_check_copy_option( pScrn, OPTION_FB_COPY, "FB_COPY", &fPtr->copy_strategy[MALI_BLIT_MEMORY_FRAMEBUFFER] );
+	mali_check_copy_option( pScrn, OPTION_CACHED_COPY, "CACHED_COPY", &fPtr->copy_strategy[MALI_BLIT_MEMORY_CACHED] );
 
-	/* EXA specific options checked here */
+	for ( m = 0; m < MALI_BLIT_MEMORY_TYPES; m++ )
+	{
+		if ( MALI_BLIT_COPY_AUTO == fPtr->copy_strategy[m].kernel || mali_blit_copy_kernel_available( fPtr->copy_strategy[m].kernel ) ) continue;
+
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "%s copy kernel not available on this CPU, probing instead\n", mali_blit_copy_kernel_name( fPtr->copy_strategy[m].kernel ) );
+		fPtr->copy_strategy[m].kernel = MALI_BLIT_COPY_AUTO;
+	}
+}
+
+static void mali_check_shadow_options( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	fPtr->use_shadow_fb = xf86ReturnOptValBool(fPtr->Options, OPTION_SHADOW_FB, FALSE );
+	fPtr->use_shadow_vsync = xf86ReturnOptValBool(fPtr->Options, OPTION_SHADOW_VSYNC, FALSE );
+
+	fPtr->use_tear_free = xf86ReturnOptValBool(fPtr->Options, OPTION_TEAR_FREE, FALSE );
+
+	/* Damage can only be held back until vblank, or converted, if X isn't drawing to the scanout directly */
+	if ( fPtr->use_shadow_vsync || fPtr->use_tear_free || fPtr->shadow_convert ) fPtr->use_shadow_fb = TRUE;
+
+	if ( !fPtr->use_shadow_fb ) return;
+
+	xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Rendering to a cached shadow framebuffer\n");
+	if ( fPtr->shadow_convert )
+	{
+		fPtr->shadow_dither = xf86ReturnOptValBool(fPtr->Options, OPTION_SHADOW_DITHER, FALSE );
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Depth 24 screen converted to the r5g6b5 framebuffer%s\n", fPtr->shadow_dither ? " with ordered dithering" : "" );
+	}
+	if ( fPtr->use_tear_free ) xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "TearFree: shadow framebuffer flipped between the two fbdev halves\n");
+	else if ( fPtr->use_shadow_vsync ) xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Shadow framebuffer flushed once per refresh, ahead of vblank\n");
+
+	fPtr->use_shadow_cursor = xf86ReturnOptValBool(fPtr->Options, OPTION_SHADOW_CURSOR, TRUE );
+	if ( fPtr->use_shadow_cursor ) xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Cursor blended in when the shadow framebuffer is flushed\n");
+
+	/* A flip would put a buffer on screen that the shadow knows nothing about */
+	if ( fPtr->use_pageflipping )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "DRI Fullscreen page flip disabled by the shadow framebuffer\n");
+		fPtr->use_pageflipping = FALSE;
+	}
 }
 
 static const xf86CrtcConfigFuncsRec fbdev_crtc_config_funcs =
@@ -473,7 +763,8 @@ Bool MaliHWModeInit(ScrnInfoPtr pScrn, DisplayModePtr mode)
 		return FALSE;
 	}
 
-	if (pScrn->defaultVisual == TrueColor || pScrn->defaultVisual == DirectColor)
+	/* When converting from a shadow the screen keeps its own pixel layout */
+	if ((pScrn->defaultVisual == TrueColor || pScrn->defaultVisual == DirectColor) && pScrn->bitsPerPixel == fPtr->var.bits_per_pixel)
 	{
 		pScrn->offset.red   = fPtr->var.red.offset;
 		pScrn->offset.green = fPtr->var.green.offset;
@@ -766,6 +1057,16 @@ int MaliHWGetDepth( ScrnInfoPtr pScrn, int *fbbpp )
 	return fPtr->var.bits_per_pixel;
 }
 
+static Bool MaliHWIsRGB565( ScrnInfoPtr pScrn )
+{
+	MaliHWPtr fPtr = MALIHWPTR( pScrn );
+
+	return 16 == fPtr->var.bits_per_pixel &&
+	       11 == fPtr->var.red.offset && 5 == fPtr->var.red.length &&
+	       5 == fPtr->var.green.offset && 6 == fPtr->var.green.length &&
+	       0 == fPtr->var.blue.offset && 5 == fPtr->var.blue.length;
+}
+
 int MaliHWGetVidmem( ScrnInfoPtr pScrn )
 {
 	MaliHWPtr fPtr = MALIHWPTR( pScrn );
@@ -923,11 +1224,32 @@ static Bool MaliPreInit(ScrnInfoPtr pScrn, int flags)
 	fPtr->dri_render = DRI_NONE;
 	fPtr->use_pageflipping = FALSE;
 	fPtr->use_pageflipping_vsync = FALSE;
+	fPtr->use_pageflipping_vsync_adaptive = FALSE;
+	fPtr->flip_ust = 0;
+	fPtr->flips_synced = 0;
+	fPtr->flips_late = 0;
 
 	/* open device */
 	if ( !MaliHWInit( pScrn, xf86FindOptionValue( fPtr->pEnt->device->options,"fbdev" ) ) ) return FALSE;
 
 	default_depth = MaliHWGetDepth(pScrn,&fbbpp);
+
+	/* A depth 24 screen asked for on an RGB565 panel is rendered into a 32bpp shadow and converted at flush time */
+	fPtr->shadow_convert = FALSE;
+	if ( 16 == fbbpp && 24 == pScrn->confScreen->defaultdepth )
+	{
+		if ( MaliHWIsRGB565( pScrn ) )
+		{
+			fPtr->shadow_convert = TRUE;
+			default_depth = 24;
+			fbbpp = 32;
+		}
+		else
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "Depth 24 needs an r5g6b5 framebuffer to convert to\n" );
+		}
+	}
+
 	if (!xf86SetDepthBpp(pScrn, default_depth, default_depth, fbbpp, Support24bppFb | Support32bppFb | SupportConvert32to24 | SupportConvert24to32)) return FALSE;
 	xf86PrintDepthBpp(pScrn);
 
@@ -984,7 +1306,9 @@ static Bool MaliPreInit(ScrnInfoPtr pScrn, int flags)
 	}
 
 	mali_check_dri_options( pScrn );
+	mali_check_cpu_kernels( pScrn );
 	mali_check_exa_options( pScrn );
+	mali_check_shadow_options( pScrn );
 
 	fPtr->fb_lcd_fd = MaliHWGetFD( pScrn );
 
@@ -1056,8 +1380,10 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	MaliPtr fPtr = MALIPTR(pScrn);
 	VisualPtr visual;
+	unsigned char *fbstart;
 	int init_picture = 0;
 	int ret, flags;
+	Bool rotation;
 
 	TRACE_ENTER();
 	IGNORE(argc);
@@ -1072,6 +1398,24 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 	       pScrn->offset.red,pScrn->offset.green,pScrn->offset.blue);
 #endif
 
+	if ( !xf86ReturnOptValBool(fPtr->Options, OPTION_STATS, TRUE ) )
+	{
+		xf86DrvMsg(pScrn->scrnIndex, X_CONFIG, "Driver statistics disabled\n");
+	}
+	else if ( !MaliStatsInit( pScrn ) )
+	{
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "driver statistics unavailable\n");
+	}
+
+	MaliTraceInit( pScrn );
+	MaliCaptureInit( pScrn, xf86GetOptValString( fPtr->Options, OPTION_EXA_CAPTURE ) );
+
+	if ( !MaliVSyncInit( pScreen ) )
+	{
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "vblank events unavailable, DRI2 swap throttling disabled\n");
+		fPtr->swap_limit = 0;
+	}
+
 	if ( fPtr->dri_render == DRI_NONE )
 	{
 		if ( TRUE == MaliDRI2ScreenInit( pScreen ) )
@@ -1125,8 +1469,21 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 
 
 	fPtr->fbstart = fPtr->fbmem + fPtr->fboff;
+	fbstart = fPtr->fbstart;
+
+	if ( fPtr->use_shadow_fb )
+	{
+		fbstart = MaliShadowAllocate( pScrn );
+		if ( NULL == fbstart )
+		{
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "Shadow framebuffer unavailable, rendering directly to the framebuffer\n");
+			fPtr->use_shadow_fb = FALSE;
+			fPtr->use_shadow_cursor = FALSE;
+			fbstart = fPtr->fbstart;
+		}
+	}
 
-	ret = fbScreenInit(pScreen, fPtr->fbstart, pScrn->virtualX,
+	ret = fbScreenInit(pScreen, fbstart, pScrn->virtualX,
 				pScrn->virtualY, pScrn->xDpi,
 				pScrn->yDpi, pScrn->displayWidth,
 				pScrn->bitsPerPixel);
@@ -1158,6 +1515,8 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 	xf86LoadSubModule(pScrn, "exa");
 	fPtr->exa = exaDriverAlloc();
 
+	MaliTuneCopy( pScrn, fPtr->fbmem );
+
 	if ( maliSetupExa( pScreen, fPtr->exa, pScrn->virtualX, pScrn->virtualY, fPtr->fbmem ) )
 	{
 		xf86DrvMsg(pScrn->scrnIndex, X_WARNING, "Initializing EXA Driver!\n");
@@ -1170,6 +1529,21 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 		fPtr->exa = NULL;
 	}
 
+	if ( fPtr->use_shadow_fb && !MaliShadowScreenInit( pScreen ) )
+	{
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR, "Shadow framebuffer initialization failed\n");
+		return FALSE;
+	}
+
+	if ( fPtr->dri_render == DRI_2 && fPtr->use_pageflipping && fPtr->exa != NULL )
+	{
+		if ( !MaliDRI2ScreenInitWindows( pScreen ) )
+		{
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR, "Failed to set up window tracking, disabling page flipping\n");
+			fPtr->use_pageflipping = FALSE;
+		}
+	}
+
 	miInitializeBackingStore(pScreen);
 	xf86SetBackingStore(pScreen);
 	xf86SetSilkenMouse(pScreen);
@@ -1177,6 +1551,15 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 	/* software cursor */
 	miDCInitialize(pScreen, xf86GetPointerScreenFuncs());
 
+	/* The shadow can stand in for a cursor plane, sparing the sprite code's save-unders */
+	if ( fPtr->use_shadow_cursor && !MaliCursorInit( pScreen ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "Falling back to the software cursor\n" );
+		fPtr->use_shadow_cursor = FALSE;
+	}
+
+	rotation = fPtr->use_shadow_fb && FBDEV_lcd_init_rotation( pScrn );
+
 	xf86SetDesiredModes(pScrn);
 
 	if ( !xf86CrtcScreenInit(pScreen) )
@@ -1185,6 +1568,17 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 		return FALSE;
 	}
 
+	if ( rotation )
+	{
+		xf86RandR12SetRotations( pScreen, RR_Rotate_0 | RR_Rotate_90 | RR_Rotate_180 | RR_Rotate_270 );
+#ifdef RANDR_13_INTERFACE
+		xf86RandR12SetTransformSupport( pScreen, TRUE );
+		xf86DrvMsg( pScrn->scrnIndex, X_INFO, "RandR rotation and transforms enabled through the shadow framebuffer\n" );
+#else
+		xf86DrvMsg( pScrn->scrnIndex, X_INFO, "RandR rotation enabled through the shadow framebuffer\n" );
+#endif
+	}
+
 	if (!miCreateDefColormap(pScreen))
 	{
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,"internal error: miCreateDefColormap failed in FBDevScreenInit()\n");
@@ -1204,10 +1598,27 @@ static Bool MaliScreenInit(SCREEN_INIT_ARGS_DECL)
 	pScreen->CloseScreen = MaliCloseScreen;
 
 	{
-		XF86VideoAdaptorPtr *ptr;
+		XF86VideoAdaptorPtr *ptr, *adaptors;
+		XF86VideoAdaptorPtr video;
+
+		fPtr->use_xv_pipeline = xf86ReturnOptValBool(fPtr->Options, OPTION_XV_PIPELINE, FALSE );
+		if ( fPtr->use_xv_pipeline ) xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Xv frames copied aside and converted while the server carries on\n");
+
+		video = MaliVideoSetupAdaptor(pScreen);
 
 		int n = xf86XVListGenericAdaptors(pScrn,&ptr);
+
+		/* Our own adaptor goes after any generic ones */
+		adaptors = malloc( (n + 1) * sizeof(*adaptors) );
+		if ( adaptors )
+		{
+			if (n) memcpy( adaptors, ptr, n * sizeof(*adaptors) );
+			if ( video ) adaptors[n++] = video;
+			ptr = adaptors;
+		}
+
 		if (n) xf86XVScreenInit(pScreen,ptr,n);
+		free( adaptors );
 	}
 
 #if UMP_LOCK_ENABLED
@@ -1233,6 +1644,13 @@ static Bool MaliCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 
 	TRACE_ENTER();
 
+	/* First, its threads may still be writing to the shadow */
+	MaliVideoCloseScreen(pScreen);
+
+	MaliVSyncClose(pScreen);
+
+	MaliShadowCloseScreen(pScreen);
+
 	MaliHWRestore(pScrn);
 	MaliHWUnmapVidmem(pScrn);
 	pScrn->vtSema = FALSE;
@@ -1241,6 +1659,9 @@ static Bool MaliCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 	pScreen->CloseScreen = fPtr->CloseScreen;
 	(*pScreen->CloseScreen)(CLOSE_SCREEN_ARGS);
 
+	/* The cursor code hides the cursor on its way out */
+	MaliCursorCloseScreen(pScreen);
+
 	if ( fPtr->dri_open && fPtr->dri_render == DRI_2 )
 	{
 		fPtr->dri_open = FALSE;
@@ -1255,6 +1676,11 @@ static Bool MaliCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 	}
 #endif /* UMP_LOCK_ENABLED */
 
+	/* Last, everything above may still count */
+	MaliCaptureClose(pScrn);
+	MaliTraceClose(pScrn);
+	MaliStatsClose(pScrn);
+
 	return TRUE;
 }
 
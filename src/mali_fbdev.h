@@ -25,6 +25,7 @@
 
 #include <linux/fb.h>
 #include "mali_def.h"
+#include "mali_blit.h"
 
 #include "xf86.h"
 #include "exa.h"
@@ -49,6 +50,36 @@ typedef struct {
 	char deviceName[64];
 	Bool use_pageflipping;
 	Bool use_pageflipping_vsync;
+	Bool use_pageflipping_vsync_adaptive;
+	CARD64 flip_ust;
+	unsigned long flips_synced;
+	unsigned long flips_late;
+	CreateWindowProcPtr    CreateWindow;
+	DestroyWindowProcPtr   DestroyWindow;
+	SetWindowPixmapProcPtr SetWindowPixmap;
+	WindowPtr *fb_windows;
+	int        num_fb_windows;
+	int        size_fb_windows;
+	Bool       fb_windows_lost;
+	int  swap_limit;
+	struct mali_vsync *vsync;
+	struct _MaliDRI2Swap *swaps;
+	Bool use_shadow_fb;
+	Bool use_shadow_vsync;
+	Bool use_tear_free;
+	Bool shadow_convert;
+	Bool shadow_dither;
+	struct mali_shadow *shadow;
+	Bool use_shadow_cursor;
+	struct mali_cursor *cursor;
+	struct mali_stats *stats;
+	char *stats_path;
+	struct mali_trace_state *trace;
+	struct mali_capture *capture;
+	struct mali_blit_copy_strategy copy_strategy[MALI_BLIT_MEMORY_TYPES];
+	ScreenBlockHandlerProcPtr BlockHandler;
+	struct mali_video *video;
+	Bool use_xv_pipeline;
 #if UMP_LOCK_ENABLED
 	int fd_umplock;
 #endif
@@ -32,6 +32,7 @@
 #include "mali_def.h"
 #include "mali_fbdev.h"
 #include "mali_lcd.h"
+#include "mali_shadow.h"
 
 static void fbdev_lcd_crtc_dpms(xf86CrtcPtr crtc, int mode)
 {
@@ -67,11 +68,11 @@ static void fbdev_lcd_crtc_prepare(xf86CrtcPtr crtc)
 
 static void fbdev_lcd_crtc_mode_set(xf86CrtcPtr crtc, DisplayModePtr mode, DisplayModePtr adjusted_mode, int x, int y)
 {
-	IGNORE( crtc );
 	IGNORE( mode );
 	IGNORE( adjusted_mode );
-	IGNORE( x );
-	IGNORE( y );
+
+	/* Only the shadow can scan out a rotated or panned part of the screen */
+	MaliShadowSetCrtc( crtc, x, y );
 }
 
 static void fbdev_lcd_crtc_commit(xf86CrtcPtr crtc)
@@ -90,9 +91,7 @@ static void fbdev_lcd_crtc_gamma_set(xf86CrtcPtr crtc, CARD16 *red, CARD16 *gree
 
 static void fbdev_lcd_crtc_set_origin(xf86CrtcPtr crtc, int x, int y)
 {
-	IGNORE( crtc );
-	IGNORE( x );
-	IGNORE( y );
+	MaliShadowSetCrtc( crtc, x, y );
 }
 
 static const xf86CrtcFuncsRec fbdev_lcd_crtc_funcs = 
@@ -192,6 +191,10 @@ static void fbdev_lcd_output_mode_set(xf86OutputPtr output, DisplayModePtr mode,
 	fPtr->fb_lcd_var.yres = mode->VDisplay;
 	fPtr->fb_lcd_var.xres_virtual = mode->HDisplay;
 	fPtr->fb_lcd_var.yres_virtual = mode->VDisplay*2;
+
+	/* Without a shadow the framebuffer holds two buffers of the whole screen, which may be larger than the mode */
+	if ( !fPtr->use_shadow_fb && output->scrn->virtualX > mode->HDisplay ) fPtr->fb_lcd_var.xres_virtual = output->scrn->virtualX;
+	if ( !fPtr->use_shadow_fb && output->scrn->virtualY > mode->VDisplay ) fPtr->fb_lcd_var.yres_virtual = output->scrn->virtualY*2;
 	xf86DrvMsg(0, X_INFO, "Changing mode to %i %i %i %i\n", fPtr->fb_lcd_var.xres, fPtr->fb_lcd_var.yres, fPtr->fb_lcd_var.xres_virtual, fPtr->fb_lcd_var.yres_virtual);
 
 	if ( ioctl( fPtr->fb_lcd_fd, FBIOPUT_VSCREENINFO, &fPtr->fb_lcd_var ) < 0 )
@@ -342,6 +345,29 @@ static const xf86OutputFuncsRec fbdev_lcd_output_funcs =
 };
 
 
+/*
+ * With a shadow framebuffer the flush rotates the damage into the panel, so
+ * the server is told not to set up its own render based rotation.
+ */
+Bool FBDEV_lcd_init_rotation(ScrnInfoPtr pScrn)
+{
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,8,0,0,0)
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int i;
+
+	for ( i = 0; i < xf86_config->num_crtc; i++ )
+	{
+		xf86_config->crtc[i]->driverIsPerformingTransform = TRUE;
+	}
+
+	return TRUE;
+#else
+	IGNORE( pScrn );
+
+	return FALSE;
+#endif
+}
+
 Bool FBDEV_lcd_init(ScrnInfoPtr pScrn)
 {
 	xf86CrtcPtr crtc;
@@ -29,6 +29,7 @@
 #define DPMSModeOff	       3
 
 extern Bool FBDEV_lcd_init(ScrnInfoPtr pScrn);
+extern Bool FBDEV_lcd_init_rotation(ScrnInfoPtr pScrn);
 
 #endif /* _MALI_LCD_H_ */
 
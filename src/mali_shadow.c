@@ -0,0 +1,787 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include "xf86.h"
+#include "damage.h"
+#include "picturestr.h"
+#include "compat-api.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_exa.h"
+#include "mali_blit.h"
+#include "mali_shadow.h"
+#include "mali_vsync.h"
+#include "mali_video.h"
+#include "mali_cursor.h"
+#include "mali_stats.h"
+
+/* How long before the predicted vblank the copy is started */
+#define MALI_SHADOW_FLUSH_MARGIN_US 3000
+
+/* Older vblank timestamps are not trusted to predict the next one */
+#define MALI_SHADOW_VBLANK_STALE_US 1000000
+
+struct mali_shadow
+{
+	mali_mem_info mem;
+	unsigned char *virt;
+	int pitch;
+	DamagePtr damage;
+	OsTimerPtr timer;
+	Bool timer_armed;
+	Bool waiting_vblank;
+	RegionRec prev_damage;
+	unsigned int front_yoffset;
+	Bool full_copy;
+	Bool flip_pending;
+	int rotation;
+	int crtc_x;
+	int crtc_y;
+	Bool transformed;
+	Bool bilinear;
+	struct pixman_f_transform to_screen;
+	struct pixman_f_transform to_panel;
+	BoxRec bounds;
+	uint32_t *row;
+	int row_size;
+	Bool video_waiting;
+	Bool video_late;
+};
+
+static ump_handle shadow_alloc_ump( ScrnInfoPtr pScrn, unsigned long size )
+{
+	ump_handle handle = ump_ref_drv_allocate( size, UMP_REF_DRV_CONSTRAINT_USE_CACHE );
+
+	if ( UMP_INVALID_MEMORY_HANDLE == handle )
+	{
+		MALI_STATS_INC( pScrn, UMP_ALLOC_FAILED );
+		return handle;
+	}
+
+	MALI_STATS_INC( pScrn, UMP_ALLOC );
+	MALI_STATS_ADD( pScrn, UMP_ALLOC_BYTES, size );
+
+	return handle;
+}
+
+/* Some fbdev drivers pad their lines, so the pitch comes from the driver whenever it says */
+static int shadow_fb_pitch( MaliPtr fPtr )
+{
+	if ( fPtr->fb_lcd_fix.line_length ) return fPtr->fb_lcd_fix.line_length;
+
+	return fPtr->fb_lcd_var.xres_virtual * fPtr->fb_lcd_var.bits_per_pixel / 8;
+}
+
+static void shadow_release_ump( ScrnInfoPtr pScrn, mali_mem_info *mem )
+{
+	MALI_STATS_INC( pScrn, UMP_FREE );
+	MALI_STATS_ADD( pScrn, UMP_FREE_BYTES, mem->usize );
+
+	ump_reference_release( mem->handle );
+}
+
+void *MaliShadowAllocate( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow;
+
+	shadow = calloc( 1, sizeof(*shadow) );
+	if ( NULL == shadow ) return NULL;
+
+	shadow->pitch = pScrn->displayWidth * pScrn->bitsPerPixel / 8;
+	shadow->mem.usize = shadow->pitch * pScrn->virtualY;
+	shadow->mem.offset = 0;
+
+	/* UMP rather than malloc so that the screen pixmap can still be handed to DRI2 clients as a front buffer */
+	shadow->mem.handle = shadow_alloc_ump( pScrn, shadow->mem.usize );
+	if ( UMP_INVALID_MEMORY_HANDLE == shadow->mem.handle )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate UMP memory (%lu bytes)\n", __FUNCTION__, __LINE__, shadow->mem.usize );
+		free( shadow );
+		return NULL;
+	}
+
+	shadow->virt = ump_mapped_pointer_get( shadow->mem.handle );
+	if ( NULL == shadow->virt )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to map shadow framebuffer\n", __FUNCTION__, __LINE__ );
+		shadow_release_ump( pScrn, &shadow->mem );
+		free( shadow );
+		return NULL;
+	}
+
+	fPtr->shadow = shadow;
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Shadow framebuffer: %dx%d, pitch %d\n", pScrn->virtualX, pScrn->virtualY, shadow->pitch );
+
+	return shadow->virt;
+}
+
+mali_mem_info *MaliShadowGetMemInfo( ScrnInfoPtr pScrn, pointer pPixData )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( NULL == fPtr->shadow || NULL == pPixData || pPixData != (pointer)fPtr->shadow->virt ) return NULL;
+
+	return &fPtr->shadow->mem;
+}
+
+/* The part of the screen that the crtc scans out */
+static void shadow_crtc_box( MaliPtr fPtr, BoxPtr box )
+{
+	struct mali_shadow *shadow = fPtr->shadow;
+	Bool swap = ( 90 == shadow->rotation || 270 == shadow->rotation );
+
+	if ( shadow->transformed )
+	{
+		*box = shadow->bounds;
+		return;
+	}
+
+	box->x1 = shadow->crtc_x;
+	box->y1 = shadow->crtc_y;
+	box->x2 = box->x1 + ( swap ? fPtr->fb_lcd_var.yres : fPtr->fb_lcd_var.xres );
+	box->y2 = box->y1 + ( swap ? fPtr->fb_lcd_var.xres : fPtr->fb_lcd_var.yres );
+}
+
+/*
+ * A RandR transform is applied by resampling: the panel area each damaged box
+ * maps to is walked row by row, every row is sampled from the screen into a
+ * cached line and then written out sequentially. Affine transforms step along
+ * the row in fixed point, projective ones are evaluated per pixel.
+ */
+static void shadow_copy_transformed( ScrnInfoPtr pScrn, RegionPtr region, unsigned char *fb )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	struct pixman_f_transform *t = &shadow->to_screen;
+	BoxPtr box = REGION_RECTS( region );
+	int nbox = REGION_NUM_RECTS( region );
+	int cpp = pScrn->bitsPerPixel / 8;
+	int fb_cpp = fPtr->fb_lcd_var.bits_per_pixel / 8;
+	int fb_pitch = shadow_fb_pitch( fPtr );
+	Bool affine = ( 0 == t->m[2][0] && 0 == t->m[2][1] );
+	Bool bilinear = shadow->bilinear && 4 == cpp;
+	int32_t dx = t->m[0][0] * 65536, dy = t->m[1][0] * 65536;
+
+	for ( ; nbox--; box++ )
+	{
+		struct pixman_box16 b;
+		int v, n;
+
+		/* Bilinear taps reach one pixel beyond the box */
+		b.x1 = box->x1 - 1;
+		b.y1 = box->y1 - 1;
+		b.x2 = box->x2 + 1;
+		b.y2 = box->y2 + 1;
+		if ( !pixman_f_transform_bounds( &shadow->to_panel, &b ) ) continue;
+
+		b.x1 = max( b.x1, 0 );
+		b.y1 = max( b.y1, 0 );
+		b.x2 = min( b.x2, min( (int)fPtr->fb_lcd_var.xres, shadow->row_size ) );
+		b.y2 = min( b.y2, (int)fPtr->fb_lcd_var.yres );
+		if ( b.x1 >= b.x2 || b.y1 >= b.y2 ) continue;
+
+		n = b.x2 - b.x1;
+
+		for ( v = b.y1; v < b.y2; v++ )
+		{
+			unsigned char *dst = fb + v * fb_pitch + b.x1 * fb_cpp;
+			int u;
+
+			for ( u = 0; u < n; u += affine ? n : 1 )
+			{
+				struct pixman_f_vector p;
+
+				p.v[0] = b.x1 + u + 0.5;
+				p.v[1] = v + 0.5;
+				p.v[2] = 1;
+				if ( !pixman_f_transform_point( t, &p ) ) continue;
+
+				if ( bilinear )
+				{
+					mali_blit_sample_row_bilinear_8888( shadow->row + u, shadow->virt, shadow->pitch, pScrn->virtualX, pScrn->virtualY,
+					                                    p.v[0] * 65536, p.v[1] * 65536, dx, dy, affine ? n : 1 );
+				}
+				else
+				{
+					mali_blit_sample_row_nearest( (unsigned char *)shadow->row + u * cpp, shadow->virt, shadow->pitch, pScrn->virtualX, pScrn->virtualY,
+					                              p.v[0] * 65536, p.v[1] * 65536, dx, dy, affine ? n : 1, cpp );
+				}
+			}
+
+			if ( fPtr->shadow_convert ) mali_blit_convert_8888_565( dst, fb_pitch, shadow->row, 0, b.x1, v, n, 1, fPtr->shadow_dither );
+			else mali_blit_copy( MALI_BLIT_MEMORY_FRAMEBUFFER, dst, fb_pitch, shadow->row, 0, n * cpp, 1 );
+		}
+	}
+}
+
+static void shadow_copy_boxes( ScrnInfoPtr pScrn, RegionPtr region, unsigned char *fb )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	BoxPtr box = REGION_RECTS( region );
+	int nbox = REGION_NUM_RECTS( region );
+	int cpp = pScrn->bitsPerPixel / 8;
+	int fb_cpp = fPtr->fb_lcd_var.bits_per_pixel / 8;
+	int fb_pitch = shadow_fb_pitch( fPtr );
+	int fb_width = fPtr->fb_lcd_var.xres;
+	int fb_height = fPtr->fb_lcd_var.yres;
+	BoxRec crtc;
+
+	if ( shadow->transformed )
+	{
+		shadow_copy_transformed( pScrn, region, fb );
+		return;
+	}
+
+	shadow_crtc_box( fPtr, &crtc );
+
+	for ( ; nbox--; box++ )
+	{
+		int x1 = max( box->x1, crtc.x1 );
+		int y1 = max( box->y1, crtc.y1 );
+		int x2 = min( box->x2, crtc.x2 );
+		int y2 = min( box->y2, crtc.y2 );
+		unsigned char *src;
+		int dx, dy;
+
+		if ( x1 >= x2 || y1 >= y2 ) continue;
+
+		src = shadow->virt + y1 * shadow->pitch + x1 * cpp;
+
+		/* Top-left corner of the box once rotated onto the panel */
+		switch ( shadow->rotation )
+		{
+		case 90:
+			dx = y1 - crtc.y1;
+			dy = fb_height - ( x2 - crtc.x1 );
+			break;
+		case 180:
+			dx = fb_width - ( x2 - crtc.x1 );
+			dy = fb_height - ( y2 - crtc.y1 );
+			break;
+		case 270:
+			dx = fb_width - ( y2 - crtc.y1 );
+			dy = x1 - crtc.x1;
+			break;
+		default:
+			dx = x1 - crtc.x1;
+			dy = y1 - crtc.y1;
+			break;
+		}
+
+		if ( fPtr->shadow_convert )
+		{
+			mali_blit_rotate_convert_8888_565( fb + dy * fb_pitch + dx * fb_cpp, fb_pitch, src, shadow->pitch,
+			                                   x2 - x1, y2 - y1, shadow->rotation, dx, dy, fPtr->shadow_dither );
+		}
+		else
+		{
+			mali_blit_rotate( fb + dy * fb_pitch + dx * cpp, fb_pitch, src, shadow->pitch,
+			                  x2 - x1, y2 - y1, cpp, shadow->rotation );
+		}
+	}
+}
+
+/* The cursor only exists in what goes out to the framebuffer */
+static void shadow_copy_region( ScrnInfoPtr pScrn, RegionPtr region, unsigned char *fb )
+{
+	struct mali_shadow *shadow = MALIPTR(pScrn)->shadow;
+	Bool cursor = MaliCursorBlend( pScrn, region, shadow->virt, shadow->pitch );
+
+	shadow_copy_boxes( pScrn, region, fb );
+
+	if ( cursor ) MaliCursorUnblend( pScrn, shadow->virt, shadow->pitch );
+}
+
+/*
+ * TearFree: the shadow is copied into the fbdev half that is not being
+ * scanned out and the display is then panned to it. That half also missed the
+ * previous frame's update, so the previous damage is copied again along with
+ * the new. Only one pan is issued per refresh; the next flush waits for the
+ * vblank that latches it.
+ */
+static void shadow_flip_done( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data );
+
+static void shadow_tear_free_flush( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	RegionPtr damage = DamageRegion( shadow->damage );
+	RegionRec region;
+	int fb_pitch = shadow_fb_pitch( fPtr );
+	unsigned int back_yoffset;
+
+	if ( shadow->flip_pending || !REGION_NOTEMPTY( pScreen, damage ) ) return;
+
+	/* Somebody else moved the display, neither half can be trusted to be current */
+	if ( fPtr->fb_lcd_var.yoffset != shadow->front_yoffset ) shadow->full_copy = TRUE;
+
+	back_yoffset = fPtr->fb_lcd_var.yoffset ? 0 : fPtr->fb_lcd_var.yres;
+
+	if ( shadow->full_copy )
+	{
+		BoxRec box;
+
+		shadow_crtc_box( fPtr, &box );
+		REGION_INIT( pScreen, &region, &box, 1 );
+	}
+	else
+	{
+		REGION_NULL( pScreen, &region );
+		REGION_UNION( pScreen, &region, damage, &shadow->prev_damage );
+	}
+
+	shadow_copy_region( pScrn, &region, fPtr->fbstart + back_yoffset * fb_pitch );
+	REGION_UNINIT( pScreen, &region );
+
+	fPtr->fb_lcd_var.yoffset = back_yoffset;
+	if ( ioctl( fPtr->fb_lcd_fd, FBIOPAN_DISPLAY, &fPtr->fb_lcd_var ) == -1 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed in FBIOPAN_DISPLAY, TearFree disabled\n", __FUNCTION__, __LINE__ );
+		ioctl( fPtr->fb_lcd_fd, FBIOGET_VSCREENINFO, &fPtr->fb_lcd_var );
+		fPtr->use_tear_free = FALSE;
+		shadow_copy_region( pScrn, damage, fPtr->fbstart + fPtr->fb_lcd_var.yoffset * fb_pitch );
+		DamageEmpty( shadow->damage );
+		return;
+	}
+
+	shadow->front_yoffset = back_yoffset;
+	shadow->full_copy = FALSE;
+	REGION_COPY( pScreen, &shadow->prev_damage, damage );
+	DamageEmpty( shadow->damage );
+
+	shadow->flip_pending = MaliVSyncQueueEvent( pScrn, shadow_flip_done, NULL );
+}
+
+static void shadow_flip_done( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+
+	IGNORE( msc );
+	IGNORE( ust );
+	IGNORE( data );
+
+	if ( NULL == shadow ) return;
+
+	shadow->flip_pending = FALSE;
+
+	/* Whatever was drawn while the pan was in flight */
+	MaliShadowFlush( pScreen );
+}
+
+static void shadow_video_vblank( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+
+	IGNORE( msc );
+	IGNORE( ust );
+	IGNORE( data );
+
+	if ( NULL == shadow ) return;
+
+	shadow->video_waiting = FALSE;
+	shadow->video_late = TRUE;
+
+	MaliShadowFlush( screenInfo.screens[pScrn->scrnIndex] );
+}
+
+void MaliShadowFlush( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	RegionPtr region;
+	int fb_pitch;
+
+	if ( NULL == shadow || NULL == shadow->damage || !pScrn->vtSema ) return;
+
+	/*
+	 * An Xv frame the threads are still converting would go out half done.
+	 * Rather than stall the server on it, it is presented at the next vblank,
+	 * and only waited for if it is not finished by then.
+	 */
+	if ( !shadow->video_late && MaliVideoBusy( pScreen ) )
+	{
+		if ( !shadow->video_waiting ) shadow->video_waiting = MaliVSyncQueueEvent( pScrn, shadow_video_vblank, NULL );
+		if ( shadow->video_waiting ) return;
+	}
+
+	MaliVideoSync( pScreen );
+	shadow->video_late = FALSE;
+
+	MaliCursorDamage( pScrn, DamageRegion( shadow->damage ) );
+
+	if ( fPtr->use_tear_free )
+	{
+		shadow_tear_free_flush( pScreen );
+		return;
+	}
+
+	region = DamageRegion( shadow->damage );
+	if ( !REGION_NOTEMPTY( pScreen, region ) ) return;
+
+	fb_pitch = shadow_fb_pitch( fPtr );
+	shadow_copy_region( pScrn, region, fPtr->fbstart + fPtr->fb_lcd_var.yoffset * fb_pitch );
+
+	shadow->full_copy = FALSE;
+	DamageEmpty( shadow->damage );
+}
+
+/*
+ * With SHADOW_VSYNC the damage of a whole refresh is collected and copied out
+ * in one go shortly before the vblank, so 2D animations don't tear and a
+ * region drawn several times per frame is only written to the framebuffer
+ * once. The vblank phase comes from the vsync thread; while updates keep
+ * coming every flush asks for the next vblank so that it stays fresh.
+ */
+static void shadow_vblank( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data );
+
+static CARD32 shadow_timer( OsTimerPtr timer, CARD32 now, pointer arg )
+{
+	ScreenPtr pScreen = arg;
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+
+	IGNORE( timer );
+	IGNORE( now );
+
+	shadow->timer_armed = FALSE;
+
+	MaliShadowFlush( pScreen );
+
+	if ( !shadow->waiting_vblank && MaliVSyncQueueEvent( pScrn, shadow_vblank, NULL ) ) shadow->waiting_vblank = TRUE;
+
+	return 0;
+}
+
+static void shadow_schedule_flush( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	CARD64 msc, ust, now, period, target;
+
+	if ( shadow->timer_armed || shadow->waiting_vblank ) return;
+
+	now = MaliVSyncGetTime();
+	period = MaliVSyncGetPeriod( pScrn );
+	MaliVSyncGetLast( pScrn, &msc, &ust );
+
+	if ( 0 == ust || now > ust + MALI_SHADOW_VBLANK_STALE_US )
+	{
+		/* Find out where the display is first, the flush is scheduled from the vblank event */
+		if ( MaliVSyncQueueEvent( pScrn, shadow_vblank, NULL ) ) shadow->waiting_vblank = TRUE;
+		else MaliShadowFlush( pScreen );
+		return;
+	}
+
+	target = ust + ( ( now - ust ) / period + 1 ) * period - MALI_SHADOW_FLUSH_MARGIN_US;
+	if ( target <= now ) target += period;
+
+	shadow->timer = TimerSet( shadow->timer, 0, ( target - now + 999 ) / 1000, shadow_timer, pScreen );
+	if ( NULL == shadow->timer )
+	{
+		MaliShadowFlush( pScreen );
+		return;
+	}
+
+	shadow->timer_armed = TRUE;
+}
+
+static void shadow_vblank( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+
+	IGNORE( msc );
+	IGNORE( ust );
+	IGNORE( data );
+
+	/* Also called while the screen is closing down */
+	if ( NULL == shadow ) return;
+
+	shadow->waiting_vblank = FALSE;
+
+	if ( shadow->damage && ( REGION_NOTEMPTY( pScreen, DamageRegion( shadow->damage ) ) || MaliCursorDirty( pScrn ) ) ) shadow_schedule_flush( pScreen );
+}
+
+static void MaliShadowBlockHandler( BLOCKHANDLER_ARGS_DECL )
+{
+	SCREEN_PTR(arg);
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+
+	pScreen->BlockHandler = fPtr->BlockHandler;
+	(*pScreen->BlockHandler)( BLOCKHANDLER_ARGS );
+	fPtr->BlockHandler = pScreen->BlockHandler;
+	pScreen->BlockHandler = MaliShadowBlockHandler;
+
+	/* TearFree paces itself by the vblank of each pan */
+	if ( !fPtr->use_shadow_vsync || fPtr->use_tear_free )
+	{
+		MaliShadowFlush( pScreen );
+	}
+	else if ( shadow->damage && ( REGION_NOTEMPTY( pScreen, DamageRegion( shadow->damage ) ) || MaliCursorDirty( pScrn ) ) )
+	{
+		shadow_schedule_flush( pScreen );
+	}
+}
+
+static Bool MaliShadowCreateScreenResources( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	PixmapPtr pPixmap;
+
+	pScreen->CreateScreenResources = fPtr->CreateScreenResources;
+	if ( !(*pScreen->CreateScreenResources)( pScreen ) ) return FALSE;
+
+	pPixmap = pScreen->GetScreenPixmap( pScreen );
+
+	shadow->damage = DamageCreate( NULL, NULL, DamageReportNone, TRUE, pScreen, pScreen );
+	if ( NULL == shadow->damage )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to create shadow damage\n", __FUNCTION__, __LINE__ );
+		return FALSE;
+	}
+
+	DamageRegister( &pPixmap->drawable, shadow->damage );
+
+	return TRUE;
+}
+
+/*
+ * RandR rotation and transforms are done by the flush: the crtc reads the
+ * screen in its own orientation and every damaged box is rotated or scaled on
+ * its way to the panel.
+ */
+void MaliShadowSetCrtc( xf86CrtcPtr crtc, int x, int y )
+{
+	ScrnInfoPtr pScrn = crtc->scrn;
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+	int degrees;
+
+	if ( NULL == shadow ) return;
+
+	switch ( crtc->rotation & 0xf )
+	{
+	case RR_Rotate_90:  degrees = 90; break;
+	case RR_Rotate_180: degrees = 180; break;
+	case RR_Rotate_270: degrees = 270; break;
+	default:            degrees = 0; break;
+	}
+
+	shadow->rotation = degrees;
+	shadow->crtc_x = x;
+	shadow->crtc_y = y;
+	shadow->transformed = FALSE;
+
+#ifdef RANDR_13_INTERFACE
+	if ( crtc->transformPresent )
+	{
+		if ( shadow->row_size < crtc->mode.HDisplay )
+		{
+			uint32_t *row = realloc( shadow->row, crtc->mode.HDisplay * sizeof(*row) );
+
+			if ( NULL == row )
+			{
+				xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate a scaling line buffer\n", __FUNCTION__, __LINE__ );
+				return;
+			}
+
+			shadow->row = row;
+			shadow->row_size = crtc->mode.HDisplay;
+		}
+
+		/* The crtc to framebuffer transform already includes the rotation and origin */
+		shadow->transformed = TRUE;
+		shadow->to_screen = crtc->f_crtc_to_framebuffer;
+		shadow->to_panel = crtc->f_framebuffer_to_crtc;
+		shadow->bounds = crtc->bounds;
+		shadow->bilinear = crtc->transform.filter && PictFilterNearest != crtc->transform.filter->id;
+
+		xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Scaling the screen to the panel with a %s filter\n", shadow->bilinear ? "bilinear" : "nearest" );
+	}
+#endif
+
+	/* Everything on the panel moved, and with TearFree the other half is stale as well */
+	shadow->full_copy = TRUE;
+
+	if ( shadow->damage )
+	{
+		RegionRec region;
+		BoxRec box;
+
+		shadow_crtc_box( fPtr, &box );
+		REGION_INIT( pScreen, &region, &box, 1 );
+		DamageDamageRegion( &pScreen->GetScreenPixmap( pScreen )->drawable, &region );
+		REGION_UNINIT( pScreen, &region );
+	}
+}
+
+/*
+ * The framebuffer keeps its size when RandR resizes the screen, so only the
+ * shadow is reallocated and the screen pixmap rewrapped around it.
+ */
+Bool MaliShadowResize( ScrnInfoPtr pScrn, int width, int height )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+	ScreenPtr pScreen = screenInfo.screens[pScrn->scrnIndex];
+	PixmapPtr pPixmap = pScreen->GetScreenPixmap( pScreen );
+	int cpp = pScrn->bitsPerPixel / 8;
+	mali_mem_info old_mem = shadow->mem;
+	unsigned char *old_virt = shadow->virt;
+	int old_pitch = shadow->pitch;
+
+	shadow->pitch = width * cpp;
+	shadow->mem.usize = shadow->pitch * height;
+	shadow->mem.offset = 0;
+	shadow->mem.handle = shadow_alloc_ump( pScrn, shadow->mem.usize );
+	shadow->virt = NULL;
+
+	if ( UMP_INVALID_MEMORY_HANDLE != shadow->mem.handle ) shadow->virt = ump_mapped_pointer_get( shadow->mem.handle );
+
+	if ( NULL == shadow->virt )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate a %dx%d shadow framebuffer\n", __FUNCTION__, __LINE__, width, height );
+		goto fail;
+	}
+
+	/* Keep the overlapping part of the old screen contents until it is redrawn */
+	mali_blit_copy( MALI_BLIT_MEMORY_CACHED, shadow->virt, shadow->pitch, old_virt, old_pitch,
+	                min( width, pPixmap->drawable.width ) * cpp, min( height, pPixmap->drawable.height ) );
+
+	if ( !pScreen->ModifyPixmapHeader( pPixmap, width, height, -1, -1, shadow->pitch, shadow->virt ) )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to rewrap the screen pixmap\n", __FUNCTION__, __LINE__ );
+		goto fail;
+	}
+
+	ump_mapped_pointer_release( old_mem.handle );
+	shadow_release_ump( pScrn, &old_mem );
+
+	shadow->full_copy = TRUE;
+
+	return TRUE;
+
+fail:
+	if ( shadow->virt ) ump_mapped_pointer_release( shadow->mem.handle );
+	if ( UMP_INVALID_MEMORY_HANDLE != shadow->mem.handle ) shadow_release_ump( pScrn, &shadow->mem );
+
+	shadow->mem = old_mem;
+	shadow->virt = old_virt;
+	shadow->pitch = old_pitch;
+
+	return FALSE;
+}
+
+Bool MaliShadowScreenInit( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( NULL == fPtr->shadow ) return FALSE;
+
+	REGION_NULL( pScreen, &fPtr->shadow->prev_damage );
+
+	if ( fPtr->use_tear_free )
+	{
+		int fb_pitch = shadow_fb_pitch( fPtr );
+
+		if ( NULL == fPtr->vsync )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "TearFree needs vblank events, disabled\n" );
+			fPtr->use_tear_free = FALSE;
+		}
+		else if ( fPtr->fb_lcd_fix.smem_len < 2 * fb_pitch * fPtr->fb_lcd_var.yres )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "Framebuffer too small for two buffers, TearFree disabled\n" );
+			fPtr->use_tear_free = FALSE;
+		}
+		else
+		{
+			fPtr->shadow->front_yoffset = fPtr->fb_lcd_var.yoffset;
+			fPtr->shadow->full_copy = TRUE;
+		}
+	}
+
+	fPtr->CreateScreenResources = pScreen->CreateScreenResources;
+	pScreen->CreateScreenResources = MaliShadowCreateScreenResources;
+	fPtr->BlockHandler = pScreen->BlockHandler;
+	pScreen->BlockHandler = MaliShadowBlockHandler;
+
+	return TRUE;
+}
+
+void MaliShadowCloseScreen( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_shadow *shadow = fPtr->shadow;
+
+	if ( NULL == shadow ) return;
+
+	if ( shadow->timer ) TimerFree( shadow->timer );
+	REGION_UNINIT( pScreen, &shadow->prev_damage );
+	free( shadow->row );
+
+	if ( fPtr->BlockHandler )
+	{
+		pScreen->BlockHandler = fPtr->BlockHandler;
+		fPtr->BlockHandler = NULL;
+	}
+
+	if ( shadow->damage )
+	{
+		DamageUnregister( &pScreen->GetScreenPixmap( pScreen )->drawable, shadow->damage );
+		DamageDestroy( shadow->damage );
+	}
+
+	/* The screen pixmap holds its own reference until it is destroyed */
+	ump_mapped_pointer_release( shadow->mem.handle );
+	shadow_release_ump( pScrn, &shadow->mem );
+	free( shadow );
+
+	fPtr->shadow = NULL;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_SHADOW_H_
+#define _MALI_SHADOW_H_
+
+#include "xf86.h"
+#include "xf86Crtc.h"
+#include "mali_exa.h"
+
+/*
+ * Optional shadow of the screen in cached memory. X renders into the shadow
+ * and the damaged parts are copied to the fbdev mapping before the server
+ * goes to sleep, so software fallbacks never read from uncached memory.
+ */
+extern void *MaliShadowAllocate( ScrnInfoPtr pScrn );
+extern Bool MaliShadowScreenInit( ScreenPtr pScreen );
+extern void MaliShadowCloseScreen( ScreenPtr pScreen );
+extern void MaliShadowFlush( ScreenPtr pScreen );
+extern mali_mem_info *MaliShadowGetMemInfo( ScrnInfoPtr pScrn, pointer pPixData );
+extern void MaliShadowSetCrtc( xf86CrtcPtr crtc, int x, int y );
+extern Bool MaliShadowResize( ScrnInfoPtr pScrn, int width, int height );
+
+#endif /* _MALI_SHADOW_H_ */
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "xf86.h"
+#include "opaque.h"
+#include "picturestr.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_vsync.h"
+#include "mali_stats.h"
+
+static const char *mali_stat_names[MALI_STAT_COUNT] =
+{
+	[MALI_STAT_EXA_PREPARE_SOLID]            = "exa.prepare_solid",
+	[MALI_STAT_EXA_SOLID]                    = "exa.solid",
+	[MALI_STAT_EXA_DONE_SOLID]               = "exa.done_solid",
+	[MALI_STAT_EXA_PREPARE_COPY]             = "exa.prepare_copy",
+	[MALI_STAT_EXA_COPY]                     = "exa.copy",
+	[MALI_STAT_EXA_DONE_COPY]                = "exa.done_copy",
+	[MALI_STAT_EXA_CHECK_COMPOSITE]          = "exa.check_composite",
+	[MALI_STAT_EXA_PREPARE_COMPOSITE]        = "exa.prepare_composite",
+	[MALI_STAT_EXA_COMPOSITE]                = "exa.composite",
+	[MALI_STAT_EXA_DONE_COMPOSITE]           = "exa.done_composite",
+	[MALI_STAT_EXA_FALLBACK_SOLID]           = "exa.fallback_solid",
+	[MALI_STAT_EXA_FALLBACK_COPY]            = "exa.fallback_copy",
+	[MALI_STAT_EXA_FALLBACK_COMPOSITE]       = "exa.fallback_composite",
+	[MALI_STAT_EXA_FALLBACK_UNRECORDED]      = "exa.fallback_unrecorded",
+	[MALI_STAT_EXA_WAIT_MARKER]              = "exa.wait_marker",
+	[MALI_STAT_EXA_CREATE_PIXMAP]            = "exa.create_pixmap",
+	[MALI_STAT_EXA_DESTROY_PIXMAP]           = "exa.destroy_pixmap",
+	[MALI_STAT_EXA_MODIFY_PIXMAP_HEADER]     = "exa.modify_pixmap_header",
+	[MALI_STAT_EXA_PIXMAP_IS_OFFSCREEN]      = "exa.pixmap_is_offscreen",
+	[MALI_STAT_EXA_PREPARE_ACCESS]           = "exa.prepare_access",
+	[MALI_STAT_EXA_PREPARE_ACCESS_TIME]      = "exa.prepare_access_us",
+	[MALI_STAT_EXA_PREPARE_ACCESS_FAILED]    = "exa.prepare_access_failed",
+	[MALI_STAT_EXA_FINISH_ACCESS]            = "exa.finish_access",
+	[MALI_STAT_EXA_FINISH_ACCESS_TIME]       = "exa.finish_access_us",
+	[MALI_STAT_UMP_ALLOC]                    = "ump.alloc",
+	[MALI_STAT_UMP_ALLOC_BYTES]              = "ump.alloc_bytes",
+	[MALI_STAT_UMP_ALLOC_FAILED]             = "ump.alloc_failed",
+	[MALI_STAT_UMP_FREE]                     = "ump.free",
+	[MALI_STAT_UMP_FREE_BYTES]               = "ump.free_bytes",
+	[MALI_STAT_UMP_IMPORT]                   = "ump.import",
+	[MALI_STAT_UMP_IMPORT_FAILED]            = "ump.import_failed",
+	[MALI_STAT_DRI2_SWAP]                    = "dri2.swap",
+	[MALI_STAT_DRI2_FLIP]                    = "dri2.flip",
+	[MALI_STAT_DRI2_FLIP_SYNCED]             = "dri2.flip_synced",
+	[MALI_STAT_DRI2_FLIP_LATE]               = "dri2.flip_late",
+	[MALI_STAT_DRI2_EXCHANGE]                = "dri2.exchange",
+	[MALI_STAT_DRI2_BLIT]                    = "dri2.blit",
+	[MALI_STAT_VSYNC_WAIT]                   = "vsync.wait",
+	[MALI_STAT_VSYNC_WAIT_TIME]              = "vsync.wait_us",
+	[MALI_STAT_VSYNC_BLOCKING_WAIT]          = "vsync.blocking_wait",
+	[MALI_STAT_VSYNC_BLOCKING_WAIT_TIME]     = "vsync.blocking_wait_us",
+};
+
+static const char *mali_fallback_op_names[] =
+{
+	[MALI_FALLBACK_SOLID]     = "solid",
+	[MALI_FALLBACK_COPY]      = "copy",
+	[MALI_FALLBACK_COMPOSITE] = "composite",
+};
+
+static const char *mali_fallback_reason_names[] =
+{
+	[MALI_FALLBACK_UNACCELERATED]   = "unaccelerated",
+	[MALI_FALLBACK_LOCATION]        = "location",
+	[MALI_FALLBACK_FORMAT]          = "format",
+	[MALI_FALLBACK_ALU]             = "alu",
+	[MALI_FALLBACK_PLANEMASK]       = "planemask",
+	[MALI_FALLBACK_OPERATOR]        = "operator",
+	[MALI_FALLBACK_SOURCE_PICTURE]  = "source_picture",
+	[MALI_FALLBACK_TRANSFORM]       = "transform",
+	[MALI_FALLBACK_REPEAT]          = "repeat",
+	[MALI_FALLBACK_ALPHA_MAP]       = "alpha_map",
+	[MALI_FALLBACK_COMPONENT_ALPHA] = "component_alpha",
+	[MALI_FALLBACK_OVERLAP]         = "overlap",
+};
+
+#define MALI_STATS_FALLBACKS_LOGGED 10
+
+static char *stats_path( ScrnInfoPtr pScrn, const char *name )
+{
+	char *path = malloc( 64 + strlen( name ) + strlen( display ) );
+
+	if ( path ) sprintf( path, "/dev/shm/%s-%s.%d", name, display, pScrn->scrnIndex );
+
+	return path;
+}
+
+void *MaliStatsMapFile( ScrnInfoPtr pScrn, const char *name, size_t size, char **path_ret )
+{
+	void *ptr = MAP_FAILED;
+	char *path = stats_path( pScrn, name );
+	int fd = -1;
+
+	/*
+	 * /dev/shm is writable by anyone, and the server usually runs as root. Whatever is at the path, a symlink
+	 * planted there included, goes, and the file is only ever created afresh. Reading it takes the server's
+	 * group.
+	 */
+	if ( path )
+	{
+		unlink( path );
+		fd = open( path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0640 );
+	}
+
+	if ( fd >= 0 && ftruncate( fd, size ) == 0 )
+	{
+		ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	}
+	if ( fd >= 0 ) close( fd );
+
+	if ( MAP_FAILED == ptr )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_WARNING, "[%s:%d] failed to map %s\n", __FUNCTION__, __LINE__, path ? path : name );
+		if ( path ) unlink( path );
+		free( path );
+		return NULL;
+	}
+
+	memset( ptr, 0, size );
+	*path_ret = path;
+
+	return ptr;
+}
+
+void MaliStatsUnmapFile( void *ptr, size_t size, char *path )
+{
+	munmap( ptr, size );
+	unlink( path );
+	free( path );
+}
+
+Bool MaliStatsInit( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	char *path = NULL;
+	struct mali_stats *stats = MaliStatsMapFile( pScrn, "xf86-video-mali", sizeof(struct mali_stats), &path );
+	int i;
+
+	if ( NULL == stats )
+	{
+		/* Keep counting, there is just nobody outside who can see it */
+		stats = calloc( 1, sizeof(struct mali_stats) );
+		if ( NULL == stats ) return FALSE;
+	}
+
+	stats->version = MALI_STATS_VERSION;
+	stats->count = MALI_STAT_COUNT;
+	stats->pid = getpid();
+	stats->screen = pScrn->scrnIndex;
+	stats->start_time = MaliVSyncGetTime();
+	for ( i = 0; i < MALI_STAT_COUNT; i++ )
+	{
+		strncpy( stats->counters[i].name, mali_stat_names[i], MALI_STATS_NAME_SIZE - 1 );
+	}
+
+	/* Readers look for the magic last, once everything else is in place */
+	__sync_synchronize();
+	memcpy( stats->magic, MALI_STATS_MAGIC, sizeof(stats->magic) );
+
+	if ( path ) xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Driver statistics published in %s\n", path );
+
+	fPtr->stats = stats;
+	fPtr->stats_path = path;
+
+	return TRUE;
+}
+
+/* Names formats the way pixman does, a8r8g8b8, x8r8g8b8, r5g6b5, a8 */
+static void fallback_format_name( char *name, size_t size, uint32_t format )
+{
+	int bpp = PICT_FORMAT_BPP( format );
+	int a = PICT_FORMAT_A( format );
+	int r = PICT_FORMAT_R( format );
+	int g = PICT_FORMAT_G( format );
+	int b = PICT_FORMAT_B( format );
+	int x = bpp - a - r - g - b;
+	char alpha[8] = "";
+
+	if ( 0 == bpp )
+	{
+		snprintf( name, size, "d%u/%ubpp", format >> 8, format & 0xff );
+		return;
+	}
+
+	if ( a ) snprintf( alpha, sizeof(alpha), "a%d", a );
+	else if ( x > 0 ) snprintf( alpha, sizeof(alpha), "x%d", x );
+
+	switch ( PICT_FORMAT_TYPE( format ) )
+	{
+		case PICT_TYPE_A:
+			snprintf( name, size, "a%d", a );
+			break;
+		case PICT_TYPE_ARGB:
+			snprintf( name, size, "%sr%dg%db%d", alpha, r, g, b );
+			break;
+		case PICT_TYPE_ABGR:
+			snprintf( name, size, "%sb%dg%dr%d", alpha, b, g, r );
+			break;
+		default:
+			snprintf( name, size, "0x%08x", format );
+			break;
+	}
+}
+
+void MaliStatsFallback( ScrnInfoPtr pScrn, enum mali_fallback_op op, enum mali_fallback_reason reason, uint32_t format )
+{
+	struct mali_stats *stats = MALIPTR(pScrn)->stats;
+	uint64_t key = ( (uint64_t)op << 40 ) | ( (uint64_t)reason << 32 ) | format;
+	struct mali_stats_fallback *fallback;
+	uint32_t i;
+
+	if ( NULL == stats ) return;
+
+	/* Only a handful of combinations show up in practice */
+	for ( i = 0; i < stats->num_fallbacks; i++ )
+	{
+		if ( stats->fallbacks[i].key == key )
+		{
+			__atomic_store_n( &stats->fallbacks[i].count, stats->fallbacks[i].count + 1, __ATOMIC_RELAXED );
+			return;
+		}
+	}
+
+	if ( stats->num_fallbacks == MALI_STATS_FALLBACKS )
+	{
+		MALI_STATS_INC( pScrn, EXA_FALLBACK_UNRECORDED );
+		return;
+	}
+
+	fallback = &stats->fallbacks[stats->num_fallbacks];
+	fallback->key = key;
+	fallback->count = 1;
+	strncpy( fallback->op, mali_fallback_op_names[op], sizeof(fallback->op) - 1 );
+	strncpy( fallback->reason, mali_fallback_reason_names[reason], sizeof(fallback->reason) - 1 );
+	fallback_format_name( fallback->format, sizeof(fallback->format), format );
+
+	__sync_synchronize();
+	stats->num_fallbacks++;
+}
+
+static int fallback_compare( const void *a, const void *b )
+{
+	const struct mali_stats_fallback *fa = *(struct mali_stats_fallback * const *)a;
+	const struct mali_stats_fallback *fb = *(struct mali_stats_fallback * const *)b;
+
+	if ( fa->count == fb->count ) return 0;
+
+	return fa->count > fb->count ? -1 : 1;
+}
+
+static void log_fallbacks( ScrnInfoPtr pScrn, struct mali_stats *stats )
+{
+	struct mali_stats_fallback *sorted[MALI_STATS_FALLBACKS];
+	uint32_t i;
+
+	if ( 0 == stats->num_fallbacks ) return;
+
+	for ( i = 0; i < stats->num_fallbacks; i++ ) sorted[i] = &stats->fallbacks[i];
+	qsort( sorted, stats->num_fallbacks, sizeof(sorted[0]), fallback_compare );
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Most frequent EXA fallbacks:\n" );
+	for ( i = 0; i < stats->num_fallbacks && i < MALI_STATS_FALLBACKS_LOGGED; i++ )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_INFO, "  %-10s %-16s %-10s %llu\n", sorted[i]->op, sorted[i]->reason,
+		            sorted[i]->format, (unsigned long long)sorted[i]->count );
+	}
+}
+
+void MaliStatsClose( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( NULL == fPtr->stats ) return;
+
+	log_fallbacks( pScrn, fPtr->stats );
+
+	if ( fPtr->stats_path ) MaliStatsUnmapFile( fPtr->stats, sizeof(struct mali_stats), fPtr->stats_path );
+	else
+	{
+		free( fPtr->stats );
+	}
+
+	fPtr->stats = NULL;
+	fPtr->stats_path = NULL;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_STATS_H_
+#define _MALI_STATS_H_
+
+#include <stdint.h>
+
+/*
+ * Per-screen counters, published in /dev/shm/xf86-video-mali-<display>.<screen>
+ * so that monitoring can read them without asking the server. The file is a
+ * struct mali_stats: a header followed by count name/value pairs. Values only
+ * ever grow and are updated with atomic 64-bit adds; readers on 32-bit ARM
+ * should read them with ldrexd or read twice until two reads agree. Times are
+ * in microseconds.
+ */
+
+#define MALI_STATS_MAGIC "MALISTAT"
+#define MALI_STATS_VERSION 2
+#define MALI_STATS_NAME_SIZE 40
+#define MALI_STATS_FALLBACKS 64
+
+enum mali_stat
+{
+	MALI_STAT_EXA_PREPARE_SOLID,
+	MALI_STAT_EXA_SOLID,
+	MALI_STAT_EXA_DONE_SOLID,
+	MALI_STAT_EXA_PREPARE_COPY,
+	MALI_STAT_EXA_COPY,
+	MALI_STAT_EXA_DONE_COPY,
+	MALI_STAT_EXA_CHECK_COMPOSITE,
+	MALI_STAT_EXA_PREPARE_COMPOSITE,
+	MALI_STAT_EXA_COMPOSITE,
+	MALI_STAT_EXA_DONE_COMPOSITE,
+	MALI_STAT_EXA_FALLBACK_SOLID,
+	MALI_STAT_EXA_FALLBACK_COPY,
+	MALI_STAT_EXA_FALLBACK_COMPOSITE,
+	MALI_STAT_EXA_FALLBACK_UNRECORDED,
+	MALI_STAT_EXA_WAIT_MARKER,
+	MALI_STAT_EXA_CREATE_PIXMAP,
+	MALI_STAT_EXA_DESTROY_PIXMAP,
+	MALI_STAT_EXA_MODIFY_PIXMAP_HEADER,
+	MALI_STAT_EXA_PIXMAP_IS_OFFSCREEN,
+	MALI_STAT_EXA_PREPARE_ACCESS,
+	MALI_STAT_EXA_PREPARE_ACCESS_TIME,
+	MALI_STAT_EXA_PREPARE_ACCESS_FAILED,
+	MALI_STAT_EXA_FINISH_ACCESS,
+	MALI_STAT_EXA_FINISH_ACCESS_TIME,
+	MALI_STAT_UMP_ALLOC,
+	MALI_STAT_UMP_ALLOC_BYTES,
+	MALI_STAT_UMP_ALLOC_FAILED,
+	MALI_STAT_UMP_FREE,
+	MALI_STAT_UMP_FREE_BYTES,
+	MALI_STAT_UMP_IMPORT,
+	MALI_STAT_UMP_IMPORT_FAILED,
+	MALI_STAT_DRI2_SWAP,
+	MALI_STAT_DRI2_FLIP,
+	MALI_STAT_DRI2_FLIP_SYNCED,
+	MALI_STAT_DRI2_FLIP_LATE,
+	MALI_STAT_DRI2_EXCHANGE,
+	MALI_STAT_DRI2_BLIT,
+	MALI_STAT_VSYNC_WAIT,
+	MALI_STAT_VSYNC_WAIT_TIME,
+	MALI_STAT_VSYNC_BLOCKING_WAIT,
+	MALI_STAT_VSYNC_BLOCKING_WAIT_TIME,
+	MALI_STAT_COUNT
+};
+
+struct mali_stats_counter
+{
+	char name[MALI_STATS_NAME_SIZE];
+	uint64_t value;
+};
+
+/*
+ * Why the EXA hooks turned operations down. Each distinct (op, reason,
+ * format) gets an entry the first time it is seen, entries are never removed
+ * and num_fallbacks only grows once an entry is complete. What does not fit
+ * is counted in exa.fallback_unrecorded.
+ */
+enum mali_fallback_op
+{
+	MALI_FALLBACK_SOLID,
+	MALI_FALLBACK_COPY,
+	MALI_FALLBACK_COMPOSITE,
+};
+
+enum mali_fallback_reason
+{
+	MALI_FALLBACK_UNACCELERATED,
+	MALI_FALLBACK_LOCATION,
+	MALI_FALLBACK_FORMAT,
+	MALI_FALLBACK_ALU,
+	MALI_FALLBACK_PLANEMASK,
+	MALI_FALLBACK_OPERATOR,
+	MALI_FALLBACK_SOURCE_PICTURE,
+	MALI_FALLBACK_TRANSFORM,
+	MALI_FALLBACK_REPEAT,
+	MALI_FALLBACK_ALPHA_MAP,
+	MALI_FALLBACK_COMPONENT_ALPHA,
+	MALI_FALLBACK_OVERLAP,
+};
+
+/* Pixmaps without a picture format, as used by Solid and Copy */
+#define MALI_FALLBACK_PIXMAP_FORMAT( depth, bpp ) ( ( (depth) << 8 ) | (bpp) )
+
+struct mali_stats_fallback
+{
+	uint64_t key;
+	uint64_t count;
+	char op[12];
+	char reason[20];
+	char format[16];
+};
+
+struct mali_stats
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint32_t pid;
+	uint32_t screen;
+	uint64_t start_time;
+	struct mali_stats_counter counters[MALI_STAT_COUNT];
+	uint32_t num_fallbacks;
+	uint32_t pad;
+	struct mali_stats_fallback fallbacks[MALI_STATS_FALLBACKS];
+};
+
+#define MALI_STATS_ADD( pScrn, stat, n ) mali_stats_add( MALIPTR(pScrn)->stats, MALI_STAT_ ## stat, n )
+#define MALI_STATS_INC( pScrn, stat ) MALI_STATS_ADD( pScrn, stat, 1 )
+
+/*
+ * Each counter has a single writer, either the server or the vsync thread, so
+ * a locked add is not needed. The relaxed load and store only keep readers
+ * from seeing half of a 64 bit value.
+ */
+static inline void mali_stats_add( struct mali_stats *stats, enum mali_stat stat, uint64_t n )
+{
+	uint64_t *value;
+
+	if ( NULL == stats ) return;
+
+	value = &stats->counters[stat].value;
+	__atomic_store_n( value, __atomic_load_n( value, __ATOMIC_RELAXED ) + n, __ATOMIC_RELAXED );
+}
+
+#ifndef _MALI_STATS_NO_SERVER
+#include "xf86.h"
+
+extern Bool MaliStatsInit( ScrnInfoPtr pScrn );
+extern void MaliStatsClose( ScrnInfoPtr pScrn );
+
+/* format is the PICT format of the picture at fault or MALI_FALLBACK_PIXMAP_FORMAT */
+extern void MaliStatsFallback( ScrnInfoPtr pScrn, enum mali_fallback_op op, enum mali_fallback_reason reason, uint32_t format );
+
+/* Creates /dev/shm/<name>-<display>.<screen>, zeroed, for other files publishing state the same way */
+extern void *MaliStatsMapFile( ScrnInfoPtr pScrn, const char *name, size_t size, char **path );
+extern void MaliStatsUnmapFile( void *ptr, size_t size, char *path );
+#endif
+
+#endif /* _MALI_STATS_H_ */
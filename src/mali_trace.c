@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xf86.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_stats.h"
+#include "mali_vsync.h"
+#include "mali_trace.h"
+
+struct mali_trace_state
+{
+	struct mali_trace *ring;
+	char *path;
+
+	/* the swap MaliDRI2ScheduleSwap is working on, 0 outside of it */
+	uint32_t current;
+};
+
+/* Takes the slot of event ticket away from readers, NULL if it has been reused since */
+static struct mali_trace_event *trace_open( struct mali_trace *ring, uint32_t ticket )
+{
+	struct mali_trace_event *ev = &ring->events[( ticket - 1 ) % MALI_TRACE_SIZE];
+
+	if ( 0 == ticket || ev->seq != ticket ) return NULL;
+
+	ev->seq = 0;
+	__sync_synchronize();
+
+	return ev;
+}
+
+static void trace_publish( struct mali_trace_event *ev, uint32_t ticket )
+{
+	__sync_synchronize();
+	ev->seq = ticket;
+}
+
+void MaliTraceInit( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_trace_state *trace;
+
+	trace = calloc( 1, sizeof(*trace) );
+	if ( NULL == trace ) return;
+
+	/* Unlike the counters the ring is only of use to someone outside, so without the file there is no trace */
+	trace->ring = MaliStatsMapFile( pScrn, "xf86-video-mali-trace", sizeof(struct mali_trace), &trace->path );
+	if ( NULL == trace->ring )
+	{
+		free( trace );
+		return;
+	}
+
+	trace->ring->version = MALI_TRACE_VERSION;
+	trace->ring->size = MALI_TRACE_SIZE;
+	trace->ring->pid = getpid();
+	trace->ring->screen = pScrn->scrnIndex;
+
+	__sync_synchronize();
+	memcpy( trace->ring->magic, MALI_TRACE_MAGIC, sizeof(trace->ring->magic) );
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Swap trace published in %s\n", trace->path );
+
+	fPtr->trace = trace;
+}
+
+void MaliTraceClose( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_trace_state *trace = fPtr->trace;
+
+	if ( NULL == trace ) return;
+
+	MaliStatsUnmapFile( trace->ring, sizeof(struct mali_trace), trace->path );
+	free( trace );
+
+	fPtr->trace = NULL;
+}
+
+uint32_t MaliTraceSwapBegin( ScrnInfoPtr pScrn, XID drawable )
+{
+	struct mali_trace_state *trace = MALIPTR(pScrn)->trace;
+	struct mali_trace_event *ev;
+	uint32_t ticket;
+
+	if ( NULL == trace ) return 0;
+
+	ticket = trace->ring->head + 1;
+	if ( 0 == ticket ) ticket = 1;
+
+	ev = &trace->ring->events[( ticket - 1 ) % MALI_TRACE_SIZE];
+	ev->seq = 0;
+	__sync_synchronize();
+
+	ev->drawable = drawable;
+	ev->path = MALI_TRACE_PATH_NONE;
+	ev->synced = 0;
+	ev->request = MaliVSyncGetTime();
+	ev->pan_start = 0;
+	ev->pan_end = 0;
+	ev->vsync_wait = 0;
+	ev->complete = 0;
+	ev->msc = 0;
+
+	trace_publish( ev, ticket );
+	trace->ring->head = ticket;
+	trace->current = ticket;
+
+	return ticket;
+}
+
+void MaliTraceSwapPan( ScrnInfoPtr pScrn, CARD64 start, CARD64 end, Bool synced, CARD64 vsync_wait )
+{
+	struct mali_trace_state *trace = MALIPTR(pScrn)->trace;
+	struct mali_trace_event *ev;
+
+	if ( NULL == trace || NULL == ( ev = trace_open( trace->ring, trace->current ) ) ) return;
+
+	ev->pan_start = start;
+	ev->pan_end = end;
+	ev->synced = synced;
+	ev->vsync_wait = vsync_wait;
+
+	trace_publish( ev, trace->current );
+}
+
+void MaliTraceSwapPath( ScrnInfoPtr pScrn, enum mali_trace_path path )
+{
+	struct mali_trace_state *trace = MALIPTR(pScrn)->trace;
+	struct mali_trace_event *ev;
+
+	if ( NULL == trace || NULL == ( ev = trace_open( trace->ring, trace->current ) ) ) return;
+
+	ev->path = path;
+
+	trace_publish( ev, trace->current );
+	trace->current = 0;
+}
+
+void MaliTraceSwapComplete( ScrnInfoPtr pScrn, uint32_t ticket, CARD64 msc, CARD64 ust )
+{
+	struct mali_trace_state *trace = MALIPTR(pScrn)->trace;
+	struct mali_trace_event *ev;
+
+	if ( NULL == trace || NULL == ( ev = trace_open( trace->ring, ticket ) ) ) return;
+
+	ev->complete = ust;
+	ev->msc = msc;
+
+	trace_publish( ev, ticket );
+}
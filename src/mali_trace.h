@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_TRACE_H_
+#define _MALI_TRACE_H_
+
+#include <stdint.h>
+
+/*
+ * A ring of the most recent DRI2 swaps, published in
+ * /dev/shm/xf86-video-mali-trace-<display>.<screen> for tools/mali-trace to
+ * dump while the server keeps running. Only the server thread writes it, so
+ * there is no lock: a slot's seq is cleared while it is being written and set
+ * to the event number once it is complete. Readers copy a slot and keep it if
+ * seq was the same non-zero value before and after the copy. head counts the
+ * events ever started, event n lives in slot (n - 1) % size. All times are
+ * CLOCK_MONOTONIC microseconds, zero when that step did not happen.
+ */
+
+#define MALI_TRACE_MAGIC "MALITRCE"
+#define MALI_TRACE_VERSION 1
+#define MALI_TRACE_SIZE 1024
+
+enum mali_trace_path
+{
+	MALI_TRACE_PATH_NONE,
+	MALI_TRACE_PATH_FLIP,
+	MALI_TRACE_PATH_EXCHANGE,
+	MALI_TRACE_PATH_BLIT,
+};
+
+struct mali_trace_event
+{
+	volatile uint32_t seq;
+	uint32_t drawable;
+	uint32_t path;
+	uint32_t synced;
+	uint64_t request;
+	uint64_t pan_start;
+	uint64_t pan_end;
+	uint64_t vsync_wait;
+	uint64_t complete;
+	uint64_t msc;
+};
+
+struct mali_trace
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+	uint32_t pid;
+	uint32_t screen;
+	volatile uint32_t head;
+	uint32_t pad;
+	struct mali_trace_event events[MALI_TRACE_SIZE];
+};
+
+#ifndef _MALI_TRACE_NO_SERVER
+#include "xf86.h"
+
+extern void MaliTraceInit( ScrnInfoPtr pScrn );
+extern void MaliTraceClose( ScrnInfoPtr pScrn );
+
+/* Called in order by MaliDRI2ScheduleSwap, Begin returns the ticket Complete needs when the swap is deferred */
+extern uint32_t MaliTraceSwapBegin( ScrnInfoPtr pScrn, XID drawable );
+extern void MaliTraceSwapPan( ScrnInfoPtr pScrn, CARD64 start, CARD64 end, Bool synced, CARD64 vsync_wait );
+extern void MaliTraceSwapPath( ScrnInfoPtr pScrn, enum mali_trace_path path );
+extern void MaliTraceSwapComplete( ScrnInfoPtr pScrn, uint32_t ticket, CARD64 msc, CARD64 ust );
+#endif
+
+#endif /* _MALI_TRACE_H_ */
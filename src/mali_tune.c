@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xf86.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_blit.h"
+#include "mali_vsync.h"
+#include "mali_tune.h"
+
+/* Enough to get past the caches of the boards we run on without holding up startup */
+#define TUNE_FB_BYTES     ( 1024 * 1024 )
+#define TUNE_CACHED_BYTES ( 2 * 1024 * 1024 )
+#define TUNE_RUNS         2
+
+/* A candidate has to beat the current pick by this much, so that noise doesn't decide */
+#define TUNE_MARGIN       1.03
+
+static const int tune_prefetch[] = { 0, 128, 256, 512 };
+
+static const struct mali_blit_copy_strategy tune_plain = { MALI_BLIT_COPY_LIBC, 0 };
+
+static const char *memory_names[MALI_BLIT_MEMORY_TYPES] = { "framebuffer", "cached" };
+
+struct tune_area
+{
+	unsigned char *dst;
+	const unsigned char *src;
+	int pitch;
+	int width;
+	int height;
+};
+
+static double tune_rate( CARD64 start, size_t bytes )
+{
+	CARD64 us = MaliVSyncGetTime() - start;
+
+	return bytes / (double)( us ? us : 1 );
+}
+
+/* Best of a few runs, in MB/s */
+static double tune_copy( const struct mali_blit_copy_strategy *strategy, const struct tune_area *a )
+{
+	double best = 0;
+	int run;
+
+	for ( run = 0; run < TUNE_RUNS; run++ )
+	{
+		CARD64 start = MaliVSyncGetTime();
+		double rate;
+
+		mali_blit_copy_with( strategy, a->dst, a->pitch, a->src, a->pitch, a->width, a->height );
+		rate = tune_rate( start, (size_t)a->width * a->height );
+		if ( rate > best ) best = rate;
+	}
+
+	return best;
+}
+
+static double tune_read( const unsigned char *src, int pitch, int width, int height )
+{
+	volatile uint32_t sink;
+	uint32_t sum = 0;
+	CARD64 start = MaliVSyncGetTime();
+	int x, y;
+
+	for ( y = 0; y < height; y++ )
+	{
+		const uint32_t *row = (const uint32_t *)( src + y * pitch );
+
+		for ( x = 0; x < width / 4; x++ ) sum += row[x];
+	}
+	sink = sum;
+	(void)sink;
+
+	return tune_rate( start, (size_t)width * height );
+}
+
+static void tune_memory( ScrnInfoPtr pScrn, enum mali_blit_memory memory, const struct tune_area *a, double read )
+{
+	struct mali_blit_copy_strategy best, candidate;
+	double best_rate;
+	int k;
+	unsigned int p;
+
+	mali_blit_get_copy_strategy( memory, &best );
+	best_rate = tune_copy( &best, a );
+
+	for ( k = MALI_BLIT_COPY_LIBC; k < MALI_BLIT_COPY_KERNELS; k++ )
+	{
+		if ( !mali_blit_copy_kernel_available( k ) ) continue;
+
+		/* memcpy does its own thing */
+		for ( p = 0; p < ( MALI_BLIT_COPY_LIBC == k ? 1 : sizeof(tune_prefetch) / sizeof(tune_prefetch[0]) ); p++ )
+		{
+			double rate;
+
+			candidate.kernel = k;
+			candidate.prefetch = tune_prefetch[p];
+			rate = tune_copy( &candidate, a );
+
+			xf86DrvMsgVerb( pScrn->scrnIndex, X_INFO, 5, "%s copy with %s, prefetch %d: %.0f MB/s\n",
+			                memory_names[memory], mali_blit_copy_kernel_name( k ), candidate.prefetch, rate );
+
+			if ( rate > best_rate * TUNE_MARGIN )
+			{
+				best = candidate;
+				best_rate = rate;
+			}
+		}
+	}
+
+	mali_blit_set_copy_strategy( memory, &best );
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Copies to %s memory use %s with prefetch %d: %.0f MB/s, reads at %.0f MB/s\n",
+	            memory_names[memory], mali_blit_copy_kernel_name( best.kernel ), best.prefetch, best_rate, read );
+}
+
+/* The framebuffer is read once into a cached copy, which is then copied back over it */
+static void tune_framebuffer( ScrnInfoPtr pScrn, unsigned char *fb )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct tune_area a;
+	unsigned char *saved;
+	double read;
+
+	a.pitch = fPtr->fb_lcd_fix.line_length;
+	a.width = fPtr->fb_lcd_var.xres * fPtr->fb_lcd_var.bits_per_pixel / 8;
+	a.height = min( (int)fPtr->fb_lcd_var.yres, TUNE_FB_BYTES / a.pitch );
+	if ( NULL == fb || a.pitch <= 0 || a.height <= 0 ) return;
+
+	if ( posix_memalign( (void **)&saved, 64, (size_t)a.pitch * a.height ) ) return;
+
+	read = tune_read( fb, a.pitch, a.width, a.height );
+	mali_blit_copy_with( &tune_plain, saved, a.pitch, fb, a.pitch, a.width, a.height );
+
+	a.dst = fb;
+	a.src = saved;
+	tune_memory( pScrn, MALI_BLIT_MEMORY_FRAMEBUFFER, &a, read );
+
+	free( saved );
+}
+
+static void tune_cached( ScrnInfoPtr pScrn )
+{
+	unsigned char *src, *dst;
+	struct tune_area a;
+	double read;
+
+	/* Rows as wide as the screen's, since that is what gets copied */
+	a.pitch = ( pScrn->virtualX * pScrn->bitsPerPixel / 8 + 63 ) & ~63;
+	a.width = pScrn->virtualX * pScrn->bitsPerPixel / 8;
+	a.height = TUNE_CACHED_BYTES / a.pitch;
+	if ( a.height <= 0 ) return;
+
+	if ( posix_memalign( (void **)&src, 64, (size_t)a.pitch * a.height ) ) return;
+	if ( posix_memalign( (void **)&dst, 64, (size_t)a.pitch * a.height ) )
+	{
+		free( src );
+		return;
+	}
+
+	memset( src, 0x5a, (size_t)a.pitch * a.height );
+	memset( dst, 0, (size_t)a.pitch * a.height );
+	read = tune_read( src, a.pitch, a.width, a.height );
+
+	a.dst = dst;
+	a.src = src;
+	tune_memory( pScrn, MALI_BLIT_MEMORY_CACHED, &a, read );
+
+	free( src );
+	free( dst );
+}
+
+void MaliTuneCopy( ScrnInfoPtr pScrn, unsigned char *fb )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	CARD64 start = MaliVSyncGetTime();
+	Bool probed = FALSE;
+	int m;
+
+	for ( m = 0; m < MALI_BLIT_MEMORY_TYPES; m++ )
+	{
+		const struct mali_blit_copy_strategy *forced = &fPtr->copy_strategy[m];
+
+		if ( MALI_BLIT_COPY_AUTO != forced->kernel )
+		{
+			mali_blit_set_copy_strategy( m, forced );
+			xf86DrvMsg( pScrn->scrnIndex, X_CONFIG, "Copies to %s memory use %s with prefetch %d\n",
+			            memory_names[m], mali_blit_copy_kernel_name( forced->kernel ), forced->prefetch );
+			continue;
+		}
+
+		if ( MALI_BLIT_MEMORY_FRAMEBUFFER == m ) tune_framebuffer( pScrn, fb );
+		else tune_cached( pScrn );
+		probed = TRUE;
+	}
+
+	if ( probed ) xf86DrvMsg( pScrn->scrnIndex, X_INFO, "Copy kernels chosen in %llu ms\n", (unsigned long long)( MaliVSyncGetTime() - start ) / 1000 );
+}
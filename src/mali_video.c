@@ -0,0 +1,803 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "xf86.h"
+#include "xf86xv.h"
+#include "fourcc.h"
+#include "damage.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_exa.h"
+#include "mali_blit.h"
+#include "mali_video.h"
+
+#ifndef FOURCC_NV12
+#define FOURCC_NV12 0x3231564e
+#define XVIMAGE_NV12 \
+	{ \
+		FOURCC_NV12, XvYUV, LSBFirst, \
+		{'N','V','1','2',0x00,0x00,0x00,0x10,0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}, \
+		12, XvPlanar, 2, 0, 0, 0, 0, 8, 8, 8, 1, 2, 2, 1, 2, 2, \
+		{'Y','U','V',0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}, \
+		XvTopToBottom \
+	}
+#endif
+
+#define MALI_VIDEO_NUM_PORTS 16
+#define MALI_VIDEO_MAX_WIDTH 2048
+#define MALI_VIDEO_MAX_HEIGHT 2048
+
+#define MALI_VIDEO_MAX_THREADS 8
+
+/* Rows of the destination handed to a thread at a time */
+#define MALI_VIDEO_SLICE_ROWS 32
+
+#define MAKE_ATOM(a) MakeAtom(a, sizeof(a) - 1, TRUE)
+
+typedef struct
+{
+	Bool bt709;
+} MaliPortPrivRec, *MaliPortPrivPtr;
+
+/* Resampled lines at destination width, one set per thread */
+struct mali_video_lines
+{
+	uint8_t *y;
+	uint8_t *u;
+	uint8_t *v;
+	uint32_t *rgb;
+	int size;
+};
+
+/* One PutImage worth of parameters */
+struct mali_video_frame
+{
+	int id;
+	const uint8_t *planes[3];
+	int pitches[3];
+	int src_x, src_y;
+	int drw_x, drw_y;
+	int32_t dx, dy;
+	Bool bt709;
+	unsigned char *dst;
+	int dst_pitch;
+	int dst_bpp;
+	int x_off, y_off;
+};
+
+struct mali_video_thread
+{
+	struct mali_video *video;
+	pthread_t thread;
+	struct mali_video_lines lines;
+};
+
+/*
+ * Frames are cut into slices of rows which the worker threads convert in
+ * parallel, straight from the client's buffer, while the server helps and
+ * waits. With EXA and XV_PIPELINE the server does not wait for them: the
+ * part of the source that is needed is copied aside, so the client may reuse
+ * its buffer as soon as PutImage returns, and the frame is fenced with an EXA
+ * marker. That copy is the price of the pipelining, hence it is optional.
+ * Anything that touches pixmaps afterwards waits for the marker first, and
+ * the shadow flush presents the frame at a vblank once it is done. Only one
+ * frame is in flight at a time. The last thread slot belongs to the server,
+ * which helps out with the remaining slices whenever it has to wait.
+ */
+struct mali_video
+{
+	ScrnInfoPtr pScrn;
+	XF86VideoAdaptorPtr adaptor;
+	int num_threads;
+	Bool threads_started;
+	struct mali_video_thread threads[MALI_VIDEO_MAX_THREADS + 1];
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	/* protected by lock */
+	Bool quit;
+	int next_slice;
+	int num_slices;
+	int pending_slices;
+
+	/* written by the server thread while no slices are pending */
+	struct mali_video_frame frame;
+	BoxPtr slices;
+	int size_slices;
+	int queued_slices;
+
+	/* only touched from the server thread */
+	Bool busy;
+	PixmapPtr pixmap;
+	Bool cpu_access;
+	uint8_t *staging;
+	int staging_size;
+};
+
+static Atom xvBT709;
+
+static XF86VideoEncodingRec mali_video_encodings[] =
+{
+	{ 0, "XV_IMAGE", MALI_VIDEO_MAX_WIDTH, MALI_VIDEO_MAX_HEIGHT, { 1, 1 } },
+};
+
+static XF86VideoFormatRec mali_video_formats[] =
+{
+	{ 15, TrueColor }, { 16, TrueColor }, { 24, TrueColor }, { 32, TrueColor },
+};
+
+static XF86AttributeRec mali_video_attributes[] =
+{
+	{ XvSettable | XvGettable, 0, 1, "XV_ITURBT_709" },
+};
+
+static XF86ImageRec mali_video_images[] =
+{
+	XVIMAGE_YUY2,
+	XVIMAGE_YV12,
+	XVIMAGE_I420,
+	XVIMAGE_NV12,
+};
+
+/* Plane pitches and offsets of an image, shared by QueryImageAttributes and PutImage */
+static int video_image_layout( int id, int width, int height, int *pitches, int *offsets )
+{
+	switch ( id )
+	{
+	case FOURCC_YV12:
+	case FOURCC_I420:
+		pitches[0] = ( width + 3 ) & ~3;
+		pitches[1] = pitches[2] = ( ( width >> 1 ) + 3 ) & ~3;
+		offsets[0] = 0;
+		offsets[1] = pitches[0] * height;
+		offsets[2] = offsets[1] + pitches[1] * ( height >> 1 );
+		return offsets[2] + pitches[2] * ( height >> 1 );
+	case FOURCC_NV12:
+		pitches[0] = pitches[1] = ( width + 3 ) & ~3;
+		offsets[0] = 0;
+		offsets[1] = pitches[0] * height;
+		return offsets[1] + pitches[1] * ( height >> 1 );
+	case FOURCC_YUY2:
+	default:
+		pitches[0] = ( width * 2 + 3 ) & ~3;
+		offsets[0] = 0;
+		return pitches[0] * height;
+	}
+}
+
+static Bool video_alloc_lines( struct mali_video_lines *lines, int width )
+{
+	unsigned char *mem;
+
+	if ( width <= lines->size ) return TRUE;
+
+	/* One block: the RGB line first to keep it aligned, then the three byte lines */
+	mem = realloc( lines->rgb, width * ( sizeof(uint32_t) + 3 ) );
+	if ( NULL == mem ) return FALSE;
+
+	lines->rgb = (uint32_t *)mem;
+	lines->y = mem + width * sizeof(uint32_t);
+	lines->u = lines->y + width;
+	lines->v = lines->u + width;
+	lines->size = width;
+
+	return TRUE;
+}
+
+/*
+ * Convert and scale the part of the frame that falls in box, which is in
+ * screen coordinates. Source pixels are picked at the centre of each
+ * destination pixel. Unscaled planar rows are converted in place from the
+ * client's buffer, everything else is gathered into planar lines first.
+ */
+static void video_convert_box( const struct mali_video_frame *f, BoxPtr box, struct mali_video_lines *lines )
+{
+	int count = box->x2 - box->x1;
+	int32_t sx = ( f->src_x << 16 ) + ( box->x1 - f->drw_x ) * f->dx + f->dx / 2;
+	int y;
+
+	for ( y = box->y1; y < box->y2; y++ )
+	{
+		int row = ( ( f->src_y << 16 ) + ( y - f->drw_y ) * f->dy + f->dy / 2 ) >> 16;
+		unsigned char *dst = f->dst + ( y + f->y_off ) * f->dst_pitch + ( box->x1 + f->x_off ) * f->dst_bpp / 8;
+		uint32_t *rgb = ( 32 == f->dst_bpp ) ? (uint32_t *)dst : lines->rgb;
+		const uint8_t *ly = lines->y, *lu = lines->u, *lv = lines->v;
+		int shift = 0, phase = 0;
+
+		switch ( f->id )
+		{
+		case FOURCC_YV12:
+		case FOURCC_I420:
+		{
+			const uint8_t *py = f->planes[0] + row * f->pitches[0];
+			const uint8_t *pu = f->planes[1] + ( row >> 1 ) * f->pitches[1];
+			const uint8_t *pv = f->planes[2] + ( row >> 1 ) * f->pitches[2];
+
+			if ( 0x10000 == f->dx )
+			{
+				ly = py + ( sx >> 16 );
+				lu = pu + ( sx >> 17 );
+				lv = pv + ( sx >> 17 );
+				shift = 1;
+				phase = ( sx >> 16 ) & 1;
+			}
+			else
+			{
+				mali_blit_gather_8( lines->y, py, 1, sx, f->dx, count );
+				mali_blit_gather_8( lines->u, pu, 1, sx >> 1, f->dx >> 1, count );
+				mali_blit_gather_8( lines->v, pv, 1, sx >> 1, f->dx >> 1, count );
+			}
+			break;
+		}
+		case FOURCC_NV12:
+		{
+			const uint8_t *py = f->planes[0] + row * f->pitches[0];
+			const uint8_t *puv = f->planes[1] + ( row >> 1 ) * f->pitches[1];
+
+			if ( 0x10000 == f->dx ) ly = py + ( sx >> 16 );
+			else mali_blit_gather_8( lines->y, py, 1, sx, f->dx, count );
+
+			mali_blit_gather_8( lines->u, puv, 2, sx >> 1, f->dx >> 1, count );
+			mali_blit_gather_8( lines->v, puv + 1, 2, sx >> 1, f->dx >> 1, count );
+			break;
+		}
+		case FOURCC_YUY2:
+		default:
+		{
+			const uint8_t *p = f->planes[0] + row * f->pitches[0];
+
+			mali_blit_gather_8( lines->y, p, 2, sx, f->dx, count );
+			mali_blit_gather_8( lines->u, p + 1, 4, sx >> 1, f->dx >> 1, count );
+			mali_blit_gather_8( lines->v, p + 3, 4, sx >> 1, f->dx >> 1, count );
+			break;
+		}
+		}
+
+		mali_blit_yuv_to_8888( rgb, ly, lu, lv, count, shift, phase, f->bt709 );
+
+		if ( 16 == f->dst_bpp ) mali_blit_convert_8888_565( dst, 0, rgb, 0, box->x1, y, count, 1, 0 );
+	}
+}
+
+/* Converts slices until there are none left, called and returning with the lock held */
+static void video_work( struct mali_video *video, struct mali_video_lines *lines )
+{
+	while ( !video->quit && video->next_slice < video->num_slices )
+	{
+		BoxPtr slice = &video->slices[video->next_slice++];
+
+		pthread_mutex_unlock( &video->lock );
+		video_convert_box( &video->frame, slice, lines );
+		pthread_mutex_lock( &video->lock );
+
+		if ( 0 == --video->pending_slices ) pthread_cond_broadcast( &video->done_cond );
+	}
+}
+
+static void *video_thread( void *arg )
+{
+	struct mali_video_thread *thread = arg;
+	struct mali_video *video = thread->video;
+
+	pthread_mutex_lock( &video->lock );
+
+	while ( !video->quit )
+	{
+		if ( video->next_slice < video->num_slices ) video_work( video, &thread->lines );
+		else pthread_cond_wait( &video->work_cond, &video->lock );
+	}
+
+	pthread_mutex_unlock( &video->lock );
+
+	return NULL;
+}
+
+static void video_start_threads( struct mali_video *video )
+{
+	sigset_t block, saved;
+	int i;
+
+	video->threads_started = TRUE;
+
+	/* Workers inherit this, signals are for the server's main thread alone */
+	sigfillset( &block );
+	pthread_sigmask( SIG_BLOCK, &block, &saved );
+
+	for ( i = 0; i < video->num_threads; i++ )
+	{
+		if ( pthread_create( &video->threads[i].thread, NULL, video_thread, &video->threads[i] ) != 0 )
+		{
+			xf86DrvMsg( video->pScrn->scrnIndex, X_WARNING, "[%s:%d] started only %d of %d video threads\n", __FUNCTION__, __LINE__, i, video->num_threads );
+			break;
+		}
+	}
+
+	pthread_sigmask( SIG_SETMASK, &saved, NULL );
+
+	/* Nothing has been allocated for the lines yet, the server simply takes the first free slot */
+	video->num_threads = i;
+
+	xf86DrvMsg( video->pScrn->scrnIndex, X_INFO, "Xv conversion uses %d threads\n", video->num_threads );
+}
+
+/*
+ * Copy the part of the source the frame samples from, rounded out to whole
+ * chroma pairs, and point the frame at the copy.
+ */
+static Bool video_snapshot( struct mali_video *video, struct mali_video_frame *f, int width, int height, int src_w, int src_h )
+{
+	/* Bytes per pair of pixels and vertical subsampling of each plane */
+	static const int yuy2[3][2] = { { 4, 0 } };
+	static const int planar[3][2] = { { 2, 0 }, { 1, 1 }, { 1, 1 } };
+	static const int nv12[3][2] = { { 2, 0 }, { 2, 1 } };
+	const int (*layout)[2];
+	int x0 = f->src_x & ~1;
+	int y0 = f->src_y & ~1;
+	int x1 = ( min( f->src_x + src_w, width ) + 1 ) & ~1;
+	int y1 = min( f->src_y + src_h, height );
+	int num_planes, size, offset, i;
+
+	switch ( f->id )
+	{
+	case FOURCC_YV12:
+	case FOURCC_I420:
+		layout = planar;
+		num_planes = 3;
+		break;
+	case FOURCC_NV12:
+		layout = nv12;
+		num_planes = 2;
+		break;
+	case FOURCC_YUY2:
+	default:
+		layout = yuy2;
+		num_planes = 1;
+		break;
+	}
+
+	for ( size = 0, i = 0; i < num_planes; i++ )
+	{
+		int shift = layout[i][1];
+
+		size += ( ( ( x1 - x0 ) / 2 * layout[i][0] + 15 ) & ~15 ) * ( ( ( y1 + shift ) >> shift ) - ( y0 >> shift ) );
+	}
+
+	if ( size > video->staging_size )
+	{
+		uint8_t *mem = realloc( video->staging, size );
+
+		if ( NULL == mem ) return FALSE;
+
+		video->staging = mem;
+		video->staging_size = size;
+	}
+
+	for ( offset = 0, i = 0; i < num_planes; i++ )
+	{
+		int shift = layout[i][1];
+		int bytes = ( x1 - x0 ) / 2 * layout[i][0];
+		int pitch = ( bytes + 15 ) & ~15;
+		int row = y0 >> shift;
+		int end = ( y1 + shift ) >> shift;
+		const uint8_t *src = f->planes[i] + row * f->pitches[i] + x0 / 2 * layout[i][0];
+		uint8_t *dst = video->staging + offset;
+
+		f->planes[i] = dst;
+
+		mali_blit_copy( MALI_BLIT_MEMORY_CACHED, dst, pitch, src, f->pitches[i], bytes, end - row );
+
+		f->pitches[i] = pitch;
+		offset += pitch * ( ( ( y1 + shift ) >> shift ) - ( y0 >> shift ) );
+	}
+
+	f->src_x -= x0;
+	f->src_y -= y0;
+
+	return TRUE;
+}
+
+/* Cut a box into slices of rows */
+static Bool video_add_slices( struct mali_video *video, BoxPtr box )
+{
+	int y;
+
+	for ( y = box->y1; y < box->y2; y += MALI_VIDEO_SLICE_ROWS )
+	{
+		BoxPtr slice;
+
+		if ( video->queued_slices == video->size_slices )
+		{
+			BoxPtr mem = realloc( video->slices, ( video->size_slices + 64 ) * sizeof(BoxRec) );
+
+			if ( NULL == mem ) return FALSE;
+
+			video->slices = mem;
+			video->size_slices += 64;
+		}
+
+		slice = &video->slices[video->queued_slices++];
+		slice->x1 = box->x1;
+		slice->x2 = box->x2;
+		slice->y1 = y;
+		slice->y2 = min( y + MALI_VIDEO_SLICE_ROWS, box->y2 );
+	}
+
+	return TRUE;
+}
+
+Bool MaliVideoBusy( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	struct mali_video *video = MALIPTR(pScrn)->video;
+	Bool busy;
+
+	if ( NULL == video || !video->busy ) return FALSE;
+
+	pthread_mutex_lock( &video->lock );
+	busy = video->pending_slices > 0;
+	pthread_mutex_unlock( &video->lock );
+
+	return busy;
+}
+
+void MaliVideoSync( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	struct mali_video *video = MALIPTR(pScrn)->video;
+	PixmapPtr pPixmap;
+
+	if ( NULL == video || !video->busy ) return;
+
+	pthread_mutex_lock( &video->lock );
+	video_work( video, &video->threads[video->num_threads].lines );
+	while ( video->pending_slices ) pthread_cond_wait( &video->done_cond, &video->lock );
+	video->next_slice = 0;
+	video->num_slices = 0;
+	pthread_mutex_unlock( &video->lock );
+
+	pPixmap = video->pixmap;
+	video->pixmap = NULL;
+	video->busy = FALSE;
+
+	if ( video->cpu_access ) maliPixmapEndCPUAccess( pPixmap );
+
+	/* Drops the reference that kept the pixmap alive while the threads were writing to it */
+	pScreen->DestroyPixmap( pPixmap );
+}
+
+static void MaliVideoStopVideo( ScrnInfoPtr pScrn, pointer data, Bool shutdown )
+{
+	IGNORE( pScrn );
+	IGNORE( data );
+	IGNORE( shutdown );
+
+	/* Nothing is left on screen that would need taking down */
+}
+
+static int MaliVideoSetPortAttribute( ScrnInfoPtr pScrn, Atom attribute, INT32 value, pointer data )
+{
+	MaliPortPrivPtr pPriv = data;
+
+	IGNORE( pScrn );
+
+	if ( attribute != xvBT709 ) return BadMatch;
+	if ( value < 0 || value > 1 ) return BadValue;
+
+	pPriv->bt709 = value;
+
+	return Success;
+}
+
+static int MaliVideoGetPortAttribute( ScrnInfoPtr pScrn, Atom attribute, INT32 *value, pointer data )
+{
+	MaliPortPrivPtr pPriv = data;
+
+	IGNORE( pScrn );
+
+	if ( attribute != xvBT709 ) return BadMatch;
+
+	*value = pPriv->bt709;
+
+	return Success;
+}
+
+static void MaliVideoQueryBestSize( ScrnInfoPtr pScrn, Bool motion, short vid_w, short vid_h, short drw_w, short drw_h,
+                                    unsigned int *p_w, unsigned int *p_h, pointer data )
+{
+	IGNORE( pScrn );
+	IGNORE( motion );
+	IGNORE( vid_w );
+	IGNORE( vid_h );
+	IGNORE( data );
+
+	/* Any scale factor is fine */
+	*p_w = drw_w;
+	*p_h = drw_h;
+}
+
+static int MaliVideoPutImage( ScrnInfoPtr pScrn, short src_x, short src_y, short drw_x, short drw_y,
+                              short src_w, short src_h, short drw_w, short drw_h, int id, unsigned char *buf,
+                              short width, short height, Bool sync, RegionPtr clipBoxes, pointer data, DrawablePtr pDraw )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	MaliPortPrivPtr pPriv = data;
+	ScreenPtr pScreen = pDraw->pScreen;
+	struct mali_video *video = fPtr->video;
+	struct mali_video_frame frame;
+	PixmapPtr pPixmap;
+	BoxPtr box;
+	Bool async;
+	int nbox, offsets[3], i;
+
+	IGNORE( sync );
+
+	if ( src_w <= 0 || src_h <= 0 || drw_w <= 0 || drw_h <= 0 ) return Success;
+
+	/* The request was only checked to hold an image of the size QueryImageAttributes clamped it to */
+	if ( width <= 0 || height <= 0 || width > MALI_VIDEO_MAX_WIDTH || height > MALI_VIDEO_MAX_HEIGHT ) return BadValue;
+	if ( src_x < 0 || src_y < 0 || src_x + src_w > width || src_y + src_h > height ) return BadValue;
+
+	if ( DRAWABLE_WINDOW == pDraw->type ) pPixmap = pScreen->GetWindowPixmap( (WindowPtr)pDraw );
+	else pPixmap = (PixmapPtr)pDraw;
+
+	if ( 32 != pPixmap->drawable.bitsPerPixel && 16 != pPixmap->drawable.bitsPerPixel ) return BadMatch;
+
+	/* The previous frame has to be out of the way, its slices and copy of the source get reused */
+	MaliVideoSync( pScreen );
+
+	if ( !video->threads_started ) video_start_threads( video );
+
+	for ( i = 0; i <= video->num_threads; i++ )
+	{
+		if ( !video_alloc_lines( &video->threads[i].lines, pPixmap->drawable.width ) )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate line buffers\n", __FUNCTION__, __LINE__ );
+			return BadAlloc;
+		}
+	}
+
+	memset( &frame, 0, sizeof(frame) );
+	frame.id = id;
+	frame.src_x = src_x;
+	frame.src_y = src_y;
+	frame.drw_x = drw_x;
+	frame.drw_y = drw_y;
+	frame.dx = ( src_w << 16 ) / drw_w;
+	frame.dy = ( src_h << 16 ) / drw_h;
+	frame.bt709 = pPriv->bt709;
+	frame.dst_bpp = pPixmap->drawable.bitsPerPixel;
+	frame.dst_pitch = pPixmap->devKind;
+
+	video_image_layout( id, ( width + 1 ) & ~1, ( height + 1 ) & ~1, frame.pitches, offsets );
+	frame.planes[0] = buf + offsets[0];
+	if ( FOURCC_YV12 == id )
+	{
+		/* Y, V, U */
+		frame.planes[1] = buf + offsets[2];
+		frame.planes[2] = buf + offsets[1];
+	}
+	else if ( FOURCC_I420 == id || FOURCC_NV12 == id )
+	{
+		frame.planes[1] = buf + offsets[1];
+		frame.planes[2] = buf + offsets[2];
+	}
+
+#ifdef COMPOSITE
+	/* Redirected windows live at an offset in their pixmap */
+	frame.x_off = -pPixmap->screen_x;
+	frame.y_off = -pPixmap->screen_y;
+#endif
+
+	/* Without EXA there is no marker to fence the frame with, nor any threads worth waking on a single core */
+	async = fPtr->use_xv_pipeline && fPtr->exa && video->num_threads > 0;
+	if ( async && !video_snapshot( video, &frame, width, height, src_w, src_h ) ) async = FALSE;
+
+	box = REGION_RECTS( clipBoxes );
+	nbox = REGION_NUM_RECTS( clipBoxes );
+
+	video->queued_slices = 0;
+	for ( ; nbox--; box++ )
+	{
+		BoxRec b;
+
+		/* Clip to the video and to the pixmap */
+		b.x1 = max( max( box->x1, drw_x ), -frame.x_off );
+		b.y1 = max( max( box->y1, drw_y ), -frame.y_off );
+		b.x2 = min( min( box->x2, drw_x + drw_w ), pPixmap->drawable.width - frame.x_off );
+		b.y2 = min( min( box->y2, drw_y + drw_h ), pPixmap->drawable.height - frame.y_off );
+
+		if ( b.x1 < b.x2 && b.y1 < b.y2 && !video_add_slices( video, &b ) )
+		{
+			xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate slices\n", __FUNCTION__, __LINE__ );
+			return BadAlloc;
+		}
+	}
+
+	if ( 0 == video->queued_slices ) return Success;
+
+	if ( fPtr->exa )
+	{
+		if ( !maliPixmapBeginCPUAccess( pPixmap ) ) return BadAlloc;
+	}
+	frame.dst = pPixmap->devPrivate.ptr;
+
+	/* EXA insists on pixmaps it has not prepared itself having no CPU pointer, the threads keep their own */
+	if ( fPtr->exa ) pPixmap->devPrivate.ptr = NULL;
+
+	video->pixmap = pPixmap;
+	pPixmap->refcnt++;
+	video->cpu_access = fPtr->exa != NULL;
+	video->busy = TRUE;
+
+	pthread_mutex_lock( &video->lock );
+	video->frame = frame;
+	video->next_slice = 0;
+	video->num_slices = video->queued_slices;
+	video->pending_slices = video->num_slices;
+	pthread_cond_broadcast( &video->work_cond );
+	pthread_mutex_unlock( &video->lock );
+
+	if ( async ) exaMarkSync( pScreen );
+	else MaliVideoSync( pScreen );
+
+	DamageDamageRegion( pDraw, clipBoxes );
+
+	return Success;
+}
+
+static int MaliVideoQueryImageAttributes( ScrnInfoPtr pScrn, int id, unsigned short *w, unsigned short *h, int *pitches, int *offsets )
+{
+	int p[3], o[3], size;
+
+	IGNORE( pScrn );
+
+	if ( *w > MALI_VIDEO_MAX_WIDTH ) *w = MALI_VIDEO_MAX_WIDTH;
+	if ( *h > MALI_VIDEO_MAX_HEIGHT ) *h = MALI_VIDEO_MAX_HEIGHT;
+
+	*w = ( *w + 1 ) & ~1;
+	if ( FOURCC_YUY2 != id ) *h = ( *h + 1 ) & ~1;
+
+	size = video_image_layout( id, *w, *h, p, o );
+
+	if ( pitches ) memcpy( pitches, p, sizeof(p) );
+	if ( offsets ) memcpy( offsets, o, sizeof(o) );
+
+	return size;
+}
+
+XF86VideoAdaptorPtr MaliVideoSetupAdaptor( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	struct mali_video *video;
+	XF86VideoAdaptorPtr adapt;
+	MaliPortPrivPtr pPriv;
+	long cpus;
+	int i;
+
+	video = calloc( 1, sizeof(struct mali_video) );
+	adapt = calloc( 1, sizeof(XF86VideoAdaptorRec) + MALI_VIDEO_NUM_PORTS * ( sizeof(DevUnion) + sizeof(MaliPortPrivRec) ) );
+	if ( NULL == video || NULL == adapt )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to allocate the Xv adaptor\n", __FUNCTION__, __LINE__ );
+		free( video );
+		free( adapt );
+		return NULL;
+	}
+
+	xvBT709 = MAKE_ATOM( "XV_ITURBT_709" );
+
+	adapt->type = XvWindowMask | XvPixmapMask | XvInputMask | XvImageMask;
+	adapt->flags = 0;
+	adapt->name = "Mali Video";
+	adapt->nEncodings = sizeof(mali_video_encodings) / sizeof(mali_video_encodings[0]);
+	adapt->pEncodings = mali_video_encodings;
+	adapt->nFormats = sizeof(mali_video_formats) / sizeof(mali_video_formats[0]);
+	adapt->pFormats = mali_video_formats;
+	adapt->nPorts = MALI_VIDEO_NUM_PORTS;
+	adapt->pPortPrivates = (DevUnion *)&adapt[1];
+	adapt->nAttributes = sizeof(mali_video_attributes) / sizeof(mali_video_attributes[0]);
+	adapt->pAttributes = mali_video_attributes;
+	adapt->nImages = sizeof(mali_video_images) / sizeof(mali_video_images[0]);
+	adapt->pImages = mali_video_images;
+	adapt->StopVideo = MaliVideoStopVideo;
+	adapt->SetPortAttribute = MaliVideoSetPortAttribute;
+	adapt->GetPortAttribute = MaliVideoGetPortAttribute;
+	adapt->QueryBestSize = MaliVideoQueryBestSize;
+	adapt->PutImage = MaliVideoPutImage;
+	adapt->QueryImageAttributes = MaliVideoQueryImageAttributes;
+
+	pPriv = (MaliPortPrivPtr)&adapt->pPortPrivates[MALI_VIDEO_NUM_PORTS];
+	for ( i = 0; i < MALI_VIDEO_NUM_PORTS; i++ )
+	{
+		adapt->pPortPrivates[i].ptr = &pPriv[i];
+	}
+
+	/* One thread per core, they are started on the first frame */
+	cpus = sysconf( _SC_NPROCESSORS_ONLN );
+	video->num_threads = ( cpus > 1 ) ? min( cpus, MALI_VIDEO_MAX_THREADS ) : 0;
+	for ( i = 0; i <= MALI_VIDEO_MAX_THREADS; i++ )
+	{
+		video->threads[i].video = video;
+	}
+
+	pthread_mutex_init( &video->lock, NULL );
+	pthread_cond_init( &video->work_cond, NULL );
+	pthread_cond_init( &video->done_cond, NULL );
+
+	video->pScrn = pScrn;
+	video->adaptor = adapt;
+	MALIPTR(pScrn)->video = video;
+
+	return adapt;
+}
+
+void MaliVideoCloseScreen( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_video *video = fPtr->video;
+	int i;
+
+	if ( NULL == video ) return;
+
+	MaliVideoSync( pScreen );
+
+	if ( video->threads_started )
+	{
+		pthread_mutex_lock( &video->lock );
+		video->quit = TRUE;
+		pthread_cond_broadcast( &video->work_cond );
+		pthread_mutex_unlock( &video->lock );
+
+		for ( i = 0; i < video->num_threads; i++ )
+		{
+			pthread_join( video->threads[i].thread, NULL );
+		}
+	}
+
+	for ( i = 0; i <= MALI_VIDEO_MAX_THREADS; i++ )
+	{
+		free( video->threads[i].lines.rgb );
+	}
+
+	pthread_mutex_destroy( &video->lock );
+	pthread_cond_destroy( &video->work_cond );
+	pthread_cond_destroy( &video->done_cond );
+
+	free( video->slices );
+	free( video->staging );
+	free( video->adaptor );
+	free( video );
+	fPtr->video = NULL;
+}
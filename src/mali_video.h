@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_VIDEO_H_
+#define _MALI_VIDEO_H_
+
+#include "xf86.h"
+#include "xf86xv.h"
+
+/*
+ * Textured-style Xv adaptor. Frames are converted from YUV and scaled by the
+ * CPU straight from the client's (shared memory) buffer into the destination
+ * drawable's pixmap, with no staging copy in between.
+ */
+extern XF86VideoAdaptorPtr MaliVideoSetupAdaptor( ScreenPtr pScreen );
+extern void MaliVideoCloseScreen( ScreenPtr pScreen );
+
+/*
+ * Frames are converted by a pool of threads and may still be in flight when
+ * PutImage returns. MaliVideoSync waits for the frame; MaliVideoBusy tells
+ * whether there is one that is not done yet.
+ */
+extern Bool MaliVideoBusy( ScreenPtr pScreen );
+extern void MaliVideoSync( ScreenPtr pScreen );
+
+#endif /* _MALI_VIDEO_H_ */
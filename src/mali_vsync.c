@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+
+#include "xf86.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_vsync.h"
+#include "mali_stats.h"
+
+/*
+ * The fbdev only offers a blocking FBIO_WAITFORVSYNC, so a helper thread sits
+ * in that ioctl whenever someone is waiting for a vblank and reports each one
+ * to the server through a pipe. The thread goes idle again as soon as nobody
+ * asked for the next vblank, so an idle desktop does not wake up 60 times a
+ * second. All event callbacks run on the server thread.
+ */
+
+typedef struct _MaliVSyncEvent
+{
+	MaliVSyncEventProc proc;
+	pointer data;
+	struct _MaliVSyncEvent *next;
+} MaliVSyncEventRec, *MaliVSyncEventPtr;
+
+struct mali_vsync
+{
+	ScrnInfoPtr pScrn;
+	int fb_fd;
+	int pipe_fd[2];
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* protected by lock */
+	Bool armed;
+	Bool quit;
+	Bool ioctl_failed;
+	CARD64 msc;
+	CARD64 ust;
+
+	/* only touched from the server thread */
+	CARD64 period;
+	Bool warned;
+	MaliVSyncEventPtr events;
+	MaliVSyncEventPtr *events_tail;
+};
+
+CARD64 MaliVSyncGetTime( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (CARD64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static CARD64 vsync_period_from_var( struct fb_var_screeninfo *var )
+{
+	CARD64 htotal = var->xres + var->left_margin + var->right_margin + var->hsync_len;
+	CARD64 vtotal = var->yres + var->upper_margin + var->lower_margin + var->vsync_len;
+
+	/* pixclock is in picoseconds, fall back to 60Hz for drivers that don't report timings */
+	if ( 0 == var->pixclock || 0 == htotal || 0 == vtotal ) return 1000000 / 60;
+
+	return ( htotal * vtotal * var->pixclock ) / 1000000;
+}
+
+static void vsync_sleep_until( CARD64 ust )
+{
+	struct timespec ts;
+
+	ts.tv_sec = ust / 1000000;
+	ts.tv_nsec = ( ust % 1000000 ) * 1000;
+
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR );
+}
+
+static void *vsync_thread( void *arg )
+{
+	struct mali_vsync *vs = arg;
+	CARD64 period = vs->period;
+	char byte = 0;
+
+	pthread_mutex_lock( &vs->lock );
+
+	while ( !vs->quit )
+	{
+		Bool use_ioctl;
+		CARD64 last, start, now;
+
+		if ( !vs->armed )
+		{
+			pthread_cond_wait( &vs->cond, &vs->lock );
+			continue;
+		}
+
+		use_ioctl = !vs->ioctl_failed;
+		last = vs->ust;
+		pthread_mutex_unlock( &vs->lock );
+
+		start = MaliVSyncGetTime();
+
+		if ( !use_ioctl || ioctl( vs->fb_fd, FBIO_WAITFORVSYNC, 0 ) < 0 )
+		{
+			/* Keep the cadence of the display without hardware help */
+			use_ioctl = FALSE;
+			now = MaliVSyncGetTime();
+			if ( last ) vsync_sleep_until( last + ( ( now - last ) / period + 1 ) * period );
+			else vsync_sleep_until( now + period );
+		}
+
+		now = MaliVSyncGetTime();
+
+		/* Only this thread writes these counters, no need to hold the lock for them */
+		MALI_STATS_INC( vs->pScrn, VSYNC_WAIT );
+		MALI_STATS_ADD( vs->pScrn, VSYNC_WAIT_TIME, now - start );
+
+		pthread_mutex_lock( &vs->lock );
+
+		if ( !use_ioctl ) vs->ioctl_failed = TRUE;
+
+		/* Account for the vblanks that went by while nobody was waiting */
+		if ( vs->ust && now > vs->ust + period + period / 2 ) vs->msc += ( now - vs->ust + period / 2 ) / period;
+		else vs->msc++;
+		vs->ust = now;
+		vs->armed = FALSE;
+
+		if ( write( vs->pipe_fd[1], &byte, 1 ) < 0 && errno != EAGAIN )
+		{
+			/* The server side is gone, nothing left to do */
+			break;
+		}
+	}
+
+	pthread_mutex_unlock( &vs->lock );
+
+	return NULL;
+}
+
+static void vsync_arm( struct mali_vsync *vs )
+{
+	pthread_mutex_lock( &vs->lock );
+	if ( !vs->armed )
+	{
+		vs->armed = TRUE;
+		pthread_cond_signal( &vs->cond );
+	}
+	pthread_mutex_unlock( &vs->lock );
+}
+
+static void vsync_dispatch( struct mali_vsync *vs )
+{
+	MaliVSyncEventPtr event, next;
+	CARD64 msc, ust;
+	Bool ioctl_failed;
+	char buf[16];
+
+	while ( read( vs->pipe_fd[0], buf, sizeof(buf) ) > 0 );
+
+	pthread_mutex_lock( &vs->lock );
+	msc = vs->msc;
+	ust = vs->ust;
+	ioctl_failed = vs->ioctl_failed;
+	pthread_mutex_unlock( &vs->lock );
+
+	if ( ioctl_failed && !vs->warned )
+	{
+		xf86DrvMsg( vs->pScrn->scrnIndex, X_WARNING, "FBIO_WAITFORVSYNC not supported, timing vblanks at %llu us\n", (unsigned long long)vs->period );
+		vs->warned = TRUE;
+	}
+
+	/* Detach the list first, callbacks may queue events for the next vblank */
+	event = vs->events;
+	vs->events = NULL;
+	vs->events_tail = &vs->events;
+
+	for ( ; event != NULL; event = next )
+	{
+		next = event->next;
+		event->proc( vs->pScrn, msc, ust, event->data );
+		free( event );
+	}
+}
+
+static void vsync_block_handler( pointer data, pointer pTimeout, pointer pReadmask )
+{
+	IGNORE( data );
+	IGNORE( pTimeout );
+	IGNORE( pReadmask );
+}
+
+static void vsync_wakeup_handler( pointer data, int result, pointer pReadmask )
+{
+	struct mali_vsync *vs = data;
+
+	if ( result <= 0 ) return;
+
+	if ( FD_ISSET( vs->pipe_fd[0], (fd_set *)pReadmask ) ) vsync_dispatch( vs );
+}
+
+Bool MaliVSyncQueueEvent( ScrnInfoPtr pScrn, MaliVSyncEventProc proc, pointer data )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_vsync *vs = fPtr->vsync;
+	MaliVSyncEventPtr event;
+
+	if ( NULL == vs ) return FALSE;
+
+	event = calloc( 1, sizeof(*event) );
+	if ( NULL == event ) return FALSE;
+
+	event->proc = proc;
+	event->data = data;
+	event->next = NULL;
+	*vs->events_tail = event;
+	vs->events_tail = &event->next;
+
+	vsync_arm( vs );
+
+	return TRUE;
+}
+
+void MaliVSyncGetLast( ScrnInfoPtr pScrn, CARD64 *msc, CARD64 *ust )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_vsync *vs = fPtr->vsync;
+
+	if ( NULL == vs )
+	{
+		*msc = 0;
+		*ust = 0;
+		return;
+	}
+
+	pthread_mutex_lock( &vs->lock );
+	*msc = vs->msc;
+	*ust = vs->ust;
+	pthread_mutex_unlock( &vs->lock );
+}
+
+/* Estimate the vblank count at ust, which may lie past the last vblank the thread has seen */
+CARD64 MaliVSyncGetMSC( ScrnInfoPtr pScrn, CARD64 ust )
+{
+	CARD64 msc, last, period;
+
+	MaliVSyncGetLast( pScrn, &msc, &last );
+	if ( 0 == last || ust <= last ) return msc;
+
+	period = MaliVSyncGetPeriod( pScrn );
+
+	return msc + ( ust - last + period / 2 ) / period;
+}
+
+CARD64 MaliVSyncGetPeriod( ScrnInfoPtr pScrn )
+{
+	MaliPtr fPtr = MALIPTR(pScrn);
+
+	if ( NULL == fPtr->vsync ) return vsync_period_from_var( &fPtr->fb_lcd_var );
+
+	return fPtr->vsync->period;
+}
+
+Bool MaliVSyncInit( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_vsync *vs;
+	sigset_t block, saved;
+	int ret;
+
+	vs = calloc( 1, sizeof(*vs) );
+	if ( NULL == vs ) return FALSE;
+
+	vs->pScrn = pScrn;
+	vs->fb_fd = fPtr->fb_lcd_fd;
+	vs->period = vsync_period_from_var( &fPtr->fb_lcd_var );
+	vs->events = NULL;
+	vs->events_tail = &vs->events;
+
+	if ( pipe( vs->pipe_fd ) < 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to create vsync pipe: %s\n", __FUNCTION__, __LINE__, strerror(errno) );
+		free( vs );
+		return FALSE;
+	}
+
+	fcntl( vs->pipe_fd[0], F_SETFL, O_NONBLOCK );
+	fcntl( vs->pipe_fd[1], F_SETFL, O_NONBLOCK );
+	fcntl( vs->pipe_fd[0], F_SETFD, FD_CLOEXEC );
+	fcntl( vs->pipe_fd[1], F_SETFD, FD_CLOEXEC );
+
+	pthread_mutex_init( &vs->lock, NULL );
+	pthread_cond_init( &vs->cond, NULL );
+
+	/* The thread inherits the mask, and the server's signal handlers must only ever run on the main thread */
+	sigfillset( &block );
+	pthread_sigmask( SIG_BLOCK, &block, &saved );
+	ret = pthread_create( &vs->thread, NULL, vsync_thread, vs );
+	pthread_sigmask( SIG_SETMASK, &saved, NULL );
+
+	if ( ret != 0 )
+	{
+		xf86DrvMsg( pScrn->scrnIndex, X_ERROR, "[%s:%d] failed to start vsync thread\n", __FUNCTION__, __LINE__ );
+		close( vs->pipe_fd[0] );
+		close( vs->pipe_fd[1] );
+		pthread_mutex_destroy( &vs->lock );
+		pthread_cond_destroy( &vs->cond );
+		free( vs );
+		return FALSE;
+	}
+
+	AddGeneralSocket( vs->pipe_fd[0] );
+	RegisterBlockAndWakeupHandlers( vsync_block_handler, vsync_wakeup_handler, vs );
+
+	fPtr->vsync = vs;
+
+	xf86DrvMsg( pScrn->scrnIndex, X_INFO, "vblank period %llu us\n", (unsigned long long)vs->period );
+
+	return TRUE;
+}
+
+void MaliVSyncClose( ScreenPtr pScreen )
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	MaliPtr fPtr = MALIPTR(pScrn);
+	struct mali_vsync *vs = fPtr->vsync;
+	MaliVSyncEventPtr event, next;
+	CARD64 msc, ust;
+
+	if ( NULL == vs ) return;
+
+	pthread_mutex_lock( &vs->lock );
+	vs->quit = TRUE;
+	pthread_cond_signal( &vs->cond );
+	pthread_mutex_unlock( &vs->lock );
+
+	/* The thread may be blocked in the vsync ioctl for up to one frame */
+	pthread_join( vs->thread, NULL );
+
+	RemoveBlockAndWakeupHandlers( vsync_block_handler, vsync_wakeup_handler, vs );
+	RemoveGeneralSocket( vs->pipe_fd[0] );
+
+	/* Deliver whatever is still pending so that the owners can release their data */
+	msc = vs->msc;
+	ust = vs->ust;
+	for ( event = vs->events; event != NULL; event = next )
+	{
+		next = event->next;
+		event->proc( pScrn, msc, ust, event->data );
+		free( event );
+	}
+
+	close( vs->pipe_fd[0] );
+	close( vs->pipe_fd[1] );
+	pthread_mutex_destroy( &vs->lock );
+	pthread_cond_destroy( &vs->cond );
+	free( vs );
+
+	fPtr->vsync = NULL;
+}
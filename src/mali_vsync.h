@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MALI_VSYNC_H_
+#define _MALI_VSYNC_H_
+
+#include "xf86.h"
+
+/*
+ * Called from the server main loop once the vblank following the request has
+ * happened. msc counts vblanks since the screen was initialised and ust is the
+ * CLOCK_MONOTONIC time of that vblank in microseconds.
+ */
+typedef void (*MaliVSyncEventProc)( ScrnInfoPtr pScrn, CARD64 msc, CARD64 ust, pointer data );
+
+extern Bool MaliVSyncInit( ScreenPtr pScreen );
+extern void MaliVSyncClose( ScreenPtr pScreen );
+extern Bool MaliVSyncQueueEvent( ScrnInfoPtr pScrn, MaliVSyncEventProc proc, pointer data );
+extern void MaliVSyncGetLast( ScrnInfoPtr pScrn, CARD64 *msc, CARD64 *ust );
+extern CARD64 MaliVSyncGetMSC( ScrnInfoPtr pScrn, CARD64 ust );
+extern CARD64 MaliVSyncGetPeriod( ScrnInfoPtr pScrn );
+extern CARD64 MaliVSyncGetTime( void );
+
+#endif /* _MALI_VSYNC_H_ */
@@ -0,0 +1,812 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+
+#include "xf86.h"
+#include "xf86drm.h"
+#include "exa.h"
+#include "dri2.h"
+#include "damage.h"
+#include "gcstruct.h"
+#include "windowstr.h"
+#include "regionstr.h"
+#include "privates.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_exa.h"
+#include "mali_dri.h"
+#include "mali_vsync.h"
+
+#include "dri2_stub.h"
+
+#define STUB_WINDOW_PRIVATES 64
+#define STUB_HANDLERS 4
+#define STUB_RESOURCES 64
+#define STUB_RESOURCE_TYPES 4
+
+struct stub_window
+{
+	WindowRec window;
+	PixmapPtr pixmap;
+	Bool own_pixmap;
+	pointer privates[STUB_WINDOW_PRIVATES / sizeof(pointer)];
+};
+
+struct stub_gc
+{
+	GC gc;
+	RegionPtr clip;
+};
+
+struct stub_resource
+{
+	XID id;
+	RESTYPE type;
+	pointer value;
+};
+
+struct stub_handler
+{
+	BlockHandlerProcPtr block;
+	WakeupHandlerProcPtr wakeup;
+	pointer data;
+};
+
+ScreenInfo screenInfo;
+unsigned long globalSerialNumber;
+unsigned long serverGeneration = 1;
+CallbackListPtr ClientStateCallback;
+static ClientRec server_client;
+ClientPtr serverClient = &server_client;
+
+BoxRec RegionEmptyBox;
+RegDataRec RegionEmptyData;
+RegDataRec RegionBrokenData;
+
+static struct dri2_stub *current;
+static int window_privates_size;
+static struct stub_handler handlers[STUB_HANDLERS];
+static struct stub_resource resources[STUB_RESOURCES];
+static DeleteType resource_types[STUB_RESOURCE_TYPES];
+static int num_resource_types;
+static fd_set sockets;
+static int max_socket = -1;
+
+/* Regions, everything else comes inline from regionstr.h */
+
+RegionPtr RegionCreate( BoxPtr rect, int size )
+{
+	RegionPtr pReg = malloc( sizeof(*pReg) );
+
+	if ( pReg ) RegionInit( pReg, rect, size );
+
+	return pReg;
+}
+
+void RegionDestroy( RegionPtr pReg )
+{
+	RegionUninit( pReg );
+	free( pReg );
+}
+
+/* Privates, only window ones are used */
+
+Bool dixRegisterPrivateKey( DevPrivateKey key, DevPrivateType type, unsigned size )
+{
+	int bytes = size ? (int)size : (int)sizeof(pointer);
+
+	if ( key->initialized ) return TRUE;
+	if ( PRIVATE_WINDOW != type || window_privates_size + bytes > STUB_WINDOW_PRIVATES ) return FALSE;
+
+	key->offset = window_privates_size;
+	key->size = size;
+	key->type = type;
+	key->initialized = TRUE;
+	window_privates_size += ( bytes + sizeof(pointer) - 1 ) & ~( sizeof(pointer) - 1 );
+
+	return TRUE;
+}
+
+/* Resources, only the driver's own are tracked, so there is no reuse of XIDs to worry about */
+
+RESTYPE CreateNewResourceType( DeleteType deleteFunc, const char *name )
+{
+	(void)name;
+
+	if ( num_resource_types == STUB_RESOURCE_TYPES ) return 0;
+
+	resource_types[num_resource_types++] = deleteFunc;
+
+	return num_resource_types;
+}
+
+Bool AddResource( XID id, RESTYPE type, pointer value )
+{
+	int i;
+
+	for ( i = 0; i < STUB_RESOURCES; i++ )
+	{
+		if ( 0 == resources[i].type )
+		{
+			resources[i].id = id;
+			resources[i].type = type;
+			resources[i].value = value;
+			return TRUE;
+		}
+	}
+
+	resource_types[type - 1]( value, id );
+
+	return FALSE;
+}
+
+void FreeResourceByType( XID id, RESTYPE type, Bool skipFree )
+{
+	int i;
+
+	for ( i = 0; i < STUB_RESOURCES; i++ )
+	{
+		if ( resources[i].id == id && resources[i].type == type )
+		{
+			resources[i].type = 0;
+			if ( !skipFree ) resource_types[type - 1]( resources[i].value, id );
+			return;
+		}
+	}
+}
+
+/* What the server does for every resource of a drawable that goes away */
+static void free_resources( XID id )
+{
+	int i;
+
+	for ( i = 0; i < STUB_RESOURCES; i++ )
+	{
+		if ( resources[i].type && resources[i].id == id ) FreeResourceByType( id, resources[i].type, FALSE );
+	}
+}
+
+int dixLookupResourceByType( pointer *result, XID id, RESTYPE type, ClientPtr client, Mask access_mode )
+{
+	int i;
+
+	(void)client;
+	(void)access_mode;
+
+	for ( i = 0; i < STUB_RESOURCES; i++ )
+	{
+		if ( resources[i].id == id && resources[i].type == type )
+		{
+			*result = resources[i].value;
+			return Success;
+		}
+	}
+
+	return BadValue;
+}
+
+/* There is a single client, which never disconnects */
+
+Bool AddCallback( CallbackListPtr *pcbl, CallbackProcPtr callback, pointer data )
+{
+	(void)pcbl;
+	(void)callback;
+	(void)data;
+
+	return TRUE;
+}
+
+Bool DeleteCallback( CallbackListPtr *pcbl, CallbackProcPtr callback, pointer data )
+{
+	(void)pcbl;
+	(void)callback;
+	(void)data;
+
+	return TRUE;
+}
+
+/* The window tree */
+
+int TraverseTree( WindowPtr pWin, VisitWindowProcPtr func, pointer data )
+{
+	WindowPtr pChild;
+	int result;
+
+	if ( NULL == pWin ) return WT_NOMATCH;
+
+	result = func( pWin, data );
+	if ( WT_STOPWALKING == result ) return WT_STOPWALKING;
+	if ( WT_DONTWALKCHILDREN == result ) return WT_WALKCHILDREN;
+
+	for ( pChild = pWin->firstChild; pChild; pChild = pChild->nextSib )
+	{
+		if ( WT_STOPWALKING == TraverseTree( pChild, func, data ) ) return WT_STOPWALKING;
+	}
+
+	return WT_WALKCHILDREN;
+}
+
+int WalkTree( ScreenPtr pScreen, VisitWindowProcPtr func, pointer data )
+{
+	return TraverseTree( pScreen->root, func, data );
+}
+
+struct lookup
+{
+	XID id;
+	WindowPtr found;
+};
+
+static int lookup_window( WindowPtr pWin, pointer data )
+{
+	struct lookup *lookup = data;
+
+	if ( pWin->drawable.id != lookup->id ) return WT_WALKCHILDREN;
+
+	lookup->found = pWin;
+
+	return WT_STOPWALKING;
+}
+
+int dixLookupDrawable( DrawablePtr *pDraw, XID id, ClientPtr client, Mask type_mask, Mask access_mode )
+{
+	struct lookup lookup = { id, NULL };
+
+	(void)client;
+	(void)type_mask;
+	(void)access_mode;
+
+	*pDraw = NULL;
+	if ( NULL == current ) return BadDrawable;
+
+	TraverseTree( current->root, lookup_window, &lookup );
+	if ( NULL == lookup.found ) return BadDrawable;
+
+	*pDraw = &lookup.found->drawable;
+
+	return Success;
+}
+
+static PixmapPtr stub_get_window_pixmap( WindowPtr pWin )
+{
+	return ( (struct stub_window *)pWin )->pixmap;
+}
+
+static void stub_set_window_pixmap( WindowPtr pWin, PixmapPtr pPixmap )
+{
+	( (struct stub_window *)pWin )->pixmap = pPixmap;
+}
+
+static void stub_set_screen_pixmap( PixmapPtr pPixmap )
+{
+	struct stub_screen *stub = (struct stub_screen *)pPixmap->drawable.pScreen;
+
+	stub->screen_pixmap = pPixmap;
+}
+
+static Bool stub_create_window( WindowPtr pWin )
+{
+	(void)pWin;
+
+	return TRUE;
+}
+
+static Bool stub_destroy_window( WindowPtr pWin )
+{
+	(void)pWin;
+
+	return TRUE;
+}
+
+static void stub_source_validate( DrawablePtr pDraw, int x, int y, int width, int height, unsigned int subWindowMode )
+{
+	(void)pDraw;
+	(void)x;
+	(void)y;
+	(void)width;
+	(void)height;
+	(void)subWindowMode;
+}
+
+WindowPtr dri2_stub_create_window( struct dri2_stub *dri2, WindowPtr parent, int x, int y, int width, int height, Bool redirected )
+{
+	ScreenPtr pScreen = &dri2->stub->screen;
+	struct stub_window *win = calloc( 1, sizeof(*win) );
+	WindowPtr pWin;
+
+	if ( NULL == win ) return NULL;
+
+	pWin = &win->window;
+	pWin->drawable.type = DRAWABLE_WINDOW;
+	pWin->drawable.class = InputOutput;
+	pWin->drawable.depth = dri2->stub->scrn.depth;
+	pWin->drawable.bitsPerPixel = dri2->stub->scrn.bitsPerPixel;
+	pWin->drawable.id = dri2->next_id++;
+	pWin->drawable.x = x;
+	pWin->drawable.y = y;
+	pWin->drawable.width = width;
+	pWin->drawable.height = height;
+	pWin->drawable.pScreen = pScreen;
+	pWin->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+	pWin->devPrivates = (PrivateRec *)win->privates;
+	pWin->mapped = TRUE;
+	pWin->realized = TRUE;
+	pWin->viewable = TRUE;
+	pWin->redirectDraw = RedirectDrawNone;
+
+	if ( NULL == parent )
+	{
+		win->pixmap = pScreen->GetScreenPixmap( pScreen );
+	}
+	else if ( redirected )
+	{
+		/* What Composite does: an offscreen pixmap positioned where the window is */
+		win->pixmap = pScreen->CreatePixmap( pScreen, width, height, pWin->drawable.depth, 0 );
+		if ( NULL == win->pixmap )
+		{
+			free( win );
+			return NULL;
+		}
+		win->pixmap->screen_x = x;
+		win->pixmap->screen_y = y;
+		win->own_pixmap = TRUE;
+		pWin->redirectDraw = RedirectDrawManual;
+	}
+	else
+	{
+		win->pixmap = pScreen->GetWindowPixmap( parent );
+	}
+
+	/* The new window goes on top of its siblings */
+	pWin->parent = parent;
+	if ( parent )
+	{
+		pWin->nextSib = parent->firstChild;
+		if ( parent->firstChild ) parent->firstChild->prevSib = pWin;
+		else parent->lastChild = pWin;
+		parent->firstChild = pWin;
+	}
+
+	if ( !pScreen->CreateWindow( pWin ) )
+	{
+		dri2_stub_destroy_window( dri2, pWin );
+		return NULL;
+	}
+
+	return pWin;
+}
+
+void dri2_stub_destroy_window( struct dri2_stub *dri2, WindowPtr pWin )
+{
+	ScreenPtr pScreen = &dri2->stub->screen;
+	struct stub_window *win = (struct stub_window *)pWin;
+
+	while ( pWin->firstChild ) dri2_stub_destroy_window( dri2, pWin->firstChild );
+
+	free_resources( pWin->drawable.id );
+	pScreen->DestroyWindow( pWin );
+
+	if ( pWin->parent )
+	{
+		if ( pWin->prevSib ) pWin->prevSib->nextSib = pWin->nextSib;
+		else pWin->parent->firstChild = pWin->nextSib;
+		if ( pWin->nextSib ) pWin->nextSib->prevSib = pWin->prevSib;
+		else pWin->parent->lastChild = pWin->prevSib;
+	}
+
+	if ( win->own_pixmap ) pScreen->DestroyPixmap( win->pixmap );
+	free( win );
+}
+
+/* Scratch GCs, only CopyArea between drawables of the same format is supported */
+
+static PixmapPtr drawable_pixmap( DrawablePtr pDraw, int *x, int *y )
+{
+	PixmapPtr pPixmap;
+
+	if ( DRAWABLE_PIXMAP == pDraw->type )
+	{
+		*x = 0;
+		*y = 0;
+		return (PixmapPtr)pDraw;
+	}
+
+	pPixmap = pDraw->pScreen->GetWindowPixmap( (WindowPtr)pDraw );
+	*x = pDraw->x - pPixmap->screen_x;
+	*y = pDraw->y - pPixmap->screen_y;
+
+	return pPixmap;
+}
+
+/* As exaCopyNtoN does: through the driver's Copy when it takes it, otherwise mapped and copied by the CPU */
+static RegionPtr stub_copy_area( DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC, int srcx, int srcy, int width, int height, int dstx, int dsty )
+{
+	struct stub_gc *gc = (struct stub_gc *)pGC;
+	ExaDriverPtr exa = current->stub->mali.exa;
+	PixmapPtr src, dst;
+	int src_x, src_y, dst_x, dst_y, cpp, i, n;
+	int xdir = 1, ydir = 1;
+	Bool accelerated;
+	BoxRec clip = { 0, 0, pDst->width, pDst->height };
+	BoxPtr boxes = &clip;
+
+	src = drawable_pixmap( pSrc, &src_x, &src_y );
+	dst = drawable_pixmap( pDst, &dst_x, &dst_y );
+	cpp = dst->drawable.bitsPerPixel / 8;
+
+	if ( src->drawable.bitsPerPixel != dst->drawable.bitsPerPixel ) return NULL;
+
+	if ( src == dst )
+	{
+		xdir = src_x + srcx < dst_x + dstx ? -1 : 1;
+		ydir = src_y + srcy < dst_y + dsty ? -1 : 1;
+	}
+
+	accelerated = exa->PrepareCopy( src, dst, xdir, ydir, GXcopy, ~0UL );
+	if ( !accelerated )
+	{
+		if ( !exa->PrepareAccess( src, EXA_PREPARE_SRC ) ) return NULL;
+		if ( src != dst && !exa->PrepareAccess( dst, EXA_PREPARE_DEST ) )
+		{
+			exa->FinishAccess( src, EXA_PREPARE_SRC );
+			return NULL;
+		}
+	}
+
+	n = 1;
+	if ( gc->clip )
+	{
+		n = RegionNumRects( gc->clip );
+		boxes = RegionRects( gc->clip );
+	}
+
+	for ( i = 0; i < n; i++ )
+	{
+		int x1 = max( max( boxes[i].x1, dstx ), 0 );
+		int y1 = max( max( boxes[i].y1, dsty ), 0 );
+		int x2 = min( min( boxes[i].x2, dstx + width ), pDst->width );
+		int y2 = min( min( boxes[i].y2, dsty + height ), pDst->height );
+		int y;
+
+		if ( x2 <= x1 || y2 <= y1 ) continue;
+
+		if ( accelerated )
+		{
+			exa->Copy( dst, src_x + srcx + x1 - dstx, src_y + srcy + y1 - dsty, dst_x + x1, dst_y + y1, x2 - x1, y2 - y1 );
+			continue;
+		}
+
+		for ( y = y1; y < y2; y++ )
+		{
+			unsigned char *s = (unsigned char *)src->devPrivate.ptr + ( src_y + srcy + y - dsty ) * src->devKind + ( src_x + srcx + x1 - dstx ) * cpp;
+			unsigned char *d = (unsigned char *)dst->devPrivate.ptr + ( dst_y + y ) * dst->devKind + ( dst_x + x1 ) * cpp;
+
+			memmove( d, s, ( x2 - x1 ) * cpp );
+		}
+	}
+
+	if ( accelerated ) exa->DoneCopy( dst );
+	else
+	{
+		if ( src != dst ) exa->FinishAccess( dst, EXA_PREPARE_DEST );
+		exa->FinishAccess( src, EXA_PREPARE_SRC );
+	}
+
+	current->copies++;
+
+	return NULL;
+}
+
+static void stub_change_clip( GCPtr pGC, int type, pointer pvalue, int nrects )
+{
+	struct stub_gc *gc = (struct stub_gc *)pGC;
+
+	(void)nrects;
+
+	if ( gc->clip ) RegionDestroy( gc->clip );
+	gc->clip = CT_REGION == type ? pvalue : NULL;
+}
+
+static GCOps stub_gc_ops = { .CopyArea = stub_copy_area };
+static GCFuncs stub_gc_funcs = { .ChangeClip = stub_change_clip };
+
+GCPtr GetScratchGC( unsigned depth, ScreenPtr pScreen )
+{
+	struct stub_gc *gc = calloc( 1, sizeof(*gc) );
+
+	(void)depth;
+	(void)pScreen;
+
+	if ( NULL == gc ) return NULL;
+
+	gc->gc.ops = &stub_gc_ops;
+	gc->gc.funcs = &stub_gc_funcs;
+
+	return &gc->gc;
+}
+
+void FreeScratchGC( GCPtr pGC )
+{
+	struct stub_gc *gc = (struct stub_gc *)pGC;
+
+	if ( gc->clip ) RegionDestroy( gc->clip );
+	free( gc );
+}
+
+void ValidateGC( DrawablePtr pDraw, GCPtr pGC )
+{
+	(void)pDraw;
+	(void)pGC;
+}
+
+void DamageDamageRegion( DrawablePtr pDraw, RegionPtr pRegion )
+{
+	(void)pDraw;
+	(void)pRegion;
+
+	current->damage_reports++;
+}
+
+void exaMoveInPixmap( PixmapPtr pPixmap )
+{
+	(void)pPixmap;
+}
+
+/* The loader and the DRI2 module */
+
+pointer xf86LoaderCheckSymbol( const char *name )
+{
+	return 0 == strcmp( name, "DRI2Version" ) ? (pointer)DRI2Version : NULL;
+}
+
+void DRI2Version( int *major, int *minor )
+{
+	*major = 1;
+	*minor = 2;
+}
+
+Bool DRI2ScreenInit( ScreenPtr pScreen, DRI2InfoRec *info )
+{
+	(void)pScreen;
+
+	current->info = *info;
+	current->initialized = TRUE;
+
+	return TRUE;
+}
+
+void DRI2CloseScreen( ScreenPtr pScreen )
+{
+	(void)pScreen;
+
+	current->initialized = FALSE;
+}
+
+/* As in the DRI2 module, short of checking that nothing covers the window */
+Bool DRI2CanFlip( DrawablePtr pDraw )
+{
+	ScreenPtr pScreen = pDraw->pScreen;
+	PixmapPtr pWinPixmap;
+
+	if ( DRAWABLE_PIXMAP == pDraw->type ) return TRUE;
+
+	pWinPixmap = pScreen->GetWindowPixmap( (WindowPtr)pDraw );
+	if ( pWinPixmap != pScreen->GetWindowPixmap( pScreen->root ) ) return FALSE;
+
+	return pDraw->x == 0 && pDraw->y == 0 &&
+	       pDraw->width == pWinPixmap->drawable.width &&
+	       pDraw->height == pWinPixmap->drawable.height;
+}
+
+void DRI2SwapComplete( ClientPtr client, DrawablePtr pDraw, int frame, unsigned int tv_sec, unsigned int tv_usec, int type, DRI2SwapEventPtr swap_complete, void *swap_data )
+{
+	if ( swap_complete ) swap_complete( client, swap_data, type, frame, tv_sec, tv_usec );
+	(void)pDraw;
+
+	current->swaps_completed++;
+}
+
+Bool DRI2SwapLimit( DrawablePtr pDraw, int swap_limit )
+{
+	(void)pDraw;
+	(void)swap_limit;
+
+	return TRUE;
+}
+
+void DRI2InvalidateDrawable( DrawablePtr pDraw )
+{
+	(void)pDraw;
+
+	current->invalidates++;
+}
+
+/*
+ * MaliDRI2ScreenInit looks for the DRM device node matching the screen's
+ * drm_fd. There is no DRM device here, so every node in the DRM directory
+ * is reported to be the one the stub opened instead. This relies on stat()
+ * being a real function, which it is since glibc 2.33.
+ */
+int stat( const char *path, struct stat *buf )
+{
+	if ( current && 0 == strncmp( path, DRM_DIR_NAME "/", strlen( DRM_DIR_NAME ) + 1 ) ) return fstat( current->drm_fd, buf );
+
+	return fstatat( AT_FDCWD, path, buf, 0 );
+}
+
+/* The dispatch loop */
+
+Bool RegisterBlockAndWakeupHandlers( BlockHandlerProcPtr blockHandler, WakeupHandlerProcPtr wakeupHandler, pointer blockData )
+{
+	int i;
+
+	for ( i = 0; i < STUB_HANDLERS; i++ )
+	{
+		if ( NULL != handlers[i].block || NULL != handlers[i].wakeup ) continue;
+
+		handlers[i].block = blockHandler;
+		handlers[i].wakeup = wakeupHandler;
+		handlers[i].data = blockData;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+void RemoveBlockAndWakeupHandlers( BlockHandlerProcPtr blockHandler, WakeupHandlerProcPtr wakeupHandler, pointer blockData )
+{
+	int i;
+
+	for ( i = 0; i < STUB_HANDLERS; i++ )
+	{
+		if ( handlers[i].block == blockHandler && handlers[i].wakeup == wakeupHandler && handlers[i].data == blockData )
+		{
+			memset( &handlers[i], 0, sizeof(handlers[i]) );
+		}
+	}
+}
+
+void AddGeneralSocket( int fd )
+{
+	FD_SET( fd, &sockets );
+	if ( fd > max_socket ) max_socket = fd;
+}
+
+void RemoveGeneralSocket( int fd )
+{
+	FD_CLR( fd, &sockets );
+}
+
+int dri2_stub_dispatch( struct dri2_stub *dri2, int timeout )
+{
+	struct timeval tv, *ptv = NULL;
+	fd_set readmask = sockets;
+	int i, result;
+
+	(void)dri2;
+
+	if ( timeout >= 0 )
+	{
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = ( timeout % 1000 ) * 1000;
+		ptv = &tv;
+	}
+
+	for ( i = 0; i < STUB_HANDLERS; i++ )
+	{
+		if ( handlers[i].block ) handlers[i].block( handlers[i].data, &ptv, &readmask );
+	}
+
+	result = select( max_socket + 1, &readmask, NULL, NULL, ptv );
+	if ( result < 0 && EINTR == errno ) result = 0;
+
+	for ( i = 0; i < STUB_HANDLERS; i++ )
+	{
+		if ( handlers[i].wakeup ) handlers[i].wakeup( handlers[i].data, result, &readmask );
+	}
+
+	return result;
+}
+
+/* Screen setup, in the order MaliScreenInit goes through it */
+
+struct dri2_stub *dri2_stub_init( struct stub_screen *stub, int swap_limit, Bool vsync, Bool adaptive )
+{
+	struct dri2_stub *dri2;
+	ScreenPtr pScreen = &stub->screen;
+	MaliPtr fPtr = &stub->mali;
+
+	if ( current ) return NULL;
+
+	dri2 = calloc( 1, sizeof(*dri2) );
+	if ( NULL == dri2 ) return NULL;
+
+	dri2->stub = stub;
+	dri2->next_id = 0x200000;
+	dri2->drm_fd = open( "/dev/null", O_RDWR );
+	if ( dri2->drm_fd < 0 )
+	{
+		free( dri2 );
+		return NULL;
+	}
+	current = dri2;
+
+	screenInfo.numScreens = 1;
+	screenInfo.screens[0] = pScreen;
+
+	pScreen->GetWindowPixmap = stub_get_window_pixmap;
+	pScreen->SetWindowPixmap = stub_set_window_pixmap;
+	pScreen->SetScreenPixmap = stub_set_screen_pixmap;
+	pScreen->CreateWindow = stub_create_window;
+	pScreen->DestroyWindow = stub_destroy_window;
+	pScreen->SourceValidate = stub_source_validate;
+
+	fPtr->drm_fd = dri2->drm_fd;
+	fPtr->dri_render = DRI_2;
+	fPtr->use_pageflipping = TRUE;
+	fPtr->use_pageflipping_vsync = vsync;
+	fPtr->use_pageflipping_vsync_adaptive = adaptive;
+	fPtr->swap_limit = swap_limit;
+
+	if ( !MaliVSyncInit( pScreen ) ) goto fail;
+	if ( !MaliDRI2ScreenInit( pScreen ) || !dri2->initialized ) goto fail_vsync;
+	if ( !MaliDRI2ScreenInitWindows( pScreen ) ) goto fail_dri2;
+
+	dri2->root = dri2_stub_create_window( dri2, NULL, 0, 0, pScreen->width, pScreen->height, FALSE );
+	if ( NULL == dri2->root ) goto fail_dri2;
+	pScreen->root = dri2->root;
+
+	return dri2;
+
+fail_dri2:
+	MaliDRI2CloseScreen( pScreen );
+fail_vsync:
+	MaliVSyncClose( pScreen );
+fail:
+	close( dri2->drm_fd );
+	current = NULL;
+	free( dri2 );
+	return NULL;
+}
+
+void dri2_stub_close( struct dri2_stub *dri2 )
+{
+	ScreenPtr pScreen = &dri2->stub->screen;
+
+	dri2_stub_destroy_window( dri2, dri2->root );
+	pScreen->root = NULL;
+
+	MaliDRI2CloseScreen( pScreen );
+	MaliVSyncClose( pScreen );
+
+	close( dri2->drm_fd );
+	if ( current == dri2 ) current = NULL;
+	free( dri2 );
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _DRI2_STUB_H_
+#define _DRI2_STUB_H_
+
+#include "xf86.h"
+#include "dri2.h"
+#include "windowstr.h"
+
+#include "xserver_stub.h"
+
+/*
+ * The rest of the server the DRI2 and vsync code in src/mali_dri.c and
+ * src/mali_vsync.c calls into: a window tree, drawable lookup, window
+ * privates, scratch GCs copying through the EXA access hooks, damage, the
+ * DRI2 module and the block and wakeup handlers of the dispatch loop.
+ *
+ * dri2_stub_init() sets the screen up the way MaliScreenInit does and keeps
+ * the DRI2InfoRec the driver registers, so the benchmark calls the real
+ * buffer and swap hooks through it.
+ */
+struct dri2_stub
+{
+	struct stub_screen *stub;
+	DRI2InfoRec info;
+	Bool initialized;
+	int drm_fd;
+
+	WindowPtr root;
+	XID next_id;
+
+	/* What the driver asked of the server */
+	unsigned long swaps_completed;
+	unsigned long damage_reports;
+	unsigned long copies;
+	unsigned long invalidates;
+};
+
+extern struct dri2_stub *dri2_stub_init( struct stub_screen *stub, int swap_limit, Bool vsync, Bool adaptive );
+extern void dri2_stub_close( struct dri2_stub *dri2 );
+
+/* A mapped InputOutput window, stacked on top of its siblings. Redirected windows get a pixmap of their own. */
+extern WindowPtr dri2_stub_create_window( struct dri2_stub *dri2, WindowPtr parent, int x, int y, int width, int height, Bool redirected );
+extern void dri2_stub_destroy_window( struct dri2_stub *dri2, WindowPtr pWin );
+
+/* One pass of the server's WaitForSomething: block for up to timeout ms (-1 waits forever) and run the wakeup handlers */
+extern int dri2_stub_dispatch( struct dri2_stub *dri2, int timeout );
+
+#endif /* _DRI2_STUB_H_ */
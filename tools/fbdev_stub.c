@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mali_def.h"
+#include "ump_stub.h"
+#include "fbdev_stub.h"
+
+static struct fbdev_stub *device;
+
+static uint64_t stub_time( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void stub_set_format( struct fb_var_screeninfo *var )
+{
+	if ( 16 == var->bits_per_pixel )
+	{
+		var->red.offset = 11;
+		var->red.length = 5;
+		var->green.offset = 5;
+		var->green.length = 6;
+		var->blue.offset = 0;
+		var->blue.length = 5;
+		var->transp.length = 0;
+	}
+	else
+	{
+		var->red.offset = 16;
+		var->red.length = 8;
+		var->green.offset = 8;
+		var->green.length = 8;
+		var->blue.offset = 0;
+		var->blue.length = 8;
+		var->transp.offset = 24;
+		var->transp.length = 8;
+	}
+}
+
+struct fbdev_stub *fbdev_stub_create( int xres, int yres, int bpp, int buffers )
+{
+	struct fbdev_stub *fb;
+	size_t pitch = (size_t)xres * bpp / 8;
+	int i;
+
+	if ( device || buffers < 1 || buffers > 2 ) return NULL;
+
+	fb = calloc( 1, sizeof(*fb) );
+	if ( NULL == fb ) return NULL;
+
+	fb->size = pitch * yres * buffers;
+	fb->buffers = buffers;
+	fb->fd = memfd_create( "mali-fbdev-stub", 0 );
+	if ( fb->fd < 0 || ftruncate( fb->fd, fb->size ) < 0 ) goto fail;
+
+	fb->virt = mmap( NULL, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fb->fd, 0 );
+	if ( MAP_FAILED == fb->virt ) goto fail;
+
+	fb->var.xres = fb->var.xres_virtual = xres;
+	fb->var.yres = yres;
+	fb->var.yres_virtual = yres * buffers;
+	fb->var.bits_per_pixel = bpp;
+	fb->var.pixclock = (uint32_t)( 1000000000000ULL / ( (uint64_t)xres * yres * 60 ) );
+	stub_set_format( &fb->var );
+
+	strncpy( fb->fix.id, "mali-stub", sizeof(fb->fix.id) - 1 );
+	fb->fix.smem_len = fb->size;
+	fb->fix.line_length = pitch;
+	fb->fix.visual = FB_VISUAL_TRUECOLOR;
+
+	for ( i = 0; i < buffers; i++ )
+	{
+		fb->ids[i] = ump_stub_wrap( fb->virt + i * pitch * yres, pitch * yres );
+	}
+
+	fb->start = stub_time();
+	fb->period = 1000000 / 60;
+
+	device = fb;
+
+	return fb;
+
+fail:
+	if ( fb->fd >= 0 ) close( fb->fd );
+	free( fb );
+	return NULL;
+}
+
+void fbdev_stub_destroy( struct fbdev_stub *fb )
+{
+	int i;
+
+	for ( i = 0; i < fb->buffers; i++ )
+	{
+		/* Drop the reference ump_stub_wrap took */
+		ump_handle handle = ump_handle_create_from_secure_id( fb->ids[i] );
+
+		ump_reference_release( handle );
+		ump_reference_release( handle );
+	}
+
+	munmap( fb->virt, fb->size );
+	close( fb->fd );
+
+	if ( device == fb ) device = NULL;
+	free( fb );
+}
+
+static int stub_ioctl( struct fbdev_stub *fb, unsigned long request, void *arg )
+{
+	struct fb_var_screeninfo *var = arg;
+	uint64_t now;
+
+	switch ( request )
+	{
+		case FBIOGET_VSCREENINFO:
+			*var = fb->var;
+			return 0;
+
+		case FBIOPUT_VSCREENINFO:
+			if ( (size_t)var->xres_virtual * var->yres_virtual * var->bits_per_pixel / 8 > fb->size ) break;
+			fb->var = *var;
+			stub_set_format( &fb->var );
+			fb->fix.line_length = fb->var.xres_virtual * fb->var.bits_per_pixel / 8;
+			*var = fb->var;
+			return 0;
+
+		case FBIOGET_FSCREENINFO:
+			*(struct fb_fix_screeninfo *)arg = fb->fix;
+			return 0;
+
+		case FBIOPAN_DISPLAY:
+			if ( var->yoffset + fb->var.yres > fb->var.yres_virtual ) break;
+			fb->var.yoffset = var->yoffset;
+			__sync_fetch_and_add( &fb->pans, 1 );
+			return 0;
+
+		case FBIO_WAITFORVSYNC:
+			now = stub_time();
+			now = fb->start + ( ( now - fb->start ) / fb->period + 1 ) * fb->period;
+			{
+				struct timespec ts = { now / 1000000, ( now % 1000000 ) * 1000 };
+
+				while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR );
+			}
+			/* The vsync thread and a blocking flip may both be waiting */
+			__sync_fetch_and_add( &fb->vsync_waits, 1 );
+			return 0;
+
+		case GET_UMP_SECURE_ID_BUF1:
+			*(unsigned int *)arg = fb->ids[0];
+			return 0;
+
+		case GET_UMP_SECURE_ID_BUF2:
+			if ( fb->buffers < 2 ) break;
+			*(unsigned int *)arg = fb->ids[1];
+			return 0;
+
+		default:
+			errno = ENOTTY;
+			return -1;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+/* Takes precedence over the C library's, only the fake device is handled here */
+int ioctl( int fd, unsigned long request, ... )
+{
+	va_list ap;
+	void *arg;
+
+	va_start( ap, request );
+	arg = va_arg( ap, void * );
+	va_end( ap );
+
+	if ( device && fd == device->fd ) return stub_ioctl( device, request, arg );
+
+	return syscall( SYS_ioctl, fd, request, arg );
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _FBDEV_STUB_H_
+#define _FBDEV_STUB_H_
+
+#include <stdint.h>
+#include <linux/fb.h>
+#include <ump/ump.h>
+
+/*
+ * A fake fbdev device: a memfd holding the buffers, and an ioctl() that
+ * answers the framebuffer ioctls the driver issues on that descriptor and
+ * passes everything else on to the kernel. Vsync waits sleep until the next
+ * tick of a 60Hz clock. There is one device per process.
+ */
+struct fbdev_stub
+{
+	int fd;
+	unsigned char *virt;
+	size_t size;
+	int buffers;
+	struct fb_var_screeninfo var;
+	struct fb_fix_screeninfo fix;
+	ump_secure_id ids[2];
+	uint64_t start;
+	uint64_t period;
+	unsigned long pans;
+	unsigned long vsync_waits;
+};
+
+extern struct fbdev_stub *fbdev_stub_create( int xres, int yres, int bpp, int buffers );
+extern void fbdev_stub_destroy( struct fbdev_stub *fb );
+
+#endif /* _FBDEV_STUB_H_ */
@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Swap path benchmark for the DRI2 code in src/mali_dri.c. A fake client
+ * swaps the buffers of one window through the driver's ScheduleSwap hook as
+ * fast as its swap limit allows, while the vsync thread of src/mali_vsync.c
+ * times vblanks off the stand-in fbdev. The scenarios cover the three ways a
+ * swap can go: a fullscreen window flips, a redirected window exchanges its
+ * buffers and a window smaller than the screen has its back buffer blitted.
+ *
+ * Each run reports the CPU time the server thread spent in ScheduleSwap, the
+ * latency from the request until the client is told it completed and,
+ * against the 60Hz clock of the fake display, how many vblanks went by
+ * without a new frame and how many frames were replaced before they were
+ * ever scanned out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_vsync.h"
+#include "mali_trace.h"
+
+#include "xserver_stub.h"
+#include "dri2_stub.h"
+#include "ump_stub.h"
+
+struct swap_record
+{
+	CARD64 request;
+	CARD64 cpu;		/* ns of server thread time in ScheduleSwap */
+	CARD64 call;		/* us of wall time in ScheduleSwap */
+	CARD64 msc;
+	CARD64 ust;
+	CARD64 delivered;
+	CARD64 vsync_wait;
+	enum mali_trace_path path;
+	Bool synced;
+	Bool completed;
+};
+
+struct scenario
+{
+	const char *name;
+	enum mali_trace_path path;
+	Bool fullscreen;
+	Bool redirected;
+};
+
+static const struct scenario scenarios[] =
+{
+	{ "flip",     MALI_TRACE_PATH_FLIP,     TRUE,  FALSE },
+	{ "exchange", MALI_TRACE_PATH_EXCHANGE, FALSE, TRUE },
+	{ "blit",     MALI_TRACE_PATH_BLIT,     FALSE, FALSE },
+};
+
+#define NUM_SCENARIOS ( sizeof(scenarios) / sizeof(scenarios[0]) )
+
+static struct swap_record *records;
+static uint32_t num_records;
+static uint32_t size_records;
+static uint32_t current_record;
+static int outstanding;
+
+/*
+ * The swap trace hooks, collecting into memory instead of the shared ring.
+ * A ticket is the index of the swap's record plus one.
+ */
+uint32_t MaliTraceSwapBegin( ScrnInfoPtr pScrn, XID drawable )
+{
+	IGNORE( pScrn );
+	IGNORE( drawable );
+
+	if ( num_records == size_records )
+	{
+		uint32_t size = size_records ? size_records * 2 : 1024;
+		struct swap_record *r = realloc( records, size * sizeof(*r) );
+
+		if ( NULL == r ) return 0;
+		records = r;
+		size_records = size;
+	}
+
+	memset( &records[num_records], 0, sizeof(records[num_records]) );
+	records[num_records].request = MaliVSyncGetTime();
+	current_record = ++num_records;
+	outstanding++;
+
+	return current_record;
+}
+
+void MaliTraceSwapPan( ScrnInfoPtr pScrn, CARD64 start, CARD64 end, Bool synced, CARD64 vsync_wait )
+{
+	IGNORE( pScrn );
+	IGNORE( start );
+	IGNORE( end );
+
+	if ( 0 == current_record ) return;
+
+	records[current_record - 1].synced = synced;
+	records[current_record - 1].vsync_wait = vsync_wait;
+}
+
+void MaliTraceSwapPath( ScrnInfoPtr pScrn, enum mali_trace_path path )
+{
+	IGNORE( pScrn );
+
+	if ( 0 == current_record ) return;
+
+	records[current_record - 1].path = path;
+	current_record = 0;
+}
+
+void MaliTraceSwapComplete( ScrnInfoPtr pScrn, uint32_t ticket, CARD64 msc, CARD64 ust )
+{
+	IGNORE( pScrn );
+
+	if ( 0 == ticket || ticket > num_records || records[ticket - 1].completed ) return;
+
+	records[ticket - 1].completed = TRUE;
+	records[ticket - 1].msc = msc;
+	records[ticket - 1].ust = ust;
+	records[ticket - 1].delivered = MaliVSyncGetTime();
+	outstanding--;
+}
+
+static CARD64 thread_cpu_ns( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+	return (CARD64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The server keeps dispatching while the client renders its next frame */
+static void client_render( struct dri2_stub *dri2, CARD64 us )
+{
+	CARD64 now = MaliVSyncGetTime(), end = now + us;
+
+	for ( ; now < end; now = MaliVSyncGetTime() )
+	{
+		dri2_stub_dispatch( dri2, ( end - now + 999 ) / 1000 );
+	}
+}
+
+static int compare_card64( const void *a, const void *b )
+{
+	CARD64 x = *(const CARD64 *)a, y = *(const CARD64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Sorts values in place */
+static CARD64 percentile( CARD64 *values, uint32_t n, int p )
+{
+	if ( 0 == n ) return 0;
+
+	qsort( values, n, sizeof(*values), compare_card64 );
+
+	return values[( (CARD64)( n - 1 ) * p ) / 100];
+}
+
+/* The vblank at which a frame completed at ust reaches the screen, allowing for a little lateness in waking up */
+static CARD64 shown_at( struct fbdev_stub *fb, CARD64 ust )
+{
+	if ( ust < fb->start ) return 0;
+
+	return ( ust - fb->start + fb->period - fb->period / 8 ) / fb->period;
+}
+
+struct bench_config
+{
+	int width;
+	int height;
+	int bpp;
+	int swap_limit;
+	Bool vsync;
+	Bool adaptive;
+	CARD64 duration;
+	CARD64 frame_time;
+};
+
+static Bool report( const struct scenario *sc, struct stub_screen *stub, CARD64 elapsed )
+{
+	CARD64 *values = malloc( ( num_records ? num_records : 1 ) * sizeof(*values) );
+	CARD64 cpu_sum = 0, call_sum = 0, cpu_p99, lat[4], missed = 0, dropped = 0, prev = 0;
+	uint32_t i, n = 0, wrong_path = 0, stale = 0;
+
+	if ( NULL == values ) return FALSE;
+
+	for ( i = 0; i < num_records; i++ )
+	{
+		cpu_sum += records[i].cpu;
+		call_sum += records[i].call;
+		values[i] = records[i].cpu;
+		if ( records[i].path != sc->path ) wrong_path++;
+	}
+	cpu_p99 = percentile( values, num_records, 99 );
+
+	for ( i = 0; i < num_records; i++ )
+	{
+		CARD64 vblank;
+
+		if ( !records[i].completed ) continue;
+
+		/* Latency is counted until the client hears about it, the timestamp may name an earlier vblank */
+		values[n++] = records[i].delivered - records[i].request;
+		if ( records[i].ust < records[i].request ) stale++;
+
+		vblank = shown_at( stub->fb, records[i].ust );
+		if ( prev && vblank > prev + 1 ) missed += vblank - prev - 1;
+		else if ( prev && vblank == prev ) dropped++;
+		prev = vblank;
+	}
+	lat[0] = percentile( values, n, 50 );
+	lat[1] = percentile( values, n, 90 );
+	lat[2] = percentile( values, n, 99 );
+	lat[3] = n ? values[n - 1] : 0;
+	free( values );
+
+	printf( "%-9s %7u %7.1f %9.1f %9.1f %9.1f %8llu %8llu %8llu %8llu %7llu %7llu %6lu %6lu\n",
+	        sc->name, num_records, num_records * 1e6 / elapsed,
+	        num_records ? cpu_sum / 1e3 / num_records : 0.0, cpu_p99 / 1e3,
+	        num_records ? (double)call_sum / num_records : 0.0,
+	        (unsigned long long)lat[0], (unsigned long long)lat[1], (unsigned long long)lat[2], (unsigned long long)lat[3],
+	        (unsigned long long)missed, (unsigned long long)dropped,
+	        stub->fb->pans, stub->fb->vsync_waits );
+
+	if ( n != num_records ) fprintf( stderr, "%s: %u swaps never completed\n", sc->name, num_records - n );
+	if ( stale ) fprintf( stderr, "%s: %u swaps were reported complete at a vblank before they were requested\n", sc->name, stale );
+	if ( wrong_path ) fprintf( stderr, "%s: %u swaps did not take the %s path\n", sc->name, wrong_path, sc->name );
+
+	return n == num_records && 0 == wrong_path;
+}
+
+static Bool run_scenario( const struct bench_config *cfg, const struct scenario *sc )
+{
+	struct stub_screen *stub;
+	struct dri2_stub *dri2;
+	WindowPtr pWin;
+	DrawablePtr pDraw;
+	DRI2BufferPtr front, back;
+	ClientRec client;
+	CARD64 start, now, target_msc = 0;
+	int idle;
+	Bool ret = FALSE;
+
+	num_records = 0;
+	current_record = 0;
+	outstanding = 0;
+	memset( &client, 0, sizeof(client) );
+
+	stub = stub_screen_create( cfg->width, cfg->height, cfg->bpp );
+	if ( NULL == stub )
+	{
+		fprintf( stderr, "failed to set up a %dx%d screen at %d bpp\n", cfg->width, cfg->height, cfg->bpp );
+		return FALSE;
+	}
+
+	dri2 = dri2_stub_init( stub, cfg->swap_limit, cfg->vsync, cfg->adaptive );
+	if ( NULL == dri2 )
+	{
+		fprintf( stderr, "failed to initialize DRI2\n" );
+		stub_screen_destroy( stub );
+		return FALSE;
+	}
+
+	if ( sc->fullscreen ) pWin = dri2_stub_create_window( dri2, dri2->root, 0, 0, cfg->width, cfg->height, sc->redirected );
+	else pWin = dri2_stub_create_window( dri2, dri2->root, cfg->width / 8, cfg->height / 8, cfg->width * 3 / 4, cfg->height * 3 / 4, sc->redirected );
+	if ( NULL == pWin ) goto out;
+	pDraw = &pWin->drawable;
+
+	front = dri2->info.CreateBuffer( pDraw, DRI2BufferFrontLeft, 0 );
+	back = dri2->info.CreateBuffer( pDraw, DRI2BufferBackLeft, 0 );
+	if ( NULL == front || NULL == back )
+	{
+		fprintf( stderr, "%s: failed to create the window's buffers\n", sc->name );
+		if ( front ) dri2->info.DestroyBuffer( pDraw, front );
+		if ( back ) dri2->info.DestroyBuffer( pDraw, back );
+		goto out;
+	}
+
+	start = MaliVSyncGetTime();
+
+	do
+	{
+		CARD64 cpu, call;
+
+		if ( cfg->frame_time ) client_render( dri2, cfg->frame_time );
+
+		/* The DRI2 core blocks the client once it has swap_limit swaps pending */
+		while ( cfg->swap_limit > 0 && outstanding >= cfg->swap_limit ) dri2_stub_dispatch( dri2, -1 );
+
+		cpu = thread_cpu_ns();
+		call = MaliVSyncGetTime();
+		dri2->info.ScheduleSwap( &client, pDraw, front, back, &target_msc, 0, 0, NULL, NULL );
+		now = MaliVSyncGetTime();
+		cpu = thread_cpu_ns() - cpu;
+
+		if ( num_records )
+		{
+			records[num_records - 1].cpu = cpu;
+			records[num_records - 1].call = now - call;
+		}
+
+		dri2_stub_dispatch( dri2, 0 );
+	}
+	while ( now - start < cfg->duration );
+
+	now = MaliVSyncGetTime();
+
+	/* Give throttled swaps a few vblanks to complete */
+	for ( idle = 0; outstanding > 0 && idle < 10; )
+	{
+		if ( dri2_stub_dispatch( dri2, 100 ) <= 0 ) idle++;
+	}
+
+	ret = report( sc, stub, now - start );
+
+	dri2->info.DestroyBuffer( pDraw, front );
+	dri2->info.DestroyBuffer( pDraw, back );
+	dri2_stub_destroy_window( dri2, pWin );
+
+out:
+	dri2_stub_close( dri2 );
+	stub_screen_destroy( stub );
+
+	return ret;
+}
+
+static Bool selected( const char *list, const char *name )
+{
+	size_t len = strlen( name );
+	const char *p;
+
+	if ( NULL == list ) return TRUE;
+
+	for ( p = list; ( p = strstr( p, name ) ) != NULL; p += len )
+	{
+		if ( ( p == list || p[-1] == ',' ) && ( p[len] == ',' || p[len] == '\0' ) ) return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-t ms] [-o scenarios] [-s WxH] [-b bpp] [-l limit] [-n] [-a] [-w us] [-c file] [-v]\n"
+	                 "  -t ms         time spent swapping in each scenario, default 2000\n"
+	                 "  -o scenarios  comma separated subset of flip,exchange,blit\n"
+	                 "  -s WxH        size of the fake screen, default 1280x720\n"
+	                 "  -b bpp        depth of the fake screen, 16 or 32, default 32\n"
+	                 "  -l limit      DRI2 swap limit, as the SwapLimit option, default 0\n"
+	                 "  -n            don't wait for vblank on flips, as SwapbuffersWait off\n"
+	                 "  -a            adaptive vsync on flips\n"
+	                 "  -w us         time the client spends on each frame, default 0\n"
+	                 "  -c file       capture the driver calls for mali-exa-replay, needs a single -o scenario\n"
+	                 "  -v            show the driver's messages\n", prog );
+	exit( 1 );
+}
+
+int main( int argc, char **argv )
+{
+	struct bench_config cfg = { 1280, 720, 32, 0, TRUE, FALSE, 2000000, 0 };
+	const char *scenario_list = NULL;
+	Bool ok = TRUE;
+	unsigned int i;
+	int opt;
+
+	while ( ( opt = getopt( argc, argv, "t:o:s:b:l:naw:c:v" ) ) != -1 )
+	{
+		switch ( opt )
+		{
+			case 't': cfg.duration = strtoull( optarg, NULL, 10 ) * 1000; break;
+			case 'o': scenario_list = optarg; break;
+			case 's': if ( sscanf( optarg, "%dx%d", &cfg.width, &cfg.height ) != 2 ) usage( argv[0] ); break;
+			case 'b': cfg.bpp = atoi( optarg ); break;
+			case 'l': cfg.swap_limit = atoi( optarg ); break;
+			case 'n': cfg.vsync = FALSE; break;
+			case 'a': cfg.adaptive = TRUE; break;
+			case 'w': cfg.frame_time = strtoull( optarg, NULL, 10 ); break;
+			case 'c': stub_capture = optarg; break;
+			case 'v': stub_verbose = TRUE; break;
+			default: usage( argv[0] );
+		}
+	}
+	if ( optind != argc || 0 == cfg.duration || cfg.width <= 0 || cfg.height <= 0 || cfg.swap_limit < 0 ) usage( argv[0] );
+	if ( 16 != cfg.bpp && 32 != cfg.bpp ) usage( argv[0] );
+	if ( stub_capture && ( NULL == scenario_list || strchr( scenario_list, ',' ) ) ) usage( argv[0] );
+
+	printf( "%-9s %7s %7s %9s %9s %9s %8s %8s %8s %8s %7s %7s %6s %6s\n",
+	        "scenario", "swaps", "fps", "cpu-us", "cpu-p99", "call-us",
+	        "lat-p50", "lat-p90", "lat-p99", "lat-max", "missed", "dropped", "pans", "vwaits" );
+
+	for ( i = 0; i < NUM_SCENARIOS; i++ )
+	{
+		if ( !selected( scenario_list, scenarios[i].name ) ) continue;
+
+		if ( !run_scenario( &cfg, &scenarios[i] ) ) ok = FALSE;
+	}
+
+	free( records );
+
+	if ( ump_stub_live() )
+	{
+		fprintf( stderr, "%d UMP allocations leaked\n", ump_stub_live() );
+		return 1;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Microbenchmarks for the EXA code in src/mali_exa.c, run against the
+ * stand-in UMP and fbdev so that any Linux machine will do. Every operation
+ * goes through the driver hooks the way EXA would call them; whatever the
+ * driver turns down is carried out with pixman on the memory PrepareAccess
+ * hands back, as EXA's fallbacks do. The numbers therefore cover the driver
+ * overhead plus the CPU kernels, which is what the screen sees today.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pixman.h>
+
+#include "mali_vsync.h"
+
+#include "xserver_stub.h"
+#include "ump_stub.h"
+
+struct bench_format
+{
+	const char *name;
+	int depth;
+	int bpp;
+	pixman_format_code_t pixman;
+};
+
+static const struct bench_format formats[] =
+{
+	{ "a8r8g8b8", 32, 32, PIXMAN_a8r8g8b8 },
+	{ "x8r8g8b8", 24, 32, PIXMAN_x8r8g8b8 },
+	{ "r5g6b5",   16, 16, PIXMAN_r5g6b5 },
+};
+
+#define NUM_FORMATS ( sizeof(formats) / sizeof(formats[0]) )
+
+static const int sizes[] = { 16, 64, 256, 1024 };
+
+#define NUM_SIZES ( sizeof(sizes) / sizeof(sizes[0]) )
+
+struct bench_case
+{
+	struct stub_screen *stub;
+	const struct bench_format *format;
+	int width;
+	int height;
+	PixmapPtr src;
+	PixmapPtr dst;
+	char *buffer;
+	int iteration;
+};
+
+typedef void (*BenchOpProc)( struct bench_case *c );
+
+struct bench_op
+{
+	const char *name;
+	BenchOpProc proc;
+	Bool screen;	/* can run on the screen pixmap */
+};
+
+static double target_ms = 200.0;
+
+static double bench_now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* The access hooks time themselves with the vsync clock, which is not linked in here */
+CARD64 MaliVSyncGetTime( void )
+{
+	return (CARD64)bench_now();
+}
+
+static void *bench_begin( struct bench_case *c, PixmapPtr pPixmap, int index )
+{
+	if ( !c->stub->exa.PrepareAccess( pPixmap, index ) )
+	{
+		fprintf( stderr, "PrepareAccess failed\n" );
+		exit( 1 );
+	}
+
+	return pPixmap->devPrivate.ptr;
+}
+
+static void bench_end( struct bench_case *c, PixmapPtr pPixmap, int index )
+{
+	c->stub->exa.FinishAccess( pPixmap, index );
+}
+
+static void op_fill( struct bench_case *c )
+{
+	ExaDriverPtr exa = &c->stub->exa;
+	PixmapPtr dst = c->dst;
+	uint32_t color = 0xff000000 | ( c->iteration * 0x010305 );
+	void *bits;
+
+	if ( exa->PrepareSolid( dst, GXcopy, ~0UL, color ) )
+	{
+		exa->Solid( dst, 0, 0, c->width, c->height );
+		exa->DoneSolid( dst );
+		return;
+	}
+
+	bits = bench_begin( c, dst, EXA_PREPARE_DEST );
+	pixman_fill( bits, dst->devKind / 4, dst->drawable.bitsPerPixel, 0, 0, c->width, c->height, color );
+	bench_end( c, dst, EXA_PREPARE_DEST );
+}
+
+static void op_copy( struct bench_case *c )
+{
+	ExaDriverPtr exa = &c->stub->exa;
+	PixmapPtr src = c->src, dst = c->dst;
+	void *src_bits, *dst_bits;
+
+	if ( exa->PrepareCopy( src, dst, 1, 1, GXcopy, ~0UL ) )
+	{
+		exa->Copy( dst, 0, 0, 0, 0, c->width, c->height );
+		exa->DoneCopy( dst );
+		return;
+	}
+
+	src_bits = bench_begin( c, src, EXA_PREPARE_SRC );
+	dst_bits = bench_begin( c, dst, EXA_PREPARE_DEST );
+	pixman_blt( src_bits, dst_bits, src->devKind / 4, dst->devKind / 4, src->drawable.bitsPerPixel,
+	            dst->drawable.bitsPerPixel, 0, 0, 0, 0, c->width, c->height );
+	bench_end( c, dst, EXA_PREPARE_DEST );
+	bench_end( c, src, EXA_PREPARE_SRC );
+}
+
+/* An a8r8g8b8 source blended over the destination, the bulk of what compositing managers ask for */
+static void op_composite( struct bench_case *c )
+{
+	ExaDriverPtr exa = &c->stub->exa;
+	PixmapPtr src = c->src, dst = c->dst;
+	PictureRec src_picture, dst_picture;
+	pixman_image_t *src_image, *dst_image;
+	void *src_bits, *dst_bits;
+
+	memset( &src_picture, 0, sizeof(src_picture) );
+	src_picture.pDrawable = &src->drawable;
+	src_picture.format = PICT_a8r8g8b8;
+	memset( &dst_picture, 0, sizeof(dst_picture) );
+	dst_picture.pDrawable = &dst->drawable;
+	dst_picture.format = c->format->pixman;
+
+	if ( exa->CheckComposite( PictOpOver, &src_picture, NULL, &dst_picture ) &&
+	     exa->PrepareComposite( PictOpOver, &src_picture, NULL, &dst_picture, src, NULL, dst ) )
+	{
+		exa->Composite( dst, 0, 0, 0, 0, 0, 0, c->width, c->height );
+		exa->DoneComposite( dst );
+		return;
+	}
+
+	src_bits = bench_begin( c, src, EXA_PREPARE_SRC );
+	dst_bits = bench_begin( c, dst, EXA_PREPARE_DEST );
+	src_image = pixman_image_create_bits( PIXMAN_a8r8g8b8, c->width, c->height, src_bits, src->devKind );
+	dst_image = pixman_image_create_bits( c->format->pixman, c->width, c->height, dst_bits, dst->devKind );
+	pixman_image_composite32( PIXMAN_OP_OVER, src_image, NULL, dst_image, 0, 0, 0, 0, 0, 0, c->width, c->height );
+	pixman_image_unref( src_image );
+	pixman_image_unref( dst_image );
+	bench_end( c, dst, EXA_PREPARE_DEST );
+	bench_end( c, src, EXA_PREPARE_SRC );
+}
+
+static void op_upload( struct bench_case *c )
+{
+	PixmapPtr dst = c->dst;
+	int line = c->width * dst->drawable.bitsPerPixel / 8;
+	char *bits = bench_begin( c, dst, EXA_PREPARE_DEST );
+	int y;
+
+	for ( y = 0; y < c->height; y++ ) memcpy( bits + y * dst->devKind, c->buffer + y * line, line );
+
+	bench_end( c, dst, EXA_PREPARE_DEST );
+}
+
+static void op_download( struct bench_case *c )
+{
+	PixmapPtr dst = c->dst;
+	int line = c->width * dst->drawable.bitsPerPixel / 8;
+	char *bits = bench_begin( c, dst, EXA_PREPARE_SRC );
+	int y;
+
+	for ( y = 0; y < c->height; y++ ) memcpy( c->buffer + y * line, bits + y * dst->devKind, line );
+
+	bench_end( c, dst, EXA_PREPARE_SRC );
+}
+
+static void op_create( struct bench_case *c )
+{
+	ScreenPtr pScreen = &c->stub->screen;
+	PixmapPtr pPixmap = stub_create_pixmap( pScreen, c->width, c->height, c->format->depth, 0 );
+
+	if ( NULL == pPixmap )
+	{
+		fprintf( stderr, "CreatePixmap failed\n" );
+		exit( 1 );
+	}
+
+	stub_destroy_pixmap( pPixmap );
+}
+
+static const struct bench_op ops[] =
+{
+	{ "fill",      op_fill,      TRUE },
+	{ "copy",      op_copy,      TRUE },
+	{ "composite", op_composite, TRUE },
+	{ "upload",    op_upload,    TRUE },
+	{ "download",  op_download,  TRUE },
+	{ "create",    op_create,    FALSE },
+};
+
+#define NUM_OPS ( sizeof(ops) / sizeof(ops[0]) )
+
+static PixmapPtr bench_pixmap( struct bench_case *c, int depth )
+{
+	PixmapPtr pPixmap = stub_create_pixmap( &c->stub->screen, c->width, c->height, depth, 0 );
+	char *bits;
+	int y;
+
+	if ( NULL == pPixmap )
+	{
+		fprintf( stderr, "failed to create a %dx%d pixmap of depth %d\n", c->width, c->height, depth );
+		exit( 1 );
+	}
+
+	/* Something other than zeroes, so that blending does real work */
+	bits = bench_begin( c, pPixmap, EXA_PREPARE_DEST );
+	for ( y = 0; y < c->height; y++ ) memset( bits + y * pPixmap->devKind, 0x40 + y % 0x80, pPixmap->devKind );
+	bench_end( c, pPixmap, EXA_PREPARE_DEST );
+
+	return pPixmap;
+}
+
+static void bench_run( struct bench_case *c, const struct bench_op *op, const char *target )
+{
+	double start, elapsed, us;
+	double bytes = (double)c->width * c->height * c->format->bpp / 8;
+	int iterations = 0;
+
+	/* Once to fault everything in */
+	op->proc( c );
+
+	start = bench_now();
+	do
+	{
+		c->iteration = iterations++;
+		op->proc( c );
+		elapsed = bench_now() - start;
+	}
+	while ( elapsed < target_ms * 1000 );
+
+	us = elapsed / iterations;
+
+	printf( "%-10s %-9s %5dx%-5d %-9s %9d %11.2f", op->name, c->format->name, c->width, c->height, target, iterations, us );
+	if ( op->proc == op_create ) printf( " %10s %10s\n", "-", "-" );
+	else printf( " %10.1f %10.1f\n", c->width * c->height / us, bytes / us );
+}
+
+static Bool selected( const char *list, const char *name )
+{
+	size_t len = strlen( name );
+	const char *p;
+
+	if ( NULL == list ) return TRUE;
+
+	for ( p = strstr( list, name ); p; p = strstr( p + 1, name ) )
+	{
+		if ( ( p == list || p[-1] == ',' ) && ( p[len] == ',' || p[len] == '\0' ) ) return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-t ms] [-o ops] [-f formats] [-s WxH] [-c file] [-v]\n"
+	                 "  -t ms       time spent on each case, default 200\n"
+	                 "  -o ops      comma separated subset of fill,copy,composite,upload,download,create\n"
+	                 "  -f formats  comma separated subset of a8r8g8b8,x8r8g8b8,r5g6b5\n"
+	                 "  -s WxH      size of the fake screen, default 1280x720\n"
+	                 "  -c file     capture the driver calls for mali-exa-replay, needs a single -f format\n"
+	                 "  -v          show the driver's messages\n", prog );
+	exit( 1 );
+}
+
+int main( int argc, char **argv )
+{
+	const char *op_list = NULL, *format_list = NULL;
+	int screen_width = 1280, screen_height = 720;
+	unsigned int f, s, o;
+	int opt;
+
+	while ( ( opt = getopt( argc, argv, "t:o:f:s:c:v" ) ) != -1 )
+	{
+		switch ( opt )
+		{
+			case 't': target_ms = atof( optarg ); break;
+			case 'o': op_list = optarg; break;
+			case 'f': format_list = optarg; break;
+			case 's': if ( sscanf( optarg, "%dx%d", &screen_width, &screen_height ) != 2 ) usage( argv[0] ); break;
+			case 'c': stub_capture = optarg; break;
+			case 'v': stub_verbose = TRUE; break;
+			default: usage( argv[0] );
+		}
+	}
+	if ( optind != argc || target_ms <= 0 || screen_width <= 0 || screen_height <= 0 ) usage( argv[0] );
+	if ( stub_capture && ( NULL == format_list || strchr( format_list, ',' ) ) ) usage( argv[0] );
+
+	printf( "%-10s %-9s %11s %-9s %9s %11s %10s %10s\n", "op", "format", "size", "target", "iters", "us/op", "Mpix/s", "MB/s" );
+
+	for ( f = 0; f < NUM_FORMATS; f++ )
+	{
+		struct bench_case c;
+
+		if ( !selected( format_list, formats[f].name ) ) continue;
+
+		memset( &c, 0, sizeof(c) );
+		c.format = &formats[f];
+
+		/* The fbdev has the depth of the format, so the screen pixmap can take part too */
+		c.stub = stub_screen_create( screen_width, screen_height, formats[f].bpp );
+		if ( NULL == c.stub )
+		{
+			fprintf( stderr, "failed to set up a %dx%d screen at %d bpp\n", screen_width, screen_height, formats[f].bpp );
+			return 1;
+		}
+
+		for ( s = 0; s <= NUM_SIZES; s++ )
+		{
+			Bool screen = s == NUM_SIZES;
+
+			c.width = screen ? screen_width : sizes[s];
+			c.height = screen ? screen_height : sizes[s];
+			c.buffer = malloc( (size_t)c.width * c.height * 4 );
+			c.src = bench_pixmap( &c, 32 );
+			c.dst = screen ? c.stub->screen_pixmap : bench_pixmap( &c, formats[f].depth );
+
+			for ( o = 0; o < NUM_OPS; o++ )
+			{
+				if ( !selected( op_list, ops[o].name ) || ( screen && !ops[o].screen ) ) continue;
+
+				/* Copies stay within the format, the source of a blend is always a8r8g8b8 */
+				if ( ops[o].proc == op_copy && 32 != formats[f].bpp )
+				{
+					PixmapPtr src = c.src;
+
+					c.src = bench_pixmap( &c, formats[f].depth );
+					bench_run( &c, &ops[o], screen ? "screen" : "offscreen" );
+					stub_destroy_pixmap( c.src );
+					c.src = src;
+				}
+				else bench_run( &c, &ops[o], screen ? "screen" : "offscreen" );
+			}
+
+			stub_destroy_pixmap( c.src );
+			if ( !screen ) stub_destroy_pixmap( c.dst );
+			free( c.buffer );
+		}
+
+		stub_screen_destroy( c.stub );
+	}
+
+	if ( ump_stub_live() )
+	{
+		fprintf( stderr, "%d UMP allocations leaked\n", ump_stub_live() );
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,721 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Randomised differential check of the EXA solid, copy and composite paths
+ * against pixman. Every case sets up pixmaps through the driver and the same
+ * pixels in plain memory, runs the operation through the driver hooks the
+ * way EXA would, and runs pixman on the plain copy. The results have to
+ * match bit for bit, apart from the unused bits of x8r8g8b8. Whatever the
+ * driver turns down is done with pixman on the memory PrepareAccess hands
+ * back, as EXA's fallbacks do, so the access hooks are checked too and the
+ * speedup column starts out as the cost of going through the driver.
+ *
+ * Cases are numbered and each one derives its randomness from the seed and
+ * its number alone, so a failure reported as case N of seed S comes back
+ * with -s S -c N.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <pixman.h>
+
+#include "picturestr.h"
+
+#include "mali_vsync.h"
+
+#include "xserver_stub.h"
+#include "ump_stub.h"
+
+struct check_format
+{
+	const char *name;
+	int depth;
+	int bpp;
+	pixman_format_code_t pixman;
+	uint32_t mask;	/* bits that are compared */
+};
+
+static const struct check_format formats[] =
+{
+	{ "a8r8g8b8", 32, 32, PIXMAN_a8r8g8b8, 0xffffffff },
+	{ "x8r8g8b8", 24, 32, PIXMAN_x8r8g8b8, 0x00ffffff },
+	{ "r5g6b5",   16, 16, PIXMAN_r5g6b5,   0xffff },
+	{ "a8",        8,  8, PIXMAN_a8,       0xff },
+};
+
+#define NUM_FORMATS ( sizeof(formats) / sizeof(formats[0]) )
+#define FORMAT_X8R8G8B8 1
+
+/* A pixmap as the driver has it, and its pixels as pixman sees them */
+struct check_surface
+{
+	const struct check_format *format;
+	PixmapPtr pixmap;
+	int width;
+	int height;
+	int pitch;
+	char *reference;
+	Bool screen;
+};
+
+struct check_case
+{
+	uint64_t rng;
+
+	struct check_surface surfaces[3];
+	struct check_surface *src;
+	struct check_surface *mask;
+	struct check_surface *dst;
+
+	int pict_op;
+	Bool src_repeat, mask_repeat;
+	uint32_t color;
+	int src_x, src_y;
+	int mask_x, mask_y;
+	int dst_x, dst_y;
+	int width, height;
+
+	Bool accelerated;
+};
+
+typedef void (*CheckProc)( struct check_case *c );
+
+struct check_op
+{
+	const char *name;
+	CheckProc setup;
+	CheckProc mali;
+	CheckProc reference;
+	void (*describe)( struct check_case *c, char *buf, size_t len );
+};
+
+struct check_result
+{
+	unsigned long cases;
+	unsigned long accelerated;
+	unsigned long mismatched;
+	unsigned long timed;
+	double reference_us;
+	double mali_us;
+	double log_speedup;
+};
+
+static struct stub_screen *stub;
+static int max_size = 256;
+static double target_us = 200.0;
+
+static double check_now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* The access hooks time themselves with the vsync clock, which is not linked in here */
+CARD64 MaliVSyncGetTime( void )
+{
+	return (CARD64)check_now();
+}
+
+/* splitmix64, the same sequence everywhere for a given seed and case */
+static uint32_t check_random( struct check_case *c )
+{
+	uint64_t z = ( c->rng += 0x9e3779b97f4a7c15ULL );
+
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+
+	return (uint32_t)( ( z ^ ( z >> 31 ) ) >> 32 );
+}
+
+static int check_range( struct check_case *c, int n )
+{
+	return n > 0 ? (int)( check_random( c ) % n ) : 0;
+}
+
+/* Mostly small, which is where the per call overhead shows, sometimes up to max_size */
+static int check_size( struct check_case *c )
+{
+	return 1 + check_range( c, check_random( c ) & 1 ? 16 : max_size );
+}
+
+static void *check_begin( PixmapPtr pPixmap, int index )
+{
+	if ( !stub->exa.PrepareAccess( pPixmap, index ) )
+	{
+		fprintf( stderr, "PrepareAccess failed\n" );
+		exit( 1 );
+	}
+
+	return pPixmap->devPrivate.ptr;
+}
+
+static void check_end( PixmapPtr pPixmap, int index )
+{
+	stub->exa.FinishAccess( pPixmap, index );
+}
+
+static void surface_create( struct check_case *c, struct check_surface *s, const struct check_format *format, int width, int height, Bool screen )
+{
+	char *bits;
+	int x, y;
+
+	s->format = format;
+	s->screen = screen;
+	if ( screen )
+	{
+		s->pixmap = stub->screen_pixmap;
+		width = s->pixmap->drawable.width;
+		height = s->pixmap->drawable.height;
+	}
+	else s->pixmap = stub_create_pixmap( &stub->screen, width, height, format->depth, 0 );
+
+	if ( NULL == s->pixmap )
+	{
+		fprintf( stderr, "failed to create a %dx%d %s pixmap\n", width, height, format->name );
+		exit( 1 );
+	}
+
+	s->width = width;
+	s->height = height;
+	s->pitch = s->pixmap->devKind;
+	s->reference = malloc( (size_t)s->pitch * height );
+	if ( NULL == s->reference )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( 1 );
+	}
+
+	/* Both sides start from the same noise, padding included */
+	bits = check_begin( s->pixmap, EXA_PREPARE_DEST );
+	for ( y = 0; y < height; y++ )
+	{
+		uint32_t *row = (uint32_t *)( s->reference + y * s->pitch );
+
+		for ( x = 0; x < s->pitch / 4; x++ ) row[x] = check_random( c );
+		memcpy( bits + y * s->pitch, row, s->pitch );
+	}
+	check_end( s->pixmap, EXA_PREPARE_DEST );
+}
+
+static void surface_destroy( struct check_surface *s )
+{
+	if ( NULL == s->pixmap ) return;
+
+	if ( !s->screen ) stub_destroy_pixmap( s->pixmap );
+	free( s->reference );
+	memset( s, 0, sizeof(*s) );
+}
+
+static uint32_t pixel_at( const char *row, int bpp, int x )
+{
+	switch ( bpp )
+	{
+		case 32: return ( (const uint32_t *)row )[x];
+		case 16: return ( (const uint16_t *)row )[x];
+		default: return ( (const uint8_t *)row )[x];
+	}
+}
+
+/* Compares the whole surface, so that writes outside the rectangle are caught as well */
+static Bool surface_compare( struct check_surface *s, int *bad_x, int *bad_y, uint32_t *got, uint32_t *expected )
+{
+	const struct check_format *f = s->format;
+	Bool same = TRUE;
+	char *bits;
+	int x, y;
+
+	bits = check_begin( s->pixmap, EXA_PREPARE_SRC );
+	for ( y = 0; y < s->height && same; y++ )
+	{
+		const char *row = bits + y * s->pitch;
+		const char *ref = s->reference + y * s->pitch;
+
+		if ( 0xffffffff == f->mask && !memcmp( row, ref, s->width * 4 ) ) continue;
+
+		for ( x = 0; x < s->width; x++ )
+		{
+			*got = pixel_at( row, f->bpp, x ) & f->mask;
+			*expected = pixel_at( ref, f->bpp, x ) & f->mask;
+			if ( *got != *expected )
+			{
+				*bad_x = x;
+				*bad_y = y;
+				same = FALSE;
+				break;
+			}
+		}
+	}
+	check_end( s->pixmap, EXA_PREPARE_SRC );
+
+	return same;
+}
+
+static pixman_image_t *check_image( struct check_surface *s, char *bits )
+{
+	return pixman_image_create_bits( s->format->pixman, s->width, s->height, (uint32_t *)bits, s->pitch );
+}
+
+/* fb copies overlapping areas safely, pixman_blt does not promise to */
+static void copy_rows( char *dst, int dst_pitch, const char *src, int src_pitch, int bpp, struct check_case *c )
+{
+	int line = c->width * bpp / 8;
+	int y;
+
+	for ( y = 0; y < c->height; y++ )
+	{
+		int row = c->src_y < c->dst_y ? c->height - 1 - y : y;
+
+		memmove( dst + ( c->dst_y + row ) * dst_pitch + c->dst_x * bpp / 8,
+		         src + ( c->src_y + row ) * src_pitch + c->src_x * bpp / 8, line );
+	}
+}
+
+static void setup_fill( struct check_case *c )
+{
+	const struct check_format *f = &formats[check_range( c, NUM_FORMATS )];
+	Bool screen = FORMAT_X8R8G8B8 == f - formats && 0 == check_range( c, 8 );
+
+	c->width = check_size( c );
+	c->height = check_size( c );
+	c->dst_x = check_range( c, 9 );
+	c->dst_y = check_range( c, 9 );
+	c->color = check_random( c ) & ( 0xffffffff >> ( 32 - f->bpp ) );
+
+	c->dst = &c->surfaces[0];
+	surface_create( c, c->dst, f, c->dst_x + c->width + check_range( c, 9 ), c->dst_y + c->height + check_range( c, 9 ), screen );
+
+	if ( screen )
+	{
+		c->width = c->width > c->dst->width - c->dst_x ? c->dst->width - c->dst_x : c->width;
+		c->height = c->height > c->dst->height - c->dst_y ? c->dst->height - c->dst_y : c->height;
+	}
+}
+
+static void mali_fill( struct check_case *c )
+{
+	ExaDriverPtr exa = &stub->exa;
+	PixmapPtr dst = c->dst->pixmap;
+	char *bits;
+
+	c->accelerated = exa->PrepareSolid( dst, GXcopy, ~0UL, c->color );
+	if ( c->accelerated )
+	{
+		exa->Solid( dst, c->dst_x, c->dst_y, c->dst_x + c->width, c->dst_y + c->height );
+		exa->DoneSolid( dst );
+		return;
+	}
+
+	bits = check_begin( dst, EXA_PREPARE_DEST );
+	pixman_fill( (uint32_t *)bits, c->dst->pitch / 4, c->dst->format->bpp, c->dst_x, c->dst_y, c->width, c->height, c->color );
+	check_end( dst, EXA_PREPARE_DEST );
+}
+
+static void reference_fill( struct check_case *c )
+{
+	pixman_fill( (uint32_t *)c->dst->reference, c->dst->pitch / 4, c->dst->format->bpp, c->dst_x, c->dst_y, c->width, c->height, c->color );
+}
+
+static void describe_fill( struct check_case *c, char *buf, size_t len )
+{
+	snprintf( buf, len, "fill %s%s %dx%d at %d,%d with 0x%x", c->dst->format->name, c->dst->screen ? " screen" : "",
+	          c->width, c->height, c->dst_x, c->dst_y, c->color );
+}
+
+/* A third of the copies stay within one pixmap, overlapping by up to 8 pixels each way */
+static void setup_copy( struct check_case *c )
+{
+	const struct check_format *f = &formats[check_range( c, NUM_FORMATS )];
+	Bool overlap = 0 == check_range( c, 3 );
+	int margin = 8;
+
+	c->width = check_size( c );
+	c->height = check_size( c );
+	c->src_x = check_range( c, 2 * margin + 1 );
+	c->src_y = check_range( c, 2 * margin + 1 );
+	c->dst_x = check_range( c, 2 * margin + 1 );
+	c->dst_y = check_range( c, 2 * margin + 1 );
+
+	c->dst = &c->surfaces[0];
+	surface_create( c, c->dst, f, c->width + 2 * margin, c->height + 2 * margin, FALSE );
+
+	if ( overlap ) c->src = c->dst;
+	else
+	{
+		c->src = &c->surfaces[1];
+		surface_create( c, c->src, f, c->width + 2 * margin, c->height + 2 * margin, FALSE );
+	}
+}
+
+static void mali_copy( struct check_case *c )
+{
+	ExaDriverPtr exa = &stub->exa;
+	PixmapPtr src = c->src->pixmap, dst = c->dst->pixmap;
+	int xdir = 1, ydir = 1;
+	char *src_bits, *dst_bits;
+
+	/* As EXA works out the direction for copies within a pixmap */
+	if ( src == dst )
+	{
+		xdir = c->src_x < c->dst_x ? -1 : 1;
+		ydir = c->src_y < c->dst_y ? -1 : 1;
+	}
+
+	c->accelerated = exa->PrepareCopy( src, dst, xdir, ydir, GXcopy, ~0UL );
+	if ( c->accelerated )
+	{
+		exa->Copy( dst, c->src_x, c->src_y, c->dst_x, c->dst_y, c->width, c->height );
+		exa->DoneCopy( dst );
+		return;
+	}
+
+	dst_bits = check_begin( dst, EXA_PREPARE_DEST );
+	src_bits = src == dst ? dst_bits : check_begin( src, EXA_PREPARE_SRC );
+	copy_rows( dst_bits, c->dst->pitch, src_bits, c->src->pitch, c->dst->format->bpp, c );
+	if ( src != dst ) check_end( src, EXA_PREPARE_SRC );
+	check_end( dst, EXA_PREPARE_DEST );
+}
+
+static void reference_copy( struct check_case *c )
+{
+	copy_rows( c->dst->reference, c->dst->pitch, c->src->reference, c->src->pitch, c->dst->format->bpp, c );
+}
+
+static void describe_copy( struct check_case *c, char *buf, size_t len )
+{
+	snprintf( buf, len, "copy %s %dx%d from %d,%d to %d,%d%s", c->dst->format->name, c->width, c->height,
+	          c->src_x, c->src_y, c->dst_x, c->dst_y, c->src == c->dst ? " within the pixmap" : "" );
+}
+
+/*
+ * A repeating picture is a small tile placed anywhere, offsets included that
+ * are negative or many tiles away, and drawn across widths longer than the
+ * 256 pixel spans mali_composite works in.
+ */
+static void setup_repeat( struct check_case *c, int *x, int *y, int *width, int *height )
+{
+	*width = 1 + check_range( c, 40 );
+	*height = 1 + check_range( c, 40 );
+	*x = check_range( c, 8 * *width ) - 4 * *width;
+	*y = check_range( c, 8 * *height ) - 4 * *height;
+	if ( 0 == check_range( c, 4 ) ) *x += ( check_range( c, 2 ) ? 1000 : -1000 ) * *width;
+
+	if ( 0 == check_range( c, 4 ) ) c->width = 257 + check_range( c, 600 );
+}
+
+static const int composite_ops[] = { PictOpSrc, PictOpOver, PictOpAdd };
+
+/* A quarter of the sources and masks repeat */
+static void setup_composite( struct check_case *c )
+{
+	const struct check_format *f = &formats[check_range( c, NUM_FORMATS )];
+	int mask = check_range( c, 3 );
+	int src_width, src_height, mask_width, mask_height;
+
+	c->pict_op = composite_ops[check_range( c, sizeof(composite_ops) / sizeof(composite_ops[0]) )];
+	c->width = check_size( c );
+	c->height = check_size( c );
+	c->src_x = check_range( c, 9 );
+	c->src_y = check_range( c, 9 );
+	c->mask_x = check_range( c, 9 );
+	c->mask_y = check_range( c, 9 );
+	c->dst_x = check_range( c, 9 );
+	c->dst_y = check_range( c, 9 );
+
+	c->src_repeat = 0 == check_range( c, 4 );
+	if ( c->src_repeat ) setup_repeat( c, &c->src_x, &c->src_y, &src_width, &src_height );
+
+	c->mask_repeat = mask && 0 == check_range( c, 4 );
+	if ( c->mask_repeat ) setup_repeat( c, &c->mask_x, &c->mask_y, &mask_width, &mask_height );
+
+	/* Only now is the width settled */
+	if ( !c->src_repeat )
+	{
+		src_width = c->src_x + c->width;
+		src_height = c->src_y + c->height;
+	}
+	if ( !c->mask_repeat )
+	{
+		mask_width = c->mask_x + c->width;
+		mask_height = c->mask_y + c->height;
+	}
+
+	c->dst = &c->surfaces[0];
+	surface_create( c, c->dst, f, c->dst_x + c->width, c->dst_y + c->height, FALSE );
+
+	c->src = &c->surfaces[1];
+	surface_create( c, c->src, &formats[check_range( c, NUM_FORMATS )], src_width, src_height, FALSE );
+
+	/* No mask, an a8 one or a8r8g8b8 without component alpha */
+	if ( mask )
+	{
+		c->mask = &c->surfaces[2];
+		surface_create( c, c->mask, &formats[1 == mask ? 3 : 0], mask_width, mask_height, FALSE );
+	}
+}
+
+static void composite( struct check_case *c, char *src_bits, char *mask_bits, char *dst_bits )
+{
+	pixman_image_t *src = check_image( c->src, src_bits );
+	pixman_image_t *mask = c->mask ? check_image( c->mask, mask_bits ) : NULL;
+	pixman_image_t *dst = check_image( c->dst, dst_bits );
+
+	if ( c->src_repeat ) pixman_image_set_repeat( src, PIXMAN_REPEAT_NORMAL );
+	if ( c->mask_repeat ) pixman_image_set_repeat( mask, PIXMAN_REPEAT_NORMAL );
+	pixman_image_composite32( c->pict_op, src, mask, dst, c->src_x, c->src_y, c->mask_x, c->mask_y, c->dst_x, c->dst_y, c->width, c->height );
+
+	pixman_image_unref( src );
+	if ( mask ) pixman_image_unref( mask );
+	pixman_image_unref( dst );
+}
+
+static void init_picture( PictureRec *pPicture, struct check_surface *s, Bool repeat )
+{
+	memset( pPicture, 0, sizeof(*pPicture) );
+	pPicture->pDrawable = &s->pixmap->drawable;
+	pPicture->format = s->format->pixman;
+	pPicture->repeat = repeat;
+	pPicture->repeatType = RepeatNormal;
+}
+
+static void mali_composite( struct check_case *c )
+{
+	ExaDriverPtr exa = &stub->exa;
+	PictureRec src_picture, mask_picture, dst_picture;
+	PixmapPtr mask = c->mask ? c->mask->pixmap : NULL;
+	char *src_bits, *mask_bits = NULL, *dst_bits;
+
+	init_picture( &src_picture, c->src, c->src_repeat );
+	if ( c->mask ) init_picture( &mask_picture, c->mask, c->mask_repeat );
+	init_picture( &dst_picture, c->dst, FALSE );
+
+	c->accelerated = exa->CheckComposite( c->pict_op, &src_picture, c->mask ? &mask_picture : NULL, &dst_picture ) &&
+	                 exa->PrepareComposite( c->pict_op, &src_picture, c->mask ? &mask_picture : NULL, &dst_picture, c->src->pixmap, mask, c->dst->pixmap );
+	if ( c->accelerated )
+	{
+		exa->Composite( c->dst->pixmap, c->src_x, c->src_y, c->mask_x, c->mask_y, c->dst_x, c->dst_y, c->width, c->height );
+		exa->DoneComposite( c->dst->pixmap );
+		return;
+	}
+
+	dst_bits = check_begin( c->dst->pixmap, EXA_PREPARE_DEST );
+	src_bits = check_begin( c->src->pixmap, EXA_PREPARE_SRC );
+	if ( mask ) mask_bits = check_begin( mask, EXA_PREPARE_MASK );
+	composite( c, src_bits, mask_bits, dst_bits );
+	if ( mask ) check_end( mask, EXA_PREPARE_MASK );
+	check_end( c->src->pixmap, EXA_PREPARE_SRC );
+	check_end( c->dst->pixmap, EXA_PREPARE_DEST );
+}
+
+static void reference_composite( struct check_case *c )
+{
+	composite( c, c->src->reference, c->mask ? c->mask->reference : NULL, c->dst->reference );
+}
+
+static void describe_composite( struct check_case *c, char *buf, size_t len )
+{
+	snprintf( buf, len, "composite op %d %s%s at %d,%d mask %s%s at %d,%d onto %s %dx%d at %d,%d", c->pict_op,
+	          c->src->format->name, c->src_repeat ? " repeating" : "", c->src_x, c->src_y,
+	          c->mask ? c->mask->format->name : "none", c->mask_repeat ? " repeating" : "", c->mask_x, c->mask_y,
+	          c->dst->format->name, c->width, c->height, c->dst_x, c->dst_y );
+}
+
+static const struct check_op ops[] =
+{
+	{ "fill",      setup_fill,      mali_fill,      reference_fill,      describe_fill },
+	{ "copy",      setup_copy,      mali_copy,      reference_copy,      describe_copy },
+	{ "composite", setup_composite, mali_composite, reference_composite, describe_composite },
+};
+
+#define NUM_OPS ( sizeof(ops) / sizeof(ops[0]) )
+
+static double time_proc( CheckProc proc, struct check_case *c )
+{
+	double start = check_now(), elapsed;
+	int iterations = 0;
+
+	do
+	{
+		proc( c );
+		iterations++;
+		elapsed = check_now() - start;
+	}
+	while ( elapsed < target_us );
+
+	return elapsed / iterations;
+}
+
+/* Results go by the format of the destination */
+static Bool run_case( const struct check_op *op, uint64_t seed, unsigned int number, struct check_result *results, Bool verbose )
+{
+	struct check_result *result;
+	struct check_case c;
+	char description[256];
+	uint32_t got = 0, expected = 0;
+	int bad_x = 0, bad_y = 0;
+	Bool same;
+	int i;
+
+	memset( &c, 0, sizeof(c) );
+	c.rng = ( seed * 0x2545f4914f6cdd1dULL + number ) ^ ( (uint64_t)( op - ops ) << 56 );
+
+	op->setup( &c );
+	op->mali( &c );
+	op->reference( &c );
+	same = surface_compare( c.dst, &bad_x, &bad_y, &got, &expected );
+	op->describe( &c, description, sizeof(description) );
+
+	result = &results[c.dst->format - formats];
+	result->cases++;
+	if ( c.accelerated ) result->accelerated++;
+	if ( !same )
+	{
+		result->mismatched++;
+		printf( "case %u of seed %llu: %s: pixel %d,%d is 0x%x, pixman has 0x%x\n",
+		        number, (unsigned long long)seed, description, bad_x, bad_y, got, expected );
+	}
+
+	/* The pixels are garbage from here on, only the time counts */
+	if ( same && target_us > 0 )
+	{
+		double reference_us = time_proc( op->reference, &c );
+		double mali_us = time_proc( op->mali, &c );
+
+		result->timed++;
+		result->reference_us += reference_us;
+		result->mali_us += mali_us;
+		result->log_speedup += log( reference_us / mali_us );
+
+		if ( verbose ) printf( "case %u: %s: %s, %.2f us against %.2f\n", number, description, c.accelerated ? "accelerated" : "fallback", mali_us, reference_us );
+	}
+	else if ( verbose ) printf( "case %u: %s: %s\n", number, description, c.accelerated ? "accelerated" : "fallback" );
+
+	for ( i = 0; i < 3; i++ ) surface_destroy( &c.surfaces[i] );
+
+	return same;
+}
+
+static Bool selected( const char *list, const char *name )
+{
+	size_t len = strlen( name );
+	const char *p;
+
+	if ( NULL == list ) return TRUE;
+
+	for ( p = strstr( list, name ); p; p = strstr( p + 1, name ) )
+	{
+		if ( ( p == list || p[-1] == ',' ) && ( p[len] == ',' || p[len] == '\0' ) ) return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-n cases] [-s seed] [-c case] [-o ops] [-m size] [-t us] [-v]\n"
+	                 "  -n cases  random cases per operation, default 1000\n"
+	                 "  -s seed   seed of the run, default 1\n"
+	                 "  -c case   run that case only, to look into a failure\n"
+	                 "  -o ops    comma separated subset of fill,copy,composite\n"
+	                 "  -m size   largest rectangle side, default 256\n"
+	                 "  -t us     time spent timing each side of a case, default 200, 0 to only compare\n"
+	                 "  -v        print every case, and the driver's messages\n", prog );
+	exit( 1 );
+}
+
+int main( int argc, char **argv )
+{
+	struct check_result results[NUM_OPS][NUM_FORMATS];
+	const char *op_list = NULL;
+	unsigned long cases = 1000, only = 0;
+	unsigned long long seed = 1;
+	Bool verbose = FALSE, single = FALSE, ok = TRUE;
+	unsigned int o, f, n;
+	int opt;
+
+	while ( ( opt = getopt( argc, argv, "n:s:c:o:m:t:v" ) ) != -1 )
+	{
+		switch ( opt )
+		{
+			case 'n': cases = strtoul( optarg, NULL, 10 ); break;
+			case 's': seed = strtoull( optarg, NULL, 10 ); break;
+			case 'c': only = strtoul( optarg, NULL, 10 ); single = TRUE; break;
+			case 'o': op_list = optarg; break;
+			case 'm': max_size = atoi( optarg ); break;
+			case 't': target_us = atof( optarg ); break;
+			case 'v': verbose = stub_verbose = TRUE; break;
+			default: usage( argv[0] );
+		}
+	}
+	if ( optind != argc || 0 == cases || max_size <= 0 || target_us < 0 ) usage( argv[0] );
+
+	stub = stub_screen_create( 640, 480, 32 );
+	if ( NULL == stub )
+	{
+		fprintf( stderr, "failed to set up the screen\n" );
+		return 1;
+	}
+
+	memset( results, 0, sizeof(results) );
+	for ( o = 0; o < NUM_OPS; o++ )
+	{
+		if ( !selected( op_list, ops[o].name ) ) continue;
+
+		for ( n = single ? only : 0; n < ( single ? only + 1 : cases ); n++ )
+		{
+			if ( !run_case( &ops[o], seed, n, results[o], verbose ) ) ok = FALSE;
+		}
+	}
+
+	stub_screen_destroy( stub );
+
+	printf( "seed %llu\n", seed );
+	printf( "%-10s %-9s %7s %7s %9s %9s %9s %8s\n", "op", "format", "cases", "accel", "mismatch", "ref-us", "mali-us", "speedup" );
+	for ( o = 0; o < NUM_OPS; o++ )
+	{
+		for ( f = 0; f < NUM_FORMATS; f++ )
+		{
+			struct check_result *r = &results[o][f];
+
+			if ( 0 == r->cases ) continue;
+
+			printf( "%-10s %-9s %7lu %7lu %9lu", ops[o].name, formats[f].name, r->cases, r->accelerated, r->mismatched );
+			if ( r->timed ) printf( " %9.2f %9.2f %7.2fx\n", r->reference_us / r->timed, r->mali_us / r->timed, exp( r->log_speedup / r->timed ) );
+			else printf( " %9s %9s %8s\n", "-", "-", "-" );
+		}
+	}
+
+	if ( ump_stub_live() )
+	{
+		fprintf( stderr, "%d UMP allocations leaked\n", ump_stub_live() );
+		return 1;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Runs an EXA capture (see src/mali_capture.h) again against the driver
+ * code, on the stand-in UMP and fbdev, and reports where the time went. The
+ * calls are replayed as fast as possible unless -r asks for the recorded
+ * pace. Only the driver side is replayed: rendering that EXA carried out
+ * itself after the driver turned an operation down is not in the capture,
+ * so this measures the hooks, their UMP and cache work and nothing else.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "picturestr.h"
+
+#include "mali_vsync.h"
+#include "mali_trace.h"
+#include "mali_capture.h"
+
+#include "xserver_stub.h"
+#include "ump_stub.h"
+
+struct replay_pixmap
+{
+	PixmapPtr pixmap;
+	Bool framebuffer;
+	int prepared;
+};
+
+struct replay_type
+{
+	unsigned long count;
+	double us;
+	double max_us;
+};
+
+struct replay
+{
+	struct stub_screen *stub;
+	struct replay_pixmap *pixmaps;
+	unsigned int num_pixmaps;
+
+	struct replay_type types[MALI_CAPTURE_TYPES];
+	unsigned long unknown;
+	unsigned long mismatched;
+
+	/* The operation RECT and DONE records belong to, if the driver took it */
+	uint16_t prepared;
+	PixmapPtr prepared_dst;
+
+	unsigned long swaps;
+	unsigned long frames;
+	double frame_us;
+	double frame_max_us;
+	double frame_start;
+	double recorded_us;
+};
+
+static const char *type_names[MALI_CAPTURE_TYPES] =
+{
+	"pad", "create", "destroy", "modify", "prepare", "finish", "solid", "copy", "composite", "swap",
+	"prep-comp", "rect", "done"
+};
+
+static const char *memory_names[] = { "none", "framebuffer", "framebuffer-back", "shadow", "other" };
+static const char *path_names[] = { "swap", "flip", "exchange", "blit" };
+
+static Bool honour_timing;
+
+static double replay_now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+CARD64 MaliVSyncGetTime( void )
+{
+	return (CARD64)replay_now();
+}
+
+static const char *name_of( const char **names, unsigned int count, uint32_t value )
+{
+	return value < count ? names[value] : "unknown";
+}
+
+/* The record at *pos, skipping padding; NULL at the end, and garbage ends the program */
+static const struct mali_capture_record *next_record( const unsigned char *data, uint64_t length, uint32_t chunk_size, uint64_t *pos )
+{
+	const struct mali_capture_record *r;
+	uint64_t in_chunk;
+
+	for ( ;; )
+	{
+		if ( *pos + sizeof(*r) > length ) return NULL;
+
+		r = (const struct mali_capture_record *)( data + *pos );
+		in_chunk = *pos % chunk_size;
+
+		if ( MALI_CAPTURE_PAD == r->type )
+		{
+			*pos += chunk_size - in_chunk;
+			continue;
+		}
+
+		if ( r->size < sizeof(*r) || r->size % 8 || in_chunk + r->size > chunk_size || *pos + r->size > length || r->type >= MALI_CAPTURE_TYPES )
+		{
+			fprintf( stderr, "corrupt record at offset %llu\n", (unsigned long long)( MALI_CAPTURE_DATA + *pos ) );
+			exit( 1 );
+		}
+
+		*pos += r->size;
+
+		return r;
+	}
+}
+
+static void dump_record( const struct mali_capture_record *r, double t )
+{
+	printf( "%12.0f %-9s", t, type_names[r->type] );
+
+	switch ( r->type )
+	{
+		case MALI_CAPTURE_CREATE_PIXMAP:
+		{
+			const struct mali_capture_create *c = (const void *)r;
+			printf( " %u size %d align %d", c->id, c->size, c->align );
+			break;
+		}
+		case MALI_CAPTURE_DESTROY_PIXMAP:
+		{
+			const struct mali_capture_destroy *d = (const void *)r;
+			printf( " %u", d->id );
+			break;
+		}
+		case MALI_CAPTURE_MODIFY_PIXMAP:
+		{
+			const struct mali_capture_modify *m = (const void *)r;
+			printf( " %u %dx%d depth %d bpp %d pitch %d %s", m->id, m->width, m->height, m->depth, m->bpp, m->devkind,
+			        name_of( memory_names, sizeof(memory_names) / sizeof(memory_names[0]), m->memory ) );
+			break;
+		}
+		case MALI_CAPTURE_PREPARE_ACCESS:
+		case MALI_CAPTURE_FINISH_ACCESS:
+		{
+			const struct mali_capture_access *a = (const void *)r;
+			printf( " %u index %d%s", a->id, a->index, a->ok ? "" : " failed" );
+			break;
+		}
+		case MALI_CAPTURE_SOLID:
+		{
+			const struct mali_capture_solid *s = (const void *)r;
+			printf( " %u alu %d planemask 0x%08x fg 0x%08x", s->id, s->alu, s->planemask, s->fg );
+			break;
+		}
+		case MALI_CAPTURE_COPY:
+		{
+			const struct mali_capture_copy *c = (const void *)r;
+			printf( " %u -> %u dir %d,%d alu %d planemask 0x%08x", c->src, c->dst, c->xdir, c->ydir, c->alu, c->planemask );
+			break;
+		}
+		case MALI_CAPTURE_COMPOSITE:
+		{
+			const struct mali_capture_composite *c = (const void *)r;
+			printf( " op %d src 0x%08x/%02x mask 0x%08x/%02x dst 0x%08x/%02x", c->op,
+			        c->src_format, c->src_flags, c->mask_format, c->mask_flags, c->dst_format, c->dst_flags );
+			break;
+		}
+		case MALI_CAPTURE_SWAP:
+		{
+			const struct mali_capture_swap *s = (const void *)r;
+			printf( " %u <- %u %s", s->front, s->back,
+			        name_of( path_names, sizeof(path_names) / sizeof(path_names[0]), s->path ) );
+			break;
+		}
+		case MALI_CAPTURE_PREPARE_COMPOSITE:
+		{
+			const struct mali_capture_prepare_composite *c = (const void *)r;
+			printf( " op %d src %u 0x%08x/%02x mask %u 0x%08x/%02x dst %u 0x%08x/%02x%s", c->op, c->src, c->src_format, c->src_flags,
+			        c->mask, c->mask_format, c->mask_flags, c->dst, c->dst_format, c->dst_flags, c->ok ? "" : " failed" );
+			break;
+		}
+		case MALI_CAPTURE_RECT:
+		{
+			const struct mali_capture_rect *c = (const void *)r;
+			printf( " %dx%d src %d,%d mask %d,%d dst %d,%d", c->width, c->height, c->src_x, c->src_y, c->mask_x, c->mask_y, c->dst_x, c->dst_y );
+			break;
+		}
+		case MALI_CAPTURE_DONE:
+		{
+			const struct mali_capture_done *d = (const void *)r;
+			printf( " %u", d->dst );
+			break;
+		}
+	}
+
+	printf( "\n" );
+}
+
+static struct replay_pixmap *lookup( struct replay *rp, uint32_t id )
+{
+	if ( 0 == id ) return NULL;
+
+	if ( id >= rp->num_pixmaps )
+	{
+		unsigned int num = rp->num_pixmaps ? rp->num_pixmaps : 256;
+
+		while ( num <= id ) num *= 2;
+
+		rp->pixmaps = realloc( rp->pixmaps, num * sizeof(*rp->pixmaps) );
+		if ( NULL == rp->pixmaps )
+		{
+			fprintf( stderr, "out of memory\n" );
+			exit( 1 );
+		}
+		memset( rp->pixmaps + rp->num_pixmaps, 0, ( num - rp->num_pixmaps ) * sizeof(*rp->pixmaps) );
+		rp->num_pixmaps = num;
+	}
+
+	return &rp->pixmaps[id];
+}
+
+/* The pixmap a record names, counting the ones the capture never saw created */
+static PixmapPtr pixmap_of( struct replay *rp, uint32_t id )
+{
+	struct replay_pixmap *p = lookup( rp, id );
+
+	if ( NULL == p || NULL == p->pixmap ) rp->unknown++;
+
+	return p ? p->pixmap : NULL;
+}
+
+static void replay_modify( struct replay *rp, const struct mali_capture_modify *m )
+{
+	static char foreign_memory[64];
+	struct stub_screen *stub = rp->stub;
+	struct replay_pixmap *p = lookup( rp, m->id );
+	pointer data = NULL;
+
+	if ( NULL == p )
+	{
+		rp->unknown++;
+		return;
+	}
+
+	/* The framebuffer pixmaps already exist, wrapped the same way when the screen was set up */
+	if ( NULL == p->pixmap && MALI_CAPTURE_MEMORY_FRAMEBUFFER == m->memory )
+	{
+		p->pixmap = stub->screen_pixmap;
+		p->framebuffer = TRUE;
+	}
+	else if ( NULL == p->pixmap && MALI_CAPTURE_MEMORY_FRAMEBUFFER_BACK == m->memory )
+	{
+		p->pixmap = ( (PrivPixmap *)exaGetPixmapDriverPrivate( stub->screen_pixmap ) )->priv->other_buffer;
+		p->framebuffer = TRUE;
+		return;
+	}
+	else if ( NULL == p->pixmap )
+	{
+		p->pixmap = stub_alloc_pixmap( &stub->screen, m->depth, m->bpp );
+		if ( NULL == p->pixmap )
+		{
+			fprintf( stderr, "failed to create pixmap %u\n", m->id );
+			exit( 1 );
+		}
+	}
+
+	/* There is no shadow here, so a shadow screen pixmap gets memory of its own instead */
+	if ( MALI_CAPTURE_MEMORY_FRAMEBUFFER == m->memory ) data = stub->fb->virt;
+	else if ( MALI_CAPTURE_MEMORY_OTHER == m->memory ) data = foreign_memory;
+
+	if ( MALI_CAPTURE_MEMORY_FRAMEBUFFER_BACK != m->memory )
+	{
+		stub->exa.ModifyPixmapHeader( p->pixmap, m->width, m->height, m->depth, m->bpp, m->devkind, data );
+	}
+
+	/* EXA keeps the pointer of its pixmaps NULL outside of PrepareAccess */
+	if ( data ) p->pixmap->devPrivate.ptr = NULL;
+}
+
+static void replay_destroy( struct replay *rp, uint32_t id )
+{
+	struct replay_pixmap *p = lookup( rp, id );
+
+	if ( NULL == p || NULL == p->pixmap ) return;
+
+	if ( !p->framebuffer ) stub_destroy_pixmap( p->pixmap );
+	memset( p, 0, sizeof(*p) );
+}
+
+static void replay_access( struct replay *rp, const struct mali_capture_access *a, Bool prepare )
+{
+	ExaDriverPtr exa = &rp->stub->exa;
+	struct replay_pixmap *p = lookup( rp, a->id );
+	Bool ok;
+
+	if ( NULL == p || NULL == p->pixmap )
+	{
+		rp->unknown++;
+		return;
+	}
+
+	if ( !prepare )
+	{
+		/* Only undo what succeeded here, whatever happened in the server */
+		if ( p->prepared > 0 )
+		{
+			exa->FinishAccess( p->pixmap, a->index );
+			p->prepared--;
+		}
+		return;
+	}
+
+	ok = exa->PrepareAccess( p->pixmap, a->index );
+	if ( ok ) p->prepared++;
+	if ( !ok != !a->ok ) rp->mismatched++;
+}
+
+/* Only the properties the driver looks at are in the capture, everything else points somewhere harmless */
+static void replay_picture( PictureRec *pPicture, uint32_t format, uint8_t flags, DrawablePtr pDrawable )
+{
+	static PictTransform identity = { { { pixman_fixed_1, 0, 0 }, { 0, pixman_fixed_1, 0 }, { 0, 0, pixman_fixed_1 } } };
+	static PictureRec alpha_map;
+
+	memset( pPicture, 0, sizeof(*pPicture) );
+	pPicture->format = format;
+	if ( flags & MALI_CAPTURE_PICT_DRAWABLE ) pPicture->pDrawable = pDrawable;
+	if ( flags & MALI_CAPTURE_PICT_TRANSFORM ) pPicture->transform = &identity;
+	pPicture->repeat = ( flags & MALI_CAPTURE_PICT_REPEAT ) != 0;
+	pPicture->repeatType = MALI_CAPTURE_PICT_REPEAT_TYPE( flags );
+	if ( flags & MALI_CAPTURE_PICT_ALPHA_MAP ) pPicture->alphaMap = &alpha_map;
+	pPicture->componentAlpha = ( flags & MALI_CAPTURE_PICT_COMPONENT_ALPHA ) != 0;
+}
+
+static void replay_composite( struct replay *rp, const struct mali_capture_composite *c )
+{
+	DrawablePtr pDrawable = &rp->stub->screen_pixmap->drawable;
+	PictureRec pictures[3];
+
+	replay_picture( &pictures[0], c->src_format, c->src_flags, pDrawable );
+	replay_picture( &pictures[1], c->mask_format, c->mask_flags, pDrawable );
+	replay_picture( &pictures[2], c->dst_format, c->dst_flags, pDrawable );
+
+	rp->stub->exa.CheckComposite( c->op,
+	                              ( c->src_flags & MALI_CAPTURE_PICT_PRESENT ) ? &pictures[0] : NULL,
+	                              ( c->mask_flags & MALI_CAPTURE_PICT_PRESENT ) ? &pictures[1] : NULL,
+	                              &pictures[2] );
+}
+
+/* A later prepare, or the end of the capture, ends one the server rejected but the replay took */
+static void replay_prepared( struct replay *rp, uint16_t type, PixmapPtr pDst )
+{
+	rp->prepared = type;
+	rp->prepared_dst = pDst;
+}
+
+static void replay_done( struct replay *rp )
+{
+	switch ( rp->prepared )
+	{
+		case MALI_CAPTURE_SOLID:
+			rp->stub->exa.DoneSolid( rp->prepared_dst );
+			break;
+		case MALI_CAPTURE_COPY:
+			rp->stub->exa.DoneCopy( rp->prepared_dst );
+			break;
+		case MALI_CAPTURE_PREPARE_COMPOSITE:
+			rp->stub->exa.DoneComposite( rp->prepared_dst );
+			break;
+	}
+
+	rp->prepared = MALI_CAPTURE_PAD;
+	rp->prepared_dst = NULL;
+}
+
+/* Pictures without a drawable are solid fills or gradients, which have no pixmap in the capture either */
+static void replay_prepare_composite( struct replay *rp, const struct mali_capture_prepare_composite *c )
+{
+	PixmapPtr pSrc = c->src ? pixmap_of( rp, c->src ) : NULL;
+	PixmapPtr pMask = c->mask ? pixmap_of( rp, c->mask ) : NULL;
+	PixmapPtr pDst = pixmap_of( rp, c->dst );
+	PictureRec pictures[3];
+	Bool ok;
+
+	replay_done( rp );
+	if ( NULL == pDst || ( c->src && NULL == pSrc ) || ( c->mask && NULL == pMask ) ) return;
+
+	replay_picture( &pictures[0], c->src_format, c->src_flags, pSrc ? &pSrc->drawable : NULL );
+	replay_picture( &pictures[1], c->mask_format, c->mask_flags, pMask ? &pMask->drawable : NULL );
+	replay_picture( &pictures[2], c->dst_format, c->dst_flags, &pDst->drawable );
+
+	ok = rp->stub->exa.PrepareComposite( c->op, &pictures[0], ( c->mask_flags & MALI_CAPTURE_PICT_PRESENT ) ? &pictures[1] : NULL, &pictures[2], pSrc, pMask, pDst );
+	if ( ok ) replay_prepared( rp, MALI_CAPTURE_PREPARE_COMPOSITE, pDst );
+	if ( !ok != !c->ok ) rp->mismatched++;
+}
+
+static void replay_rect( struct replay *rp, const struct mali_capture_rect *c )
+{
+	switch ( rp->prepared )
+	{
+		case MALI_CAPTURE_SOLID:
+			rp->stub->exa.Solid( rp->prepared_dst, c->dst_x, c->dst_y, c->dst_x + c->width, c->dst_y + c->height );
+			break;
+		case MALI_CAPTURE_COPY:
+			rp->stub->exa.Copy( rp->prepared_dst, c->src_x, c->src_y, c->dst_x, c->dst_y, c->width, c->height );
+			break;
+		case MALI_CAPTURE_PREPARE_COMPOSITE:
+			rp->stub->exa.Composite( rp->prepared_dst, c->src_x, c->src_y, c->mask_x, c->mask_y, c->dst_x, c->dst_y, c->width, c->height );
+			break;
+	}
+}
+
+/* An exchange trades the memory of the two pixmaps, as exchange_buffers does; a flip or blit leaves them be */
+static void replay_swap( struct replay *rp, const struct mali_capture_swap *s )
+{
+	struct replay_pixmap *front = lookup( rp, s->front );
+	struct replay_pixmap *back = lookup( rp, s->back );
+	double now = replay_now();
+
+	if ( MALI_TRACE_PATH_EXCHANGE == s->path && front && back && front->pixmap && back->pixmap && !front->framebuffer && !back->framebuffer )
+	{
+		PrivPixmapInternal *f = ( (PrivPixmap *)exaGetPixmapDriverPrivate( front->pixmap ) )->priv;
+		PrivPixmapInternal *b = ( (PrivPixmap *)exaGetPixmapDriverPrivate( back->pixmap ) )->priv;
+		mali_mem_info *mem_info = f->mem_info;
+
+		f->mem_info = b->mem_info;
+		b->mem_info = mem_info;
+	}
+
+	/* A frame is what lies between two swaps of the same run */
+	if ( rp->frame_start > 0 )
+	{
+		double us = now - rp->frame_start;
+
+		rp->frames++;
+		rp->frame_us += us;
+		if ( us > rp->frame_max_us ) rp->frame_max_us = us;
+	}
+	rp->frame_start = now;
+	rp->swaps++;
+}
+
+static void replay_record( struct replay *rp, const struct mali_capture_record *r )
+{
+	ExaDriverPtr exa = &rp->stub->exa;
+
+	switch ( r->type )
+	{
+		case MALI_CAPTURE_CREATE_PIXMAP:
+			/* The pixmap is made on its first ModifyPixmapHeader, once it is known what it wraps */
+			lookup( rp, ( (const struct mali_capture_create *)r )->id );
+			break;
+		case MALI_CAPTURE_DESTROY_PIXMAP:
+			replay_done( rp );
+			replay_destroy( rp, ( (const struct mali_capture_destroy *)r )->id );
+			break;
+		case MALI_CAPTURE_MODIFY_PIXMAP:
+			replay_modify( rp, (const struct mali_capture_modify *)r );
+			break;
+		case MALI_CAPTURE_PREPARE_ACCESS:
+		case MALI_CAPTURE_FINISH_ACCESS:
+			replay_access( rp, (const struct mali_capture_access *)r, MALI_CAPTURE_PREPARE_ACCESS == r->type );
+			break;
+		case MALI_CAPTURE_SOLID:
+		{
+			const struct mali_capture_solid *s = (const void *)r;
+			PixmapPtr pPixmap = pixmap_of( rp, s->id );
+
+			replay_done( rp );
+			if ( pPixmap && exa->PrepareSolid( pPixmap, s->alu, s->planemask, s->fg ) ) replay_prepared( rp, r->type, pPixmap );
+			break;
+		}
+		case MALI_CAPTURE_COPY:
+		{
+			const struct mali_capture_copy *c = (const void *)r;
+			PixmapPtr pSrc = pixmap_of( rp, c->src );
+			PixmapPtr pDst = pixmap_of( rp, c->dst );
+
+			replay_done( rp );
+			if ( pSrc && pDst && exa->PrepareCopy( pSrc, pDst, c->xdir, c->ydir, c->alu, c->planemask ) ) replay_prepared( rp, r->type, pDst );
+			break;
+		}
+		case MALI_CAPTURE_COMPOSITE:
+			replay_composite( rp, (const struct mali_capture_composite *)r );
+			break;
+		case MALI_CAPTURE_SWAP:
+			replay_swap( rp, (const struct mali_capture_swap *)r );
+			break;
+		case MALI_CAPTURE_PREPARE_COMPOSITE:
+			replay_prepare_composite( rp, (const struct mali_capture_prepare_composite *)r );
+			break;
+		case MALI_CAPTURE_RECT:
+			replay_rect( rp, (const struct mali_capture_rect *)r );
+			break;
+		case MALI_CAPTURE_DONE:
+			replay_done( rp );
+			break;
+	}
+}
+
+static Bool replay_run( const struct mali_capture_file *file, const unsigned char *data, struct replay *rp )
+{
+	const struct mali_capture_record *r;
+	double start, recorded = 0, t, us;
+	uint64_t pos = 0;
+	unsigned int i;
+
+	rp->pixmaps = NULL;
+	rp->num_pixmaps = 0;
+	rp->frame_start = 0;
+	rp->prepared = MALI_CAPTURE_PAD;
+	rp->prepared_dst = NULL;
+
+	rp->stub = stub_screen_create( file->width, file->height, file->bpp );
+	if ( NULL == rp->stub )
+	{
+		fprintf( stderr, "failed to set up a %ux%u screen at %u bpp\n", file->width, file->height, file->bpp );
+		return FALSE;
+	}
+
+	start = replay_now();
+	while ( ( r = next_record( data, file->length, file->chunk_size, &pos ) ) )
+	{
+		recorded += r->delta;
+
+		if ( honour_timing )
+		{
+			while ( ( t = replay_now() ) < start + recorded ) usleep( start + recorded - t );
+		}
+
+		t = replay_now();
+		replay_record( rp, r );
+		us = replay_now() - t;
+
+		rp->types[r->type].count++;
+		rp->types[r->type].us += us;
+		if ( us > rp->types[r->type].max_us ) rp->types[r->type].max_us = us;
+	}
+
+	/* Whatever the capture left alive, so that leaks in the driver show up */
+	replay_done( rp );
+	for ( i = 0; i < rp->num_pixmaps; i++ )
+	{
+		while ( rp->pixmaps[i].prepared-- > 0 ) rp->stub->exa.FinishAccess( rp->pixmaps[i].pixmap, EXA_PREPARE_DEST );
+		if ( rp->pixmaps[i].pixmap ) replay_destroy( rp, i );
+	}
+	free( rp->pixmaps );
+	rp->recorded_us += recorded;
+
+	stub_screen_destroy( rp->stub );
+
+	return TRUE;
+}
+
+static void replay_report( const struct replay *rp )
+{
+	double total = 0;
+	unsigned int i;
+
+	printf( "%-10s %10s %12s %9s %9s\n", "call", "count", "total-us", "mean-us", "max-us" );
+	for ( i = 0; i < MALI_CAPTURE_TYPES; i++ )
+	{
+		const struct replay_type *t = &rp->types[i];
+
+		if ( 0 == t->count ) continue;
+
+		printf( "%-10s %10lu %12.0f %9.2f %9.2f\n", type_names[i], t->count, t->us, t->us / t->count, t->max_us );
+		total += t->us;
+	}
+	printf( "%-10s %10s %12.0f\n", "total", "", total );
+
+	if ( rp->frames )
+	{
+		printf( "%lu frames, %.1f us replaying each on average, %.1f at most, %.1f us each when captured\n",
+		        rp->frames, rp->frame_us / rp->frames, rp->frame_max_us, rp->recorded_us / rp->swaps );
+	}
+
+	if ( rp->unknown ) printf( "%lu records named pixmaps created before the capture started\n", rp->unknown );
+	if ( rp->mismatched ) printf( "%lu prepare calls ended differently than in the capture\n", rp->mismatched );
+}
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-d] [-r] [-n loops] [-v] capture\n"
+	                 "  -d        print the records instead of replaying them\n"
+	                 "  -r        keep to the pace of the capture\n"
+	                 "  -n loops  times to replay the capture, default 1\n"
+	                 "  -v        show the driver's messages\n", prog );
+	exit( 1 );
+}
+
+int main( int argc, char **argv )
+{
+	const struct mali_capture_file *file;
+	const unsigned char *data;
+	Bool dump = FALSE;
+	int loops = 1, opt, fd, i;
+	struct stat st;
+	struct replay rp;
+	void *map;
+
+	while ( ( opt = getopt( argc, argv, "drn:v" ) ) != -1 )
+	{
+		switch ( opt )
+		{
+			case 'd': dump = TRUE; break;
+			case 'r': honour_timing = TRUE; break;
+			case 'n': loops = atoi( optarg ); break;
+			case 'v': stub_verbose = TRUE; break;
+			default: usage( argv[0] );
+		}
+	}
+	if ( optind + 1 != argc || loops <= 0 ) usage( argv[0] );
+
+	fd = open( argv[optind], O_RDONLY );
+	if ( fd < 0 || fstat( fd, &st ) < 0 )
+	{
+		perror( argv[optind] );
+		return 1;
+	}
+	if ( st.st_size < MALI_CAPTURE_DATA )
+	{
+		fprintf( stderr, "%s: too short for a capture\n", argv[optind] );
+		return 1;
+	}
+
+	map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == map )
+	{
+		perror( argv[optind] );
+		return 1;
+	}
+
+	file = map;
+	data = (const unsigned char *)map + MALI_CAPTURE_DATA;
+	if ( memcmp( file->magic, MALI_CAPTURE_MAGIC, sizeof(file->magic) ) || MALI_CAPTURE_VERSION != file->version || 0 == file->chunk_size )
+	{
+		fprintf( stderr, "%s: not a version %d EXA capture\n", argv[optind], MALI_CAPTURE_VERSION );
+		return 1;
+	}
+	if ( MALI_CAPTURE_DATA + file->length > (uint64_t)st.st_size )
+	{
+		fprintf( stderr, "%s: truncated\n", argv[optind] );
+		return 1;
+	}
+
+	if ( dump )
+	{
+		const struct mali_capture_record *r;
+		uint64_t pos = 0;
+		double t = 0;
+
+		printf( "screen %u, %ux%u at %u bpp, pitch %u\n", file->screen, file->width, file->height, file->bpp, file->pitch );
+		while ( ( r = next_record( data, file->length, file->chunk_size, &pos ) ) )
+		{
+			t += r->delta;
+			dump_record( r, t );
+		}
+		return 0;
+	}
+
+	memset( &rp, 0, sizeof(rp) );
+	for ( i = 0; i < loops; i++ )
+	{
+		if ( !replay_run( file, data, &rp ) ) return 1;
+	}
+	replay_report( &rp );
+
+	munmap( map, st.st_size );
+
+	if ( ump_stub_live() )
+	{
+		fprintf( stderr, "%d UMP allocations leaked\n", ump_stub_live() );
+		return 1;
+	}
+
+	return 0;
+}
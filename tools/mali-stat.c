@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Prints the counters and the EXA fallback histogram a running server
+ * publishes in /dev/shm. The file is only readable by the server's user and
+ * group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define _MALI_STATS_NO_SERVER
+#include "mali_stats.h"
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-n count] [-d display] [-s screen] [-f file]\n"
+	                 "  -n count    show the count most frequent fallbacks, default all\n"
+	                 "  -d display  X display number, default 0\n"
+	                 "  -s screen   X screen number, default 0\n"
+	                 "  -f file     read this file instead of the one for display and screen\n", prog );
+	exit( 1 );
+}
+
+/* 64-bit reads are not atomic everywhere, retry until two of them agree */
+static uint64_t read_value( const volatile uint64_t *value )
+{
+	uint64_t a, b;
+
+	do
+	{
+		a = *value;
+		b = *value;
+	}
+	while ( a != b );
+
+	return a;
+}
+
+static int fallback_compare( const void *a, const void *b )
+{
+	const struct mali_stats_fallback *fa = a;
+	const struct mali_stats_fallback *fb = b;
+
+	if ( fa->count == fb->count ) return 0;
+
+	return fa->count > fb->count ? -1 : 1;
+}
+
+int main( int argc, char **argv )
+{
+	const char *display = "0";
+	const char *screen = "0";
+	const char *file = NULL;
+	char path[256];
+	int limit = MALI_STATS_FALLBACKS;
+	struct mali_stats *stats;
+	struct mali_stats_fallback fallbacks[MALI_STATS_FALLBACKS];
+	uint32_t i, count, num_fallbacks;
+	int fd, opt;
+
+	while ( ( opt = getopt( argc, argv, "n:d:s:f:" ) ) != -1 )
+	{
+		switch ( opt )
+		{
+			case 'n': limit = atoi( optarg ); break;
+			case 'd': display = optarg[0] == ':' ? optarg + 1 : optarg; break;
+			case 's': screen = optarg; break;
+			case 'f': file = optarg; break;
+			default: usage( argv[0] );
+		}
+	}
+	if ( optind != argc ) usage( argv[0] );
+
+	if ( NULL == file )
+	{
+		snprintf( path, sizeof(path), "/dev/shm/xf86-video-mali-%s.%s", display, screen );
+		file = path;
+	}
+
+	fd = open( file, O_RDONLY );
+	if ( fd < 0 )
+	{
+		perror( file );
+		return 1;
+	}
+
+	stats = mmap( NULL, sizeof(*stats), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == stats )
+	{
+		perror( file );
+		return 1;
+	}
+
+	if ( memcmp( stats->magic, MALI_STATS_MAGIC, sizeof(stats->magic) ) || MALI_STATS_VERSION != stats->version )
+	{
+		fprintf( stderr, "%s: not a statistics file this tool understands\n", file );
+		return 1;
+	}
+
+	printf( "pid %u screen %u\n\n", stats->pid, stats->screen );
+
+	count = stats->count < MALI_STAT_COUNT ? stats->count : MALI_STAT_COUNT;
+	for ( i = 0; i < count; i++ )
+	{
+		printf( "%-40s %20llu\n", stats->counters[i].name, (unsigned long long)read_value( &stats->counters[i].value ) );
+	}
+
+	num_fallbacks = *(volatile uint32_t *)&stats->num_fallbacks;
+	if ( num_fallbacks > MALI_STATS_FALLBACKS ) num_fallbacks = MALI_STATS_FALLBACKS;
+	__sync_synchronize();
+
+	for ( i = 0; i < num_fallbacks; i++ )
+	{
+		fallbacks[i] = stats->fallbacks[i];
+		fallbacks[i].count = read_value( &stats->fallbacks[i].count );
+	}
+	qsort( fallbacks, num_fallbacks, sizeof(fallbacks[0]), fallback_compare );
+
+	if ( num_fallbacks ) printf( "\n%-12s %-20s %-16s %20s\n", "fallback", "reason", "format", "count" );
+	for ( i = 0; i < num_fallbacks && (int)i < limit; i++ )
+	{
+		printf( "%-12.12s %-20.20s %-16.16s %20llu\n", fallbacks[i].op, fallbacks[i].reason, fallbacks[i].format,
+		        (unsigned long long)fallbacks[i].count );
+	}
+
+	munmap( stats, sizeof(*stats) );
+
+	return 0;
+}
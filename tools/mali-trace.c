@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Dumps the DRI2 swap trace a running server publishes in /dev/shm, either as
+ * a table or as Chrome trace event JSON for chrome://tracing and Perfetto.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define _MALI_TRACE_NO_SERVER
+#include "mali_trace.h"
+
+static const char *path_names[] = { "swap", "flip", "exchange", "blit" };
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-j] [-d display] [-s screen] [-f file]\n"
+	                 "  -j          write Chrome trace event JSON instead of a table\n"
+	                 "  -d display  X display number, default 0\n"
+	                 "  -s screen   X screen number, default 0\n"
+	                 "  -f file     read this file instead of the one for display and screen\n", prog );
+	exit( 1 );
+}
+
+/* Copies out the valid events, oldest first; the server keeps running while we read */
+static int snapshot( const struct mali_trace *ring, struct mali_trace_event *out )
+{
+	uint32_t head = ring->head;
+	uint32_t first = head > MALI_TRACE_SIZE ? head - MALI_TRACE_SIZE + 1 : 1;
+	uint32_t n;
+	int count = 0;
+
+	for ( n = first; n != head + 1; n++ )
+	{
+		const struct mali_trace_event *ev = &ring->events[( n - 1 ) % MALI_TRACE_SIZE];
+		uint32_t seq = ev->seq;
+
+		if ( seq != n ) continue;
+
+		__sync_synchronize();
+		memcpy( &out[count], (const void *)ev, sizeof(*ev) );
+		__sync_synchronize();
+
+		if ( ev->seq == seq ) count++;
+	}
+
+	return count;
+}
+
+static const char *path_name( uint32_t path )
+{
+	return path < sizeof(path_names) / sizeof(path_names[0]) ? path_names[path] : "unknown";
+}
+
+static void print_table( const struct mali_trace_event *events, int count )
+{
+	uint64_t base = count ? events[0].request : 0;
+	int i;
+
+	printf( "%10s %10s %-8s %12s %8s %8s %8s %8s %10s\n",
+	        "seq", "drawable", "path", "request_us", "pan_us", "wait_us", "synced", "total_us", "msc" );
+
+	for ( i = 0; i < count; i++ )
+	{
+		const struct mali_trace_event *ev = &events[i];
+
+		printf( "%10u 0x%08x %-8s %12llu ", ev->seq, ev->drawable, path_name( ev->path ), (unsigned long long)( ev->request - base ) );
+
+		if ( ev->pan_start ) printf( "%8llu %8llu %8s ", (unsigned long long)( ev->pan_end - ev->pan_start ),
+		                             (unsigned long long)ev->vsync_wait, ev->synced ? "yes" : "no" );
+		else printf( "%8s %8s %8s ", "-", "-", "-" );
+
+		if ( ev->complete ) printf( "%8llu %10llu\n", (unsigned long long)( ev->complete - ev->request ), (unsigned long long)ev->msc );
+		else printf( "%8s %10s\n", "pending", "-" );
+	}
+}
+
+static void print_json_event( const char *name, uint64_t ts, uint64_t dur, uint32_t pid, uint32_t tid, int *first )
+{
+	printf( "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%u,\"tid\":%u",
+	        *first ? "" : ",", name, (unsigned long long)ts, (unsigned long long)dur, pid, tid );
+	*first = 0;
+}
+
+static void print_json( const struct mali_trace *ring, const struct mali_trace_event *events, int count )
+{
+	int first = 1;
+	int i;
+
+	printf( "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+
+	for ( i = 0; i < count; i++ )
+	{
+		const struct mali_trace_event *ev = &events[i];
+		uint64_t end = ev->complete ? ev->complete : ev->pan_end ? ev->pan_end : ev->request;
+
+		/* Each drawable gets a track of its own */
+		print_json_event( path_name( ev->path ), ev->request, end - ev->request, ring->pid, ev->drawable, &first );
+		printf( ",\"args\":{\"seq\":%u,\"msc\":%llu,\"synced\":%s,\"completed\":%s}}", ev->seq,
+		        (unsigned long long)ev->msc, ev->synced ? "true" : "false", ev->complete ? "true" : "false" );
+
+		if ( ev->pan_start )
+		{
+			print_json_event( "pan", ev->pan_start, ev->pan_end - ev->pan_start, ring->pid, ev->drawable, &first );
+			printf( "}" );
+		}
+		if ( ev->vsync_wait )
+		{
+			print_json_event( "vsync wait", ev->pan_end, ev->vsync_wait, ring->pid, ev->drawable, &first );
+			printf( "}" );
+		}
+	}
+
+	printf( "\n]}\n" );
+}
+
+int main( int argc, char **argv )
+{
+	const char *display = "0";
+	const char *screen = "0";
+	const char *file = NULL;
+	char path[256];
+	int json = 0;
+	struct mali_trace *ring;
+	struct mali_trace_event *events;
+	int fd, opt, count;
+
+	while ( ( opt = getopt( argc, argv, "jd:s:f:" ) ) != -1 )
+	{
+		switch ( opt )
+		{
+			case 'j': json = 1; break;
+			case 'd': display = optarg[0] == ':' ? optarg + 1 : optarg; break;
+			case 's': screen = optarg; break;
+			case 'f': file = optarg; break;
+			default: usage( argv[0] );
+		}
+	}
+	if ( optind != argc ) usage( argv[0] );
+
+	if ( NULL == file )
+	{
+		snprintf( path, sizeof(path), "/dev/shm/xf86-video-mali-trace-%s.%s", display, screen );
+		file = path;
+	}
+
+	fd = open( file, O_RDONLY );
+	if ( fd < 0 )
+	{
+		perror( file );
+		return 1;
+	}
+
+	ring = mmap( NULL, sizeof(*ring), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == ring )
+	{
+		perror( file );
+		return 1;
+	}
+
+	if ( memcmp( ring->magic, MALI_TRACE_MAGIC, sizeof(ring->magic) ) || MALI_TRACE_VERSION != ring->version || MALI_TRACE_SIZE != ring->size )
+	{
+		fprintf( stderr, "%s: not a swap trace this tool understands\n", file );
+		return 1;
+	}
+
+	events = malloc( MALI_TRACE_SIZE * sizeof(*events) );
+	if ( NULL == events )
+	{
+		perror( "malloc" );
+		return 1;
+	}
+
+	count = snapshot( ring, events );
+
+	if ( json ) print_json( ring, events, count );
+	else print_table( events, count );
+
+	free( events );
+	munmap( ring, sizeof(*ring) );
+
+	return 0;
+}
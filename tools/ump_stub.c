@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ump/ump.h>
+#include <ump/ump_ref_drv.h>
+
+#include "ump_stub.h"
+
+#define UMP_STUB_MAX_IDS 4096
+
+struct ump_stub_mem
+{
+	void *ptr;
+	size_t size;
+	int refs;
+	int owned;
+	ump_secure_id id;
+};
+
+/* Secure IDs index this table, 0 is never handed out */
+static struct ump_stub_mem *ids[UMP_STUB_MAX_IDS];
+static ump_secure_id next_id = 1;
+static int live;
+
+static struct ump_stub_mem *stub_new( void *ptr, size_t size, int owned )
+{
+	struct ump_stub_mem *mem;
+	ump_secure_id id = 0;
+	int i;
+
+	for ( i = 0; i < UMP_STUB_MAX_IDS; i++ )
+	{
+		id = ( next_id + i ) % UMP_STUB_MAX_IDS;
+		if ( id && NULL == ids[id] ) break;
+	}
+	if ( UMP_STUB_MAX_IDS == i ) return NULL;
+
+	mem = calloc( 1, sizeof(*mem) );
+	if ( NULL == mem ) return NULL;
+
+	mem->ptr = ptr;
+	mem->size = size;
+	mem->refs = 1;
+	mem->owned = owned;
+	mem->id = id;
+
+	ids[mem->id] = mem;
+	next_id = id + 1;
+	live++;
+
+	return mem;
+}
+
+ump_secure_id ump_stub_wrap( void *ptr, size_t size )
+{
+	struct ump_stub_mem *mem = stub_new( ptr, size, 0 );
+
+	return mem ? mem->id : UMP_INVALID_SECURE_ID;
+}
+
+int ump_stub_live( void )
+{
+	return live;
+}
+
+ump_result ump_open( void )
+{
+	return UMP_OK;
+}
+
+void ump_close( void )
+{
+}
+
+ump_handle ump_ref_drv_allocate( unsigned long size, ump_alloc_constraints constraints )
+{
+	struct ump_stub_mem *mem;
+	void *ptr;
+
+	(void)constraints;
+
+	/* UMP hands out whole pages */
+	if ( 0 == size || posix_memalign( &ptr, 4096, ( size + 4095 ) & ~4095UL ) ) return UMP_INVALID_MEMORY_HANDLE;
+
+	mem = stub_new( ptr, size, 1 );
+	if ( NULL == mem )
+	{
+		free( ptr );
+		return UMP_INVALID_MEMORY_HANDLE;
+	}
+
+	return (ump_handle)mem;
+}
+
+ump_handle ump_handle_create_from_secure_id( ump_secure_id id )
+{
+	struct ump_stub_mem *mem;
+
+	if ( id >= UMP_STUB_MAX_IDS || NULL == ( mem = ids[id] ) ) return UMP_INVALID_MEMORY_HANDLE;
+
+	mem->refs++;
+
+	return (ump_handle)mem;
+}
+
+ump_secure_id ump_secure_id_get( ump_handle handle )
+{
+	return ( (struct ump_stub_mem *)handle )->id;
+}
+
+unsigned long ump_size_get( ump_handle handle )
+{
+	return ( (struct ump_stub_mem *)handle )->size;
+}
+
+void *ump_mapped_pointer_get( ump_handle handle )
+{
+	return ( (struct ump_stub_mem *)handle )->ptr;
+}
+
+void ump_mapped_pointer_release( ump_handle handle )
+{
+	(void)handle;
+}
+
+void ump_reference_add( ump_handle handle )
+{
+	( (struct ump_stub_mem *)handle )->refs++;
+}
+
+void ump_reference_release( ump_handle handle )
+{
+	struct ump_stub_mem *mem = (struct ump_stub_mem *)handle;
+
+	if ( --mem->refs > 0 ) return;
+
+	ids[mem->id] = NULL;
+	if ( mem->owned ) free( mem->ptr );
+	free( mem );
+	live--;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _UMP_STUB_H_
+#define _UMP_STUB_H_
+
+#include <stddef.h>
+#include <ump/ump.h>
+
+/*
+ * A stand-in for libUMP backed by the heap, so that driver code can be run
+ * on machines without a Mali kernel driver. Only what the driver calls is
+ * provided. Memory the test owns, such as a fake framebuffer, can be given a
+ * secure ID with ump_stub_wrap; it is never freed by the stub.
+ */
+extern ump_secure_id ump_stub_wrap( void *ptr, size_t size );
+
+/* Allocations and wrapped buffers still referenced, for leak checks */
+extern int ump_stub_live( void );
+
+#endif /* _UMP_STUB_H_ */
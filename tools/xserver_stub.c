@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xf86.h"
+#include "exa.h"
+#include "mi.h"
+
+#include "mali_def.h"
+#include "mali_fbdev.h"
+#include "mali_exa.h"
+#include "mali_shadow.h"
+#include "mali_video.h"
+#include "mali_stats.h"
+#include "mali_capture.h"
+
+#include "xserver_stub.h"
+
+struct stub_pixmap
+{
+	PixmapRec pixmap;
+	void *driver_priv;
+};
+
+ScrnInfoPtr *xf86Screens;
+Bool stub_verbose;
+const char *stub_capture;
+
+static struct stub_screen *current;
+
+void xf86DrvMsg( int scrnIndex, MessageType type, const char *format, ... )
+{
+	va_list ap;
+
+	(void)scrnIndex;
+
+	if ( !stub_verbose && X_ERROR != type && X_WARNING != type ) return;
+
+	va_start( ap, format );
+	vfprintf( stderr, format, ap );
+	va_end( ap );
+}
+
+void xf86DrvMsgVerb( int scrnIndex, MessageType type, int verb, const char *format, ... )
+{
+	va_list ap;
+
+	(void)scrnIndex;
+	(void)type;
+	(void)verb;
+
+	if ( !stub_verbose ) return;
+
+	va_start( ap, format );
+	vfprintf( stderr, format, ap );
+	va_end( ap );
+}
+
+void ErrorF( const char *format, ... )
+{
+	va_list ap;
+
+	if ( !stub_verbose ) return;
+
+	va_start( ap, format );
+	vfprintf( stderr, format, ap );
+	va_end( ap );
+}
+
+Bool miModifyPixmapHeader( PixmapPtr pPixmap, int width, int height, int depth, int bitsPerPixel, int devKind, pointer pPixData )
+{
+	if ( width > 0 ) pPixmap->drawable.width = width;
+	if ( height > 0 ) pPixmap->drawable.height = height;
+	if ( depth > 0 ) pPixmap->drawable.depth = depth;
+	if ( bitsPerPixel > 0 ) pPixmap->drawable.bitsPerPixel = bitsPerPixel;
+	if ( devKind > 0 ) pPixmap->devKind = devKind;
+	if ( pPixData ) pPixmap->devPrivate.ptr = pPixData;
+
+	return TRUE;
+}
+
+void *exaGetPixmapDriverPrivate( PixmapPtr pPixmap )
+{
+	return ( (struct stub_pixmap *)pPixmap )->driver_priv;
+}
+
+unsigned long exaGetPixmapPitch( PixmapPtr pPixmap )
+{
+	return pPixmap->devKind;
+}
+
+/* There is no shadow, video or statistics file here */
+mali_mem_info *MaliShadowGetMemInfo( ScrnInfoPtr pScrn, pointer pPixData )
+{
+	(void)pScrn;
+	(void)pPixData;
+
+	return NULL;
+}
+
+void MaliVideoSync( ScreenPtr pScreen )
+{
+	(void)pScreen;
+}
+
+void MaliStatsFallback( ScrnInfoPtr pScrn, enum mali_fallback_op op, enum mali_fallback_reason reason, uint32_t format )
+{
+	(void)pScrn;
+	(void)op;
+	(void)reason;
+	(void)format;
+}
+
+static PixmapPtr stub_get_screen_pixmap( ScreenPtr pScreen )
+{
+	return ( (struct stub_screen *)pScreen )->screen_pixmap;
+}
+
+PixmapPtr stub_alloc_pixmap( ScreenPtr pScreen, int depth, int bpp )
+{
+	struct stub_screen *stub = (struct stub_screen *)pScreen;
+	struct stub_pixmap *pix = calloc( 1, sizeof(*pix) );
+
+	if ( NULL == pix ) return NULL;
+
+	pix->pixmap.drawable.type = DRAWABLE_PIXMAP;
+	pix->pixmap.drawable.pScreen = pScreen;
+	pix->pixmap.drawable.depth = depth;
+	pix->pixmap.drawable.bitsPerPixel = bpp;
+	pix->pixmap.refcnt = 1;
+
+	pix->driver_priv = stub->exa.CreatePixmap( pScreen, 0, 0 );
+	if ( NULL == pix->driver_priv )
+	{
+		free( pix );
+		return NULL;
+	}
+
+	return &pix->pixmap;
+}
+
+PixmapPtr stub_create_pixmap( ScreenPtr pScreen, int width, int height, int depth, unsigned usage_hint )
+{
+	struct stub_screen *stub = (struct stub_screen *)pScreen;
+	int bpp = depth <= 8 ? 8 : depth <= 16 ? 16 : 32;
+	PixmapPtr pPixmap;
+
+	(void)usage_hint;
+
+	pPixmap = stub_alloc_pixmap( pScreen, depth, bpp );
+	if ( NULL == pPixmap ) return NULL;
+
+	/* EXA hands the driver the pitch fb would use */
+	if ( !stub->exa.ModifyPixmapHeader( pPixmap, width, height, depth, bpp, ( ( width * bpp + 31 ) / 32 ) * 4, NULL ) )
+	{
+		stub_destroy_pixmap( pPixmap );
+		return NULL;
+	}
+
+	return pPixmap;
+}
+
+Bool stub_destroy_pixmap( PixmapPtr pPixmap )
+{
+	struct stub_pixmap *pix = (struct stub_pixmap *)pPixmap;
+	struct stub_screen *stub = (struct stub_screen *)pPixmap->drawable.pScreen;
+
+	if ( --pPixmap->refcnt > 0 ) return TRUE;
+
+	stub->exa.DestroyPixmap( &stub->screen, pix->driver_priv );
+	free( pix );
+
+	return TRUE;
+}
+
+struct stub_screen *stub_screen_create( int xres, int yres, int bpp )
+{
+	struct stub_screen *stub;
+	MaliPtr fPtr;
+	int depth = 16 == bpp ? 16 : 24;
+
+	if ( current ) return NULL;
+
+	stub = calloc( 1, sizeof(*stub) );
+	if ( NULL == stub ) return NULL;
+
+	/* The driver always wraps both halves of a double buffered fbdev */
+	stub->fb = fbdev_stub_create( xres, yres, bpp, 2 );
+	if ( NULL == stub->fb )
+	{
+		free( stub );
+		return NULL;
+	}
+
+	fPtr = &stub->mali;
+	fPtr->fb_lcd_fd = stub->fb->fd;
+	fPtr->fbmem = stub->fb->virt;
+	fPtr->fb_lcd_var = stub->fb->var;
+	fPtr->fb_lcd_fix = stub->fb->fix;
+	fPtr->exa = &stub->exa;
+
+	stub->scrn.scrnIndex = 0;
+	stub->scrn.bitsPerPixel = bpp;
+	stub->scrn.depth = depth;
+	stub->scrn.virtualX = xres;
+	stub->scrn.virtualY = yres;
+	stub->scrn.displayWidth = xres;
+	stub->scrn.driverPrivate = fPtr;
+	stub->screens[0] = &stub->scrn;
+	xf86Screens = stub->screens;
+
+	stub->screen.myNum = 0;
+	stub->screen.width = xres;
+	stub->screen.height = yres;
+	stub->screen.GetScreenPixmap = stub_get_screen_pixmap;
+	stub->screen.CreatePixmap = stub_create_pixmap;
+	stub->screen.DestroyPixmap = stub_destroy_pixmap;
+	stub->scrn.pScreen = &stub->screen;
+
+	/* Same place as in MaliScreenInit, so that the screen pixmap is in the capture */
+	MaliCaptureInit( &stub->scrn, stub_capture );
+
+	if ( !maliSetupExa( &stub->screen, &stub->exa, xres, yres, stub->fb->virt ) ) goto fail;
+
+	/* The screen pixmap wraps the first fbdev buffer and brings the second one along */
+	stub->screen_pixmap = stub_alloc_pixmap( &stub->screen, depth, bpp );
+	if ( NULL == stub->screen_pixmap ) goto fail;
+
+	if ( !stub->exa.ModifyPixmapHeader( stub->screen_pixmap, xres, yres, depth, bpp, stub->fb->fix.line_length, stub->fb->virt ) ) goto fail;
+
+	/* EXA keeps the pointer of pixmaps it considers offscreen NULL outside of PrepareAccess */
+	stub->screen_pixmap->devPrivate.ptr = NULL;
+
+	current = stub;
+
+	return stub;
+
+fail:
+	if ( stub->screen_pixmap ) stub_destroy_pixmap( stub->screen_pixmap );
+	MaliCaptureClose( &stub->scrn );
+	fbdev_stub_destroy( stub->fb );
+	free( stub );
+	return NULL;
+}
+
+void stub_screen_destroy( struct stub_screen *stub )
+{
+	PrivPixmapInternal *front = ( (PrivPixmap *)exaGetPixmapDriverPrivate( stub->screen_pixmap ) )->priv;
+	PixmapPtr back_pixmap = front->other_buffer;
+	PrivPixmapInternal *back = ( (PrivPixmap *)exaGetPixmapDriverPrivate( back_pixmap ) )->priv;
+
+	/* The server never destroys the framebuffer pixmaps and the driver insists they are unlinked first */
+	front->other_buffer = NULL;
+	back->other_buffer = NULL;
+	stub_destroy_pixmap( back_pixmap );
+	stub_destroy_pixmap( stub->screen_pixmap );
+
+	MaliCaptureClose( &stub->scrn );
+	fbdev_stub_destroy( stub->fb );
+
+	if ( current == stub ) current = NULL;
+	xf86Screens = NULL;
+	free( stub );
+}
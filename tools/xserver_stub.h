@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2010 ARM Limited. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _XSERVER_STUB_H_
+#define _XSERVER_STUB_H_
+
+#include "xf86.h"
+#include "exa.h"
+#include "pixmapstr.h"
+#include "scrnintstr.h"
+
+#include "mali_fbdev.h"
+#include "fbdev_stub.h"
+
+/*
+ * Just enough of the X server, and of the rest of the driver, to run the EXA
+ * code from src/mali_exa.c in a plain process. Pixmaps are created the way
+ * EXA does with EXA_HANDLES_PIXMAPS: a bare header, driver private memory
+ * from CreatePixmap and the size set through ModifyPixmapHeader. Only one
+ * screen exists at a time.
+ */
+struct stub_screen
+{
+	ScreenRec screen;
+	ScrnInfoRec scrn;
+	MaliRec mali;
+	ExaDriverRec exa;
+	ScrnInfoPtr screens[1];
+	PixmapPtr screen_pixmap;
+	struct fbdev_stub *fb;
+};
+
+extern Bool stub_verbose;
+extern const char *stub_capture;	/* EXA_CAPTURE for the next screen */
+
+extern struct stub_screen *stub_screen_create( int xres, int yres, int bpp );
+extern void stub_screen_destroy( struct stub_screen *stub );
+
+/* A pixmap with its driver private but no storage yet, as EXA has it before ModifyPixmapHeader */
+extern PixmapPtr stub_alloc_pixmap( ScreenPtr pScreen, int depth, int bpp );
+extern PixmapPtr stub_create_pixmap( ScreenPtr pScreen, int width, int height, int depth, unsigned usage_hint );
+extern Bool stub_destroy_pixmap( PixmapPtr pPixmap );
+
+#endif /* _XSERVER_STUB_H_ */